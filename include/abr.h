@@ -0,0 +1,37 @@
+#ifndef ABR_H
+#define ABR_H
+
+#include <stdint.h>
+#include "stream_writer.h"
+
+typedef struct {
+    int64_t min_bit_rate;
+    int64_t max_bit_rate;
+    int interval_ms;            // how often the network state is sampled
+} abr_config_t;
+
+// Adaptive bitrate controller fed by the writer's queue/latency metrics and
+// the socket's TCP_INFO. Bitrate is adjusted first; only when it is already at
+// the floor does the controller halve the frame rate, then the resolution.
+// With fixed_bit_rate set (the encoder can't be retargeted) it goes straight
+// to the frame rate and resolution steps.
+typedef struct {
+    abr_config_t cfg;
+    int64_t bit_rate;           // current encoder target
+    int fixed_bit_rate;
+    int fps_div;                // encode every fps_div-th frame
+    int scale_div;              // encode at width/scale_div x height/scale_div
+    int congested_intervals;
+    int clear_intervals;
+    uint32_t min_rtt_us;
+    uint64_t last_dropped;
+    uint32_t last_retrans;
+    int64_t last_check_us;
+} abr_controller_t;
+
+void abr_init(abr_controller_t *abr, const abr_config_t *cfg, int64_t start_bit_rate);
+// Samples the writer when an interval has elapsed. Returns 1 if bit_rate,
+// fps_div or scale_div changed and the encoder needs updating.
+int abr_update(abr_controller_t *abr, stream_writer_t *writer, int64_t now_us);
+
+#endif /* ABR_H */
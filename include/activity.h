@@ -0,0 +1,55 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include <stdint.h>
+#include "postprocess.h"
+
+#define ACTIVITY_THUMB_W 80
+#define ACTIVITY_THUMB_H 45
+
+typedef struct {
+    int enabled;
+    int idle_fps;               // frame rate while nothing happens
+    int64_t idle_bit_rate;      // 0 = full bitrate / 10
+    int idle_delay_ms;          // quiet time before dropping to idle
+    double motion_threshold;    // percent of thumbnail cells that must change
+} activity_config_t;
+
+typedef enum {
+    ACTIVITY_NONE = 0,
+    ACTIVITY_WAKE,              // idle -> active: restore full rate and send an IDR now
+    ACTIVITY_SLEEP,             // active -> idle
+} activity_change_t;
+
+// Encode policy driven by the scene: any detection or enough motion in a
+// coarse luma thumbnail keeps the encoder at full frame rate and bitrate;
+// after idle_delay_ms of quiet it drops to idle_fps and idle_bit_rate.
+// Skipped frames leave gaps in the PTS, so FLV/MP4 timestamps stay correct.
+typedef struct {
+    activity_config_t cfg;
+    int fps;
+    int active;
+    int64_t last_activity_us;
+    uint8_t thumb[2][ACTIVITY_THUMB_W * ACTIVITY_THUMB_H];
+    int cur;                    // thumb[cur] is the newest thumbnail
+    int has_prev;
+    double motion;              // last motion score, percent of changed cells
+    uint64_t active_frames;
+    uint64_t idle_frames;
+    uint64_t wakeups;
+} activity_policy_t;
+
+void activity_config_default(activity_config_t *cfg);
+activity_policy_t* activity_create(const activity_config_t *cfg, int fps);
+void activity_destroy(activity_policy_t *a);
+
+// Called for every captured frame, including the ones that end up skipped.
+// rgb is packed RGB888 of width x height.
+activity_change_t activity_update(activity_policy_t *a, const char *rgb, int width, int height,
+                                  const detect_result_group_t *group, int64_t now_us);
+// Capture frames per encoded frame: 1 while active
+int activity_frame_step(const activity_policy_t *a);
+// Bitrate for the current state, never above full_bit_rate
+int64_t activity_bit_rate(const activity_policy_t *a, int64_t full_bit_rate);
+
+#endif /* ACTIVITY_H */
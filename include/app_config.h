@@ -0,0 +1,63 @@
+#ifndef APP_CONFIG_H
+#define APP_CONFIG_H
+
+#include "abr.h"
+#include "activity.h"
+#include "audio_capture.h"
+#include "cascade.h"
+#include "encoder.h"
+#include "event_recorder.h"
+#include "live_server.h"
+#include "npu_scheduler.h"
+#include "roi.h"
+#include "rtp_multicast.h"
+#include "segment_store.h"
+#include "substream.h"
+
+#define APP_MAX_SINKS 8
+#define APP_MAX_CAMERAS NPU_MAX_CLIENTS
+
+// A camera besides the main one: its own capture, overlay and encode
+// pipeline and sinks, sharing the NPU with the other cameras
+typedef struct {
+    const char *source;
+    const char *subdev;         // sensor subdev for the frame rate, default /dev/v4l-subdevN
+    const char *sinks[APP_MAX_SINKS];
+    int sink_count;
+    int det_weight;             // share of the NPU under wfq
+    int det_fps;                // detection rate cap, 0 = unlimited, -1 = same as the main camera
+} camera_config_t;
+
+// Runtime configuration assembled from the command line
+typedef struct {
+    const char *source;         // V4L2 device node or raw NV12 file
+    const char *sinks[APP_MAX_SINKS];   // "TYPE:URL" outputs fed by the one encoder
+    int sink_count;
+    int det_weight;             // NPU share of the main camera
+    int det_fps;                // detection rate cap of the main camera, 0 = unlimited
+    camera_config_t cameras[APP_MAX_CAMERAS - 1];   // additional cameras
+    int camera_count;
+    npu_config_t npu;           // one detector shared by all cameras
+    cascade_config_t cascade;   // second stage on the main camera's detections
+    int queue_size;             // packets buffered per network writer
+    int rtmp_lite;              // rtmp:// sinks use the in-tree RTMP client
+    int rtmp_chunk_size;        // its outgoing chunk size
+    encoder_config_t encoder;
+    int abr_enabled;            // adapt bitrate/fps/resolution to the uplink
+    abr_config_t abr;           // 0 bitrates are derived from encoder.bit_rate
+    event_config_t event;       // detection triggered recording with pre-roll
+    store_config_t store;       // continuous recording into preallocated segments
+    const char *index_path;     // detection index, defaults to <store dir>/detections.idx
+    roi_config_t roi;           // detection driven quality regions
+    activity_config_t activity; // low fps/bitrate while the scene is idle
+    audio_config_t audio;       // ALSA capture muxed as AAC into the outputs
+    live_config_t live;         // built-in HTTP-FLV/RTSP server
+    multicast_config_t multicast;   // RTP/UDP to a multicast group
+    substream_config_t substream;   // low resolution simulcast, off without sinks
+} app_config_t;
+
+void app_config_default(app_config_t *cfg);
+// Returns 0 on success, 1 if the program should exit cleanly (--help), -1 on error
+int app_config_parse(app_config_t *cfg, int argc, char **argv);
+
+#endif /* APP_CONFIG_H */
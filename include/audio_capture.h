@@ -0,0 +1,91 @@
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/audio_fifo.h>
+#include <libswresample/swresample.h>
+}
+
+#define AUDIO_RING_SIZE 32          // ALSA periods between capture and the AAC encoder
+#define AUDIO_PACKET_RING_SIZE 64   // AAC packets waiting to be interleaved, ~1.4 s at 48 kHz
+
+typedef struct {
+    const char *device;         // ALSA PCM ("default", "hw:0", "null", ...), NULL disables audio
+    int sample_rate;
+    int channels;
+    int64_t bit_rate;           // AAC bitrate
+} audio_config_t;
+
+// 添加音频缓冲区结构
+typedef struct {
+    char *data;          // 音频数据
+    size_t size;         // 缓冲区大小
+    size_t data_size;    // 实际数据大小
+    int64_t timestamp;   // 时间戳, CLOCK_MONOTONIC us of the first sample
+} audio_buffer_t;
+
+// ALSA capture -> PCM ring -> AAC encode thread -> packet ring -> video encode thread
+// Both rings are single producer/single consumer and lock free: the capture
+// thread never waits for the encoder, and the video encode thread only pops
+// finished AAC packets when it interleaves them with its own output.
+// Packet timestamps are CLOCK_MONOTONIC us, the clock the video frames use.
+typedef struct {
+    audio_config_t cfg;
+    void *pcm;                  // snd_pcm_t
+    int period_frames;
+    int frame_bytes;            // bytes per interleaved S16 sample frame
+
+    // capture thread -> AAC encode thread
+    audio_buffer_t ring[AUDIO_RING_SIZE];
+    unsigned ring_head;         // next chunk to encode
+    unsigned ring_tail;         // next chunk to fill
+    sem_t ring_sem;
+
+    // AAC encode thread
+    AVCodecContext *enc;
+    SwrContext *swr;
+    AVAudioFifo *fifo;
+    int64_t fifo_start;         // timestamp of the first sample in the fifo, in samples
+    uint8_t **conv;             // planar float conversion buffer, one period
+    AVFrame *frame;
+    AVPacket *pkt;
+    pthread_t encode_thread;
+    int encode_started;
+    int running;
+
+    // AAC encode thread -> video encode thread
+    AVPacket *packets[AUDIO_PACKET_RING_SIZE];
+    unsigned pkt_head;
+    unsigned pkt_tail;
+
+    uint64_t overruns;          // ALSA xruns
+    uint64_t dropped_chunks;    // PCM ring full
+    uint64_t dropped_packets;   // packet ring full
+    uint64_t resyncs;           // sample clock re-anchored to the measured capture time
+    uint64_t encoded_packets;
+} audio_capture_t;
+
+void audio_config_default(audio_config_t *cfg);
+// Opens the PCM and the AAC encoder; nothing runs until start/run
+audio_capture_t* audio_capture_open(const audio_config_t *cfg);
+// Stream parameters for the muxers; the time base is 1/sample_rate
+int audio_capture_codecpar(const audio_capture_t *a, AVCodecParameters *par, AVRational *time_base);
+// Starts the AAC encode thread
+int audio_capture_start(audio_capture_t *a);
+// Capture loop, runs on the caller's thread until *running is cleared
+void audio_capture_run(audio_capture_t *a, const int *running);
+
+// Video encode thread side: returns 1 and the timestamp of the oldest finished
+// packet, 0 if there is none
+int audio_capture_peek(audio_capture_t *a, int64_t *pts_us);
+// Takes the oldest packet; the caller frees it
+AVPacket* audio_capture_pop(audio_capture_t *a);
+
+void audio_capture_close(audio_capture_t *a);
+
+#endif /* AUDIO_CAPTURE_H */
@@ -6,6 +6,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include "rknn_yolov5.h"
+#include "app_config.h"
+#include "stream_fanout.h"
+#include "event_recorder.h"
+#include "segment_store.h"
+#include "audio_capture.h"
+#include "substream.h"
+#include "npu_scheduler.h"
+#include "cascade.h"
 // Forward declaration
 struct v4l2_dev;
 
@@ -14,18 +22,9 @@ typedef struct {
     char *data;
     size_t size;
     int frame_index;
-    unsigned long timestamp;
+    int64_t timestamp;          // capture time, CLOCK_MONOTONIC us
 } frame_buffer_t;
 
-
-// 添加音频缓冲区结构
-typedef struct {
-    char *data;          // 音频数据
-    size_t size;         // 缓冲区大小
-    size_t data_size;    // 实际数据大小
-    int64_t timestamp;   // 时间戳
-} audio_buffer_t;
-
 // Define a buffer manager structure
 typedef struct {
     frame_buffer_t *buffers;
@@ -45,19 +44,32 @@ typedef struct {
     size_t bgra_size;
     size_t RGB_size;
     char* RGB_buffer;
+    int64_t RGB_timestamp;      // capture time of the frame in RGB_buffer
     sem_t encode_sem;
     int encode_index;
-    char *encode_buffer;
     detect_result_group_t detect_result;
 } buffer_manager_t;
 
 
 typedef struct {
+    int camera_id;                  // 0 is the main camera
     struct v4l2_dev *camdev;
     buffer_manager_t *buffer_mgr;
     int width;
     int height;
     int screen_size;
+    int display;                    // shown on the DRM screen; the others only overlay
+    npu_scheduler_t *npu;           // shared by all cameras
+    npu_client_t *npu_client;
+    const app_config_t *config;
+    stream_fanout_t *fanout;
+    event_recorder_t *recorder;     // NULL unless event recording is enabled
+    segment_store_t *store;         // NULL unless continuous recording is enabled
+    audio_capture_t *audio;         // NULL unless audio is enabled
+    live_server_t *live;            // NULL unless the built-in server is enabled
+    rtp_multicast_t *multicast;     // NULL unless multicast output is enabled
+    substream_t *substream;         // NULL unless substream sinks are configured
+    cascade_t *cascade;             // NULL unless a second-stage model classifies the detections
 } thread_params_t;
 
 
@@ -71,6 +83,7 @@ void* Inference_thread_func(void *arg);
 void* encode_thread_func(void *arg);
 void* audio_capture_thread_func(void *arg);
 // Main multithreaded processing function
-int main_multithreaded(struct v4l2_dev *camdev, int width, int height);
+// camdevs[0] is the main camera, the others follow config->cameras
+int main_multithreaded(struct v4l2_dev **camdevs, int camera_count, const app_config_t *config);
 
 #endif /* BUFFER_MANAGER_H */
@@ -0,0 +1,28 @@
+#ifndef BYTE_BUF_H
+#define BYTE_BUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Growable byte buffer for serialising tags and packets. Allocation failures
+// are sticky: writers keep going and the caller checks error once at the end.
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int error;
+} byte_buf_t;
+
+int byte_buf_reserve(byte_buf_t *b, size_t extra);
+void byte_buf_append(byte_buf_t *b, const void *data, size_t size);
+void byte_buf_printf(byte_buf_t *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void byte_buf_u8(byte_buf_t *b, uint8_t v);
+void byte_buf_be16(byte_buf_t *b, uint16_t v);
+void byte_buf_be24(byte_buf_t *b, uint32_t v);
+void byte_buf_be32(byte_buf_t *b, uint32_t v);
+// Overwrites already written bytes, e.g. a size field once the body is known
+void byte_buf_patch_be24(byte_buf_t *b, size_t offset, uint32_t v);
+void byte_buf_reset(byte_buf_t *b);
+void byte_buf_free(byte_buf_t *b);
+
+#endif /* BYTE_BUF_H */
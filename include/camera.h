@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <linux/videodev2.h>
 
@@ -25,9 +26,10 @@ struct v4l2_dev {
     unsigned int req_count;
     enum v4l2_memory memory_type;
     struct buffer *buffers;
-    unsigned long int timestamp;
+    int64_t timestamp;      // capture time of the last frame, CLOCK_MONOTONIC us
     int data_len;
     unsigned char *out_data;
+    int is_file;    // raw NV12 file source instead of a V4L2 device
 };
 
 void open_device(struct v4l2_dev *dev);
@@ -0,0 +1,72 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "npu_scheduler.h"
+#include "postprocess.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#define CASCADE_MAX_CLASSES 16
+#define CASCADE_MAX_LABELS 256
+
+typedef struct {
+    const char *model;          // name of an --npu-model, NULL disables the cascade
+    const char *classes;        // comma separated detection classes to classify, NULL = all
+    const char *labels;         // one second-stage class name per line, NULL = "attrN"
+    int min_size;               // boxes narrower or lower than this are not classified
+    int max_crops;              // per frame, largest boxes first
+    int deadline_ms;            // results later than this are dropped
+} cascade_config_t;
+
+// The newest classified frame: boxes and their second-stage classes
+typedef struct {
+    uint64_t seq;               // detection sequence number, result.id
+    int count;
+    int det_index[NPU_JOB_MAX_INPUTS];
+    BOX_RECT boxes[NPU_JOB_MAX_INPUTS];
+    int class_ids[NPU_JOB_MAX_INPUTS];
+    int attr[NPU_JOB_MAX_INPUTS];
+    float prop[NPU_JOB_MAX_INPUTS];
+} cascade_result_t;
+
+// Two-stage detection: after a camera's detection finished, the boxes are
+// cropped from the full resolution NV12 frame the detector saw and scaled
+// to the second-stage input in one RGA job (libswscale when RGA is not
+// available), straight into an NPU job of the second-stage model. The
+// classes come back asynchronously and are attached to the detections of
+// later frames by box overlap, so detection results are never held back.
+typedef struct {
+    cascade_config_t cfg;
+    npu_scheduler_t *npu;
+    int model;
+    char classes[CASCADE_MAX_CLASSES][OBJ_NAME_MAX_SIZE];
+    int class_count;
+    char *labels[CASCADE_MAX_LABELS];
+    int label_count;
+    int use_rga;                // cleared after the first RGA failure
+    struct SwsContext *sws;     // host fallback, guarded by mutex
+    pthread_mutex_t mutex;
+    cascade_result_t latest;
+    uint64_t frames;
+    uint64_t crops;
+    uint64_t classified;
+    uint64_t dropped;           // jobs rejected, failed or late
+} cascade_t;
+
+void cascade_config_default(cascade_config_t *cfg);
+// NULL if the model is not loaded on the scheduler
+cascade_t* cascade_create(const cascade_config_t *cfg, npu_scheduler_t *npu);
+// npu_result_hook_fn: crops the boxes of one detection and queues them
+void cascade_on_detection(void *opaque, const unsigned char *nv12, int width, int height,
+                          const detect_result_group_t *result, uint64_t seq);
+// Fills attr_name/attr_prop of the detections that match a classified box
+void cascade_annotate(cascade_t *cc, detect_result_group_t *group);
+void cascade_print_stats(cascade_t *cc);
+// Call after the scheduler is destroyed: its callbacks point here
+void cascade_destroy(cascade_t *cc);
+
+#endif /* CASCADE_H */
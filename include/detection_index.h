@@ -0,0 +1,80 @@
+#ifndef DETECTION_INDEX_H
+#define DETECTION_INDEX_H
+
+#include <stdint.h>
+#include "postprocess.h"
+
+// On-disk layout (little endian):
+//   file header, DETIDX_HEADER_SIZE bytes: geometry and class names
+//   fixed-size blocks of DETIDX_BLOCK_ENTRIES detections, stored as columns:
+//     block header | time delta u32[] | class u8[] | confidence u8[] | box u16[][4]
+// Blocks are appended in time order; each header carries the block's min/max
+// time and a class bitmap, so a query binary-searches the start block and
+// skips blocks that can't contain the requested classes.
+#define DETIDX_MAGIC "DETIDX1"
+#define DETIDX_VERSION 1
+#define DETIDX_HEADER_SIZE 4096
+#define DETIDX_BLOCK_ENTRIES 4096
+#define DETIDX_BLOCK_MAGIC 0x4b4c4244   // "DBLK"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_entries;
+    uint32_t block_size;
+    uint32_t width;                     // boxes are quantised relative to this frame size
+    uint32_t height;
+    uint32_t reserved[9];
+    char names[OBJ_CLASS_NUM][OBJ_NAME_MAX_SIZE];   // filled as classes are first seen
+} detidx_file_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    int64_t min_time_ms;
+    int64_t max_time_ms;
+    uint64_t class_bits[2];             // bit n set if class n occurs in the block
+    uint32_t reserved[6];
+} detidx_block_header_t;
+
+// Writer, fed by the inference thread
+typedef struct {
+    int fd;
+    detidx_file_header_t header;
+    uint8_t *block;                     // block being filled
+    int block_index;
+    int flushed;                        // entries of the current block already on disk
+    int64_t last_time_ms;
+    int64_t last_flush_ms;
+    uint64_t entries;
+} detection_index_t;
+
+// One decoded detection
+typedef struct {
+    int64_t time_ms;                    // wall clock, ms since the epoch
+    int class_id;
+    const char *class_name;
+    float prop;
+    BOX_RECT box;                       // pixels of the recorded frame
+} detection_hit_t;
+
+typedef struct {
+    int blocks_total;
+    int blocks_scanned;
+    int blocks_skipped;                 // rejected by the class bitmap
+    uint64_t hits;
+} detection_query_stats_t;
+
+// Return non-zero from the callback to stop the query
+typedef int (*detection_hit_cb)(const detection_hit_t *hit, void *opaque);
+
+detection_index_t* detection_index_open(const char *path, int width, int height);
+// Appends every detection of one frame; timestamps never go backwards
+int detection_index_append(detection_index_t *idx, int64_t time_ms, const detect_result_group_t *group);
+void detection_index_close(detection_index_t *idx);
+
+// classes is a comma separated list of names, NULL for all classes
+int detection_index_query(const char *path, int64_t from_ms, int64_t to_ms, const char *classes,
+                          detection_hit_cb cb, void *opaque, detection_query_stats_t *stats);
+
+#endif /* DETECTION_INDEX_H */
@@ -0,0 +1,28 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include "postprocess.h"
+
+// Object detector behind the NPU scheduler. Every inference worker owns its
+// own instances and only calls them from its own thread.
+class Detector {
+public:
+    virtual ~Detector() {}
+
+    virtual int Init(const char* model_path, int width = 640, int height = 640) = 0;
+    // NPU cores this instance may run on (rknn_core_mask), 0 = let the driver choose
+    virtual int SetCoreMask(int core_mask) = 0;
+    // Class names, one per line, NULL = the postprocess default; call before inferring
+    virtual int SetLabels(const char* label_path) { return 0; }
+    // Up to BatchSize() NV12 frames of any size, one result group per frame
+    virtual int InferenceBatch(unsigned char* const* input_data, const int* img_width, const int* img_height,
+                               int count, detect_result_group_t* detect_results) = 0;
+    virtual int BatchSize() const = 0;
+    virtual void Release() = 0;
+};
+
+// backend is "rknn" or "mock[:LATENCY_MS[:JITTER_MS]]"; NULL if unknown
+Detector* detector_create(const char* backend);
+int detector_backend_valid(const char* backend);
+
+#endif // DETECTOR_H
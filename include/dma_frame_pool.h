@@ -0,0 +1,44 @@
+#ifndef DMA_FRAME_POOL_H
+#define DMA_FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+}
+
+// One NV12 DMA-BUF the encoder can read without a CPU copy
+typedef struct {
+    int fd;             // dma-buf fd
+    size_t size;        // total size of the allocation
+    int pitch;          // bytes per line (Y and UV)
+    int vstride;        // rows between the Y and UV planes
+    void *map;          // CPU mapping, only set for the memfd fallback
+    int in_use;         // set while an AVFrame references this slot
+} dma_frame_slot_t;
+
+// Pool of DMA-BUF backed NV12 frames exposed as AV_PIX_FMT_DRM_PRIME
+typedef struct {
+    dma_frame_slot_t *slots;
+    int count;
+    int width;
+    int height;
+    int next;           // round-robin search start
+    int is_memfd;       // host fallback: memfd instead of a real dma-buf
+    AVBufferRef *device_ref;    // AV_HWDEVICE_TYPE_DRM
+    AVBufferRef *frames_ref;    // DRM_PRIME frames, sw_format NV12
+} dma_frame_pool_t;
+
+dma_frame_pool_t* init_dma_frame_pool(int count, int width, int height);
+void destroy_dma_frame_pool(dma_frame_pool_t *pool);
+
+// Returns a free slot index, or -1 if every slot is still owned by the encoder
+int dma_frame_pool_acquire(dma_frame_pool_t *pool);
+// Gives back an acquired slot that is not going to be wrapped, e.g. after a failed conversion
+void dma_frame_pool_release(dma_frame_pool_t *pool, int slot);
+// Wraps a slot as a DRM_PRIME AVFrame; the slot is released when the frame is freed
+AVFrame* dma_frame_pool_wrap(dma_frame_pool_t *pool, int slot);
+
+#endif /* DMA_FRAME_POOL_H */
@@ -0,0 +1,80 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+// Rate control modes shared by every backend
+typedef enum {
+    ENC_RC_CBR = 0,
+    ENC_RC_VBR,
+    ENC_RC_CQP,
+} encoder_rc_mode_t;
+
+// Low-latency knobs every backend understands
+typedef struct {
+    const char *backend;    // "auto", "h264_rkmpp", "hevc_rkmpp", "libx264", ...
+    int width;
+    int height;
+    int fps;
+    int64_t bit_rate;
+    int gop_size;
+    encoder_rc_mode_t rc_mode;
+    int qp;                 // only used by ENC_RC_CQP
+    int slices;             // 0 = encoder default
+    int threads;            // 0 = encoder default
+    int low_latency;        // intra refresh instead of periodic IDRs, no lookahead, one-frame VBV
+} encoder_config_t;
+
+struct encoder_backend_t;
+
+typedef struct {
+    const struct encoder_backend_t *backend;
+    const AVCodec *codec;
+    AVCodecContext *ctx;
+    int hw_input;               // encoder imports DRM_PRIME frames directly
+    AVFrame *sw_frame;          // conversion target when the encoder can't take NV12
+    struct SwsContext *sws_ctx;
+    int force_idr;              // next frame is sent as a keyframe
+    int bitrate_warned;         // set_bitrate failure already logged
+    encoder_config_t cfg;
+} encoder_t;
+
+// Backend description; apply_options maps the common knobs onto encoder private options
+typedef struct encoder_backend_t {
+    const char *name;           // name used on the command line
+    const char *codec_name;     // libavcodec encoder name
+    int hw_input;               // accepts AV_PIX_FMT_DRM_PRIME through hw_frames_ctx
+    int live_bitrate;           // rate control re-reads bit_rate after open
+    void (*apply_options)(AVCodecContext *ctx, AVDictionary **opts, const encoder_config_t *cfg);
+} encoder_backend_t;
+
+void encoder_default_config(encoder_config_t *cfg);
+const char* encoder_rc_mode_name(encoder_rc_mode_t mode);
+int encoder_parse_rc_mode(const char *name, encoder_rc_mode_t *mode);
+void encoder_list_backends(void);
+
+// hw_frames_ref describes the DRM_PRIME frames that will be sent; software
+// backends map them to NV12 internally
+encoder_t* encoder_open(const encoder_config_t *cfg, AVBufferRef *hw_frames_ref);
+void encoder_close(encoder_t *enc);
+
+// Sends a DRM_PRIME frame (or NULL to flush); the caller keeps its reference
+int encoder_send_frame(encoder_t *enc, AVFrame *frame);
+int encoder_receive_packet(encoder_t *enc, AVPacket *pkt);
+// Makes the next frame an IDR, e.g. so a reconnected viewer can start decoding
+void encoder_force_idr(encoder_t *enc);
+// Whether encoder_set_bitrate works: CBR/VBR on a backend that re-reads bit_rate
+int encoder_can_set_bitrate(const encoder_t *enc);
+// Retargets a running CBR/VBR encoder; takes effect from the next frame.
+// Returns AVERROR(ENOSYS), logged once, if the encoder can't be retargeted.
+int encoder_set_bitrate(encoder_t *enc, int64_t bit_rate);
+
+#endif /* ENCODER_H */
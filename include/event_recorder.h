@@ -0,0 +1,61 @@
+#ifndef EVENT_RECORDER_H
+#define EVENT_RECORDER_H
+
+#include <stdint.h>
+#include "postprocess.h"
+#include "stream_writer.h"
+
+#define EVENT_MAX_CLASSES 16
+
+typedef struct {
+    const char *dir;            // output directory, NULL disables event recording
+    const char *classes;        // comma separated class names that start an event
+    int pre_roll_s;             // seconds kept in memory before the trigger
+    int post_roll_s;            // seconds recorded after the last detection
+} event_config_t;
+
+// Keeps the last pre_roll_s seconds of encoded packets in memory, always
+// starting on an IDR. A matching detection writes the ring to a new MP4
+// and keeps recording until post_roll_s after the last match.
+typedef struct {
+    event_config_t cfg;
+    char classes[EVENT_MAX_CLASSES][OBJ_NAME_MAX_SIZE];
+    int class_count;
+
+    AVPacket **ring;
+    int capacity;
+    int head;
+    int count;
+
+    AVCodecParameters *codecpar;
+    AVRational time_base;
+    stream_writer_t *writer;        // current event, NULL while idle
+    stream_writer_t **finishing;    // earlier events still being written out
+    int finishing_count;
+    int finishing_capacity;
+    int64_t last_trigger_us;        // set by the inference thread
+    int64_t retry_after_us;         // back off after a failed file open
+    int64_t last_idr_us;            // packet time of the newest IDR
+    int idr_requested;              // asked the encoder for an IDR, none came yet
+    int keyframe_request;           // polled by the encoder
+    uint64_t events;
+} event_recorder_t;
+
+void event_config_default(event_config_t *cfg);
+// fps and gop_size size the ring: up to twice the pre-roll between two IDRs, plus GOP slack
+event_recorder_t* event_recorder_create(const event_config_t *cfg, int fps, int gop_size);
+void event_recorder_destroy(event_recorder_t *rec);
+
+// Called by the inference thread; returns 1 if the detections start/extend an event
+int event_recorder_match(event_recorder_t *rec, const detect_result_group_t *group);
+
+// Called by the encode thread for every packet
+int event_recorder_start(event_recorder_t *rec, const AVCodecParameters *codecpar, AVRational time_base);
+void event_recorder_push(event_recorder_t *rec, const AVPacket *pkt);
+// Returns 1 once when the ring has gone pre_roll_s without an IDR: in
+// low-latency mode the encoder should emit one next
+int event_recorder_keyframe_requested(event_recorder_t *rec);
+// Ends the current event and drops the ring, e.g. on a resolution change
+void event_recorder_reset(event_recorder_t *rec, const AVCodecParameters *codecpar);
+
+#endif /* EVENT_RECORDER_H */
@@ -0,0 +1,32 @@
+#ifndef FLV_TAG_H
+#define FLV_TAG_H
+
+#include <stdint.h>
+#include "byte_buf.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// FLV serialisation for H.264 video and AAC audio, shared by the HTTP-FLV
+// server and the RTMP muxer. Every tag is appended together with its
+// PreviousTagSize, so a stream is just the concatenation of the outputs.
+#define FLV_TAG_AUDIO 8
+#define FLV_TAG_VIDEO 9
+#define FLV_TAG_SCRIPT 18
+#define FLV_TAG_HEADER_SIZE 11
+
+// "FLV" file header and PreviousTagSize0
+void flv_write_file_header(byte_buf_t *b, int has_audio);
+// onMetaData script tag; audio may be NULL
+void flv_write_metadata(byte_buf_t *b, const AVCodecParameters *video, int fps,
+                        const AVCodecParameters *audio);
+// AVC/AAC sequence header tags, sent before the first frame and again after
+// the stream parameters change. Return -1 if the extradata is unusable.
+int flv_write_avc_config(byte_buf_t *b, const AVCodecParameters *par);
+int flv_write_aac_config(byte_buf_t *b, const AVCodecParameters *par);
+// One frame; Annex-B start codes are rewritten as 4-byte lengths
+void flv_write_video(byte_buf_t *b, const AVPacket *pkt, AVRational time_base);
+void flv_write_audio(byte_buf_t *b, const AVPacket *pkt, AVRational time_base);
+
+#endif /* FLV_TAG_H */
@@ -0,0 +1,45 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+// Maps capture timestamps (CLOCK_MONOTONIC, us) to encoder PTS. Stream time
+// follows the camera clock exactly, so dropped or late frames leave gaps
+// instead of shifting everything after them. Repeated or slightly backwards
+// timestamps are bumped by one tick; a large jump either way (driver
+// restart, bogus timestamp) rebases the clock so the stream continues one
+// frame interval after the last PTS.
+typedef struct {
+    AVRational time_base;
+    int64_t first_us;           // capture time of PTS 0
+    int64_t base_us;            // capture time that maps to base_pts
+    int64_t base_pts;
+    int64_t last_us;
+    int64_t last_pts;
+    double interval_us;         // smoothed capture interval, follows fps changes
+    int started;
+    uint64_t frames;
+    uint64_t bumped;            // frames whose timestamp did not advance
+    uint64_t rebases;
+} frame_clock_t;
+
+void frame_clock_init(frame_clock_t *clock, AVRational time_base, int nominal_fps);
+int64_t frame_clock_pts(frame_clock_t *clock, int64_t capture_us);
+// Stream time of another capture timestamp on the same clock (e.g. audio),
+// without advancing the clock
+int64_t frame_clock_map(const frame_clock_t *clock, int64_t capture_us);
+// Inverse of frame_clock_map: capture time of a stream timestamp, used to
+// measure capture -> packet latency
+int64_t frame_clock_capture_us(const frame_clock_t *clock, int64_t pts);
+// Length of n capture intervals in time_base units, the duration of a packet
+// when only every n-th frame is encoded
+int64_t frame_clock_duration(const frame_clock_t *clock, int n);
+// Capture time elapsed minus stream time elapsed, in us; only rebases and
+// bumped timestamps make it non-zero
+int64_t frame_clock_drift_us(const frame_clock_t *clock);
+
+#endif /* FRAME_CLOCK_H */
@@ -6,4 +6,6 @@
 int convert_nv12_to_RGB(char *src, char *dst, int width, int height);
 int convert_RGB_to_BGRA_dma_buf(char *src, My_drm_context_t *drm, int width, int height);
 int convert_color(char *src, char *dst, int width, int height, int src_format, int dst_format);
+int convert_RGB_to_NV12_dma_buf(char *src, int dst_fd, void *dst_map, int width, int height,
+                                int dst_width, int dst_height, int wstride, int hstride);
 #endif /* IMAGE_CONVERTER_H */
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef LIVE_SERVER_H
+#define LIVE_SERVER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "byte_buf.h"
+#include "rtp_packetizer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define LIVE_MAX_CLIENTS 64
+#define LIVE_GOP_MAX 1024               // items cached since the last keyframe
+#define LIVE_CLIENT_QUEUE 1024          // items waiting to be sent to one client
+#define LIVE_CLIENT_MAX_BYTES (8 * 1024 * 1024)
+#define LIVE_IN_SIZE 4096
+
+typedef struct {
+    int http_port;              // HTTP-FLV, any path ending in .flv; 0 = off
+    int rtsp_port;              // RTSP with RTP interleaved over TCP; 0 = off
+    int max_clients;
+    int fps;                    // nominal frame rate for the FLV metadata
+} live_config_t;
+
+typedef enum {
+    LIVE_HTTP = 0,
+    LIVE_RTSP,
+} live_proto_t;
+
+// One serialised FLV tag or run of interleaved RTP packets. Built once per
+// encoded packet and shared by reference between the GOP cache and every
+// client queue.
+typedef struct {
+    int refs;                   // protected by the server mutex
+    int key;                    // video keyframe: clients may start here
+    int control;                // response or stream header, never dropped
+    uint16_t rtp_seq;           // RTSP items: first sequence number and timestamp
+    uint32_t rtp_time;
+    byte_buf_t buf;
+} live_item_t;
+
+typedef struct {
+    int fd;
+    live_proto_t proto;
+    char addr[48];
+    int playing;                // receives stream items
+    int wait_key;               // backlog was dropped, restart at the next keyframe
+    int closing;                // close once the queue is sent
+    int dead;
+    char in[LIVE_IN_SIZE];
+    size_t in_len;
+    size_t in_skip;             // rest of an interleaved RTCP packet or request body
+    uint32_t session;
+    live_item_t *queue[LIVE_CLIENT_QUEUE];
+    int head;
+    int count;
+    size_t offset;              // bytes of the head item already sent
+    size_t queued_bytes;
+    uint64_t sent_bytes;
+    uint64_t dropped_items;
+} live_client_t;
+
+// Embedded HTTP-FLV and RTSP/TCP server fed straight from the encoder. One
+// epoll thread accepts, parses requests and writes; the encoder thread only
+// serialises each packet once per protocol and queues references. A new
+// viewer first gets the cached GOP, so playback starts on a keyframe at once.
+typedef struct {
+    live_config_t cfg;
+    int epoll_fd;
+    int wake_fd;                // eventfd: new items or shutdown
+    int http_fd;                // listening sockets, -1 when disabled
+    int rtsp_fd;
+    int abort;
+    pthread_t thread;
+    int thread_started;
+
+    // encoder thread only
+    rtp_packetizer_t rtp;
+
+    pthread_mutex_t mutex;      // protects everything below
+    live_client_t *clients[LIVE_MAX_CLIENTS];
+    int client_count;
+    AVCodecParameters *codecpar;        // NULL until started
+    AVRational time_base;
+    AVCodecParameters *audio_codecpar;  // HTTP-FLV only
+    AVRational audio_time_base;
+    live_item_t *flv_header;    // file header, metadata and sequence headers
+    char *sdp;
+    live_item_t *gop[2][LIVE_GOP_MAX];  // per protocol
+    int gop_count[2];
+    uint16_t rtp_next_seq;
+    uint32_t rtp_next_time;
+    uint64_t clients_served;
+} live_server_t;
+
+void live_config_default(live_config_t *cfg);
+// Binds the ports and starts the server thread; viewers are refused until start
+live_server_t* live_server_open(const live_config_t *cfg);
+// Adds AAC to HTTP-FLV viewers; call before start
+int live_server_set_audio(live_server_t *s, const AVCodecParameters *codecpar, AVRational time_base);
+// Video stream parameters (H.264 only); again after a resolution change
+int live_server_start(live_server_t *s, const AVCodecParameters *codecpar, AVRational time_base);
+// Serialises pkt (stream_index 0 video, 1 audio) and queues it on every viewer
+void live_server_send(live_server_t *s, const AVPacket *pkt);
+void live_server_list(live_server_t *s);
+void live_server_close(live_server_t *s);
+
+#endif /* LIVE_SERVER_H */
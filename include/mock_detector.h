@@ -0,0 +1,48 @@
+#ifndef MOCK_DETECTOR_H
+#define MOCK_DETECTOR_H
+
+#include "detector.h"
+#include "npu_model.h"
+
+// Stands in for the NPU on hosts without one: sleeps for a configurable
+// latency with random jitter and reports one person in the frame centre.
+// The jitter makes workers finish out of order, which exercises the
+// scheduler's reorder buffer.
+class MockDetector : public Detector {
+public:
+    MockDetector(int latency_ms, int jitter_ms);
+
+    int Init(const char* model_path, int width = 640, int height = 640);
+    int SetCoreMask(int core_mask);
+    int InferenceBatch(unsigned char* const* input_data, const int* img_width, const int* img_height,
+                       int count, detect_result_group_t* detect_results);
+    int BatchSize() const { return 1; }
+    void Release() {}
+
+private:
+    int latency_ms;
+    int jitter_ms;
+    unsigned int seed;
+};
+
+// Second-stage counterpart: a 224x224 classifier with batch 4 and 8 scores
+// per input. Every run takes the configured latency, whatever the count.
+class MockModel : public NpuModel {
+public:
+    MockModel(int latency_ms, int jitter_ms);
+
+    int Init(const char* model_path);
+    int SetCoreMask(int core_mask) { return 0; }
+    int InputWidth() const { return 224; }
+    int InputHeight() const { return 224; }
+    int BatchSize() const { return 4; }
+    int OutputSize() const { return 8; }
+    int Run(const unsigned char* input, int count, float* output);
+
+private:
+    int latency_ms;
+    int jitter_ms;
+    unsigned int seed;
+};
+
+#endif // MOCK_DETECTOR_H
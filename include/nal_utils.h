@@ -0,0 +1,37 @@
+#ifndef NAL_UTILS_H
+#define NAL_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// One NAL unit inside an encoded packet (payload without start code / length prefix)
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} nal_unit_t;
+
+// Iterates over the NAL units of an Annex-B or 4-byte length-prefixed (AVCC/HVCC)
+// packet. *pos must start at 0. Returns 1 while a unit was produced, 0 at the end.
+int nal_next(const uint8_t *buf, size_t size, size_t *pos, nal_unit_t *nal);
+
+int nal_type(enum AVCodecID codec_id, const nal_unit_t *nal);
+int nal_is_vcl(enum AVCodecID codec_id, int type);
+int nal_is_idr(enum AVCodecID codec_id, int type);
+
+// First SPS and PPS of H.264 extradata in Annex-B or avcC form. Returns 0 if
+// both were found; the units point into extradata.
+int nal_h264_parameter_sets(const uint8_t *extradata, size_t size, nal_unit_t *sps, nal_unit_t *pps);
+
+// True for a keyframe a decoder can start on. With intra refresh the encoder
+// also flags recovery points as keyframes; those are P slices and are not.
+// Codecs without NAL units trust the flag.
+int nal_packet_is_idr(enum AVCodecID codec_id, const AVPacket *pkt);
+
+// True when nothing else references this picture, so it can be dropped safely
+int nal_packet_is_disposable(enum AVCodecID codec_id, const AVPacket *pkt);
+
+#endif /* NAL_UTILS_H */
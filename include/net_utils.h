@@ -0,0 +1,27 @@
+#ifndef NET_UTILS_H
+#define NET_UTILS_H
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Inodes of the sockets the process holds at one moment. libavformat keeps
+// its socket private (ffurl_get_file_handle is not exported by the shared
+// library), so a snapshot taken right before opening an output tells the
+// socket that open creates apart from the connections of other outputs.
+typedef struct {
+    ino_t *inodes;
+    int count;
+} net_socket_set_t;
+
+int net_socket_snapshot(net_socket_set_t *set);
+void net_socket_set_free(net_socket_set_t *set);
+// The socket connected to the host:port of url that is not in before.
+// Returns the fd (still owned by libavformat), or -1 if there is none or
+// more than one, e.g. another output connected to the same server meanwhile.
+int net_find_new_peer_socket(const net_socket_set_t *before, const char *url, int default_port);
+
+// Returns 0 and fills info on success, -1 otherwise
+int net_get_tcp_info(int fd, struct tcp_info *info);
+
+#endif /* NET_UTILS_H */
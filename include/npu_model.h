@@ -0,0 +1,25 @@
+#ifndef NPU_MODEL_H
+#define NPU_MODEL_H
+
+// Second-stage network run on detection crops (classifier, attributes,
+// face or plate recognition): RGB888 input at the model size, the first
+// output dequantized to floats. Like Detector, an instance belongs to one
+// inference worker.
+class NpuModel {
+public:
+    virtual ~NpuModel() {}
+
+    virtual int Init(const char* model_path) = 0;
+    virtual int SetCoreMask(int core_mask) = 0;
+    virtual int InputWidth() const = 0;
+    virtual int InputHeight() const = 0;
+    virtual int BatchSize() const = 0;
+    virtual int OutputSize() const = 0;     // floats per input
+    // count (<= BatchSize()) inputs back to back in, count * OutputSize() floats out
+    virtual int Run(const unsigned char* input, int count, float* output) = 0;
+};
+
+// backend as for detector_create(); NULL if unknown
+NpuModel* npu_model_create(const char* backend);
+
+#endif // NPU_MODEL_H
@@ -0,0 +1,272 @@
+#ifndef NPU_SCHEDULER_H
+#define NPU_SCHEDULER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "postprocess.h"
+
+#define NPU_MAX_CLIENTS 4
+#define NPU_MAX_BATCH NPU_MAX_CLIENTS
+#define NPU_MAX_WORKERS 6
+#define NPU_MAX_LEVELS 3            // the detection model plus lighter builds of it
+#define NPU_MAX_MODELS 2            // second-stage models next to detection
+#define NPU_MODEL_QUEUE 4           // jobs per second-stage model
+#define NPU_JOB_MAX_INPUTS 16       // crops per job
+#define NPU_PATH_MAX 256
+#define NPU_DEFAULT_MODEL "./model/yolov5s-640-640.rknn"
+
+typedef enum {
+    NPU_POLICY_RR = 0,          // cameras take turns
+    NPU_POLICY_WFQ,             // NPU time shared in proportion to the weights
+} npu_policy_t;
+
+// A second-stage model, loaded on every worker next to the detector
+typedef struct {
+    const char *name;
+    const char *path;
+    const char *backend;        // NULL = the detector's backend
+    int priority;               // higher runs first among second-stage models
+} npu_model_config_t;
+
+typedef struct {
+    const char *model_path;
+    const char *labels_path;    // class names of the detection model, NULL = postprocess default
+    const char *batch_model_path;   // same network compiled with batch N, NULL = no batching
+    int batch_window_ms;        // how long a partial batch may wait for more cameras
+    int deadline_ms;            // submit -> result limit the batch window must respect,
+                                // and the budget the lite models are switched in to keep
+    const char *lite_models[NPU_MAX_LEVELS - 1];   // lower resolution builds, heaviest first
+    int lite_count;
+    npu_policy_t policy;
+    const char *backend;        // detector_create() backend, "rknn" or "mock:..."
+    int workers;                // inference threads, each with its own contexts
+    int core_masks[NPU_MAX_WORKERS];    // RKNN_NPU_CORE_* per worker
+    int core_mask_count;        // 0 = spread the workers over the three RK3588 cores
+    npu_model_config_t models[NPU_MAX_MODELS];
+    int model_count;
+} npu_config_t;
+
+// Called on a worker thread without the scheduler lock once all inputs of a
+// job ran; outputs is count * output_size floats, or NULL if the job failed
+// or missed its deadline. outputs is only valid during the call.
+typedef void (*npu_job_done_fn)(void *opaque, const float *outputs, int count, int output_size);
+
+typedef enum {
+    NPU_JOB_FREE = 0,
+    NPU_JOB_FILLING,            // the submitter writes the inputs
+    NPU_JOB_QUEUED,             // waits for slack on the NPU, possibly partly run
+    NPU_JOB_DONE,               // callback in progress
+} npu_job_state_t;
+
+// Up to NPU_JOB_MAX_INPUTS inputs of one second-stage model, run in slices
+// of the model batch size between detection frames
+typedef struct {
+    int model;
+    npu_job_state_t state;
+    unsigned char *input;       // count inputs of input_size bytes back to back
+    float *output;
+    int count;
+    int next;                   // first input not run yet
+    int running;                // a worker runs a slice of it
+    int failed;
+    int64_t deadline_us;        // 0 = none
+    uint64_t seq;
+    npu_job_done_fn done;
+    void *opaque;
+} npu_job_t;
+
+typedef struct {
+    npu_model_config_t cfg;
+    int input_width;
+    int input_height;
+    size_t input_size;          // bytes of one RGB888 input
+    int batch;
+    int output_size;            // floats per input
+    npu_job_t jobs[NPU_MODEL_QUEUE];
+    uint64_t next_seq;
+    double run_ms;              // EWMA cost of one slice
+    uint64_t runs;
+    uint64_t inputs;
+    uint64_t completed;
+    uint64_t expired;           // jobs dropped at their deadline
+    uint64_t rejected;          // jobs refused because the queue was full
+    int64_t busy_us;
+} npu_model_t;
+
+// Called on the worker thread after a detection of the client succeeded,
+// while its NV12 frame is still reserved, e.g. to crop the boxes for a
+// second stage. Boxes are in frame pixels; seq becomes the result id.
+typedef void (*npu_result_hook_fn)(void *opaque, const unsigned char *nv12, int width, int height,
+                                   const detect_result_group_t *result, uint64_t seq);
+
+// Where one dispatched frame of a camera is in the reorder ring
+typedef struct {
+    uint64_t seq;
+    int done;
+    int ok;
+    detect_result_group_t result;
+} npu_reorder_slot_t;
+
+// One camera. It owns one frame buffer per worker plus one: up to one frame
+// per worker is being inferred and one is queued, where a newer frame
+// replaces an older one. A camera never has more than one job waiting, so a
+// slow NPU only lowers its detection rate. Workers may finish its frames out
+// of order; the reorder ring hands results out in dispatch order.
+typedef struct {
+    int id;
+    int width;
+    int height;
+    int weight;                 // WFQ share, >= 1
+    int max_fps;                // detection rate cap, 0 = as fast as the NPU allows
+    npu_result_hook_fn result_hook;
+    void *hook_opaque;
+    unsigned char *frames[NPU_MAX_WORKERS + 1];    // NV12 copies; frames[write_idx] takes the next submit
+    int in_flight[NPU_MAX_WORKERS + 1];             // frames[i] is being inferred
+    int frame_count;
+    size_t frame_size;
+    int write_idx;
+    int filling;                // the camera is copying into frames[write_idx]
+    int pending;                // frames[write_idx] waits for the NPU
+    uint64_t dispatch_seq;      // sequence number of the next dispatched frame
+    uint64_t emit_seq;          // oldest dispatched frame whose result is not out yet
+    npu_reorder_slot_t ring[NPU_MAX_WORKERS];      // indexed by seq % NPU_MAX_WORKERS
+    int64_t next_due_us;        // max_fps pacing
+    int64_t submit_us;          // when the pending frame was queued
+    int64_t last_call_us;       // last submit call, paced out or not
+    int64_t interval_us;        // EWMA of the camera frame interval
+    double vtime;               // WFQ virtual finish time
+    detect_result_group_t result;   // newest in-order result, id = its sequence number
+    uint64_t result_seq;
+    uint64_t submitted;
+    uint64_t skipped;           // frames paced out by max_fps
+    uint64_t replaced;          // queued frames overwritten by a newer one
+    uint64_t inferred;
+    uint64_t reordered;         // results that finished before an older frame
+    double infer_ms_avg;        // EWMA
+} npu_client_t;
+
+struct npu_scheduler;
+class Detector;
+
+// One inference thread, owning its own detector contexts pinned to core_mask
+typedef struct {
+    struct npu_scheduler *s;
+    int index;
+    int core_mask;
+    pthread_t thread;
+    Detector *standby[NPU_MAX_LEVELS];  // reloaded builds, warmed up, taken over between two frames
+    Detector *standby_batch;
+    Detector *retired[NPU_MAX_LEVELS + 1];  // contexts it replaced, released by the reload thread
+    int retired_count;
+    uint64_t runs;
+    uint64_t frames;
+    int64_t busy_us;
+} npu_worker_t;
+
+// Runs every inference of every camera on a pool of worker threads, each
+// owning its own RKNN contexts, so a multi-core NPU runs several frames at
+// once. Cameras submit without blocking and pick the newest result up
+// later, so NPU contention never holds back capture, display or encode.
+// With a batch model a worker gathers frames of several cameras within
+// batch_window_ms and runs them as one input whenever the measured cost of
+// a batch is below that of running them one by one.
+//
+// With lite models the scheduler keeps every build loaded and warmed up on
+// each worker and picks one per frame: when the measured submit -> result
+// latency exceeds deadline_ms it steps down to a lighter build, and it steps
+// back up once the heavier build is predicted to fit comfortably again.
+//
+// npu_scheduler_reload() swaps the detection model while cameras keep
+// running: a background thread loads and warms up standby contexts of every
+// build per worker, each worker takes its standby set over between two
+// frames, and the old contexts are released once all workers switched.
+//
+// Detection always goes first. Second-stage jobs run one slice at a time,
+// and only when the slice fits before the next camera frame is expected or
+// another worker is idle to take that frame, so a saturated second-stage
+// model never delays detection.
+typedef struct npu_scheduler {
+    npu_config_t cfg;
+    npu_worker_t workers[NPU_MAX_WORKERS];
+    int worker_count;
+    npu_client_t *clients[NPU_MAX_CLIENTS];
+    int client_count;
+    int rr_next;
+    double vclock;              // WFQ virtual time: start tag of the job in service
+    int batch_size;             // of the batch model, 1 without one
+    double single_ms;           // EWMA cost of one rknn_run with the batch-1 model
+    double batch_ms;            // EWMA cost of one rknn_run with the batch model
+    uint64_t single_runs;
+    uint64_t batch_runs;
+    uint64_t batch_frames;
+    uint64_t decisions;         // batch-or-not choices, every 64th probes the other way
+    int level;                  // detection model in use, 0 = model_path, then lite_models
+    int level_count;
+    double level_ms[NPU_MAX_LEVELS];    // EWMA cost of one run at each level
+    uint64_t level_frames[NPU_MAX_LEVELS];
+    double e2e_ms;              // EWMA submit -> result of all cameras
+    int64_t level_since_us;     // last switch
+    uint64_t level_switches;
+    npu_model_t models[NPU_MAX_MODELS];
+    int model_count;
+    int64_t det_busy_us;
+    int idle_workers;           // workers waiting for work
+    int loaded;                 // workers done loading their models
+    int load_failed;
+    pthread_t reload_thread;
+    int reloading;              // a reload runs; a second request is refused
+    int reload_joinable;        // reload_thread ended but was not joined yet
+    int reload_swapped;         // workers that took their standby over
+    int reload_all_builds;      // same model path: the lite and batch builds are reloaded too
+    uint64_t reloads;
+    char reload_model[NPU_PATH_MAX];    // what the running reload loads
+    char reload_labels[NPU_PATH_MAX];   // "" = postprocess default
+    char model_path[NPU_PATH_MAX];      // cfg.model_path and cfg.labels_path after a reload
+    char labels_path[NPU_PATH_MAX];
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int64_t start_us;
+} npu_scheduler_t;
+
+void npu_config_default(npu_config_t *cfg);
+const char* npu_policy_name(npu_policy_t policy);
+int npu_parse_policy(const char *name, npu_policy_t *policy);
+// "1,2,4" or "0x3,..." into cfg->core_masks; -1 if malformed
+int npu_parse_core_masks(const char *list, npu_config_t *cfg);
+
+// Loads the models on every worker thread; NULL if any can't be loaded
+npu_scheduler_t* npu_scheduler_create(const npu_config_t *cfg);
+void npu_scheduler_destroy(npu_scheduler_t *s);
+
+npu_client_t* npu_scheduler_add_client(npu_scheduler_t *s, int id, int width, int height,
+                                       int weight, int max_fps);
+// Set before the first submit
+void npu_client_set_result_hook(npu_client_t *c, npu_result_hook_fn fn, void *opaque);
+// Copies nv12 into the client's queue buffer if the rate cap allows it.
+// Never waits for the NPU: returns 1 if queued, 0 if skipped.
+int npu_scheduler_submit(npu_scheduler_t *s, npu_client_t *c, const unsigned char *nv12, int64_t now_us);
+// Copies the newest result into out if it is newer than *seq; returns 1 then.
+// Results come out in submit order even when workers finish out of order.
+int npu_client_poll(npu_scheduler_t *s, npu_client_t *c, detect_result_group_t *out, uint64_t *seq);
+void npu_scheduler_print_stats(npu_scheduler_t *s);
+// Loads model_path with labels_path in the background and swaps it in for
+// the detection model; NULL keeps the current path, so (NULL, NULL) picks up
+// files replaced on disk, the lite and batch builds included. A different
+// model_path retires the lite and batch builds of the old model.
+// Returns without waiting: 0 if the reload started, -1 if
+// one is still running or the thread could not start.
+int npu_scheduler_reload(npu_scheduler_t *s, const char *model_path, const char *labels_path);
+
+// Index of the second-stage model called name, -1 if there is none
+int npu_scheduler_find_model(npu_scheduler_t *s, const char *name);
+// Reserves a job of count inputs of the model; fill job->input, then commit
+// or cancel. NULL if the model queue is full, so a slow second stage sheds
+// work instead of growing a backlog.
+npu_job_t* npu_job_begin(npu_scheduler_t *s, int model, int count);
+// Queues the job; done is called when it finished or passed deadline_us
+void npu_job_commit(npu_scheduler_t *s, npu_job_t *job, int64_t deadline_us, npu_job_done_fn done, void *opaque);
+void npu_job_cancel(npu_scheduler_t *s, npu_job_t *job);
+
+#endif /* NPU_SCHEDULER_H */
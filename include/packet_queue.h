@@ -0,0 +1,74 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+typedef struct {
+    AVPacket *pkt;
+    int64_t enqueue_us;     // monotonic time the packet entered the queue
+} queued_packet_t;
+
+// What a queue gives up when its consumer falls behind
+typedef enum {
+    QUEUE_DROP_GOP = 0,     // live outputs: disposable frames above the high watermark, then whole GOPs
+    QUEUE_NO_DROP,          // recordings: every frame is kept until the queue is full, then the
+                            // oldest GOP goes as a last resort
+} queue_policy_t;
+
+// Bounded FIFO of refcounted packets with congestion-aware dropping:
+//  - above the high watermark, disposable (non-reference) frames are dropped first
+//  - when full, the oldest GOP is dropped so the queue restarts on a keyframe
+//  - once a GOP has been cut, nothing is queued again until the next IDR
+// A QUEUE_NO_DROP queue skips the first step and drops no disposable frames.
+// Stream 0 is the video stream. Packets of other streams (audio) never start
+// a GOP and are dropped together with the GOP they were queued in.
+typedef struct {
+    queued_packet_t *entries;
+    int capacity;
+    int head;
+    int count;
+    int64_t bytes;
+    int high_watermark;
+    int wait_keyframe;
+    int flushed;            // waiting for the keyframe after a flush, not after congestion
+    int abort;
+    int finished;           // no more puts; get drains what is left, then fails
+    queue_policy_t policy;
+    enum AVCodecID codec_id;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    uint64_t queued_packets;
+    uint64_t dropped_packets;   // congestion only
+    uint64_t flushed_packets;   // discarded on purpose by a flush and until the next keyframe
+    uint64_t dropped_nonref;
+    uint64_t dropped_gops;
+} packet_queue_t;
+
+packet_queue_t* packet_queue_create(int capacity, enum AVCodecID codec_id);
+void packet_queue_destroy(packet_queue_t *q);
+// QUEUE_DROP_GOP unless set; call before the first put
+void packet_queue_set_policy(packet_queue_t *q, queue_policy_t policy);
+
+// Queues a new reference to pkt. Returns 0 if queued, 1 if dropped, <0 on error.
+int packet_queue_put(packet_queue_t *q, const AVPacket *pkt);
+// Blocks until a packet is available. Returns 0 on success, -1 once aborted
+// or once a finished queue is empty.
+int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int64_t *enqueue_us);
+// Drops everything and waits for the next keyframe before queueing again;
+// counted in flushed_packets so rate control does not read it as congestion
+void packet_queue_flush(packet_queue_t *q);
+void packet_queue_abort(packet_queue_t *q);
+// Ends the stream: later puts fail, queued packets are still delivered
+void packet_queue_finish(packet_queue_t *q);
+int packet_queue_depth(packet_queue_t *q);
+uint64_t packet_queue_dropped_gops(packet_queue_t *q);
+
+int64_t monotonic_us(void);
+
+#endif /* PACKET_QUEUE_H */
@@ -24,6 +24,9 @@ typedef struct __detect_result_t
     char name[OBJ_NAME_MAX_SIZE];
     BOX_RECT box;
     float prop;
+    int class_id;
+    char attr_name[OBJ_NAME_MAX_SIZE];  // second-stage class of the crop, "" if none
+    float attr_prop;
 } detect_result_t;
 
 typedef struct _detect_result_group_t
@@ -33,10 +36,18 @@ typedef struct _detect_result_group_t
     detect_result_t results[OBJ_NUMB_MAX_SIZE];
 } detect_result_group_t;
 
-int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w,
+// Label table of one detector instance, so several inference workers can
+// post-process at the same time
+typedef struct {
+    char *labels[OBJ_CLASS_NUM];
+} postprocess_ctx_t;
+
+// label_path NULL loads the default COCO label list
+int initPostProcess(postprocess_ctx_t *ctx, const char *label_path);
+int post_process(postprocess_ctx_t *ctx, int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h, int model_in_w,
                  float conf_threshold, float nms_threshold, float scale_w, float scale_h,
                  std::vector<int32_t> &qnt_zps, std::vector<float> &qnt_scales,
                  detect_result_group_t *group);
 
-void deinitPostProcess();
+void deinitPostProcess(postprocess_ctx_t *ctx);
 #endif //_RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
@@ -0,0 +1,31 @@
+#ifndef RKNN_MODEL_H
+#define RKNN_MODEL_H
+
+#include "rknn_api.h"
+#include "npu_model.h"
+
+class RknnModel : public NpuModel {
+public:
+    RknnModel();
+    ~RknnModel();
+
+    int Init(const char* model_path);
+    int SetCoreMask(int core_mask);
+    int InputWidth() const { return width; }
+    int InputHeight() const { return height; }
+    int BatchSize() const { return batch; }
+    int OutputSize() const { return output_size; }
+    int Run(const unsigned char* input, int count, float* output);
+    void Release();
+
+private:
+    rknn_context ctx;
+    int width;
+    int height;
+    int channel;
+    int batch;
+    int output_size;
+    unsigned char* input_buffer;    // a full batch, for runs of fewer inputs
+};
+
+#endif // RKNN_MODEL_H
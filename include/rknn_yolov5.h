@@ -5,26 +5,37 @@
 #include <vector>
 #include <string>
 #include "rknn_api.h"
+#include "detector.h"
 #include "postprocess.h"
 
 
-class RknnYolov5 {
+class RknnYolov5 : public Detector {
 public:
     RknnYolov5();
     ~RknnYolov5();
     
     int Init(const char* model_path, int width = 640, int height = 640);
+    // Pins the context to NPU cores (RKNN_NPU_CORE_*); only multi-core NPUs support it
+    int SetCoreMask(int core_mask);
+    int SetLabels(const char* label_path);
     int Inference(unsigned char* input_data, int img_width, int img_height, detect_result_group_t* detect_result);
+    // One rknn_run for up to BatchSize() NV12 frames of any size; a model
+    // compiled with batch N always computes N, unused slots are ignored
+    int InferenceBatch(unsigned char* const* input_data, const int* img_width, const int* img_height,
+                       int count, detect_result_group_t* detect_results);
+    int BatchSize() const { return batch; }
     void Release();
 
 private:
-    int PreProcess(unsigned char* input_data, int img_width, int img_height);
+    int PreProcess(unsigned char* input_data, int img_width, int img_height, unsigned char* dst);
     
     rknn_context ctx;
     int model_width;
     int model_height;
     int channel;
+    int batch;                  // dims[0] of the input tensor
     int input_index;
+    postprocess_ctx_t pp;       // labels of this instance
     std::vector<int32_t> qnt_zps;
     std::vector<float> qnt_scales;
     
@@ -35,6 +46,7 @@ private:
     // Pre-allocated buffers
     unsigned char* input_buffer;
     int8_t* output_buffer[3];
+    int output_stride[3];       // bytes of one batch item in each output
 };
 
 #endif // RKNN_YOLOV5_H
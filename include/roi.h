@@ -0,0 +1,58 @@
+#ifndef ROI_H
+#define ROI_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "postprocess.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#define ROI_MAX_CLASSES 16
+#define ROI_HISTORY 256             // frames in flight between send and receive
+
+typedef struct {
+    int enabled;
+    const char *classes;        // comma separated classes encoded at higher quality
+    double qoffset;             // -1..1, negative = better quality inside the boxes
+    double bg_qoffset;          // applied to the rest of the frame, 0 = untouched
+    const char *log_path;       // measurement mode: ROI toggles every GOP, sizes go to a CSV
+} roi_config_t;
+
+// Turns the latest detections into AV_FRAME_DATA_REGIONS_OF_INTEREST side
+// data: one region per matching box, then a full-frame background region.
+// FFmpeg applies the first region that covers a macroblock, so boxes win.
+typedef struct {
+    roi_config_t cfg;
+    char classes[ROI_MAX_CLASSES][OBJ_NAME_MAX_SIZE];
+    int class_count;
+    int supported;              // encoder is known to honour ROI side data
+
+    // measurement mode
+    FILE *log;
+    uint64_t frames;            // frames seen by roi_attach
+    int64_t roi_pts[ROI_HISTORY];       // frames in flight, matched to packets by pts
+    uint8_t roi_on[ROI_HISTORY];        // whether the frame carried regions
+    uint8_t roi_count[ROI_HISTORY];
+    uint64_t packets[2];        // [0] ROI off, [1] ROI on
+    uint64_t bytes[2];
+    uint64_t key_packets[2];
+    uint64_t key_bytes[2];
+} roi_state_t;
+
+void roi_config_default(roi_config_t *cfg);
+roi_state_t* roi_create(const roi_config_t *cfg);
+// Checks the encoder once it is (re)opened, warns if ROI will be ignored
+void roi_set_encoder(roi_state_t *roi, const AVCodecContext *ctx);
+// Adds the regions for one frame; boxes are in src_w x src_h pixels and
+// are scaled to the frame size. Returns the number of regions attached.
+int roi_attach(roi_state_t *roi, AVFrame *frame, const detect_result_group_t *group,
+               int src_w, int src_h, int gop_size);
+// Measurement mode: records the size of one encoded packet
+void roi_log_packet(roi_state_t *roi, const AVPacket *pkt);
+// Prints the on/off comparison and closes the log
+void roi_destroy(roi_state_t *roi);
+
+#endif /* ROI_H */
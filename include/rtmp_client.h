@@ -0,0 +1,110 @@
+#ifndef RTMP_CLIENT_H
+#define RTMP_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "byte_buf.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define RTMP_DEFAULT_PORT 1935
+#define RTMP_DEFAULT_CHUNK_SIZE 4096
+#define RTMP_HANDSHAKE_SIZE 1536
+#define RTMP_MAX_CSID 64
+
+// Message types used by a publisher
+#define RTMP_MSG_SET_CHUNK_SIZE 1
+#define RTMP_MSG_AUDIO 8
+#define RTMP_MSG_VIDEO 9
+#define RTMP_MSG_DATA_AMF0 18
+#define RTMP_MSG_COMMAND_AMF0 20
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t delta;
+    uint32_t length;
+    uint8_t type;
+    uint32_t stream_id;
+    int ext_ts;                 // the last header carried an extended timestamp
+    size_t received;            // bytes of the current message so far
+    byte_buf_t payload;
+} rtmp_chunk_stream_t;
+
+// Reassembles incoming chunks into messages; Set Chunk Size is applied here
+typedef struct {
+    int fd;
+    uint32_t chunk_size;
+    rtmp_chunk_stream_t streams[RTMP_MAX_CSID];
+} rtmp_reader_t;
+
+typedef struct {
+    uint8_t type;
+    uint32_t stream_id;
+    uint32_t timestamp;
+    const uint8_t *data;        // valid until the next read
+    size_t size;
+} rtmp_message_t;
+
+// One slice of a message payload
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} rtmp_seg_t;
+
+// Minimal RTMP publisher: simple handshake, connect/createStream/publish,
+// then FLV audio/video messages. Media is written with writev: chunk
+// headers, FLV tag prefixes and NAL lengths go into one preallocated buffer
+// and the NAL payloads are referenced in place, so a packet costs one
+// syscall and no copy. Sockets are blocking with send/receive timeouts.
+typedef struct {
+    int fd;
+    uint32_t chunk_size;        // outgoing, announced with Set Chunk Size
+    uint32_t stream_id;         // message stream returned by createStream
+    char *stream_name;
+    rtmp_reader_t reader;
+    // preallocated, grown to the largest packet seen
+    uint8_t *hdr;               // chunk headers, tag prefixes, NAL lengths
+    size_t hdr_capacity;
+    rtmp_seg_t *segs;
+    int seg_capacity;
+    struct iovec *iov;
+    int iov_capacity;
+    uint64_t bytes;
+    uint64_t syscalls;
+    uint64_t messages;
+} rtmp_client_t;
+
+// url: rtmp://host[:port]/app[/...]/stream. Returns NULL if the server did
+// not accept the publish within timeout_ms.
+rtmp_client_t* rtmp_client_connect(const char *url, int chunk_size, int timeout_ms);
+// @setDataFrame onMetaData and the sequence headers; audio may be NULL
+int rtmp_client_write_header(rtmp_client_t *c, const AVCodecParameters *video, int fps,
+                             const AVCodecParameters *audio);
+// Timestamps are converted to ms; stream_index 1 is audio
+int rtmp_client_write_packet(rtmp_client_t *c, const AVPacket *pkt, AVRational time_base);
+// Sends FCUnpublish/deleteStream when graceful, then closes the socket
+void rtmp_client_close(rtmp_client_t *c, int graceful);
+
+// Shared with the benchmark's server stand-in
+int rtmp_read_message(rtmp_reader_t *r, rtmp_message_t *msg);
+void rtmp_reader_free(rtmp_reader_t *r);
+int rtmp_write_full(int fd, const void *data, size_t size);
+int rtmp_read_full(int fd, void *data, size_t size);
+// Sends a message from segments, chunked at c->chunk_size
+int rtmp_client_write_message(rtmp_client_t *c, int csid, uint8_t type, uint32_t stream_id,
+                              uint32_t timestamp, const rtmp_seg_t *segs, int nsegs);
+// AMF0 writers and a reader for command name/transaction id
+void rtmp_amf_string(byte_buf_t *b, const char *s);
+void rtmp_amf_number(byte_buf_t *b, double v);
+void rtmp_amf_null(byte_buf_t *b);
+void rtmp_amf_object_begin(byte_buf_t *b);
+void rtmp_amf_prop_string(byte_buf_t *b, const char *key, const char *value);
+void rtmp_amf_prop_number(byte_buf_t *b, const char *key, double v);
+void rtmp_amf_object_end(byte_buf_t *b);
+// Parses "name, transaction id" of a command; returns the offset after them or -1
+int rtmp_amf_command(const uint8_t *data, size_t size, char *name, size_t name_size, double *txn);
+
+#endif /* RTMP_CLIENT_H */
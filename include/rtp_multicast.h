@@ -0,0 +1,54 @@
+#ifndef RTP_MULTICAST_H
+#define RTP_MULTICAST_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "rtp_packetizer.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define RTP_BATCH_MAX 128               // packets per sendmmsg call
+
+typedef struct {
+    const char *group;          // "239.255.0.1:5004", NULL disables the output
+    const char *iface;          // address of the outgoing interface, NULL = routing table
+    int ttl;                    // multicast hops, 1 stays on the LAN
+    const char *sdp_path;       // optional SDP file for the receivers
+} multicast_config_t;
+
+// RTP/H.264 to one UDP destination, normally a multicast group: every packet
+// leaves the board once whatever the number of viewers. Runs in the encoder
+// thread; an access unit becomes one sendmmsg call whose iovecs point into
+// the encoded packet, so nothing is copied. UDP never blocks the encoder: a
+// full socket buffer drops the rest of the frame.
+typedef struct {
+    multicast_config_t cfg;
+    int fd;
+    struct sockaddr_in dest;
+    rtp_packetizer_t rtp;
+    AVCodecParameters *codecpar;
+    AVRational time_base;
+    // batch being assembled
+    uint8_t headers[RTP_BATCH_MAX][RTP_HEADER_SIZE + 2];
+    struct iovec iov[RTP_BATCH_MAX][2];
+    struct mmsghdr msgs[RTP_BATCH_MAX];
+    int batch;
+    uint64_t frames;
+    uint64_t packets_sent;
+    uint64_t packets_dropped;
+    uint64_t syscalls;
+} rtp_multicast_t;
+
+void multicast_config_default(multicast_config_t *cfg);
+rtp_multicast_t* rtp_multicast_open(const multicast_config_t *cfg);
+// Stream parameters (H.264 only), again after a resolution change; rewrites the SDP file
+int rtp_multicast_start(rtp_multicast_t *m, const AVCodecParameters *codecpar, AVRational time_base);
+// Sends a video packet; other streams are ignored
+void rtp_multicast_send(rtp_multicast_t *m, const AVPacket *pkt);
+void rtp_multicast_close(rtp_multicast_t *m);
+
+#endif /* RTP_MULTICAST_H */
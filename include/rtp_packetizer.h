@@ -0,0 +1,43 @@
+#ifndef RTP_PACKETIZER_H
+#define RTP_PACKETIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define RTP_HEADER_SIZE 12
+#define RTP_H264_PAYLOAD_TYPE 96
+#define RTP_DEFAULT_PAYLOAD 1400        // fits a 1500 byte MTU with IP/UDP/RTP headers
+
+typedef struct {
+    uint8_t payload_type;
+    uint32_t ssrc;
+    uint16_t seq;               // next sequence number
+    size_t max_payload;
+    uint64_t packets;
+} rtp_packetizer_t;
+
+// Called for every RTP packet with the header (RTP header, plus the FU-A
+// indicator and header for fragments) and a payload slice that points into
+// the access unit, so callers can send or copy without an intermediate buffer.
+// A negative return stops packetizing.
+typedef int (*rtp_emit_fn)(void *opaque, const uint8_t *header, size_t header_size,
+                           const uint8_t *payload, size_t payload_size);
+
+void rtp_packetizer_init(rtp_packetizer_t *p, uint8_t payload_type, uint32_t ssrc, size_t max_payload);
+// RTP timestamp (90 kHz) of a packet timestamp
+uint32_t rtp_timestamp(int64_t pts, AVRational time_base);
+// Packetizes one H.264 access unit per RFC 6184 (packetization-mode 1):
+// single NAL unit packets, FU-A for larger units, marker bit on the last
+// packet. Keyframes without in-band SPS/PPS get them from par first.
+int rtp_packetize_h264(rtp_packetizer_t *p, const AVPacket *pkt, AVRational time_base,
+                       const AVCodecParameters *par, rtp_emit_fn emit, void *opaque);
+// SDP media section for the stream: m=, rtpmap and fmtp lines with
+// sprop-parameter-sets. Returns the length or -1.
+int rtp_h264_sdp_media(const AVCodecParameters *par, uint8_t payload_type, int port,
+                       char *buf, size_t size);
+
+#endif /* RTP_PACKETIZER_H */
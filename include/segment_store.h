@@ -0,0 +1,115 @@
+#ifndef SEGMENT_STORE_H
+#define SEGMENT_STORE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "packet_queue.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#define STORE_IO_BUFS 8
+#define STORE_IO_BUF_SIZE (256 * 1024)     // one batched write, a multiple of the eMMC page size
+
+typedef struct {
+    const char *dir;            // NULL disables continuous recording
+    int64_t max_bytes;          // size retention: total space of the slot files
+    int max_age_s;              // age retention, 0 = keep until the slot is reused
+    int segment_s;              // target segment duration
+} store_config_t;
+
+typedef enum {
+    SEG_FREE = 0,
+    SEG_OPEN,                   // being written; recovered by scanning after a crash
+    SEG_DONE,
+} segment_state_t;
+
+// One slot file and the segment it currently holds
+typedef struct {
+    int fd;
+    segment_state_t state;
+    uint64_t seq;               // increasing segment number, the oldest is reused first
+    int64_t start_ms;           // wall clock of the first packet
+    int64_t duration_ms;
+    int64_t bytes;              // valid length; after reuse a free box covers the rest of the file
+    int trim;                   // written with another slot size, truncate on reuse
+} segment_slot_t;
+
+// Aligned buffer handed from the mux thread to the write-behind thread
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    int slot;
+    int64_t offset;
+    int flags;                  // STORE_IO_BEGIN / STORE_IO_END markers
+    int64_t duration_ms;
+    uint64_t seq;
+} store_io_buf_t;
+
+// Continuous recording into a ring of preallocated fMP4 slot files.
+//   encoder -> packet_queue -> mux thread (fMP4 into aligned buffers)
+//           -> write-behind thread (pwrite or io_uring, sync_file_range)
+// The encoder only queues packet references, so it never waits on the disk.
+// Reused slots are overwritten in place and the rest of the file is covered
+// by a free box, so every slot file plays by itself. segments.idx holds the
+// valid length of each slot and is rewritten atomically at every segment
+// boundary; a slot left open by a crash is recovered up to its last complete
+// fragment.
+typedef struct {
+    store_config_t cfg;
+    int slot_count;
+    int64_t slot_size;
+    segment_slot_t *slots;
+
+    // mux thread
+    packet_queue_t *queue;
+    AVCodecParameters *codecpar;
+    AVCodecParameters *pending_codecpar;    // applied when the marker packet arrives
+    AVRational time_base;
+    AVFormatContext *mux;
+    AVIOContext *avio;
+    int cur_slot;               // -1 between segments
+    int64_t cur_offset;         // bytes of the current segment handed to the I/O thread
+    int64_t seg_start_pts;
+    int64_t seg_start_ms;
+    uint64_t next_seq;
+    store_io_buf_t *fill;       // buffer being filled by the muxer
+    int idr_requested;          // a segment is due and an IDR was asked for
+    int keyframe_request;       // set by the mux thread, polled by the encoder
+    pthread_t mux_thread;
+
+    // write-behind thread
+    store_io_buf_t bufs[STORE_IO_BUFS];
+    store_io_buf_t *free_bufs[STORE_IO_BUFS];
+    int free_count;
+    store_io_buf_t *pending[STORE_IO_BUFS];
+    int pending_head;
+    int pending_count;
+    int io_abort;
+    pthread_mutex_t io_mutex;   // protects the buffer lists and slots[]; the mux thread takes slots
+    pthread_cond_t io_cond;
+    pthread_t io_thread;
+    void *uring;                // struct io_uring when built with liburing
+
+    int threads_started;
+    uint64_t bytes_written;
+    uint64_t segments_written;
+    double io_ms_max;
+} segment_store_t;
+
+void store_config_default(store_config_t *cfg);
+// bit_rate sizes the slot files: one segment at 1.5x the target rate
+segment_store_t* segment_store_open(const store_config_t *cfg, int64_t bit_rate);
+int segment_store_start(segment_store_t *store, const AVCodecParameters *codecpar, AVRational time_base);
+// Queues a reference to pkt; never blocks on I/O
+int segment_store_send(segment_store_t *store, const AVPacket *pkt);
+// Returns 1 once when a segment is due and no IDR came: in low-latency mode
+// the encoder has no periodic IDRs and should emit one next
+int segment_store_keyframe_requested(segment_store_t *store);
+// Ends the current segment and continues with new stream parameters
+int segment_store_update_codecpar(segment_store_t *store, const AVCodecParameters *codecpar);
+// Finishes the open segment, flushes and closes everything
+void segment_store_close(segment_store_t *store);
+
+#endif /* SEGMENT_STORE_H */
@@ -0,0 +1,72 @@
+#ifndef STREAM_FANOUT_H
+#define STREAM_FANOUT_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "stream_writer.h"
+#include "abr.h"
+
+#define FANOUT_MAX_SINKS 8
+
+// How one kind of sink is muxed
+typedef struct {
+    const char *name;           // used as the TYPE in "TYPE:URL"
+    const char *format;         // libavformat muxer
+    const char *mux_options;    // muxer private options
+    int network;                // remote sink: its TCP state drives ABR
+    int queue_factor;           // queue length in multiples of the configured queue size
+    queue_policy_t policy;      // what the queue drops when the sink falls behind
+} sink_type_t;
+
+typedef struct {
+    const sink_type_t *type;
+    char *url;
+    stream_writer_t *writer;    // NULL until the fan-out is started
+} stream_sink_t;
+
+// Delivers every encoded packet to N independent sinks. Each sink has its own
+// writer thread and bounded queue, so a slow sink only drops its own packets:
+// network sinks shed frames and GOPs to stay live, file sinks keep everything
+// in a long queue and drop only when it overflows.
+// Sinks can be added and removed at any time, also while streaming.
+typedef struct {
+    stream_sink_t sinks[FANOUT_MAX_SINKS];
+    int count;
+    int queue_size;
+    int rtmp_lite;              // bare rtmp:// URLs use the in-tree RTMP client
+    int rtmp_chunk_size;        // outgoing chunk size of rtmp-lite sinks
+    AVCodecParameters *codecpar;    // set by start, needed for sinks added later
+    AVRational time_base;
+    AVCodecParameters *audio_codecpar;  // NULL for video only outputs
+    AVRational audio_time_base;
+    int started;
+    pthread_mutex_t mutex;
+} stream_fanout_t;
+
+stream_fanout_t* stream_fanout_create(int queue_size);
+void stream_fanout_destroy(stream_fanout_t *f);
+
+// spec is "TYPE:URL" or a bare URL whose type is guessed (rtmp://, .m3u8, .mp4, .flv).
+// Set rtmp_lite/rtmp_chunk_size before adding sinks.
+int stream_fanout_add(stream_fanout_t *f, const char *spec);
+int stream_fanout_remove(stream_fanout_t *f, const char *url);
+void stream_fanout_list(stream_fanout_t *f);
+void stream_fanout_list_types(void);
+
+// Adds an audio stream to every sink opened afterwards; audio packets are
+// sent with stream_index 1
+int stream_fanout_set_audio(stream_fanout_t *f, const AVCodecParameters *codecpar, AVRational time_base);
+// Opens a writer for every configured sink
+int stream_fanout_start(stream_fanout_t *f, const AVCodecParameters *codecpar, AVRational time_base);
+// Closes every writer (writing trailers); sinks stay configured
+void stream_fanout_stop(stream_fanout_t *f);
+
+// Queues a reference to pkt on every sink; the caller keeps ownership of pkt
+void stream_fanout_send(stream_fanout_t *f, const AVPacket *pkt);
+// Returns 1 if any sink (re)connected since the last call
+int stream_fanout_keyframe_requested(stream_fanout_t *f);
+int stream_fanout_update_codecpar(stream_fanout_t *f, const AVCodecParameters *codecpar);
+// Runs the ABR controller against the first network sink
+int stream_fanout_abr_update(stream_fanout_t *f, abr_controller_t *abr, int64_t now_us);
+
+#endif /* STREAM_FANOUT_H */
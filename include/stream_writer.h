@@ -0,0 +1,106 @@
+#ifndef STREAM_WRITER_H
+#define STREAM_WRITER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <netinet/tcp.h>
+#include "packet_queue.h"
+#include "rtmp_client.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+typedef struct {
+    int connected;
+    int queue_depth;
+    int64_t queue_bytes;
+    double send_ms_avg;         // av_write_frame duration, EWMA
+    double send_ms_max;         // worst case since the last stats print
+    double latency_ms_avg;      // enqueue -> written, EWMA
+    double cpu_us_avg;          // writer thread CPU time per packet, EWMA
+    uint64_t written_packets;
+    uint64_t written_bytes;
+    uint64_t dropped_packets;
+    uint64_t flushed_packets;   // reconnects, codec changes and waits for an IDR, not congestion
+    uint64_t dropped_nonref;
+    uint64_t dropped_gops;
+    uint64_t write_errors;
+    uint64_t reconnects;
+} stream_writer_stats_t;
+
+// Owns one muxer and a writer thread fed by a bounded packet queue, so a
+// stalled network send never blocks the encoder. The writer connects, and
+// reconnects with exponential backoff, from its own thread.
+typedef struct {
+    char *url;
+    char *format;
+    AVDictionary *mux_opts;         // muxer private options, reapplied on every connect
+    AVCodecParameters *codecpar;    // cached extradata, used to rebuild the header
+    AVRational src_time_base;       // time base of the packets handed to send()
+    AVFormatContext *out_ctx;       // NULL while disconnected
+    AVStream *stream;
+    AVCodecParameters *audio_codecpar;  // optional second stream, packets with stream_index 1
+    AVRational audio_time_base;
+    AVStream *audio_stream;
+    int64_t ts_offset;              // rebases every connection to start at 0, video time base
+    int local;                      // file output: keep the backlog on connect, never truncate on reopen
+    int reopens;                    // local only: times the output was reopened
+    char *out_url;                  // local only: file written after a reopen, NULL while it is url
+    int native;                     // format "rtmp-lite": in-tree RTMP client instead of libavformat
+    int chunk_size;                 // native only, from the chunk_size mux option
+    rtmp_client_t *rtmp;            // native connection, NULL while disconnected
+    int sock_fd;                    // TCP socket of the current connection, -1 if unknown
+    AVCodecParameters *pending_codecpar;    // new stream parameters, applied by reconnecting
+    int keyframe_request;           // set after (re)connect and when a segment is due, polled by the encoder
+    int64_t segment_us;             // hls/segment only: segment length, segments start on an IDR
+    int64_t last_idr_pts;           // segment muxers: newest IDR of this connection, source time base
+    int recovery_points;            // the encoder flags non-IDR keyframes (intra refresh)
+    int idr_requested;              // a segment is due and an IDR was asked for
+    int abort;
+    packet_queue_t *queue;
+    queue_policy_t queue_policy;
+    uint64_t dropped_gops_seen;     // QUEUE_NO_DROP: last-resort drops already logged, sender side
+    pthread_t thread;
+    int thread_started;
+    int thread_exited;              // set by the writer thread as its last step
+    pthread_mutex_t mutex;          // protects stats and abort waits
+    pthread_cond_t cond;
+    stream_writer_stats_t stats;
+} stream_writer_t;
+
+// codecpar/time_base describe the encoder output; nothing is connected until start.
+// mux_options is an optional "key=value:key=value" list for the muxer (e.g. hls_time=2).
+// Format "rtmp-lite" publishes through rtmp_client.h; its only option is chunk_size.
+stream_writer_t* stream_writer_open(const char *url, const char *format, const char *mux_options,
+                                    const AVCodecParameters *codecpar, AVRational time_base,
+                                    int queue_size);
+// Adds an audio stream to every connection; call before start. Audio packets
+// are sent with stream_index 1 and must already be interleaved with the video.
+int stream_writer_set_audio(stream_writer_t *w, const AVCodecParameters *codecpar, AVRational time_base);
+// How the queue sheds load when the output falls behind; QUEUE_DROP_GOP by
+// default. Call before start. QUEUE_NO_DROP logs every drop it has to make.
+void stream_writer_set_queue_policy(stream_writer_t *w, queue_policy_t policy);
+int stream_writer_start(stream_writer_t *w);
+// Queues a reference to pkt; the caller keeps ownership of pkt
+int stream_writer_send(stream_writer_t *w, const AVPacket *pkt);
+// Returns 1 once after each (re)connect, and for hls/segment outputs when a
+// segment is due but intra refresh sends no IDRs: the encoder should emit one next
+int stream_writer_keyframe_requested(stream_writer_t *w);
+// Restarts the stream with new parameters (e.g. a resolution change); packets
+// queued before the switch are dropped
+int stream_writer_update_codecpar(stream_writer_t *w, const AVCodecParameters *codecpar);
+// TCP_INFO of the live connection. Returns -1 while disconnected, for non-TCP
+// outputs and when the socket of the connection could not be identified.
+int stream_writer_get_tcp_info(stream_writer_t *w, struct tcp_info *info);
+void stream_writer_get_stats(stream_writer_t *w, stream_writer_stats_t *stats);
+// Lets the thread write out everything queued, write the trailer and stop;
+// close still has to be called
+void stream_writer_finish(stream_writer_t *w);
+// 1 once the thread has exited, so close returns without waiting
+int stream_writer_finished(stream_writer_t *w);
+// Stops the thread, writes the trailer and frees everything. A finished
+// writer is not aborted: close waits until its queue is written out.
+void stream_writer_close(stream_writer_t *w);
+
+#endif /* STREAM_WRITER_H */
@@ -0,0 +1,60 @@
+#ifndef SUBSTREAM_H
+#define SUBSTREAM_H
+
+#include <stdint.h>
+#include "dma_frame_pool.h"
+#include "encoder.h"
+#include "stream_fanout.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#define SUBSTREAM_MAX_SINKS 4
+
+typedef struct {
+    int width;
+    int height;
+    int64_t bit_rate;
+    const char *sinks[SUBSTREAM_MAX_SINKS];    // "TYPE:URL"; no sinks = substream off
+    int sink_count;
+} substream_config_t;
+
+// Low resolution simulcast of the main stream for mobile viewers and
+// thumbnails. It reuses capture, inference and the overlay: every frame the
+// main stream encodes is scaled from the same RGB buffer into a second DMA
+// frame pool (RGA, or SIMD libswscale when the pool is the host memfd
+// fallback), encoded on a second encoder and published through its own
+// fan-out. Runs on the encode thread; ABR only drives the main stream.
+typedef struct {
+    substream_config_t cfg;
+    stream_fanout_t *fanout;
+    dma_frame_pool_t *pool;
+    encoder_t *enc;
+    AVCodecParameters *codecpar;
+    AVRational clock_time_base;     // time base of the pts passed to encode
+    AVPacket *pkt;
+    struct SwsContext *sws;         // host fallback only
+    uint64_t frames;
+    uint64_t dropped;
+} substream_t;
+
+void substream_config_default(substream_config_t *cfg);
+// Takes ownership of fanout, which already holds the substream sinks
+substream_t* substream_create(const substream_config_t *cfg, stream_fanout_t *fanout);
+// Opens the encoder with the main settings at the substream size and bitrate
+// and starts the sinks; pts later passed to encode are in clock_time_base
+int substream_start(substream_t *s, const encoder_config_t *main_cfg, AVRational clock_time_base);
+// Scales rgb (width x height RGB888) and encodes it; duration is the time to
+// the next encoded frame, both in clock_time_base
+void substream_encode(substream_t *s, const char *rgb, int width, int height, int64_t pts, int64_t duration);
+// Interleaves an audio packet (stream_index 1) into the substream sinks
+void substream_send_audio(substream_t *s, const AVPacket *pkt);
+// Follows the activity policy: bit_rate is scaled like the main stream's
+void substream_set_bitrate(substream_t *s, int64_t bit_rate);
+void substream_force_idr(substream_t *s);
+// Closes the sinks and the encoder; the fan-out keeps its sink list
+void substream_stop(substream_t *s);
+void substream_destroy(substream_t *s);
+
+#endif /* SUBSTREAM_H */
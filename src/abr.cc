@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include "abr.h"
+
+#define ABR_DECREASE_FACTOR 0.7
+#define ABR_INCREASE_FACTOR 1.1
+#define ABR_DEGRADE_INTERVALS 3     // intervals at the floor before dropping fps/resolution
+#define ABR_PROBE_INTERVALS 5       // clear intervals before stepping back up
+#define ABR_MAX_LATENCY_MS 500.0
+#define ABR_RTT_SLACK_US 50000
+
+void abr_init(abr_controller_t *abr, const abr_config_t *cfg, int64_t start_bit_rate) {
+    memset(abr, 0, sizeof(*abr));
+    abr->cfg = *cfg;
+    if (abr->cfg.max_bit_rate < abr->cfg.min_bit_rate) {
+        abr->cfg.max_bit_rate = abr->cfg.min_bit_rate;
+    }
+    abr->bit_rate = start_bit_rate;
+    if (abr->bit_rate > abr->cfg.max_bit_rate) abr->bit_rate = abr->cfg.max_bit_rate;
+    if (abr->bit_rate < abr->cfg.min_bit_rate) abr->bit_rate = abr->cfg.min_bit_rate;
+    abr->fps_div = 1;
+    abr->scale_div = 1;
+}
+
+// Queue growth, slow sends, queue drops, RTT inflation and retransmits all mean
+// we are sending faster than the path drains
+static int is_congested(abr_controller_t *abr, stream_writer_t *writer,
+                        const stream_writer_stats_t *s, char *reason, size_t reason_size) {
+    int congested = 0;
+    reason[0] = '\0';
+
+    if (s->queue_depth >= writer->queue->capacity / 4) {
+        snprintf(reason, reason_size, "queue depth %d", s->queue_depth);
+        congested = 1;
+    } else if (s->latency_ms_avg > ABR_MAX_LATENCY_MS) {
+        snprintf(reason, reason_size, "send latency %.0f ms", s->latency_ms_avg);
+        congested = 1;
+    } else if (s->dropped_packets > abr->last_dropped) {
+        snprintf(reason, reason_size, "%llu packets dropped",
+                 (unsigned long long)(s->dropped_packets - abr->last_dropped));
+        congested = 1;
+    }
+    abr->last_dropped = s->dropped_packets;
+
+    struct tcp_info info;
+    if (stream_writer_get_tcp_info(writer, &info) == 0 && info.tcpi_rtt > 0) {
+        if (abr->min_rtt_us == 0 || info.tcpi_rtt < abr->min_rtt_us) {
+            abr->min_rtt_us = info.tcpi_rtt;
+        }
+        if (!congested && info.tcpi_rtt > abr->min_rtt_us * 2 &&
+            info.tcpi_rtt > abr->min_rtt_us + ABR_RTT_SLACK_US) {
+            snprintf(reason, reason_size, "rtt %u us (min %u us)", info.tcpi_rtt, abr->min_rtt_us);
+            congested = 1;
+        }
+        if (!congested && info.tcpi_total_retrans > abr->last_retrans && abr->last_retrans != 0) {
+            snprintf(reason, reason_size, "%u retransmits", info.tcpi_total_retrans - abr->last_retrans);
+            congested = 1;
+        }
+        abr->last_retrans = info.tcpi_total_retrans;
+    }
+    return congested;
+}
+
+int abr_update(abr_controller_t *abr, stream_writer_t *writer, int64_t now_us) {
+    if (now_us - abr->last_check_us < (int64_t)abr->cfg.interval_ms * 1000) {
+        return 0;
+    }
+    abr->last_check_us = now_us;
+
+    stream_writer_stats_t s;
+    stream_writer_get_stats(writer, &s);
+    if (!s.connected) {
+        // 断线期间由重连逻辑处理，不调整码率
+        abr->congested_intervals = 0;
+        abr->clear_intervals = 0;
+        abr->min_rtt_us = 0;
+        abr->last_retrans = 0;
+        return 0;
+    }
+
+    char reason[96];
+    int64_t old_bit_rate = abr->bit_rate;
+    int old_fps_div = abr->fps_div;
+    int old_scale_div = abr->scale_div;
+
+    if (is_congested(abr, writer, &s, reason, sizeof(reason))) {
+        abr->clear_intervals = 0;
+        abr->congested_intervals++;
+        if (!abr->fixed_bit_rate && abr->bit_rate > abr->cfg.min_bit_rate) {
+            abr->bit_rate = (int64_t)(abr->bit_rate * ABR_DECREASE_FACTOR);
+            if (abr->bit_rate < abr->cfg.min_bit_rate) {
+                abr->bit_rate = abr->cfg.min_bit_rate;
+            }
+            abr->congested_intervals = 0;
+        } else if (abr->congested_intervals >= ABR_DEGRADE_INTERVALS) {
+            // 码率已到下限仍然拥塞: 先降帧率，再降分辨率
+            if (abr->fps_div == 1) {
+                abr->fps_div = 2;
+            } else if (abr->scale_div == 1) {
+                abr->scale_div = 2;
+            }
+            abr->congested_intervals = 0;
+        }
+    } else {
+        snprintf(reason, sizeof(reason), "link clear");
+        abr->congested_intervals = 0;
+        if (++abr->clear_intervals >= ABR_PROBE_INTERVALS) {
+            abr->clear_intervals = 0;
+            // 恢复顺序与降级相反
+            if (abr->scale_div > 1) {
+                abr->scale_div = 1;
+            } else if (abr->fps_div > 1) {
+                abr->fps_div = 1;
+            } else if (!abr->fixed_bit_rate && abr->bit_rate < abr->cfg.max_bit_rate) {
+                abr->bit_rate = (int64_t)(abr->bit_rate * ABR_INCREASE_FACTOR) + abr->cfg.max_bit_rate / 20;
+                if (abr->bit_rate > abr->cfg.max_bit_rate) {
+                    abr->bit_rate = abr->cfg.max_bit_rate;
+                }
+            }
+        }
+    }
+
+    if (abr->bit_rate == old_bit_rate && abr->fps_div == old_fps_div &&
+        abr->scale_div == old_scale_div) {
+        return 0;
+    }
+    printf("ABR: %s -> bitrate %lld bps, fps 1/%d, scale 1/%d\n", reason,
+           (long long)abr->bit_rate, abr->fps_div, abr->scale_div);
+    return 1;
+}
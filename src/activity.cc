@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "activity.h"
+
+// 单元亮度变化超过该值才算运动，滤掉传感器噪声
+#define ACTIVITY_CELL_DIFF 24
+
+void activity_config_default(activity_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->idle_fps = 2;
+    cfg->idle_delay_ms = 3000;
+    cfg->motion_threshold = 1.0;
+}
+
+activity_policy_t* activity_create(const activity_config_t *cfg, int fps) {
+    activity_policy_t *a = (activity_policy_t*)calloc(1, sizeof(activity_policy_t));
+    if (!a) {
+        perror("Failed to allocate activity policy");
+        return NULL;
+    }
+    a->cfg = *cfg;
+    a->fps = fps;
+    if (a->cfg.idle_fps <= 0 || a->cfg.idle_fps > fps) {
+        a->cfg.idle_fps = fps;
+    }
+    // 启动时按有活动处理，安静一段时间后再降档
+    a->active = 1;
+    printf("Activity policy: idle after %d ms at %d fps, motion threshold %.1f%%\n",
+           a->cfg.idle_delay_ms, a->cfg.idle_fps, a->cfg.motion_threshold);
+    return a;
+}
+
+void activity_destroy(activity_policy_t *a) {
+    if (!a) return;
+    printf("Activity policy: %llu active frames, %llu idle frames, %llu wakeups\n",
+           (unsigned long long)a->active_frames, (unsigned long long)a->idle_frames,
+           (unsigned long long)a->wakeups);
+    free(a);
+}
+
+// 每个单元取一个像素的亮度，80x45个采样点足以发现画面中的运动
+static void make_thumbnail(uint8_t *thumb, const char *rgb, int width, int height) {
+    const uint8_t *src = (const uint8_t*)rgb;
+    for (int y = 0; y < ACTIVITY_THUMB_H; y++) {
+        const uint8_t *row = src + (size_t)((2 * y + 1) * height / (2 * ACTIVITY_THUMB_H)) * width * 3;
+        for (int x = 0; x < ACTIVITY_THUMB_W; x++) {
+            const uint8_t *p = row + (size_t)((2 * x + 1) * width / (2 * ACTIVITY_THUMB_W)) * 3;
+            thumb[y * ACTIVITY_THUMB_W + x] = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
+        }
+    }
+}
+
+static double motion_score(const uint8_t *a, const uint8_t *b) {
+    int changed = 0;
+    for (int i = 0; i < ACTIVITY_THUMB_W * ACTIVITY_THUMB_H; i++) {
+        if (abs((int)a[i] - (int)b[i]) > ACTIVITY_CELL_DIFF) {
+            changed++;
+        }
+    }
+    return changed * 100.0 / (ACTIVITY_THUMB_W * ACTIVITY_THUMB_H);
+}
+
+activity_change_t activity_update(activity_policy_t *a, const char *rgb, int width, int height,
+                                  const detect_result_group_t *group, int64_t now_us) {
+    if (a->last_activity_us == 0) {
+        a->last_activity_us = now_us;
+    }
+    int next = a->cur ^ 1;
+    make_thumbnail(a->thumb[next], rgb, width, height);
+    a->motion = a->has_prev ? motion_score(a->thumb[next], a->thumb[a->cur]) : 0.0;
+    a->cur = next;
+    a->has_prev = 1;
+
+    int detected = group->count > 0;
+    if (detected || a->motion >= a->cfg.motion_threshold) {
+        a->last_activity_us = now_us;
+    }
+
+    activity_change_t change = ACTIVITY_NONE;
+    if (!a->active && a->last_activity_us == now_us) {
+        a->active = 1;
+        a->wakeups++;
+        change = ACTIVITY_WAKE;
+        printf("Activity: wake (%s, motion %.1f%%)\n", detected ? "detection" : "motion", a->motion);
+    } else if (a->active && now_us - a->last_activity_us >= (int64_t)a->cfg.idle_delay_ms * 1000) {
+        a->active = 0;
+        change = ACTIVITY_SLEEP;
+        printf("Activity: idle\n");
+    }
+    if (a->active) {
+        a->active_frames++;
+    } else {
+        a->idle_frames++;
+    }
+    return change;
+}
+
+int activity_frame_step(const activity_policy_t *a) {
+    if (a->active) {
+        return 1;
+    }
+    int step = a->fps / a->cfg.idle_fps;
+    return step > 1 ? step : 1;
+}
+
+int64_t activity_bit_rate(const activity_policy_t *a, int64_t full_bit_rate) {
+    if (a->active) {
+        return full_bit_rate;
+    }
+    int64_t idle = a->cfg.idle_bit_rate > 0 ? a->cfg.idle_bit_rate : full_bit_rate / 10;
+    return idle < full_bit_rate ? idle : full_bit_rate;
+}
@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "app_config.h"
+#include "stream_fanout.h"
+#include "detector.h"
+
+void app_config_default(app_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->source = "/dev/video0";
+    cfg->det_weight = 1;
+    npu_config_default(&cfg->npu);
+    cascade_config_default(&cfg->cascade);
+    cfg->queue_size = 30;
+    cfg->rtmp_chunk_size = RTMP_DEFAULT_CHUNK_SIZE;
+    encoder_default_config(&cfg->encoder);
+    cfg->abr.interval_ms = 1000;
+    event_config_default(&cfg->event);
+    store_config_default(&cfg->store);
+    roi_config_default(&cfg->roi);
+    activity_config_default(&cfg->activity);
+    audio_config_default(&cfg->audio);
+    live_config_default(&cfg->live);
+    multicast_config_default(&cfg->multicast);
+    substream_config_default(&cfg->substream);
+}
+
+// DEV[,subdev=PATH][,sink=[TYPE:]URL]...[,weight=W][,det-fps=N], parsed in place
+static int parse_camera(char *spec, camera_config_t *cam) {
+    memset(cam, 0, sizeof(*cam));
+    cam->det_weight = 1;
+    cam->det_fps = -1;
+    char *save = NULL;
+    cam->source = strtok_r(spec, ",", &save);
+    char *tok;
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+        if (!strncmp(tok, "subdev=", 7)) {
+            cam->subdev = tok + 7;
+        } else if (!strncmp(tok, "sink=", 5)) {
+            if (cam->sink_count >= APP_MAX_SINKS) {
+                fprintf(stderr, "Too many sinks (max %d)\n", APP_MAX_SINKS);
+                return -1;
+            }
+            cam->sinks[cam->sink_count++] = tok + 5;
+        } else if (!strncmp(tok, "weight=", 7)) {
+            cam->det_weight = atoi(tok + 7);
+        } else if (!strncmp(tok, "det-fps=", 8)) {
+            cam->det_fps = atoi(tok + 8);
+        } else {
+            fprintf(stderr, "Unknown camera option '%s'\n", tok);
+            return -1;
+        }
+    }
+    // 附加摄像头没有默认输出，不推流的管线没有意义
+    if (!cam->source || cam->sink_count == 0) {
+        fprintf(stderr, "--camera needs a device and at least one sink=URL\n");
+        return -1;
+    }
+    return 0;
+}
+
+// NAME=PATH[,priority=N][,backend=B]
+static int parse_npu_model(char *spec, npu_config_t *npu) {
+    if (npu->model_count >= NPU_MAX_MODELS) {
+        fprintf(stderr, "Too many second-stage models (max %d)\n", NPU_MAX_MODELS);
+        return -1;
+    }
+    npu_model_config_t *m = &npu->models[npu->model_count];
+    memset(m, 0, sizeof(*m));
+    char *save = NULL;
+    char *name = strtok_r(spec, ",", &save);
+    char *path = name ? strchr(name, '=') : NULL;
+    if (!path || path == name || !path[1]) {
+        fprintf(stderr, "--npu-model needs NAME=PATH\n");
+        return -1;
+    }
+    *path++ = '\0';
+    m->name = name;
+    m->path = path;
+    char *tok;
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+        if (!strncmp(tok, "priority=", 9)) {
+            m->priority = atoi(tok + 9);
+        } else if (!strncmp(tok, "backend=", 8) && detector_backend_valid(tok + 8)) {
+            m->backend = tok + 8;
+        } else {
+            fprintf(stderr, "Unknown model option '%s'\n", tok);
+            return -1;
+        }
+    }
+    for (int i = 0; i < npu->model_count; i++) {
+        if (!strcmp(npu->models[i].name, m->name)) {
+            fprintf(stderr, "Model %s given twice\n", m->name);
+            return -1;
+        }
+    }
+    npu->model_count++;
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -s, --source PATH     V4L2 device or raw NV12 file (default /dev/video0)\n"
+           "  -o, --sink [TYPE:]URL add an output, repeatable; TYPE is rtmp, rtmp-lite, flv, mp4\n"
+           "                        or hls, guessed from the URL if omitted, 'list' shows the types\n"
+           "                        (default rtmp://127.0.0.1:1935/live/test, none when the\n"
+           "                        built-in server or multicast is enabled)\n"
+           "      --camera DEV[,subdev=PATH][,sink=[TYPE:]URL]...[,weight=W][,det-fps=N]\n"
+           "                        add a camera with its own encoder and sinks, repeatable\n"
+           "                        (max %d cameras); subdev defaults to /dev/v4l-subdevN\n"
+           "      --det-weight W    NPU share of the main camera under wfq (default 1)\n"
+           "      --det-fps N       detection rate cap of the main camera and default of the\n"
+           "                        others (default 0, as fast as the NPU allows)\n"
+           "      --npu-policy P    rr or wfq: how cameras share the NPU (default wfq)\n"
+           "      --model PATH      RKNN detection model (default " NPU_DEFAULT_MODEL ")\n"
+           "      --labels PATH     class names of the detection model, one per line (default\n"
+           "                        ./model/coco_80_labels_list.txt);\n"
+           "                        'reload [MODEL [LABELS]]' on the console or SIGHUP swaps\n"
+           "                        both in without stopping the cameras\n"
+           "      --batch-model PATH the same model compiled with batch N: frames of several\n"
+           "                        cameras run as one input when that is faster (default off)\n"
+           "      --batch-window MS how long a partial batch waits for more cameras (default 5)\n"
+           "      --det-deadline MS capture to detection limit the batch window respects and\n"
+           "                        the lite models keep (default 100)\n"
+           "      --lite-model PATH lower resolution build of the detection model, used while\n"
+           "                        detection takes longer than --det-deadline; repeatable,\n"
+           "                        heaviest first (max %d)\n"
+           "      --npu-workers N   inference threads, each with its own model contexts, 1..%d\n"
+           "                        (default 1; 3 uses all RK3588 NPU cores)\n"
+           "      --npu-core-masks M,... core mask per worker, 1/2/4 = core 0/1/2, 0 = driver\n"
+           "                        (default one core per worker)\n"
+           "      --npu-backend B   rknn or mock[:LATENCY_MS[:JITTER_MS]] for hosts without\n"
+           "                        an NPU (default rknn)\n"
+           "      --npu-model NAME=PATH[,priority=N][,backend=B]\n"
+           "                        load a second-stage model (classifier, recognition) on\n"
+           "                        every worker; it runs on crops in the time detection\n"
+           "                        leaves free, higher priority first (max %d)\n"
+           "      --cascade NAME    classify the main camera's detections with --npu-model NAME\n"
+           "                        on crops of the full resolution frame (default off)\n"
+           "      --cascade-classes L comma separated detection classes to classify (default all)\n"
+           "      --cascade-labels PATH one second-stage class name per line\n"
+           "      --cascade-min-size PX smallest box side worth classifying (default 32)\n"
+           "      --cascade-max-crops N boxes per frame, largest first (default 8, max %d)\n"
+           "  -e, --encoder NAME    encoder backend, 'auto' or 'list' (default auto)\n"
+           "  -b, --bitrate BPS     target bitrate (default 10000000)\n"
+           "  -g, --gop N           keyframe interval in frames (default 10)\n"
+           "  -f, --fps N           encoder frame rate (default 15)\n"
+           "  -r, --rc MODE         rate control: cbr, vbr, cqp (default cbr)\n"
+           "  -q, --qp N            QP for cqp mode (default 26)\n"
+           "      --slices N        slices per frame (default encoder)\n"
+           "      --threads N       encoder threads (default encoder)\n"
+           "      --low-latency     intra refresh over the gop instead of IDRs, no lookahead,\n"
+           "                        one-frame VBV; recordings and HLS segments still start\n"
+           "                        on an IDR\n"
+           "      --queue N         packets buffered by the network writer (default 30)\n"
+           "      --rtmp-lite       publish rtmp:// sinks with the built-in RTMP client (one\n"
+           "                        writev per packet) instead of libavformat\n"
+           "      --rtmp-chunk-size N outgoing RTMP chunk size of rtmp-lite sinks (default 4096)\n"
+           "      --abr             adapt bitrate, fps and resolution to the uplink\n"
+           "      --min-bitrate BPS ABR floor (default bitrate/8)\n"
+           "      --max-bitrate BPS ABR ceiling (default bitrate)\n"
+           "      --event-dir DIR   record detection events as MP4 files into DIR\n"
+           "      --event-classes L comma separated classes that trigger an event (default person)\n"
+           "      --pre-roll S      seconds kept before the first detection (default 5)\n"
+           "      --post-roll S     seconds recorded after the last detection (default 10)\n"
+           "      --store-dir DIR   continuous recording into preallocated fMP4 segments\n"
+           "      --store-size MB   space used by the segment ring (default 4096)\n"
+           "      --store-age H     delete segments older than H hours (default: keep)\n"
+           "      --segment-sec S   segment duration (default 60)\n"
+           "      --index PATH      detection index (default <store-dir>/detections.idx)\n"
+           "      --roi             encode detected objects at higher quality (ROI side data)\n"
+           "      --roi-classes L   comma separated ROI classes (default person,car,bus,truck,\n"
+           "                        motorbike,bicycle)\n"
+           "      --roi-qoffset Q   quality offset inside boxes, -1..1 (default -0.3)\n"
+           "      --roi-bg-qoffset Q quality offset of the background, -1..1 (default 0.2)\n"
+           "      --roi-log FILE    measurement mode: toggle ROI every GOP, log packet sizes\n"
+           "      --activity        drop fps and bitrate while nothing moves or is detected\n"
+           "      --idle-fps N      frame rate while idle (default 2)\n"
+           "      --idle-bitrate BPS bitrate while idle (default bitrate/10)\n"
+           "      --idle-delay MS   quiet time before going idle (default 3000)\n"
+           "      --motion-threshold P percent of the picture that must change (default 1.0)\n"
+           "      --audio DEVICE    capture audio from an ALSA PCM (default, hw:0, null, ...)\n"
+           "      --audio-rate HZ   sample rate (default 48000)\n"
+           "      --audio-channels N channels (default 1)\n"
+           "      --audio-bitrate BPS AAC bitrate (default 64000)\n"
+           "      --http-port N     serve HTTP-FLV at http://<host>:N/live.flv (default off)\n"
+           "      --rtsp-port N     serve RTSP (RTP over TCP) at rtsp://<host>:N/live (default off)\n"
+           "      --live-clients N  viewers of the built-in server (default 32)\n"
+           "      --multicast IP:PORT RTP/H.264 over UDP to a multicast group (e.g. 239.255.0.1:5004)\n"
+           "      --multicast-ttl N hops of the multicast packets (default 1)\n"
+           "      --multicast-if IP interface address to send the multicast on\n"
+           "      --sdp FILE        write the SDP description of the multicast stream\n"
+           "      --sub-sink [TYPE:]URL output of the low resolution substream, repeatable\n"
+           "                        (default off)\n"
+           "      --sub-size WxH    substream resolution (default 640x360)\n"
+           "      --sub-bitrate BPS substream bitrate (default 800000)\n"
+           "  -h, --help\n", prog, APP_MAX_CAMERAS, NPU_MAX_LEVELS - 1, NPU_MAX_WORKERS, NPU_MAX_MODELS,
+           NPU_JOB_MAX_INPUTS);
+}
+
+int app_config_parse(app_config_t *cfg, int argc, char **argv) {
+    enum { OPT_SLICES = 256, OPT_THREADS, OPT_QUEUE, OPT_ABR, OPT_MIN_BITRATE, OPT_MAX_BITRATE,
+           OPT_EVENT_DIR, OPT_EVENT_CLASSES, OPT_PRE_ROLL, OPT_POST_ROLL,
+           OPT_STORE_DIR, OPT_STORE_SIZE, OPT_STORE_AGE, OPT_SEGMENT_SEC, OPT_INDEX,
+           OPT_ROI, OPT_ROI_CLASSES, OPT_ROI_QOFFSET, OPT_ROI_BG_QOFFSET, OPT_ROI_LOG,
+           OPT_ACTIVITY, OPT_IDLE_FPS, OPT_IDLE_BITRATE, OPT_IDLE_DELAY, OPT_MOTION_THRESHOLD,
+           OPT_AUDIO, OPT_AUDIO_RATE, OPT_AUDIO_CHANNELS, OPT_AUDIO_BITRATE,
+           OPT_LOW_LATENCY, OPT_HTTP_PORT, OPT_RTSP_PORT, OPT_LIVE_CLIENTS,
+           OPT_MULTICAST, OPT_MULTICAST_TTL, OPT_MULTICAST_IF, OPT_SDP,
+           OPT_RTMP_LITE, OPT_RTMP_CHUNK_SIZE, OPT_SUB_SINK, OPT_SUB_SIZE, OPT_SUB_BITRATE,
+           OPT_CAMERA, OPT_DET_WEIGHT, OPT_DET_FPS, OPT_NPU_POLICY, OPT_MODEL, OPT_LABELS,
+           OPT_BATCH_MODEL, OPT_BATCH_WINDOW, OPT_DET_DEADLINE, OPT_LITE_MODEL,
+           OPT_NPU_WORKERS, OPT_NPU_CORE_MASKS, OPT_NPU_BACKEND, OPT_NPU_MODEL,
+           OPT_CASCADE, OPT_CASCADE_CLASSES, OPT_CASCADE_LABELS, OPT_CASCADE_MIN_SIZE, OPT_CASCADE_MAX_CROPS };
+    static const struct option long_opts[] = {
+        { "source",  required_argument, NULL, 's' },
+        { "sink",    required_argument, NULL, 'o' },
+        { "url",     required_argument, NULL, 'o' },
+        { "encoder", required_argument, NULL, 'e' },
+        { "bitrate", required_argument, NULL, 'b' },
+        { "gop",     required_argument, NULL, 'g' },
+        { "fps",     required_argument, NULL, 'f' },
+        { "rc",      required_argument, NULL, 'r' },
+        { "qp",      required_argument, NULL, 'q' },
+        { "slices",  required_argument, NULL, OPT_SLICES },
+        { "threads", required_argument, NULL, OPT_THREADS },
+        { "low-latency", no_argument,   NULL, OPT_LOW_LATENCY },
+        { "queue",   required_argument, NULL, OPT_QUEUE },
+        { "rtmp-lite", no_argument,     NULL, OPT_RTMP_LITE },
+        { "rtmp-chunk-size", required_argument, NULL, OPT_RTMP_CHUNK_SIZE },
+        { "abr",     no_argument,       NULL, OPT_ABR },
+        { "min-bitrate", required_argument, NULL, OPT_MIN_BITRATE },
+        { "max-bitrate", required_argument, NULL, OPT_MAX_BITRATE },
+        { "event-dir", required_argument, NULL, OPT_EVENT_DIR },
+        { "event-classes", required_argument, NULL, OPT_EVENT_CLASSES },
+        { "pre-roll", required_argument, NULL, OPT_PRE_ROLL },
+        { "post-roll", required_argument, NULL, OPT_POST_ROLL },
+        { "store-dir", required_argument, NULL, OPT_STORE_DIR },
+        { "store-size", required_argument, NULL, OPT_STORE_SIZE },
+        { "store-age", required_argument, NULL, OPT_STORE_AGE },
+        { "segment-sec", required_argument, NULL, OPT_SEGMENT_SEC },
+        { "index",   required_argument, NULL, OPT_INDEX },
+        { "roi",     no_argument,       NULL, OPT_ROI },
+        { "roi-classes", required_argument, NULL, OPT_ROI_CLASSES },
+        { "roi-qoffset", required_argument, NULL, OPT_ROI_QOFFSET },
+        { "roi-bg-qoffset", required_argument, NULL, OPT_ROI_BG_QOFFSET },
+        { "roi-log", required_argument, NULL, OPT_ROI_LOG },
+        { "activity", no_argument,      NULL, OPT_ACTIVITY },
+        { "idle-fps", required_argument, NULL, OPT_IDLE_FPS },
+        { "idle-bitrate", required_argument, NULL, OPT_IDLE_BITRATE },
+        { "idle-delay", required_argument, NULL, OPT_IDLE_DELAY },
+        { "motion-threshold", required_argument, NULL, OPT_MOTION_THRESHOLD },
+        { "audio",   required_argument, NULL, OPT_AUDIO },
+        { "audio-rate", required_argument, NULL, OPT_AUDIO_RATE },
+        { "audio-channels", required_argument, NULL, OPT_AUDIO_CHANNELS },
+        { "audio-bitrate", required_argument, NULL, OPT_AUDIO_BITRATE },
+        { "http-port", required_argument, NULL, OPT_HTTP_PORT },
+        { "rtsp-port", required_argument, NULL, OPT_RTSP_PORT },
+        { "live-clients", required_argument, NULL, OPT_LIVE_CLIENTS },
+        { "multicast", required_argument, NULL, OPT_MULTICAST },
+        { "multicast-ttl", required_argument, NULL, OPT_MULTICAST_TTL },
+        { "multicast-if", required_argument, NULL, OPT_MULTICAST_IF },
+        { "sdp",     required_argument, NULL, OPT_SDP },
+        { "sub-sink", required_argument, NULL, OPT_SUB_SINK },
+        { "sub-size", required_argument, NULL, OPT_SUB_SIZE },
+        { "sub-bitrate", required_argument, NULL, OPT_SUB_BITRATE },
+        { "camera",  required_argument, NULL, OPT_CAMERA },
+        { "det-weight", required_argument, NULL, OPT_DET_WEIGHT },
+        { "det-fps", required_argument, NULL, OPT_DET_FPS },
+        { "npu-policy", required_argument, NULL, OPT_NPU_POLICY },
+        { "model",   required_argument, NULL, OPT_MODEL },
+        { "labels",  required_argument, NULL, OPT_LABELS },
+        { "batch-model", required_argument, NULL, OPT_BATCH_MODEL },
+        { "batch-window", required_argument, NULL, OPT_BATCH_WINDOW },
+        { "det-deadline", required_argument, NULL, OPT_DET_DEADLINE },
+        { "lite-model", required_argument, NULL, OPT_LITE_MODEL },
+        { "npu-workers", required_argument, NULL, OPT_NPU_WORKERS },
+        { "npu-core-masks", required_argument, NULL, OPT_NPU_CORE_MASKS },
+        { "npu-backend", required_argument, NULL, OPT_NPU_BACKEND },
+        { "npu-model", required_argument, NULL, OPT_NPU_MODEL },
+        { "cascade", required_argument, NULL, OPT_CASCADE },
+        { "cascade-classes", required_argument, NULL, OPT_CASCADE_CLASSES },
+        { "cascade-labels", required_argument, NULL, OPT_CASCADE_LABELS },
+        { "cascade-min-size", required_argument, NULL, OPT_CASCADE_MIN_SIZE },
+        { "cascade-max-crops", required_argument, NULL, OPT_CASCADE_MAX_CROPS },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:o:e:b:g:f:r:q:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 's': cfg->source = optarg; break;
+        case 'o':
+            if (!strcmp(optarg, "list")) {
+                stream_fanout_list_types();
+                return 1;
+            }
+            if (cfg->sink_count >= APP_MAX_SINKS) {
+                fprintf(stderr, "Too many sinks (max %d)\n", APP_MAX_SINKS);
+                return -1;
+            }
+            cfg->sinks[cfg->sink_count++] = optarg;
+            break;
+        case 'e':
+            if (!strcmp(optarg, "list")) {
+                encoder_list_backends();
+                return 1;
+            }
+            cfg->encoder.backend = optarg;
+            break;
+        case 'b': cfg->encoder.bit_rate = atoll(optarg); break;
+        case 'g': cfg->encoder.gop_size = atoi(optarg); break;
+        case 'f': cfg->encoder.fps = atoi(optarg); break;
+        case 'r':
+            if (encoder_parse_rc_mode(optarg, &cfg->encoder.rc_mode) < 0) {
+                fprintf(stderr, "Unknown rate control mode '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case 'q': cfg->encoder.qp = atoi(optarg); break;
+        case OPT_SLICES: cfg->encoder.slices = atoi(optarg); break;
+        case OPT_THREADS: cfg->encoder.threads = atoi(optarg); break;
+        case OPT_LOW_LATENCY: cfg->encoder.low_latency = 1; break;
+        case OPT_QUEUE: cfg->queue_size = atoi(optarg); break;
+        case OPT_RTMP_LITE: cfg->rtmp_lite = 1; break;
+        case OPT_RTMP_CHUNK_SIZE: cfg->rtmp_chunk_size = atoi(optarg); break;
+        case OPT_ABR: cfg->abr_enabled = 1; break;
+        case OPT_MIN_BITRATE: cfg->abr.min_bit_rate = atoll(optarg); break;
+        case OPT_MAX_BITRATE: cfg->abr.max_bit_rate = atoll(optarg); break;
+        case OPT_EVENT_DIR: cfg->event.dir = optarg; break;
+        case OPT_EVENT_CLASSES: cfg->event.classes = optarg; break;
+        case OPT_PRE_ROLL: cfg->event.pre_roll_s = atoi(optarg); break;
+        case OPT_POST_ROLL: cfg->event.post_roll_s = atoi(optarg); break;
+        case OPT_STORE_DIR: cfg->store.dir = optarg; break;
+        case OPT_STORE_SIZE: cfg->store.max_bytes = atoll(optarg) * 1024 * 1024; break;
+        case OPT_STORE_AGE: cfg->store.max_age_s = atoi(optarg) * 3600; break;
+        case OPT_SEGMENT_SEC: cfg->store.segment_s = atoi(optarg); break;
+        case OPT_INDEX: cfg->index_path = optarg; break;
+        case OPT_ROI: cfg->roi.enabled = 1; break;
+        case OPT_ROI_CLASSES: cfg->roi.classes = optarg; break;
+        case OPT_ROI_QOFFSET: cfg->roi.qoffset = atof(optarg); break;
+        case OPT_ROI_BG_QOFFSET: cfg->roi.bg_qoffset = atof(optarg); break;
+        case OPT_ROI_LOG:
+            cfg->roi.enabled = 1;
+            cfg->roi.log_path = optarg;
+            break;
+        case OPT_ACTIVITY: cfg->activity.enabled = 1; break;
+        case OPT_IDLE_FPS: cfg->activity.idle_fps = atoi(optarg); break;
+        case OPT_IDLE_BITRATE: cfg->activity.idle_bit_rate = atoll(optarg); break;
+        case OPT_IDLE_DELAY: cfg->activity.idle_delay_ms = atoi(optarg); break;
+        case OPT_MOTION_THRESHOLD: cfg->activity.motion_threshold = atof(optarg); break;
+        case OPT_AUDIO: cfg->audio.device = optarg; break;
+        case OPT_AUDIO_RATE: cfg->audio.sample_rate = atoi(optarg); break;
+        case OPT_AUDIO_CHANNELS: cfg->audio.channels = atoi(optarg); break;
+        case OPT_AUDIO_BITRATE: cfg->audio.bit_rate = atoll(optarg); break;
+        case OPT_HTTP_PORT: cfg->live.http_port = atoi(optarg); break;
+        case OPT_RTSP_PORT: cfg->live.rtsp_port = atoi(optarg); break;
+        case OPT_LIVE_CLIENTS: cfg->live.max_clients = atoi(optarg); break;
+        case OPT_MULTICAST: cfg->multicast.group = optarg; break;
+        case OPT_MULTICAST_TTL: cfg->multicast.ttl = atoi(optarg); break;
+        case OPT_MULTICAST_IF: cfg->multicast.iface = optarg; break;
+        case OPT_SDP: cfg->multicast.sdp_path = optarg; break;
+        case OPT_SUB_SINK:
+            if (cfg->substream.sink_count >= SUBSTREAM_MAX_SINKS) {
+                fprintf(stderr, "Too many substream sinks (max %d)\n", SUBSTREAM_MAX_SINKS);
+                return -1;
+            }
+            cfg->substream.sinks[cfg->substream.sink_count++] = optarg;
+            break;
+        case OPT_SUB_SIZE:
+            if (sscanf(optarg, "%dx%d", &cfg->substream.width, &cfg->substream.height) != 2) {
+                fprintf(stderr, "Invalid substream size '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_SUB_BITRATE: cfg->substream.bit_rate = atoll(optarg); break;
+        case OPT_CAMERA:
+            if (cfg->camera_count >= APP_MAX_CAMERAS - 1) {
+                fprintf(stderr, "Too many cameras (max %d)\n", APP_MAX_CAMERAS);
+                return -1;
+            }
+            if (parse_camera(optarg, &cfg->cameras[cfg->camera_count]) < 0) {
+                return -1;
+            }
+            cfg->camera_count++;
+            break;
+        case OPT_DET_WEIGHT: cfg->det_weight = atoi(optarg); break;
+        case OPT_DET_FPS: cfg->det_fps = atoi(optarg); break;
+        case OPT_NPU_POLICY:
+            if (npu_parse_policy(optarg, &cfg->npu.policy) < 0) {
+                fprintf(stderr, "Unknown NPU policy '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_MODEL: cfg->npu.model_path = optarg; break;
+        case OPT_LABELS: cfg->npu.labels_path = optarg; break;
+        case OPT_BATCH_MODEL: cfg->npu.batch_model_path = optarg; break;
+        case OPT_BATCH_WINDOW: cfg->npu.batch_window_ms = atoi(optarg); break;
+        case OPT_DET_DEADLINE: cfg->npu.deadline_ms = atoi(optarg); break;
+        case OPT_LITE_MODEL:
+            if (cfg->npu.lite_count >= NPU_MAX_LEVELS - 1) {
+                fprintf(stderr, "Too many lite models (max %d)\n", NPU_MAX_LEVELS - 1);
+                return -1;
+            }
+            cfg->npu.lite_models[cfg->npu.lite_count++] = optarg;
+            break;
+        case OPT_NPU_WORKERS: cfg->npu.workers = atoi(optarg); break;
+        case OPT_NPU_CORE_MASKS:
+            if (npu_parse_core_masks(optarg, &cfg->npu) < 0) {
+                fprintf(stderr, "Invalid NPU core masks '%s'\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_NPU_BACKEND:
+            if (!detector_backend_valid(optarg)) {
+                fprintf(stderr, "Unknown detector backend '%s'\n", optarg);
+                return -1;
+            }
+            cfg->npu.backend = optarg;
+            break;
+        case OPT_NPU_MODEL:
+            if (parse_npu_model(optarg, &cfg->npu) < 0) {
+                return -1;
+            }
+            break;
+        case OPT_CASCADE: cfg->cascade.model = optarg; break;
+        case OPT_CASCADE_CLASSES: cfg->cascade.classes = optarg; break;
+        case OPT_CASCADE_LABELS: cfg->cascade.labels = optarg; break;
+        case OPT_CASCADE_MIN_SIZE: cfg->cascade.min_size = atoi(optarg); break;
+        case OPT_CASCADE_MAX_CROPS: cfg->cascade.max_crops = atoi(optarg); break;
+        case 'h':
+            print_usage(argv[0]);
+            return 1;
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (cfg->encoder.fps <= 0 || cfg->encoder.gop_size <= 0 || cfg->encoder.bit_rate < 0 ||
+        cfg->queue_size < 2) {
+        fprintf(stderr, "Invalid encoder settings\n");
+        return -1;
+    }
+    // RTMP规定块大小最大0xFFFFFF; 小于128比默认值还小, 没有意义
+    if (cfg->rtmp_chunk_size < 128 || cfg->rtmp_chunk_size > 0xffffff) {
+        fprintf(stderr, "Invalid RTMP chunk size\n");
+        return -1;
+    }
+    if (cfg->event.pre_roll_s < 0 || cfg->event.post_roll_s <= 0) {
+        fprintf(stderr, "Invalid pre-roll/post-roll\n");
+        return -1;
+    }
+    if (cfg->store.segment_s <= 0 || cfg->store.max_bytes <= 0) {
+        fprintf(stderr, "Invalid segment store settings\n");
+        return -1;
+    }
+    if (cfg->roi.qoffset < -1.0 || cfg->roi.qoffset > 1.0 ||
+        cfg->roi.bg_qoffset < -1.0 || cfg->roi.bg_qoffset > 1.0) {
+        fprintf(stderr, "ROI quality offsets must be within -1..1\n");
+        return -1;
+    }
+    if (cfg->activity.idle_fps <= 0 || cfg->activity.idle_delay_ms < 0 ||
+        cfg->activity.idle_bit_rate < 0) {
+        fprintf(stderr, "Invalid activity settings\n");
+        return -1;
+    }
+    if (cfg->audio.sample_rate <= 0 || cfg->audio.channels < 1 || cfg->audio.channels > 2 ||
+        cfg->audio.bit_rate <= 0) {
+        fprintf(stderr, "Invalid audio settings\n");
+        return -1;
+    }
+    if (cfg->live.http_port < 0 || cfg->live.http_port > 65535 || cfg->live.rtsp_port < 0 ||
+        cfg->live.rtsp_port > 65535 || cfg->live.max_clients < 1) {
+        fprintf(stderr, "Invalid live server settings\n");
+        return -1;
+    }
+    if (cfg->multicast.ttl < 1 || cfg->multicast.ttl > 255) {
+        fprintf(stderr, "Invalid multicast ttl\n");
+        return -1;
+    }
+    // NV12和大多数编码器要求偶数宽高
+    if (cfg->substream.width < 16 || cfg->substream.height < 16 || (cfg->substream.width & 1) ||
+        (cfg->substream.height & 1) || cfg->substream.bit_rate <= 0) {
+        fprintf(stderr, "Invalid substream settings\n");
+        return -1;
+    }
+    for (int i = 0; i < cfg->camera_count; i++) {
+        if (cfg->cameras[i].det_fps < 0) {
+            cfg->cameras[i].det_fps = cfg->det_fps;
+        }
+        if (cfg->cameras[i].det_weight < 1) {
+            fprintf(stderr, "Invalid weight of camera %s\n", cfg->cameras[i].source);
+            return -1;
+        }
+    }
+    if (cfg->det_weight < 1 || cfg->det_fps < 0 || cfg->npu.batch_window_ms < 0 ||
+        cfg->npu.deadline_ms <= cfg->npu.batch_window_ms || cfg->npu.workers < 1 ||
+        cfg->npu.workers > NPU_MAX_WORKERS) {
+        fprintf(stderr, "Invalid detection settings\n");
+        return -1;
+    }
+    if (cfg->cascade.model) {
+        int found = 0;
+        for (int i = 0; i < cfg->npu.model_count; i++) {
+            found |= !strcmp(cfg->npu.models[i].name, cfg->cascade.model);
+        }
+        if (!found || cfg->cascade.min_size < 0 || cfg->cascade.max_crops < 1 ||
+            cfg->cascade.max_crops > NPU_JOB_MAX_INPUTS) {
+            fprintf(stderr, "--cascade needs an --npu-model of that name and 1..%d crops\n", NPU_JOB_MAX_INPUTS);
+            return -1;
+        }
+    }
+    cfg->live.fps = cfg->encoder.fps;
+    // 内置服务器或组播直接对外服务时不再默认推到外部RTMP服务器
+    if (cfg->sink_count == 0 && !cfg->live.http_port && !cfg->live.rtsp_port && !cfg->multicast.group) {
+        cfg->sinks[cfg->sink_count++] = "rtmp://127.0.0.1:1935/live/test";
+    }
+    if (cfg->abr.max_bit_rate <= 0) {
+        cfg->abr.max_bit_rate = cfg->encoder.bit_rate;
+    }
+    if (cfg->abr.min_bit_rate <= 0) {
+        cfg->abr.min_bit_rate = cfg->encoder.bit_rate / 8;
+    }
+    if (cfg->abr_enabled && (cfg->encoder.rc_mode == ENC_RC_CQP ||
+                             cfg->abr.min_bit_rate > cfg->abr.max_bit_rate)) {
+        fprintf(stderr, "ABR needs cbr/vbr and min-bitrate <= max-bitrate\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <alsa/asoundlib.h>
+#include "audio_capture.h"
+#include "packet_queue.h"
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/samplefmt.h>
+}
+
+#define AUDIO_LATENCY_US 40000      // ALSA buffer, split into periods by the driver
+// 采样计数推算的时间与实测采集时间相差超过该值时重新对齐，保证音画同步
+#define AUDIO_RESYNC_US 20000
+
+void audio_config_default(audio_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->sample_rate = 48000;
+    cfg->channels = 1;
+    cfg->bit_rate = 64000;
+}
+
+static int open_encoder(audio_capture_t *a) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!codec) {
+        fprintf(stderr, "AAC encoder not found\n");
+        return -1;
+    }
+    a->enc = avcodec_alloc_context3(codec);
+    if (!a->enc) {
+        fprintf(stderr, "Could not allocate AAC context\n");
+        return -1;
+    }
+    AVCodecContext *ctx = a->enc;
+    ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    ctx->sample_rate = a->cfg.sample_rate;
+    av_channel_layout_default(&ctx->ch_layout, a->cfg.channels);
+    ctx->bit_rate = a->cfg.bit_rate;
+    ctx->time_base = (AVRational){1, a->cfg.sample_rate};
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // FLV/MP4需要AudioSpecificConfig
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        fprintf(stderr, "Could not open AAC encoder\n");
+        return -1;
+    }
+
+    // ALSA采集S16交织格式，AAC编码器需要平面浮点
+    AVChannelLayout layout;
+    av_channel_layout_default(&layout, a->cfg.channels);
+    if (swr_alloc_set_opts2(&a->swr, &ctx->ch_layout, AV_SAMPLE_FMT_FLTP, ctx->sample_rate,
+                            &layout, AV_SAMPLE_FMT_S16, a->cfg.sample_rate, 0, NULL) < 0 ||
+        swr_init(a->swr) < 0) {
+        fprintf(stderr, "Could not initialize the audio resampler\n");
+        return -1;
+    }
+    a->fifo = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, a->cfg.channels, ctx->frame_size * 4);
+    if (!a->fifo ||
+        av_samples_alloc_array_and_samples(&a->conv, NULL, a->cfg.channels, a->period_frames,
+                                           AV_SAMPLE_FMT_FLTP, 0) < 0) {
+        fprintf(stderr, "Could not allocate audio buffers\n");
+        return -1;
+    }
+
+    a->frame = av_frame_alloc();
+    a->pkt = av_packet_alloc();
+    if (!a->frame || !a->pkt) {
+        fprintf(stderr, "Could not allocate audio frame\n");
+        return -1;
+    }
+    a->frame->format = AV_SAMPLE_FMT_FLTP;
+    a->frame->nb_samples = ctx->frame_size;
+    a->frame->sample_rate = ctx->sample_rate;
+    av_channel_layout_copy(&a->frame->ch_layout, &ctx->ch_layout);
+    if (av_frame_get_buffer(a->frame, 0) < 0) {
+        fprintf(stderr, "Could not allocate audio frame data\n");
+        return -1;
+    }
+    return 0;
+}
+
+audio_capture_t* audio_capture_open(const audio_config_t *cfg) {
+    audio_capture_t *a = (audio_capture_t*)calloc(1, sizeof(audio_capture_t));
+    if (!a) {
+        perror("Failed to allocate audio capture");
+        return NULL;
+    }
+    a->cfg = *cfg;
+    a->frame_bytes = 2 * cfg->channels;
+    a->fifo_start = AV_NOPTS_VALUE;
+    sem_init(&a->ring_sem, 0, 0);
+
+    snd_pcm_t *pcm = NULL;
+    int err = snd_pcm_open(&pcm, cfg->device, SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) {
+        fprintf(stderr, "Could not open ALSA device %s: %s\n", cfg->device, snd_strerror(err));
+        audio_capture_close(a);
+        return NULL;
+    }
+    a->pcm = pcm;
+    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                             cfg->channels, cfg->sample_rate, 1, AUDIO_LATENCY_US);
+    snd_pcm_uframes_t buffer_size = 0, period_size = 0;
+    if (err < 0 || (err = snd_pcm_get_params(pcm, &buffer_size, &period_size)) < 0) {
+        fprintf(stderr, "Could not configure %s for %d Hz x%d S16: %s\n",
+                cfg->device, cfg->sample_rate, cfg->channels, snd_strerror(err));
+        audio_capture_close(a);
+        return NULL;
+    }
+    a->period_frames = (int)period_size;
+
+    for (int i = 0; i < AUDIO_RING_SIZE; i++) {
+        a->ring[i].size = (size_t)a->period_frames * a->frame_bytes;
+        a->ring[i].data = (char*)malloc(a->ring[i].size);
+        if (!a->ring[i].data) {
+            perror("Failed to allocate audio ring");
+            audio_capture_close(a);
+            return NULL;
+        }
+    }
+    if (open_encoder(a) < 0) {
+        audio_capture_close(a);
+        return NULL;
+    }
+    printf("Audio %s: %d Hz x%d, period %d frames, buffer %lu frames, AAC %lld bps\n",
+           cfg->device, cfg->sample_rate, cfg->channels, a->period_frames,
+           (unsigned long)buffer_size, (long long)cfg->bit_rate);
+    return a;
+}
+
+int audio_capture_codecpar(const audio_capture_t *a, AVCodecParameters *par, AVRational *time_base) {
+    *time_base = a->enc->time_base;
+    return avcodec_parameters_from_context(par, a->enc);
+}
+
+void audio_capture_run(audio_capture_t *a, const int *running) {
+    snd_pcm_t *pcm = (snd_pcm_t*)a->pcm;
+    while (__atomic_load_n(running, __ATOMIC_RELAXED)) {
+        unsigned tail = a->ring_tail;
+        unsigned head = __atomic_load_n(&a->ring_head, __ATOMIC_ACQUIRE);
+        audio_buffer_t *chunk = &a->ring[tail % AUDIO_RING_SIZE];
+        int full = tail - head >= AUDIO_RING_SIZE;
+        char scratch[4096];
+        // 编码跟不上时读入临时缓冲区丢弃，保证ALSA不会溢出
+        char *dst = full ? scratch : chunk->data;
+        snd_pcm_uframes_t want = full ? sizeof(scratch) / a->frame_bytes : (snd_pcm_uframes_t)a->period_frames;
+
+        snd_pcm_sframes_t n = snd_pcm_readi(pcm, dst, want);
+        if (n < 0) {
+            a->overruns++;
+            if (snd_pcm_recover(pcm, (int)n, 1) < 0) {
+                fprintf(stderr, "ALSA read failed: %s\n", snd_strerror((int)n));
+                break;
+            }
+            continue;
+        }
+        if (full) {
+            a->dropped_chunks++;
+            continue;
+        }
+
+        // 第一个样本的采集时刻 = 当前时间 - (缓冲区中剩余 + 本次读出)的时长
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(pcm, &delay) < 0 || delay < 0) {
+            delay = 0;
+        }
+        int64_t now_us = monotonic_us();
+        chunk->timestamp = now_us - av_rescale(delay + n, 1000000, a->cfg.sample_rate);
+        chunk->data_size = (size_t)n * a->frame_bytes;
+        __atomic_store_n(&a->ring_tail, tail + 1, __ATOMIC_RELEASE);
+        sem_post(&a->ring_sem);
+    }
+}
+
+static void push_packet(audio_capture_t *a, AVPacket *pkt) {
+    unsigned tail = a->pkt_tail;
+    unsigned head = __atomic_load_n(&a->pkt_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= AUDIO_PACKET_RING_SIZE) {
+        a->dropped_packets++;
+        return;
+    }
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref) {
+        a->dropped_packets++;
+        return;
+    }
+    // 时间戳换成单调时钟微秒，与视频帧的采集时间直接比较
+    av_packet_rescale_ts(ref, a->enc->time_base, (AVRational){1, 1000000});
+    a->packets[tail % AUDIO_PACKET_RING_SIZE] = ref;
+    __atomic_store_n(&a->pkt_tail, tail + 1, __ATOMIC_RELEASE);
+    a->encoded_packets++;
+}
+
+static void encode_frames(audio_capture_t *a, int flush) {
+    AVCodecContext *ctx = a->enc;
+    while (av_audio_fifo_size(a->fifo) >= ctx->frame_size || flush) {
+        int ret;
+        if (av_audio_fifo_size(a->fifo) >= ctx->frame_size) {
+            if (av_frame_make_writable(a->frame) < 0) {
+                return;
+            }
+            av_audio_fifo_read(a->fifo, (void**)a->frame->data, ctx->frame_size);
+            a->frame->pts = a->fifo_start;
+            a->fifo_start += ctx->frame_size;
+            ret = avcodec_send_frame(ctx, a->frame);
+        } else {
+            ret = avcodec_send_frame(ctx, NULL);
+            flush = 0;
+        }
+        if (ret < 0) {
+            return;
+        }
+        while (avcodec_receive_packet(ctx, a->pkt) == 0) {
+            push_packet(a, a->pkt);
+            av_packet_unref(a->pkt);
+        }
+    }
+}
+
+static void encode_chunk(audio_capture_t *a, const audio_buffer_t *chunk) {
+    int samples = (int)(chunk->data_size / a->frame_bytes);
+    int64_t ts = av_rescale(chunk->timestamp, a->cfg.sample_rate, 1000000);
+    // 期望的位置: FIFO起点 + FIFO中已有的样本
+    int64_t expected = a->fifo_start + av_audio_fifo_size(a->fifo);
+    if (a->fifo_start == AV_NOPTS_VALUE) {
+        a->fifo_start = ts;
+    } else if (llabs(ts - expected) > av_rescale(AUDIO_RESYNC_US, a->cfg.sample_rate, 1000000)) {
+        // 声卡时钟与系统时钟有漂移，或者发生了xrun
+        av_audio_fifo_reset(a->fifo);
+        a->fifo_start = ts;
+        a->resyncs++;
+    }
+
+    const uint8_t *in = (const uint8_t*)chunk->data;
+    int out = swr_convert(a->swr, a->conv, a->period_frames, &in, samples);
+    if (out > 0) {
+        av_audio_fifo_write(a->fifo, (void**)a->conv, out);
+    }
+    encode_frames(a, 0);
+}
+
+static void* encode_thread_func(void *arg) {
+    audio_capture_t *a = (audio_capture_t*)arg;
+    while (1) {
+        sem_wait(&a->ring_sem);
+        unsigned head = a->ring_head;
+        if (head == __atomic_load_n(&a->ring_tail, __ATOMIC_ACQUIRE)) {
+            if (!__atomic_load_n(&a->running, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            continue;
+        }
+        encode_chunk(a, &a->ring[head % AUDIO_RING_SIZE]);
+        __atomic_store_n(&a->ring_head, head + 1, __ATOMIC_RELEASE);
+    }
+    encode_frames(a, 1);
+    return NULL;
+}
+
+int audio_capture_start(audio_capture_t *a) {
+    a->running = 1;
+    if (pthread_create(&a->encode_thread, NULL, encode_thread_func, a) != 0) {
+        perror("Failed to create audio encode thread");
+        a->running = 0;
+        return -1;
+    }
+    a->encode_started = 1;
+    return 0;
+}
+
+int audio_capture_peek(audio_capture_t *a, int64_t *pts_us) {
+    unsigned head = a->pkt_head;
+    if (head == __atomic_load_n(&a->pkt_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    *pts_us = a->packets[head % AUDIO_PACKET_RING_SIZE]->pts;
+    return 1;
+}
+
+AVPacket* audio_capture_pop(audio_capture_t *a) {
+    unsigned head = a->pkt_head;
+    if (head == __atomic_load_n(&a->pkt_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    AVPacket *pkt = a->packets[head % AUDIO_PACKET_RING_SIZE];
+    __atomic_store_n(&a->pkt_head, head + 1, __ATOMIC_RELEASE);
+    return pkt;
+}
+
+void audio_capture_close(audio_capture_t *a) {
+    if (!a) return;
+    if (a->encode_started) {
+        __atomic_store_n(&a->running, 0, __ATOMIC_RELEASE);
+        sem_post(&a->ring_sem);
+        pthread_join(a->encode_thread, NULL);
+        printf("Audio: %llu AAC packets, %llu xruns, %llu chunks and %llu packets dropped, %llu resyncs\n",
+               (unsigned long long)a->encoded_packets, (unsigned long long)a->overruns,
+               (unsigned long long)a->dropped_chunks, (unsigned long long)a->dropped_packets,
+               (unsigned long long)a->resyncs);
+    }
+    AVPacket *pkt;
+    while ((pkt = audio_capture_pop(a)) != NULL) {
+        av_packet_free(&pkt);
+    }
+    if (a->pcm) {
+        snd_pcm_close((snd_pcm_t*)a->pcm);
+    }
+    for (int i = 0; i < AUDIO_RING_SIZE; i++) {
+        free(a->ring[i].data);
+    }
+    if (a->conv) {
+        av_freep(&a->conv[0]);
+        av_freep(&a->conv);
+    }
+    av_audio_fifo_free(a->fifo);
+    swr_free(&a->swr);
+    av_frame_free(&a->frame);
+    av_packet_free(&a->pkt);
+    avcodec_free_context(&a->enc);
+    sem_destroy(&a->ring_sem);
+    free(a);
+}
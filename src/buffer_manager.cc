@@ -2,8 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <signal.h>
 #include "image_converter.h"
 #include "buffer_manager.h"
 #include "camera.h"
@@ -13,6 +17,16 @@
 #include "rga.h"
 #include "rknn_yolov5.h"
 #include "postprocess.h"
+#include "dma_frame_pool.h"
+#include "encoder.h"
+#include "stream_fanout.h"
+#include "segment_store.h"
+#include "detection_index.h"
+#include "abr.h"
+#include "roi.h"
+#include "activity.h"
+#include "frame_clock.h"
+#include "audio_capture.h"
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
@@ -25,6 +39,7 @@ extern "C" {
 #include <libswresample/swresample.h>
 #include <libavutil/avassert.h>
 #include <libavutil/opt.h>
+#include <libavutil/hwcontext.h>
 }
 
 // 16字节对齐函数
@@ -77,8 +92,8 @@ buffer_manager_t* init_buffer_manager(int buffer_count, int width, int height) {
     mgr->width = width;
     mgr->height = height;
     mgr->nv12_size = nv12_size;
-    mgr->encode_buffer = (char*)malloc(nv12_size);
     mgr->RGB_buffer = (char*)malloc(RGB_size);
+    mgr->RGB_timestamp = 0;
 
     mgr->bgra_size = bgra_size;
     mgr->RGB_size = RGB_size;
@@ -109,9 +124,6 @@ void destroy_buffer_manager(buffer_manager_t *mgr) {
     }
 
     // Free other buffers
-    if (mgr->encode_buffer) {
-        free(mgr->encode_buffer);
-    }
     if (mgr->RGB_buffer) {
         free(mgr->RGB_buffer);
     }
@@ -165,23 +177,38 @@ void* video_capture_thread_func(void *arg) {
 }
 
 
+// 音频采集线程: ALSA读出的PCM写入无锁环形缓冲区，由AAC编码线程取走
+void* audio_capture_thread_func(void *arg) {
+    thread_params_t *params = (thread_params_t*)arg;
+    printf("Audio capture thread started\n");
+    audio_capture_run(params->audio, &params->buffer_mgr->running);
+    printf("Audio capture thread exiting\n");
+    return NULL;
+}
 
 // Process thread function
+// 推理交给共享的NPU调度器: 这里只提交帧和取回最新结果，从不等待NPU，
+// 多个摄像头争用NPU时降低的只是检测帧率，视频照常输出
 void* Inference_thread_func(void *arg) {
     thread_params_t *params = (thread_params_t*)arg;
     buffer_manager_t *mgr = params->buffer_mgr;
     int width = mgr->width;
     int height = mgr->height;
-    int ret;
-    printf("Process thread started\n");
+    printf("Process thread of camera %d started\n", params->camera_id);
     
-    // Initialize RKNN model
-    RknnYolov5 rknn;
-    ret = rknn.Init("./model/yolov5s-640-640.rknn");
-    if (ret < 0) {
-        fprintf(stderr, "Failed to initialize RKNN model\n");
-        return NULL;
+    // 检测结果写入紧凑的二进制索引，回放检索时无需解码视频
+    detection_index_t *det_index = NULL;
+    char index_path[512];
+    const char *path = params->config->index_path;
+    if (!path && params->config->store.dir) {
+        snprintf(index_path, sizeof(index_path), "%s/detections.idx", params->config->store.dir);
+        path = index_path;
+    }
+    // 录像和索引只属于主摄像头
+    if (path && params->camera_id == 0) {
+        det_index = detection_index_open(path, width, height);
     }
+    uint64_t result_seq = 0;
     
     while (mgr->running) {
         // Wait for filled buffer
@@ -194,15 +221,33 @@ void* Inference_thread_func(void *arg) {
         mgr->process_index = (mgr->process_index + 1) % mgr->buffer_count;
         pthread_mutex_unlock(&mgr->mutex);
         
-        ret = rknn.Inference((unsigned char*)mgr->buffers[idx].data, width, height, &(mgr->detect_result));
-        if (ret < 0) {
-            printf("Inference failed!\n");
-        } else {
+        if (params->npu_client) {
+            npu_scheduler_submit(params->npu, params->npu_client, (unsigned char*)mgr->buffers[idx].data,
+                                 monotonic_us());
+        }
+        // 叠加和编码用最近一次完成的检测结果
+        if (params->npu_client &&
+            npu_client_poll(params->npu, params->npu_client, &mgr->detect_result, &result_seq)) {
+            // 第二级的分类结果按框对应挂到检测结果上
+            if (params->cascade) {
+                cascade_annotate(params->cascade, &mgr->detect_result);
+            }
+            // 检测到指定类别时触发或延长事件录像
+            if (params->recorder) {
+                event_recorder_match(params->recorder, &mgr->detect_result);
+            }
+            if (det_index) {
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+                detection_index_append(det_index, (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000,
+                                       &mgr->detect_result);
+            }
             //printf("Detect Result Count: %d\n", mgr->detect_result.count);
         }
         sem_post(&mgr->display_sem);
     }
 
+    detection_index_close(det_index);
     printf("Inference thread exiting\n");
     return NULL;
 }
@@ -215,15 +260,19 @@ void* display_thread_func(void *arg){
     int ret;
 
         // Initialize DRM
-    My_drm_context_t *drm = init_drm(width, height);
-    if (!drm) {
-        fprintf(stderr, "Failed to initialize DRM, exiting display thread\n");
-        return NULL;
-    }
+    // 屏幕只有一块: 其余摄像头只做RGB转换和叠加，供编码使用
+    My_drm_context_t *drm = NULL;
+    if (params->display) {
+        drm = init_drm(width, height);
+        if (!drm) {
+            fprintf(stderr, "Failed to initialize DRM, exiting display thread\n");
+            return NULL;
+        }
 
-    // Print buffer dimensions
-    printf("Input buffer: %dx%d, Display buffer: %dx%d\n", 
-        width, height, drm->width, drm->height);
+        // Print buffer dimensions
+        printf("Input buffer: %dx%d, Display buffer: %dx%d\n", 
+            width, height, drm->width, drm->height);
+    }
 
         // Variables for FPS calculation
     int frame_count = 0;
@@ -247,6 +296,7 @@ void* display_thread_func(void *arg){
             printf("Error converting NV12 to RGB: %s\n", imStrError((IM_STATUS)ret));
             continue;
         }
+        mgr->RGB_timestamp = mgr->buffers[idx].timestamp;
     
         // Calculate FPS
         frame_count++;
@@ -257,7 +307,7 @@ void* display_thread_func(void *arg){
             fps = frame_count / time_elapsed;
             frame_count = 0;
             start_time = current_time;
-            printf("FPS = %.1f \n",fps);
+            printf("Camera %d FPS = %.1f \n", params->camera_id, fps);
         }
     
         // Create OpenCV Mat for drawing
@@ -282,7 +332,11 @@ void* display_thread_func(void *arg){
     
             // Format text with class name and confidence
             char text[128];
-            snprintf(text, sizeof(text), "%s %.2f", det->name, det->prop);
+            if (det->attr_name[0]) {
+                snprintf(text, sizeof(text), "%s %.2f %s", det->name, det->prop, det->attr_name);
+            } else {
+                snprintf(text, sizeof(text), "%s %.2f", det->name, det->prop);
+            }
     
             // Draw text
             cv::putText(rgb_frame, text, cv::Point(x1, y1 - 12), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 0, 0),2);
@@ -290,6 +344,12 @@ void* display_thread_func(void *arg){
             //printf("%s @ (%d, %d, %d, %d) %.3f\n", det->name, x1, y1, x2, y2, det->prop);
         }
     
+        if (!drm) {
+            sem_post(&mgr->empty_sem);
+            sem_post(&mgr->encode_sem);
+            continue;
+        }
+    
         // Convert RGB to BGRA
         ret = convert_RGB_to_BGRA_dma_buf(mgr->RGB_buffer, drm, width, height);
         if (ret != IM_STATUS_SUCCESS) {
@@ -346,9 +406,149 @@ void* display_thread_func(void *arg){
     return NULL;
 }
 
+// 打开指定分辨率的DMA帧池和编码器，ABR切换分辨率时也走这里
+static int open_encode_pipeline(const app_config_t *config, int width, int height, int64_t bit_rate,
+                                dma_frame_pool_t **pool, encoder_t **enc) {
+    // DMA-BUF帧池: RGA直接写入，编码器通过DRM_PRIME导入，CPU不再接触像素
+    *pool = init_dma_frame_pool(4, width, height);
+    if (!*pool) {
+        fprintf(stderr, "Could not create DMA frame pool\n");
+        return -1;
+    }
+    
+    // 按配置打开编码器后端，软件后端内部把DRM_PRIME帧映射为NV12
+    encoder_config_t enc_cfg = config->encoder;
+    enc_cfg.width = width;
+    enc_cfg.height = height;
+    enc_cfg.bit_rate = bit_rate;
+    *enc = encoder_open(&enc_cfg, (*pool)->frames_ref);
+    if (!*enc) {
+        fprintf(stderr, "Could not open encoder\n");
+        destroy_dma_frame_pool(*pool);
+        *pool = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// 编码线程无法继续时通过管道唤醒主循环退出，不能默默停止推流
+static int fatal_pipe[2] = { -1, -1 };
+
+static void report_fatal(const thread_params_t *params, const char *what) {
+    fprintf(stderr, "Camera %d: %s, stopping\n", params->camera_id, what);
+    char c = 1;
+    if (fatal_pipe[1] >= 0 && write(fatal_pipe[1], &c, 1) < 0) {
+        perror("write");
+    }
+}
+
+// 编码输出的所有去向，未启用的为NULL
+typedef struct {
+    stream_fanout_t *fanout;
+    event_recorder_t *recorder;
+    segment_store_t *store;
+    roi_state_t *roi;           // measurement mode logs every packet size
+    int64_t frame_duration;     // time until the next encoded frame, in encoder time_base
+    audio_capture_t *audio;     // AAC packets interleaved into the fan-out
+    const frame_clock_t *clock; // maps audio capture time onto the video time line
+    int64_t last_audio_pts;
+    double latency_ms;          // capture -> encoded packet, EWMA
+    live_server_t *live;        // built-in HTTP-FLV/RTSP server
+    rtp_multicast_t *multicast; // RTP to a multicast group, sent from this thread
+    substream_t *substream;     // low resolution simulcast, gets the same audio
+} encode_outputs_t;
+
+// 音频包最多等待视频这么久，视频停顿(如空闲降帧)时音频照常输出
+#define AUDIO_MAX_HOLD_US 500000
+
+// 把时间戳不晚于until_pts(视频时间基)的音频包插入输出，两路按时间戳交织
+static void send_audio(encode_outputs_t *out, int64_t until_pts) {
+    int64_t pts_us;
+    while (audio_capture_peek(out->audio, &pts_us)) {
+        int64_t pts = frame_clock_map(out->clock, pts_us);
+        if (pts > until_pts) {
+            break;
+        }
+        AVPacket *apkt = audio_capture_pop(out->audio);
+        AVRational tb = out->audio->enc->time_base;
+        int64_t apts = av_rescale_q(pts, out->clock->time_base, tb);
+        // 视频开始前的音频，以及重新对齐后时间戳回退的包直接丢弃
+        if (pts >= 0 && apts > out->last_audio_pts) {
+            apkt->pts = apts;
+            apkt->dts = apts;
+            apkt->duration = av_rescale_q(apkt->duration, (AVRational){1, 1000000}, tb);
+            apkt->stream_index = 1;
+            stream_fanout_send(out->fanout, apkt);
+            if (out->live) {
+                live_server_send(out->live, apkt);
+            }
+            if (out->substream) {
+                substream_send_audio(out->substream, apkt);
+            }
+            out->last_audio_pts = apts;
+        }
+        av_packet_free(&apkt);
+    }
+}
+
+// 取出编码器中所有可用的数据包，分发给所有输出
+static void drain_encoder(encoder_t *enc, AVPacket *pkt, encode_outputs_t *out, int *frame_count) {
+    int ret = 0;
+    while (ret >= 0) {
+        ret = encoder_receive_packet(enc, pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            fprintf(stderr, "Error during encoding\n");
+            break;
+        }
+        
+        // 可变帧率: 跳帧后包的时长覆盖到下一编码帧，分片MP4的时间轴才连续
+        pkt->duration = out->frame_duration;
+        double latency_ms = (monotonic_us() - frame_clock_capture_us(out->clock, pkt->pts)) / 1000.0;
+        out->latency_ms = out->latency_ms > 0 ? out->latency_ms * 0.9 + latency_ms * 0.1 : latency_ms;
+        if (out->roi) {
+            roi_log_packet(out->roi, pkt);
+        }
+        if (out->audio) {
+            send_audio(out, pkt->pts);
+        }
+        // 每个输出有自己的写线程和队列，慢的输出只丢自己的包
+        stream_fanout_send(out->fanout, pkt);
+        if (out->live) {
+            live_server_send(out->live, pkt);
+        }
+        // 每个包只发一次，观众数量不影响上行流量
+        if (out->multicast) {
+            rtp_multicast_send(out->multicast, pkt);
+        }
+        if (out->recorder) {
+            event_recorder_push(out->recorder, pkt);
+        }
+        // 连续录像只做入队，写盘在存储引擎自己的线程中完成
+        if (out->store) {
+            segment_store_send(out->store, pkt);
+        }
+        av_packet_unref(pkt);
+        
+        (*frame_count)++;
+        if (*frame_count % 100 == 0) {
+            printf("Encoded %d frames, capture to packet %.1f ms\n", *frame_count, out->latency_ms);
+        }
+    }
+}
+
+// 编码器码率: 网络允许的码率，场景空闲时再降低
+static int64_t encode_bit_rate(const app_config_t *config, const abr_controller_t *abr,
+                               const activity_policy_t *activity) {
+    int64_t bit_rate = config->abr_enabled ? abr->bit_rate : config->encoder.bit_rate;
+    return activity ? activity_bit_rate(activity, bit_rate) : bit_rate;
+}
+
 void* encode_thread_func(void *arg) {
     thread_params_t *params = (thread_params_t*)arg;
     buffer_manager_t *mgr = params->buffer_mgr;
+    const app_config_t *config = params->config;
     int width = mgr->width;
     int height = mgr->height;
     
@@ -357,139 +557,105 @@ void* encode_thread_func(void *arg) {
     // 初始化FFmpeg网络功能
     avformat_network_init();
     
-    // RTMP流地址
-    const char *rtmp_url = "rtmp://127.0.0.1:1935/live/test";
+    // 一次编码，多路输出(RTMP/录像/HLS)
+    stream_fanout_t *fanout = params->fanout;
     
-    // 设置输出格式上下文
-    AVFormatContext *out_ctx = NULL;
-    avformat_alloc_output_context2(&out_ctx, NULL, "flv", rtmp_url); // 使用FLV格式进行RTMP流
-    if (!out_ctx) {
-        fprintf(stderr, "Could not create output context\n");
-        return NULL;
-    }
+    // 码率自适应: 拥塞时先降码率，到下限后再降帧率和分辨率
+    abr_controller_t abr;
+    abr_init(&abr, &config->abr, config->encoder.bit_rate);
+    int64_t bit_rate = config->abr_enabled ? abr.bit_rate : config->encoder.bit_rate;
     
-    // 查找H.264编码器
-    const AVCodec *codec = avcodec_find_encoder_by_name("h264_rkmpp");
-    if (!codec) {
-        fprintf(stderr, "Could not find H.264 encoder\n");
-        avformat_free_context(out_ctx);
+    dma_frame_pool_t *pool = NULL;
+    encoder_t *enc = NULL;
+    if (open_encode_pipeline(config, width, height, bit_rate, &pool, &enc) < 0) {
+        report_fatal(params, "could not open the encoder");
         return NULL;
     }
-    
-    // 创建编码器上下文
-    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
-        fprintf(stderr, "Could not allocate encoding context\n");
-        avformat_free_context(out_ctx);
-        return NULL;
+    // 编码器不能在运行中改码率时，ABR只调帧率和分辨率
+    abr.fixed_bit_rate = !encoder_can_set_bitrate(enc);
+    if (config->abr_enabled && abr.fixed_bit_rate) {
+        printf("ABR: encoder bitrate is fixed, adapting frame rate and resolution only\n");
     }
     
-    // 设置编码参数
-    codec_ctx->width = width;
-    codec_ctx->height = height;
-    codec_ctx->time_base = (AVRational){1, 15}; // 30fps
-    codec_ctx->framerate = (AVRational){15, 1};
-    codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P; // 使用YUV420P格式编码
-    codec_ctx->bit_rate = 10000000; // 5 Mbps，可以根据网络情况调整
-    
-    // 对于RTMP流，设置一些特定的参数
-    codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // RTMP需要全局头
-    codec_ctx->max_b_frames = 0; // RTMP流不使用B帧，更好的实时性
-    codec_ctx->gop_size = 10; // 每秒一个关键帧
-    
-    // 打开编码器
-    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
-        fprintf(stderr, "Could not open codec\n");
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
+    // 网络发送放到独立的写线程，编码线程只负责入队，不会被TCP阻塞
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (!codecpar) {
+        fprintf(stderr, "Could not allocate codec parameters\n");
+        encoder_close(enc);
+        destroy_dma_frame_pool(pool);
         return NULL;
     }
-    
-    // 创建视频流
-    AVStream *stream = avformat_new_stream(out_ctx, NULL);
-    if (!stream) {
-        fprintf(stderr, "Could not create stream\n");
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
+    avcodec_parameters_from_context(codecpar, enc->ctx);
+    if (stream_fanout_start(fanout, codecpar, enc->ctx->time_base) < 0) {
+        fprintf(stderr, "Could not start any output\n");
+        avcodec_parameters_free(&codecpar);
+        stream_fanout_stop(fanout);
+        encoder_close(enc);
+        destroy_dma_frame_pool(pool);
         return NULL;
     }
-    out_ctx->flags |= AVFMT_FLAG_NOBUFFER; 
-    out_ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
-    stream->id = out_ctx->nb_streams - 1;
-    avcodec_parameters_from_context(stream->codecpar, codec_ctx);
-    
-    // 打开RTMP输出连接
-    // 注意：RTMP总是需要AVFMT_NOFILE标志，因此不检查该标志
-    if (avio_open(&out_ctx->pb, rtmp_url, AVIO_FLAG_WRITE) < 0) {
-        fprintf(stderr, "Could not open output URL '%s'\n", rtmp_url);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
-        return NULL;
+    if (params->live) {
+        live_server_start(params->live, codecpar, enc->ctx->time_base);
+    }
+    if (params->multicast && rtp_multicast_start(params->multicast, codecpar, enc->ctx->time_base) < 0) {
+        fprintf(stderr, "Multicast output disabled\n");
+        params->multicast = NULL;
     }
     
-    // 写入流头信息
-    if (avformat_write_header(out_ctx, NULL) < 0) {
-        fprintf(stderr, "Error writing header\n");
-        avio_closep(&out_ctx->pb);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
-        return NULL;
+    // 检测框区域提高编码质量，背景降低质量以节省码率
+    roi_state_t *roi = NULL;
+    if (config->roi.enabled) {
+        roi = roi_create(&config->roi);
+        if (roi) {
+            roi_set_encoder(roi, enc->ctx);
+        }
     }
     
-    // 创建帧
-    AVFrame *frame = av_frame_alloc();
-    if (!frame) {
-        fprintf(stderr, "Could not allocate frame\n");
-        avio_closep(&out_ctx->pb);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
-        return NULL;
+    // 场景空闲时降低帧率和码率，目标出现时立即恢复
+    activity_policy_t *activity = NULL;
+    if (config->activity.enabled) {
+        activity = activity_create(&config->activity, config->encoder.fps);
     }
     
-    frame->format = codec_ctx->pix_fmt;
-    frame->width = codec_ctx->width;
-    frame->height = codec_ctx->height;
+    // PTS由采集时间戳换算，丢帧和摄像头帧率变化都不会让流时间偏离墙上时间
+    frame_clock_t clock;
+    frame_clock_init(&clock, enc->ctx->time_base, config->encoder.fps);
     
-    // 分配帧缓冲区
-    if (av_frame_get_buffer(frame, 0) < 0) {
-        fprintf(stderr, "Could not allocate frame data\n");
-        av_frame_free(&frame);
-        avio_closep(&out_ctx->pb);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
-        return NULL;
+    encode_outputs_t outputs = { fanout, params->recorder, params->store, roi,
+                                 frame_clock_duration(&clock, 1), params->audio, &clock, INT64_MIN, 0,
+                                 params->live, params->multicast, NULL };
+    // 事件录像: 编码数据先进入内存中的预录缓冲区
+    if (outputs.recorder && event_recorder_start(outputs.recorder, codecpar, enc->ctx->time_base) < 0) {
+        fprintf(stderr, "Could not start event recorder, events are not recorded\n");
+        outputs.recorder = NULL;
+    }
+    if (outputs.store && segment_store_start(outputs.store, codecpar, enc->ctx->time_base) < 0) {
+        fprintf(stderr, "Could not start segment store, continuous recording disabled\n");
+        outputs.store = NULL;
+    }
+    
+    // 子码流用自己的编码器，与主码流共享采集、推理和叠加结果
+    if (params->substream && substream_start(params->substream, &config->encoder, clock.time_base) == 0) {
+        outputs.substream = params->substream;
     }
     
     // 创建数据包
     AVPacket *pkt = av_packet_alloc();
     if (!pkt) {
         fprintf(stderr, "Could not allocate packet\n");
-        av_frame_free(&frame);
-        avio_closep(&out_ctx->pb);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
-        return NULL;
-    }
-    
-    // 为格式转换创建上下文
-    struct SwsContext *sws_ctx = sws_getContext(
-        width, height, AV_PIX_FMT_NV12,  // 源格式
-        width, height, AV_PIX_FMT_YUV420P,  // 目标格式 
-        SWS_BILINEAR, NULL, NULL, NULL);
-    
-    if (!sws_ctx) {
-        fprintf(stderr, "Could not initialize the conversion context\n");
-        av_packet_free(&pkt);
-        av_frame_free(&frame);
-        avio_closep(&out_ctx->pb);
-        avcodec_free_context(&codec_ctx);
-        avformat_free_context(out_ctx);
+        avcodec_parameters_free(&codecpar);
+        stream_fanout_stop(fanout);
+        encoder_close(enc);
+        destroy_dma_frame_pool(pool);
         return NULL;
     }
     
     int frame_count = 0;
-    int64_t pts = 0;
-    struct timeval start_time, end_time;
+    int dropped = 0;
+    int64_t frame_index = 0;
+    int enc_width = width;
+    int enc_height = height;
+    int enc_scale_div = 1;
     // 主循环: 获取帧，转换，编码，推流
     while (mgr->running) {
         // 等待新帧可用
@@ -497,80 +663,277 @@ void* encode_thread_func(void *arg) {
         
         if (!mgr->running) break;
         
-        // 确保帧数据可写
-        if (av_frame_make_writable(frame) < 0) {
-            fprintf(stderr, "Could not make frame writable\n");
+        // 跳过的帧在时间轴上留空
+        int64_t frame_pts = frame_clock_pts(&clock, mgr->RGB_timestamp);
+        int64_t frame_no = frame_index++;
+        if (outputs.audio) {
+            send_audio(&outputs, frame_pts - av_rescale_q(AUDIO_MAX_HOLD_US, (AVRational){1, 1000000},
+                                                          clock.time_base));
+        }
+        if (clock.frames % 9000 == 0) {
+            printf("Capture %.2f fps, stream time drift %lld ms\n", 1000000.0 / clock.interval_us,
+                   (long long)frame_clock_drift_us(&clock) / 1000);
+        }
+        
+        int64_t now_us = monotonic_us();
+        if (activity) {
+            activity_change_t change = activity_update(activity, mgr->RGB_buffer, width, height,
+                                                       &mgr->detect_result, now_us);
+            if (change != ACTIVITY_NONE) {
+                encoder_set_bitrate(enc, encode_bit_rate(config, &abr, activity));
+                if (outputs.substream) {
+                    substream_set_bitrate(outputs.substream,
+                                          activity_bit_rate(activity, outputs.substream->cfg.bit_rate));
+                }
+            }
+            // 目标出现的这一帧就以IDR和全码率编码
+            if (change == ACTIVITY_WAKE) {
+                encoder_force_idr(enc);
+                if (outputs.substream) {
+                    substream_force_idr(outputs.substream);
+                }
+            }
+        }
+        
+        if (config->abr_enabled && stream_fanout_abr_update(fanout, &abr, now_us)) {
+            encoder_set_bitrate(enc, encode_bit_rate(config, &abr, activity));
+            int new_width = (width / abr.scale_div) & ~1;
+            int new_height = (height / abr.scale_div) & ~1;
+            if (new_width != enc_width || new_height != enc_height) {
+                // 分辨率变化需要重建编码器，先冲刷旧编码器再释放它引用的DMA帧
+                encoder_send_frame(enc, NULL);
+                drain_encoder(enc, pkt, &outputs, &frame_count);
+                encoder_close(enc);
+                destroy_dma_frame_pool(pool);
+                if (open_encode_pipeline(config, new_width, new_height, encode_bit_rate(config, &abr, activity),
+                                         &pool, &enc) < 0) {
+                    // 新分辨率打不开就退回原分辨率，ABR也回到原来的档位
+                    fprintf(stderr, "Could not reopen encoder at %dx%d, staying at %dx%d\n",
+                            new_width, new_height, enc_width, enc_height);
+                    abr.scale_div = enc_scale_div;
+                    new_width = enc_width;
+                    new_height = enc_height;
+                    if (open_encode_pipeline(config, new_width, new_height,
+                                             encode_bit_rate(config, &abr, activity), &pool, &enc) < 0) {
+                        report_fatal(params, "could not reopen the encoder");
+                        enc = NULL;
+                        break;
+                    }
+                }
+                enc_width = new_width;
+                enc_height = new_height;
+                enc_scale_div = abr.scale_div;
+                if (roi) {
+                    roi_set_encoder(roi, enc->ctx);
+                }
+                avcodec_parameters_from_context(codecpar, enc->ctx);
+                stream_fanout_update_codecpar(fanout, codecpar);
+                if (outputs.live) {
+                    live_server_start(outputs.live, codecpar, enc->ctx->time_base);
+                }
+                if (outputs.multicast) {
+                    rtp_multicast_start(outputs.multicast, codecpar, enc->ctx->time_base);
+                }
+                if (outputs.recorder) {
+                    event_recorder_reset(outputs.recorder, codecpar);
+                }
+                if (outputs.store) {
+                    segment_store_update_codecpar(outputs.store, codecpar);
+                }
+            }
+        }
+        int frame_step = config->abr_enabled ? abr.fps_div : 1;
+        if (activity && activity_frame_step(activity) > frame_step) {
+            frame_step = activity_frame_step(activity);
+        }
+        if (frame_step > 1 && frame_no % frame_step != 0) {
             continue;
         }
-
-        //RGB转NV12
-        convert_color(mgr->RGB_buffer, mgr->encode_buffer, width, height, RK_FORMAT_RGB_888, RK_FORMAT_YCbCr_420_SP);
-
-                // 准备源数据指针
-        const uint8_t *src_data[2] = {
-            (uint8_t*)mgr->encode_buffer,                         // Y平面
-            (uint8_t*)mgr->encode_buffer + (width * height)       // UV平面
-        };
-        int src_linesize[2] = { width, width };  // NV12格式的跨步
-
-        sws_scale(sws_ctx, src_data, src_linesize, 0, height,
-                  frame->data, frame->linesize);
+        outputs.frame_duration = frame_clock_duration(&clock, frame_step);
+        
+        // 子码流不受ABR影响: 始终从全分辨率RGB帧缩放，帧率跟随主码流
+        if (outputs.substream) {
+            substream_encode(outputs.substream, mgr->RGB_buffer, width, height, frame_pts,
+                             outputs.frame_duration);
+        }
+        
+        // 取一个编码器已释放的DMA缓冲区，全部占用时丢弃本帧
+        int slot = dma_frame_pool_acquire(pool);
+        if (slot < 0) {
+            if (++dropped % 100 == 1) {
+                fprintf(stderr, "No free DMA frame, dropped %d frames\n", dropped);
+            }
+            continue;
+        }
+        dma_frame_slot_t *s = &pool->slots[slot];
         
+        //RGB转NV12，由RGA直接写入DMA-BUF，ABR降分辨率时同时缩放
+        int ret = convert_RGB_to_NV12_dma_buf(mgr->RGB_buffer, s->fd, s->map, width, height,
+                                              enc_width, enc_height, s->pitch, s->vstride);
+        if (ret != IM_STATUS_SUCCESS) {
+            // 缓冲区里是上一次的内容，不能送给编码器
+            dma_frame_pool_release(pool, slot);
+            continue;
+        }
+        
+        AVFrame *hw_frame = dma_frame_pool_wrap(pool, slot);
+        if (!hw_frame) {
+            fprintf(stderr, "Could not wrap DMA frame\n");
+            continue;
+        }
         // 设置帧的PTS
-        frame->pts = pts++;
+        hw_frame->pts = frame_pts;
         
-        // 将帧发送给编码器
-        int ret = avcodec_send_frame(codec_ctx, frame);
+        if (roi) {
+            roi_attach(roi, hw_frame, &mgr->detect_result, width, height, config->encoder.gop_size);
+        }
+        
+        // 推流重连后立即输出IDR，观众无需等待下一个GOP
+        int force_idr = stream_fanout_keyframe_requested(fanout);
+        // 低延迟模式只有帧内刷新，录像分片和事件片段要开始时才插入真正的IDR
+        if (outputs.store && segment_store_keyframe_requested(outputs.store) && config->encoder.low_latency) {
+            force_idr = 1;
+        }
+        if (outputs.recorder && event_recorder_keyframe_requested(outputs.recorder) &&
+            config->encoder.low_latency) {
+            force_idr = 1;
+        }
+        if (force_idr) {
+            encoder_force_idr(enc);
+        }
+        
+        // 将帧发送给编码器，编码器持有引用直到DMA缓冲区用完
+        ret = encoder_send_frame(enc, hw_frame);
+        av_frame_free(&hw_frame);
         if (ret < 0) {
             fprintf(stderr, "Error sending a frame for encoding\n");
             continue;
         }
         
         // 从编码器接收数据包
-        while (ret >= 0) {
-            ret = avcodec_receive_packet(codec_ctx, pkt);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                break;
-            } else if (ret < 0) {
-                fprintf(stderr, "Error during encoding\n");
-                break;
-            }
-            
-            // 转换时间基准
-            av_packet_rescale_ts(pkt, codec_ctx->time_base, stream->time_base);
-            pkt->stream_index = stream->index;
-            
-            // 写入数据包到RTMP流
-            ret = av_write_frame(out_ctx, pkt);
-            if (ret < 0) {
-                fprintf(stderr, "Error writing packet\n");
-                break;
-            }
-            
-            frame_count++;
-            if (frame_count % 100 == 0) {
-                printf("Streamed %d frames\n", frame_count);
-            }
-        }
+        drain_encoder(enc, pkt, &outputs, &frame_count);
     }
     
-    // 写入流尾
-    av_write_trailer(out_ctx);
+    // 停止所有写线程并写入流尾
+    stream_fanout_stop(fanout);
+    if (outputs.substream) {
+        substream_stop(outputs.substream);
+    }
     
-    // 清理资源
-    sws_freeContext(sws_ctx);
+    // 清理资源，编码器释放帧引用后才能销毁DMA帧池
+    avcodec_parameters_free(&codecpar);
     av_packet_free(&pkt);
-    av_frame_free(&frame);
-    avcodec_free_context(&codec_ctx);
-    avio_closep(&out_ctx->pb);
-    avformat_free_context(out_ctx);
+    encoder_close(enc);
+    destroy_dma_frame_pool(pool);
+    roi_destroy(roi);
+    activity_destroy(activity);
     
-    printf("Encode thread exiting, streamed %d frames to %s\n", frame_count, rtmp_url);
+    printf("Stream time drift %lld ms over %llu frames (%llu rebases, %llu repeated timestamps)\n",
+           (long long)frame_clock_drift_us(&clock) / 1000, (unsigned long long)clock.frames,
+           (unsigned long long)clock.rebases, (unsigned long long)clock.bumped);
+    printf("Encode thread exiting, encoded %d frames\n", frame_count);
     return NULL;
 }
 
 
-int main_multithreaded(struct v4l2_dev *camdev, int width, int height) {
+// 一个摄像头的完整管线: 采集、推理提交、叠加(显示)和编码各一个线程
+typedef struct {
+    thread_params_t params;
+    pthread_t capture_thread;
+    pthread_t inference_thread;
+    pthread_t display_thread;
+    pthread_t encode_thread;
+} camera_pipeline_t;
+
+static void camera_pipeline_start(camera_pipeline_t *p) {
+    pthread_create(&p->capture_thread, NULL, video_capture_thread_func, &p->params);
+    pthread_create(&p->inference_thread, NULL, Inference_thread_func, &p->params);
+    pthread_create(&p->display_thread, NULL, display_thread_func, &p->params);
+    pthread_create(&p->encode_thread, NULL, encode_thread_func, &p->params);
+}
+
+static void camera_pipeline_stop(camera_pipeline_t *p) {
+    buffer_manager_t *mgr = p->params.buffer_mgr;
+    mgr->running = 0;
+    sem_post(&mgr->filled_sem);
+    sem_post(&mgr->encode_sem);
+    sem_post(&mgr->display_sem);
+    sem_post(&mgr->empty_sem);
+    pthread_join(p->capture_thread, NULL);
+    pthread_join(p->inference_thread, NULL);
+    pthread_join(p->display_thread, NULL);
+    pthread_join(p->encode_thread, NULL);
+}
+
+// 附加摄像头: 只有自己的输出，音频、录像和内置服务器都属于主摄像头
+static stream_fanout_t* open_camera_fanout(const app_config_t *config, const camera_config_t *cam) {
+    stream_fanout_t *fanout = stream_fanout_create(config->queue_size);
+    if (!fanout) {
+        return NULL;
+    }
+    fanout->rtmp_lite = config->rtmp_lite;
+    fanout->rtmp_chunk_size = config->rtmp_chunk_size;
+    for (int i = 0; i < cam->sink_count; i++) {
+        stream_fanout_add(fanout, cam->sinks[i]);
+    }
+    return fanout;
+}
+
+static volatile int reload_signal_stop = 0;
+
+// 收到SIGHUP时从原路径重新加载检测模型，替换了磁盘上的模型文件后用
+static void* reload_signal_thread(void *arg) {
+    npu_scheduler_t *npu = (npu_scheduler_t*)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    int sig;
+    while (sigwait(&set, &sig) == 0 && !reload_signal_stop) {
+        npu_scheduler_reload(npu, NULL, NULL);
+    }
+    return NULL;
+}
+
+// "cam N ..." 中的N，无效时返回NULL
+static camera_pipeline_t* console_camera(camera_pipeline_t *pipelines, int count, const char **cmd) {
+    char *end;
+    long id = strtol(*cmd, &end, 10);
+    if (end != *cmd && *end == ' ') {
+        for (int i = 0; i < count; i++) {
+            if (pipelines[i].params.camera_id == id) {
+                *cmd = end + 1;
+                return &pipelines[i];
+            }
+        }
+    }
+    printf("No such camera\n");
+    return NULL;
+}
+
+// 等待一行控制台输入，同时等待致命错误通知。
+// 返回0读到一行，-1输入结束，1有管线无法继续
+static int read_console_line(char *line, int size) {
+    struct pollfd pfd[2] = { { STDIN_FILENO, POLLIN, 0 }, { fatal_pipe[0], POLLIN, 0 } };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (pfd[1].revents) {
+            return 1;
+        }
+        if (pfd[0].revents) {
+            return fgets(line, size, stdin) ? 0 : -1;
+        }
+    }
+}
+
+int main_multithreaded(struct v4l2_dev **camdevs, int camera_count, const app_config_t *config) {
+    struct v4l2_dev *camdev = camdevs[0];
+    int width = camdev->width;
+    int height = camdev->height;
     // 初始化缓冲区管理器，使用2个缓冲区，传入宽高参数
     buffer_manager_t *buffer_mgr = init_buffer_manager(2, width, height);
     if (!buffer_mgr) {
@@ -578,38 +941,306 @@ int main_multithreaded(struct v4l2_dev *camdev, int width, int height) {
         return -1;
     }
     
+    // SIGHUP只由reload_signal_thread接收，之后创建的线程都继承这个屏蔽
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+
+    // 所有摄像头共用一个NPU调度器，模型只加载一次
+    npu_scheduler_t *npu = npu_scheduler_create(&config->npu);
+    pthread_t reload_thread;
+    if (!npu) {
+        fprintf(stderr, "Detection disabled\n");
+    } else {
+        pthread_create(&reload_thread, NULL, reload_signal_thread, npu);
+    }
+    
+    // 音频可选，打不开声卡时只推视频
+    audio_capture_t *audio = NULL;
+    int queue_size = config->queue_size;
+    if (config->audio.device) {
+        audio = audio_capture_open(&config->audio);
+        if (!audio) {
+            fprintf(stderr, "Audio disabled\n");
+        } else {
+            // 队列按包计数，AAC每1024个样本一个包，放大队列以保持相同的缓冲时长
+            int audio_pps = config->audio.sample_rate / 1024 + 1;
+            queue_size += queue_size * ((audio_pps + config->encoder.fps - 1) / config->encoder.fps);
+        }
+    }
+    
+    // 输出在运行中可以通过控制台增删
+    stream_fanout_t *fanout = stream_fanout_create(queue_size);
+    if (!fanout) {
+        audio_capture_close(audio);
+        npu_scheduler_destroy(npu);
+        destroy_buffer_manager(buffer_mgr);
+        return -1;
+    }
+    if (audio) {
+        AVCodecParameters *audio_par = avcodec_parameters_alloc();
+        AVRational audio_tb;
+        if (!audio_par || audio_capture_codecpar(audio, audio_par, &audio_tb) < 0 ||
+            stream_fanout_set_audio(fanout, audio_par, audio_tb) < 0 || audio_capture_start(audio) < 0) {
+            fprintf(stderr, "Could not set up the audio stream, audio disabled\n");
+            audio_capture_close(audio);
+            audio = NULL;
+        }
+        avcodec_parameters_free(&audio_par);
+    }
+    // 内置服务器: 局域网观众直接从本进程拉流，省去一跳RTMP中转
+    live_server_t *live = NULL;
+    if (config->live.http_port || config->live.rtsp_port) {
+        live = live_server_open(&config->live);
+        if (!live) {
+            fprintf(stderr, "Live server disabled\n");
+        } else if (audio) {
+            AVCodecParameters *audio_par = avcodec_parameters_alloc();
+            AVRational audio_tb;
+            if (audio_par && audio_capture_codecpar(audio, audio_par, &audio_tb) >= 0) {
+                live_server_set_audio(live, audio_par, audio_tb);
+            }
+            avcodec_parameters_free(&audio_par);
+        }
+    }
+    rtp_multicast_t *multicast = NULL;
+    if (config->multicast.group) {
+        multicast = rtp_multicast_open(&config->multicast);
+    }
+    event_recorder_t *recorder = NULL;
+    if (config->event.dir) {
+        recorder = event_recorder_create(&config->event, config->encoder.fps, config->encoder.gop_size);
+    }
+    // 连续录像的槽位按可能出现的最高码率预分配
+    segment_store_t *store = NULL;
+    if (config->store.dir) {
+        int64_t bit_rate = config->encoder.bit_rate;
+        if (config->abr_enabled && config->abr.max_bit_rate > bit_rate) {
+            bit_rate = config->abr.max_bit_rate;
+        }
+        store = segment_store_open(&config->store, bit_rate);
+    }
+    fanout->rtmp_lite = config->rtmp_lite;
+    fanout->rtmp_chunk_size = config->rtmp_chunk_size;
+    for (int i = 0; i < config->sink_count; i++) {
+        stream_fanout_add(fanout, config->sinks[i]);
+    }
+    // 子码流: 给手机观看和缩略图的低分辨率副本，有自己的一组输出
+    substream_t *substream = NULL;
+    if (config->substream.sink_count > 0) {
+        stream_fanout_t *sub_fanout = stream_fanout_create(queue_size);
+        if (sub_fanout) {
+            sub_fanout->rtmp_lite = config->rtmp_lite;
+            sub_fanout->rtmp_chunk_size = config->rtmp_chunk_size;
+            if (audio) {
+                AVCodecParameters *audio_par = avcodec_parameters_alloc();
+                AVRational audio_tb;
+                if (audio_par && audio_capture_codecpar(audio, audio_par, &audio_tb) >= 0) {
+                    stream_fanout_set_audio(sub_fanout, audio_par, audio_tb);
+                }
+                avcodec_parameters_free(&audio_par);
+            }
+            for (int i = 0; i < config->substream.sink_count; i++) {
+                stream_fanout_add(sub_fanout, config->substream.sinks[i]);
+            }
+            substream = substream_create(&config->substream, sub_fanout);
+        }
+    }
+    
+    // 第二级: 主摄像头的检测框裁剪后交给分类模型
+    cascade_t *cascade = NULL;
+    if (npu && config->cascade.model) {
+        cascade = cascade_create(&config->cascade, npu);
+        if (!cascade) {
+            fprintf(stderr, "Cascade disabled\n");
+        }
+    }
+    
     // 设置线程参数
-    thread_params_t params = {
+    camera_pipeline_t pipelines[APP_MAX_CAMERAS];
+    memset(pipelines, 0, sizeof(pipelines));
+    pipelines[0].params = (thread_params_t){
+        .camera_id = 0,
         .camdev = camdev, 
         .buffer_mgr = buffer_mgr,
         .width = width,
         .height = height,
+        .screen_size = 0,
+        .display = 1,
+        .npu = npu,
+        .npu_client = npu ? npu_scheduler_add_client(npu, 0, width, height, config->det_weight,
+                                                     config->det_fps) : NULL,
+        .config = config,
+        .fanout = fanout,
+        .recorder = recorder,
+        .store = store,
+        .audio = audio,
+        .live = live,
+        .multicast = multicast,
+        .substream = substream,
+        .cascade = cascade,
     };
+    if (cascade && pipelines[0].params.npu_client) {
+        npu_client_set_result_hook(pipelines[0].params.npu_client, cascade_on_detection, cascade);
+    }
+    // 附加摄像头各自一套缓冲区、线程和输出，只有NPU是共享的
+    int pipeline_count = 1;
+    for (int i = 1; i < camera_count; i++) {
+        const camera_config_t *cam = &config->cameras[i - 1];
+        buffer_manager_t *mgr = init_buffer_manager(2, camdevs[i]->width, camdevs[i]->height);
+        stream_fanout_t *cam_fanout = mgr ? open_camera_fanout(config, cam) : NULL;
+        if (!cam_fanout) {
+            fprintf(stderr, "Camera %d (%s) disabled\n", i, cam->source);
+            destroy_buffer_manager(mgr);
+            continue;
+        }
+        pipelines[pipeline_count++].params = (thread_params_t){
+            .camera_id = i,
+            .camdev = camdevs[i],
+            .buffer_mgr = mgr,
+            .width = camdevs[i]->width,
+            .height = camdevs[i]->height,
+            .screen_size = 0,
+            .display = 0,
+            .npu = npu,
+            .npu_client = npu ? npu_scheduler_add_client(npu, i, camdevs[i]->width, camdevs[i]->height,
+                                                         cam->det_weight, cam->det_fps) : NULL,
+            .config = config,
+            .fanout = cam_fanout,
+        };
+    }
     
+    // stdin不缓冲: poll看到的就是fgets还没读的内容
+    if (pipe(fatal_pipe) < 0) {
+        perror("pipe");
+    }
+    setvbuf(stdin, NULL, _IONBF, 0);
+
     // 创建线程
-    pthread_t video_capture_thread, Inference_thread, encode_thread, display_thread;
-    pthread_create(&video_capture_thread, NULL, video_capture_thread_func, &params);
-    pthread_create(&Inference_thread, NULL, Inference_thread_func, &params);
-    pthread_create(&display_thread, NULL, display_thread_func, &params);
-    pthread_create(&encode_thread, NULL, encode_thread_func, &params);
+    for (int i = 0; i < pipeline_count; i++) {
+        camera_pipeline_start(&pipelines[i]);
+    }
+    pthread_t audio_thread;
+    if (audio) {
+        pthread_create(&audio_thread, NULL, audio_capture_thread_func, &pipelines[0].params);
+    }
     
-    // 等待用户输入来退出
-    printf("Press Enter to stop...\n");
-    getchar();
+    // 控制台命令: 增删输出，空行退出
+    printf("Commands: add [TYPE:]URL | del URL | sub add|del URL | cam N add|del URL | sinks | viewers"
+           " | npu | reload [MODEL [LABELS]] | Enter to stop\n");
+    char line[512];
+    int fatal = 0;
+    while ((fatal = read_console_line(line, sizeof(line))) == 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            break;
+        } else if (!strncmp(line, "add ", 4)) {
+            stream_fanout_add(fanout, line + 4);
+        } else if (!strncmp(line, "del ", 4)) {
+            stream_fanout_remove(fanout, line + 4);
+        } else if (!strncmp(line, "sub ", 4)) {
+            if (!substream) {
+                printf("Substream is off, start with --sub-sink to enable it\n");
+            } else if (!strncmp(line + 4, "add ", 4)) {
+                stream_fanout_add(substream->fanout, line + 8);
+            } else if (!strncmp(line + 4, "del ", 4)) {
+                stream_fanout_remove(substream->fanout, line + 8);
+            } else {
+                printf("Unknown command '%s'\n", line);
+            }
+        } else if (!strncmp(line, "cam ", 4)) {
+            const char *cmd = line + 4;
+            camera_pipeline_t *p = console_camera(pipelines, pipeline_count, &cmd);
+            if (!p) {
+                continue;
+            } else if (!strncmp(cmd, "add ", 4)) {
+                stream_fanout_add(p->params.fanout, cmd + 4);
+            } else if (!strncmp(cmd, "del ", 4)) {
+                stream_fanout_remove(p->params.fanout, cmd + 4);
+            } else {
+                printf("Unknown command '%s'\n", line);
+            }
+        } else if (!strcmp(line, "sinks")) {
+            for (int i = 0; i < pipeline_count; i++) {
+                if (pipeline_count > 1) {
+                    printf("Camera %d (%s):\n", pipelines[i].params.camera_id,
+                           pipelines[i].params.camdev->path);
+                }
+                stream_fanout_list(pipelines[i].params.fanout);
+            }
+            if (substream) {
+                printf("Substream %dx%d:\n", substream->cfg.width, substream->cfg.height);
+                stream_fanout_list(substream->fanout);
+            }
+        } else if (!strcmp(line, "viewers")) {
+            if (live) {
+                live_server_list(live);
+            } else {
+                printf("Built-in server is off\n");
+            }
+        } else if (!strcmp(line, "npu")) {
+            if (npu) {
+                npu_scheduler_print_stats(npu);
+                if (cascade) {
+                    cascade_print_stats(cascade);
+                }
+            } else {
+                printf("Detection is off\n");
+            }
+        } else if (!strcmp(line, "reload") || !strncmp(line, "reload ", 7)) {
+            // 不带参数时从原路径重新读，模型和标签文件可以先在磁盘上替换
+            char model[NPU_PATH_MAX] = "";
+            char labels[NPU_PATH_MAX] = "";
+            sscanf(line + 6, "%255s %255s", model, labels);
+            if (npu) {
+                npu_scheduler_reload(npu, model[0] ? model : NULL, labels[0] ? labels : NULL);
+            } else {
+                printf("Detection is off\n");
+            }
+        } else {
+            printf("Unknown command '%s'\n", line);
+        }
+    }
 
     // 停止所有线程
-    buffer_mgr->running = 0;
-    sem_post(&buffer_mgr->filled_sem);
-    sem_post(&buffer_mgr->encode_sem);
-    sem_post(&buffer_mgr->display_sem);
-    sem_post(&buffer_mgr->empty_sem);
-    pthread_join(video_capture_thread, NULL);
-    pthread_join(Inference_thread, NULL);
-    pthread_join(display_thread, NULL);
-    pthread_join(encode_thread, NULL);
+    for (int i = 0; i < pipeline_count; i++) {
+        camera_pipeline_stop(&pipelines[i]);
+    }
+    if (audio) {
+        pthread_join(audio_thread, NULL);
+    }
+    if (npu) {
+        npu_scheduler_print_stats(npu);
+    }
+    if (cascade) {
+        cascade_print_stats(cascade);
+    }
+    if (npu) {
+        reload_signal_stop = 1;
+        pthread_kill(reload_thread, SIGHUP);
+        pthread_join(reload_thread, NULL);
+    }
+    npu_scheduler_destroy(npu);
+    // 调度器销毁时还会回调排队中的任务，之后才能释放
+    cascade_destroy(cascade);
+    for (int i = 1; i < pipeline_count; i++) {
+        stream_fanout_destroy(pipelines[i].params.fanout);
+        destroy_buffer_manager(pipelines[i].params.buffer_mgr);
+    }
+    stream_fanout_destroy(fanout);
+    substream_destroy(substream);
+    live_server_close(live);
+    rtp_multicast_close(multicast);
+    audio_capture_close(audio);
+    event_recorder_destroy(recorder);
+    segment_store_close(store);
     // 清理缓冲区管理器
     destroy_buffer_manager(buffer_mgr);
+    close(fatal_pipe[0]);
+    close(fatal_pipe[1]);
+    fatal_pipe[0] = fatal_pipe[1] = -1;
 
     printf("Main thread exiting\n");
-    return 0;
+    return fatal > 0 ? -1 : 0;
 }
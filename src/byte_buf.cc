@@ -0,0 +1,88 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "byte_buf.h"
+
+int byte_buf_reserve(byte_buf_t *b, size_t extra) {
+    if (b->error) {
+        return -1;
+    }
+    if (b->size + extra <= b->capacity) {
+        return 0;
+    }
+    size_t capacity = b->capacity ? b->capacity : 256;
+    while (capacity < b->size + extra) {
+        capacity *= 2;
+    }
+    uint8_t *data = (uint8_t*)realloc(b->data, capacity);
+    if (!data) {
+        b->error = 1;
+        return -1;
+    }
+    b->data = data;
+    b->capacity = capacity;
+    return 0;
+}
+
+void byte_buf_append(byte_buf_t *b, const void *data, size_t size) {
+    if (byte_buf_reserve(b, size) < 0) {
+        return;
+    }
+    memcpy(b->data + b->size, data, size);
+    b->size += size;
+}
+
+void byte_buf_printf(byte_buf_t *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    // vsnprintf还要写结尾的0
+    if (n < 0 || byte_buf_reserve(b, n + 1) < 0) {
+        b->error = 1;
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf((char*)b->data + b->size, n + 1, fmt, ap);
+    va_end(ap);
+    b->size += n;
+}
+
+void byte_buf_u8(byte_buf_t *b, uint8_t v) {
+    byte_buf_append(b, &v, 1);
+}
+
+void byte_buf_be16(byte_buf_t *b, uint16_t v) {
+    uint8_t p[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+    byte_buf_append(b, p, sizeof(p));
+}
+
+void byte_buf_be24(byte_buf_t *b, uint32_t v) {
+    uint8_t p[3] = { (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    byte_buf_append(b, p, sizeof(p));
+}
+
+void byte_buf_be32(byte_buf_t *b, uint32_t v) {
+    uint8_t p[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    byte_buf_append(b, p, sizeof(p));
+}
+
+void byte_buf_patch_be24(byte_buf_t *b, size_t offset, uint32_t v) {
+    if (b->error || offset + 3 > b->size) {
+        return;
+    }
+    b->data[offset] = (uint8_t)(v >> 16);
+    b->data[offset + 1] = (uint8_t)(v >> 8);
+    b->data[offset + 2] = (uint8_t)v;
+}
+
+void byte_buf_reset(byte_buf_t *b) {
+    b->size = 0;
+    b->error = 0;
+}
+
+void byte_buf_free(byte_buf_t *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <linux/v4l2-subdev.h>
 
 #include "camera.h"
@@ -14,7 +16,9 @@ void close_device(struct v4l2_dev *dev)
 {
     if (dev->buffers) {
         for (unsigned int i = 0; i < dev->req_count; ++i) {
-            if (dev->buffers[i].start) {
+            if (dev->buffers[i].start && dev->is_file) {
+                free(dev->buffers[i].start);
+            } else if (dev->buffers[i].start) {
                 munmap(dev->buffers[i].start, dev->buffers[i].length);
             }
         }
@@ -216,9 +220,57 @@ void stream_on(struct v4l2_dev *dev)
     return;
 }
 
+// Raw NV12 file played in a loop, so the pipeline can run without a sensor
+static void file_source_init(struct v4l2_dev *dev)
+{
+    dev->fd = open(dev->path, O_RDONLY | O_CLOEXEC);
+    if (dev->fd < 0) {
+        printf("Cannot open %s\n\n", dev->path);
+        exit_failure(dev);
+    }
+    dev->is_file = 1;
+    dev->req_count = 1;
+    dev->data_len = dev->width * dev->height * 3 / 2;
+    dev->buffers = (struct buffer *)calloc(1, sizeof(*(dev->buffers)));
+    if (!dev->buffers) {
+        exit_failure(dev);
+    }
+    dev->buffers[0].length = dev->data_len;
+    dev->buffers[0].start = malloc(dev->data_len);
+    if (!dev->buffers[0].start) {
+        printf("Out of memory!\n");
+        exit_failure(dev);
+    }
+    printf("Open file source %s (%dx%d NV12)\n\n", dev->path, dev->width, dev->height);
+}
+
+static void file_source_get_frame(struct v4l2_dev *dev)
+{
+    struct timespec ts;
+    ssize_t n = read(dev->fd, dev->buffers[0].start, dev->data_len);
+    if (n < dev->data_len) {
+        // 文件结束，从头循环
+        lseek(dev->fd, 0, SEEK_SET);
+        n = read(dev->fd, dev->buffers[0].start, dev->data_len);
+        if (n < dev->data_len) {
+            printf("File source %s is shorter than one frame\n", dev->path);
+            exit_failure(dev);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    dev->out_data = (unsigned char *)dev->buffers[0].start;
+    dev->timestamp = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 void get_frame(struct v4l2_dev *dev, int skip_frame)
 {
     struct v4l2_buffer buf;
+    if (dev->is_file) {
+        for (int i = 0; i <= skip_frame; ++i) {
+            file_source_get_frame(dev);
+        }
+        return;
+    }
     struct v4l2_plane planes[FMT_NUM_PLANES];
     for (int i = 0; i <= skip_frame; ++i) {
         memset(&buf, 0, sizeof(buf));
@@ -238,7 +290,16 @@ void get_frame(struct v4l2_dev *dev, int skip_frame)
 
         dev->out_data = (unsigned char *)dev->buffers[buf.index].start;
 
-        dev->timestamp = buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        // 驱动在帧开始时打的单调时钟时间戳，不受用户态调度延迟影响；
+        // 不提供单调时间戳的驱动退回到出队时刻
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC &&
+            (buf.timestamp.tv_sec || buf.timestamp.tv_usec)) {
+            dev->timestamp = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            dev->timestamp = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
 
         if (ioctl(dev->fd, VIDIOC_QBUF, &buf) == -1) {
             printf("VIDIOC_QBUF failed!\n");
@@ -304,6 +365,11 @@ void set_fps(struct v4l2_dev *dev, unsigned int fps)
 
 void camera_init(struct v4l2_dev *dev)
 {
+    struct stat st;
+    if (stat(dev->path, &st) == 0 && S_ISREG(st.st_mode)) {
+        file_source_init(dev);
+        return;
+    }
     open_device(dev);
     get_capabilities(dev);
     set_fmt(dev);
@@ -316,6 +382,7 @@ void camera_init(struct v4l2_dev *dev)
 
 void camera_deinit(struct v4l2_dev *dev)
 {
-    stream_off(dev);
+    if (!dev->is_file)
+        stream_off(dev);
     close_device(dev);
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cascade.h"
+#include "packet_queue.h"
+#include "rga/im2d.h"
+#include "rga/rga.h"
+
+// 一次检测的裁剪任务: 推理完成前记住每个输入对应哪个框
+typedef struct {
+    cascade_t *cc;
+    uint64_t seq;
+    int count;
+    int det_index[NPU_JOB_MAX_INPUTS];
+    BOX_RECT boxes[NPU_JOB_MAX_INPUTS];
+    int class_ids[NPU_JOB_MAX_INPUTS];
+} cascade_pending_t;
+
+void cascade_config_default(cascade_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->min_size = 32;
+    cfg->max_crops = 8;
+    cfg->deadline_ms = 500;
+}
+
+static void parse_classes(cascade_t *cc, const char *list) {
+    const char *p = list;
+    while (*p && cc->class_count < CASCADE_MAX_CLASSES) {
+        size_t len = strcspn(p, ",");
+        if (len > 0 && len < OBJ_NAME_MAX_SIZE) {
+            memcpy(cc->classes[cc->class_count], p, len);
+            cc->classes[cc->class_count][len] = '\0';
+            cc->class_count++;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+}
+
+static void load_labels(cascade_t *cc, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return;
+    }
+    char line[256];
+    while (cc->label_count < CASCADE_MAX_LABELS && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        cc->labels[cc->label_count++] = strdup(line);
+    }
+    fclose(fp);
+}
+
+cascade_t* cascade_create(const cascade_config_t *cfg, npu_scheduler_t *npu) {
+    int model = npu_scheduler_find_model(npu, cfg->model);
+    if (model < 0) {
+        fprintf(stderr, "Cascade model %s is not loaded\n", cfg->model);
+        return NULL;
+    }
+    cascade_t *cc = (cascade_t*)calloc(1, sizeof(cascade_t));
+    if (!cc) {
+        perror("Failed to allocate cascade");
+        return NULL;
+    }
+    cc->cfg = *cfg;
+    if (cc->cfg.max_crops > NPU_JOB_MAX_INPUTS) {
+        cc->cfg.max_crops = NPU_JOB_MAX_INPUTS;
+    }
+    cc->npu = npu;
+    cc->model = model;
+    cc->use_rga = 1;
+    if (cfg->classes) {
+        parse_classes(cc, cfg->classes);
+    }
+    if (cfg->labels) {
+        load_labels(cc, cfg->labels);
+    }
+    pthread_mutex_init(&cc->mutex, NULL);
+    const npu_model_t *m = &npu->models[model];
+    printf("Cascade: %s on %s crops, %dx%d, up to %d per frame\n", cfg->model,
+           cfg->classes ? cfg->classes : "all", m->input_width, m->input_height, cc->cfg.max_crops);
+    return cc;
+}
+
+static int wanted(const cascade_t *cc, const detect_result_t *det) {
+    if (det->box.right - det->box.left < cc->cfg.min_size || det->box.bottom - det->box.top < cc->cfg.min_size) {
+        return 0;
+    }
+    if (cc->class_count == 0) {
+        return 1;
+    }
+    for (int i = 0; i < cc->class_count; i++) {
+        if (!strcmp(det->name, cc->classes[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// NV12的色度是2x2采样，裁剪起点和尺寸取偶数
+static im_rect crop_rect(const BOX_RECT *box, int width, int height) {
+    im_rect r;
+    r.x = box->left < 0 ? 0 : box->left & ~1;
+    r.y = box->top < 0 ? 0 : box->top & ~1;
+    int right = box->right < width ? box->right : width;
+    int bottom = box->bottom < height ? box->bottom : height;
+    r.width = (right - r.x) & ~1;
+    r.height = (bottom - r.y) & ~1;
+    if (r.width < 2) r.width = 2;
+    if (r.height < 2) r.height = 2;
+    if (r.x + r.width > width) r.x = width - r.width;
+    if (r.y + r.height > height) r.y = height - r.height;
+    return r;
+}
+
+// 所有框在一个RGA任务里裁剪、缩放并转RGB，输出首尾相接就是模型的批量输入
+static int crop_rga(const unsigned char *nv12, int width, int height, const im_rect *rects, int count,
+                    unsigned char *dst_buf, int dst_w, int dst_h) {
+    im_job_handle_t job = imbeginJob();
+    if (!job) {
+        return -1;
+    }
+    rga_buffer_t src = wrapbuffer_virtualaddr((void*)nv12, width, height, RK_FORMAT_YCbCr_420_SP);
+    rga_buffer_t dst = wrapbuffer_virtualaddr((void*)dst_buf, dst_w, dst_h * count, RK_FORMAT_RGB_888);
+    rga_buffer_t pat;
+    memset(&pat, 0, sizeof(pat));
+    im_rect prect = {0, 0, 0, 0};
+    for (int i = 0; i < count; i++) {
+        im_rect drect = {0, i * dst_h, dst_w, dst_h};
+        int ret = improcessTask(job, src, dst, pat, rects[i], drect, prect, NULL, 0);
+        if (ret != IM_STATUS_SUCCESS) {
+            printf("Cascade crop failed: %s\n", imStrError((IM_STATUS)ret));
+            imcancelJob(job);
+            return -1;
+        }
+    }
+    int ret = imendJob(job);
+    if (ret != IM_STATUS_SUCCESS) {
+        printf("Cascade crop job failed: %s\n", imStrError((IM_STATUS)ret));
+        return -1;
+    }
+    return 0;
+}
+
+// 主机上没有RGA: libswscale(自带SIMD)逐个框缩放
+static int crop_sw(cascade_t *cc, const unsigned char *nv12, int width, int height, const im_rect *rects,
+                   int count, unsigned char *dst_buf, int dst_w, int dst_h) {
+    int ret = 0;
+    pthread_mutex_lock(&cc->mutex);
+    for (int i = 0; i < count && ret == 0; i++) {
+        const im_rect *r = &rects[i];
+        cc->sws = sws_getCachedContext(cc->sws, r->width, r->height, AV_PIX_FMT_NV12,
+                                       dst_w, dst_h, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+        if (!cc->sws) {
+            ret = -1;
+            break;
+        }
+        const uint8_t *src[2] = { nv12 + (size_t)r->y * width + r->x,
+                                  nv12 + (size_t)width * height + (size_t)(r->y / 2) * width + r->x };
+        int src_stride[2] = { width, width };
+        uint8_t *dst[1] = { dst_buf + (size_t)i * dst_w * dst_h * 3 };
+        int dst_stride[1] = { dst_w * 3 };
+        ret = sws_scale(cc->sws, src, src_stride, 0, r->height, dst, dst_stride) > 0 ? 0 : -1;
+    }
+    pthread_mutex_unlock(&cc->mutex);
+    return ret;
+}
+
+// 分数之和不是1时当作logits做softmax
+static int best_class(const float *out, int n, float *prop) {
+    int best = 0;
+    float sum = 0;
+    int probs = 1;
+    for (int i = 0; i < n; i++) {
+        if (out[i] > out[best]) best = i;
+        if (out[i] < 0 || out[i] > 1) probs = 0;
+        sum += out[i];
+    }
+    if (probs && fabsf(sum - 1.0f) < 0.01f) {
+        *prop = out[best];
+        return best;
+    }
+    float denom = 0;
+    for (int i = 0; i < n; i++) {
+        denom += expf(out[i] - out[best]);
+    }
+    *prop = 1.0f / denom;
+    return best;
+}
+
+static void cascade_done(void *opaque, const float *outputs, int count, int output_size) {
+    cascade_pending_t *p = (cascade_pending_t*)opaque;
+    cascade_t *cc = p->cc;
+    pthread_mutex_lock(&cc->mutex);
+    if (!outputs) {
+        cc->dropped++;
+    } else {
+        cc->classified += count;
+        // 几个worker并行时旧帧的结果可能后到，不覆盖更新的
+        if (p->seq >= cc->latest.seq || cc->latest.count == 0) {
+            cascade_result_t *r = &cc->latest;
+            r->seq = p->seq;
+            r->count = count;
+            for (int i = 0; i < count; i++) {
+                r->det_index[i] = p->det_index[i];
+                r->boxes[i] = p->boxes[i];
+                r->class_ids[i] = p->class_ids[i];
+                r->attr[i] = best_class(outputs + (size_t)i * output_size, output_size, &r->prop[i]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cc->mutex);
+    free(p);
+}
+
+void cascade_on_detection(void *opaque, const unsigned char *nv12, int width, int height,
+                          const detect_result_group_t *result, uint64_t seq) {
+    cascade_t *cc = (cascade_t*)opaque;
+    // 面积最大的几个框优先
+    int picked[NPU_JOB_MAX_INPUTS];
+    int areas[NPU_JOB_MAX_INPUTS];
+    int count = 0;
+    for (int i = 0; i < result->count; i++) {
+        const detect_result_t *det = &result->results[i];
+        if (!wanted(cc, det)) {
+            continue;
+        }
+        int area = (det->box.right - det->box.left) * (det->box.bottom - det->box.top);
+        int pos = count < cc->cfg.max_crops ? count : cc->cfg.max_crops;
+        while (pos > 0 && areas[pos - 1] < area) {
+            pos--;
+        }
+        if (pos >= cc->cfg.max_crops) {
+            continue;
+        }
+        for (int k = (count < cc->cfg.max_crops ? count : cc->cfg.max_crops - 1); k > pos; k--) {
+            picked[k] = picked[k - 1];
+            areas[k] = areas[k - 1];
+        }
+        picked[pos] = i;
+        areas[pos] = area;
+        if (count < cc->cfg.max_crops) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    const npu_model_t *m = &cc->npu->models[cc->model];
+    npu_job_t *job = npu_job_begin(cc->npu, cc->model, count);
+    cascade_pending_t *p = job ? (cascade_pending_t*)malloc(sizeof(cascade_pending_t)) : NULL;
+    if (!p) {
+        // 第二级跟不上时丢掉这一帧，下一帧的框还会再来
+        if (job) {
+            npu_job_cancel(cc->npu, job);
+        }
+        pthread_mutex_lock(&cc->mutex);
+        cc->dropped++;
+        pthread_mutex_unlock(&cc->mutex);
+        return;
+    }
+    im_rect rects[NPU_JOB_MAX_INPUTS];
+    p->cc = cc;
+    p->seq = seq;
+    p->count = count;
+    for (int i = 0; i < count; i++) {
+        const detect_result_t *det = &result->results[picked[i]];
+        p->det_index[i] = picked[i];
+        p->boxes[i] = det->box;
+        p->class_ids[i] = det->class_id;
+        rects[i] = crop_rect(&det->box, width, height);
+    }
+    int ret = -1;
+    if (__atomic_load_n(&cc->use_rga, __ATOMIC_RELAXED)) {
+        ret = crop_rga(nv12, width, height, rects, count, job->input, m->input_width, m->input_height);
+        if (ret < 0 && __atomic_exchange_n(&cc->use_rga, 0, __ATOMIC_RELAXED)) {
+            printf("Cascade: RGA cropping failed, using libswscale\n");
+        }
+    }
+    if (ret < 0) {
+        ret = crop_sw(cc, nv12, width, height, rects, count, job->input, m->input_width, m->input_height);
+    }
+    pthread_mutex_lock(&cc->mutex);
+    if (ret < 0) {
+        cc->dropped++;
+    } else {
+        cc->frames++;
+        cc->crops += count;
+    }
+    pthread_mutex_unlock(&cc->mutex);
+    if (ret < 0) {
+        npu_job_cancel(cc->npu, job);
+        free(p);
+        return;
+    }
+    npu_job_commit(cc->npu, job, monotonic_us() + (int64_t)cc->cfg.deadline_ms * 1000, cascade_done, p);
+}
+
+static float iou(const BOX_RECT *a, const BOX_RECT *b) {
+    int w = (a->right < b->right ? a->right : b->right) - (a->left > b->left ? a->left : b->left);
+    int h = (a->bottom < b->bottom ? a->bottom : b->bottom) - (a->top > b->top ? a->top : b->top);
+    if (w <= 0 || h <= 0) {
+        return 0;
+    }
+    float inter = (float)w * h;
+    float area_a = (float)(a->right - a->left) * (a->bottom - a->top);
+    float area_b = (float)(b->right - b->left) * (b->bottom - b->top);
+    return inter / (area_a + area_b - inter);
+}
+
+void cascade_annotate(cascade_t *cc, detect_result_group_t *group) {
+    pthread_mutex_lock(&cc->mutex);
+    const cascade_result_t *r = &cc->latest;
+    // 同一帧按下标对应; 之后的帧按同类别框的重叠度找回对应的目标
+    int exact = r->count > 0 && group->id == (int)r->seq;
+    for (int i = 0; i < group->count; i++) {
+        detect_result_t *det = &group->results[i];
+        det->attr_name[0] = '\0';
+        det->attr_prop = 0;
+        int match = -1;
+        float best = 0.3f;
+        for (int k = 0; k < r->count; k++) {
+            if (exact) {
+                if (r->det_index[k] == i) {
+                    match = k;
+                    break;
+                }
+                continue;
+            }
+            float o = r->class_ids[k] == det->class_id ? iou(&r->boxes[k], &det->box) : 0;
+            if (o > best) {
+                best = o;
+                match = k;
+            }
+        }
+        if (match < 0) {
+            continue;
+        }
+        int attr = r->attr[match];
+        if (attr < cc->label_count) {
+            snprintf(det->attr_name, sizeof(det->attr_name), "%s", cc->labels[attr]);
+        } else {
+            snprintf(det->attr_name, sizeof(det->attr_name), "attr%d", attr);
+        }
+        det->attr_prop = r->prop[match];
+    }
+    pthread_mutex_unlock(&cc->mutex);
+}
+
+void cascade_print_stats(cascade_t *cc) {
+    pthread_mutex_lock(&cc->mutex);
+    printf("Cascade %s: %llu frames, %llu crops (%s), %llu classified, %llu jobs dropped\n", cc->cfg.model,
+           (unsigned long long)cc->frames, (unsigned long long)cc->crops, cc->use_rga ? "RGA" : "libswscale",
+           (unsigned long long)cc->classified, (unsigned long long)cc->dropped);
+    pthread_mutex_unlock(&cc->mutex);
+}
+
+void cascade_destroy(cascade_t *cc) {
+    if (!cc) return;
+    for (int i = 0; i < cc->label_count; i++) {
+        free(cc->labels[i]);
+    }
+    sws_freeContext(cc->sws);
+    pthread_mutex_destroy(&cc->mutex);
+    free(cc);
+}
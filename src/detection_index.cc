@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "detection_index.h"
+
+// 每秒把当前块中新增的检测写入文件，异常退出最多丢失一秒的数据
+#define DETIDX_FLUSH_MS 1000
+
+// Column offsets inside a block
+#define COL_TIME    ((size_t)sizeof(detidx_block_header_t))
+#define COL_CLASS   (COL_TIME + DETIDX_BLOCK_ENTRIES * sizeof(uint32_t))
+#define COL_CONF    (COL_CLASS + DETIDX_BLOCK_ENTRIES * sizeof(uint8_t))
+#define COL_BOX     (COL_CONF + DETIDX_BLOCK_ENTRIES * sizeof(uint8_t))
+#define BLOCK_BYTES (COL_BOX + DETIDX_BLOCK_ENTRIES * 4 * sizeof(uint16_t))
+#define BLOCK_SIZE  ((BLOCK_BYTES + 4095) / 4096 * 4096)
+
+static inline detidx_block_header_t* block_header(uint8_t *block) {
+    return (detidx_block_header_t*)block;
+}
+
+static inline off_t block_offset(int index) {
+    return DETIDX_HEADER_SIZE + (off_t)index * BLOCK_SIZE;
+}
+
+static inline uint16_t quantise(int v, uint32_t size) {
+    if (v <= 0 || size == 0) return 0;
+    if ((uint32_t)v >= size) return 65535;
+    return (uint16_t)((uint64_t)v * 65535 / size);
+}
+
+static inline int dequantise(uint16_t q, uint32_t size) {
+    return (int)(((uint64_t)q * size + 32767) / 65535);
+}
+
+static int write_header(detection_index_t *idx) {
+    if (pwrite(idx->fd, &idx->header, sizeof(idx->header), 0) != (ssize_t)sizeof(idx->header)) {
+        perror("Failed to write detection index header");
+        return -1;
+    }
+    return 0;
+}
+
+static void start_block(detection_index_t *idx, int index) {
+    memset(idx->block, 0, BLOCK_SIZE);
+    block_header(idx->block)->magic = DETIDX_BLOCK_MAGIC;
+    idx->block_index = index;
+    idx->flushed = 0;
+    // 文件按整块扩展，查询时块数 = (文件大小 - 头) / 块大小
+    if (ftruncate(idx->fd, block_offset(index + 1)) < 0) {
+        perror("Failed to extend detection index");
+    }
+}
+
+// Writes the entries added since the last flush, then the block header, so
+// the header never claims entries that are not on disk yet
+static int flush_block(detection_index_t *idx) {
+    detidx_block_header_t *bh = block_header(idx->block);
+    int from = idx->flushed;
+    int to = bh->count;
+    if (from == to) {
+        return 0;
+    }
+    off_t base = block_offset(idx->block_index);
+    struct { size_t col; size_t elem; } cols[] = {
+        { COL_TIME, sizeof(uint32_t) },
+        { COL_CLASS, sizeof(uint8_t) },
+        { COL_CONF, sizeof(uint8_t) },
+        { COL_BOX, 4 * sizeof(uint16_t) },
+    };
+    for (size_t i = 0; i < sizeof(cols) / sizeof(cols[0]); i++) {
+        size_t off = cols[i].col + from * cols[i].elem;
+        size_t len = (to - from) * cols[i].elem;
+        if (pwrite(idx->fd, idx->block + off, len, base + off) != (ssize_t)len) {
+            perror("Failed to write detection index block");
+            return -1;
+        }
+    }
+    if (pwrite(idx->fd, bh, sizeof(*bh), base) != (ssize_t)sizeof(*bh)) {
+        perror("Failed to write detection index block header");
+        return -1;
+    }
+    idx->flushed = to;
+    return 0;
+}
+
+detection_index_t* detection_index_open(const char *path, int width, int height) {
+    detection_index_t *idx = (detection_index_t*)calloc(1, sizeof(detection_index_t));
+    if (!idx) {
+        perror("Failed to allocate detection index");
+        return NULL;
+    }
+    idx->block = (uint8_t*)calloc(1, BLOCK_SIZE);
+    idx->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (!idx->block || idx->fd < 0) {
+        fprintf(stderr, "Could not open detection index %s: %s\n", path, strerror(errno));
+        detection_index_close(idx);
+        return NULL;
+    }
+
+    struct stat st;
+    fstat(idx->fd, &st);
+    int reuse = 0;
+    if (st.st_size >= DETIDX_HEADER_SIZE &&
+        pread(idx->fd, &idx->header, sizeof(idx->header), 0) == (ssize_t)sizeof(idx->header)) {
+        reuse = !memcmp(idx->header.magic, DETIDX_MAGIC, sizeof(DETIDX_MAGIC)) &&
+                idx->header.version == DETIDX_VERSION &&
+                idx->header.block_entries == DETIDX_BLOCK_ENTRIES &&
+                idx->header.block_size == BLOCK_SIZE &&
+                idx->header.width == (uint32_t)width && idx->header.height == (uint32_t)height;
+        if (!reuse) {
+            fprintf(stderr, "Detection index %s has a different layout, starting a new one\n", path);
+        }
+    }
+
+    if (!reuse) {
+        if (ftruncate(idx->fd, 0) < 0) {
+            perror("Failed to reset detection index");
+        }
+        memset(&idx->header, 0, sizeof(idx->header));
+        memcpy(idx->header.magic, DETIDX_MAGIC, sizeof(DETIDX_MAGIC));
+        idx->header.version = DETIDX_VERSION;
+        idx->header.block_entries = DETIDX_BLOCK_ENTRIES;
+        idx->header.block_size = BLOCK_SIZE;
+        idx->header.width = width;
+        idx->header.height = height;
+        if (write_header(idx) < 0) {
+            detection_index_close(idx);
+            return NULL;
+        }
+        start_block(idx, 0);
+    } else {
+        // 继续追加到最后一个未写满的块
+        int blocks = (int)((st.st_size - DETIDX_HEADER_SIZE) / BLOCK_SIZE);
+        int last = blocks > 0 ? blocks - 1 : 0;
+        if (blocks > 0 && pread(idx->fd, idx->block, BLOCK_SIZE, block_offset(last)) == (ssize_t)BLOCK_SIZE &&
+            block_header(idx->block)->magic == DETIDX_BLOCK_MAGIC) {
+            detidx_block_header_t *bh = block_header(idx->block);
+            idx->block_index = last;
+            idx->flushed = bh->count;
+            idx->last_time_ms = bh->max_time_ms;
+            idx->entries = (uint64_t)last * DETIDX_BLOCK_ENTRIES + bh->count;
+            if (bh->count == DETIDX_BLOCK_ENTRIES) {
+                start_block(idx, last + 1);
+            }
+        } else {
+            start_block(idx, last);
+        }
+    }
+    printf("Detection index %s: %llu detections in %d blocks\n", path,
+           (unsigned long long)idx->entries, idx->block_index + 1);
+    return idx;
+}
+
+int detection_index_append(detection_index_t *idx, int64_t time_ms, const detect_result_group_t *group) {
+    if (group->count <= 0) {
+        return 0;
+    }
+    // 块内按时间有序才能二分查找，系统时间回退时沿用上一次的时间
+    if (time_ms < idx->last_time_ms) {
+        time_ms = idx->last_time_ms;
+    }
+    idx->last_time_ms = time_ms;
+
+    int header_dirty = 0;
+    for (int i = 0; i < group->count; i++) {
+        detidx_block_header_t *bh = block_header(idx->block);
+        // 块内时间用32位毫秒偏移，跨度超过约49天时另起一块
+        if (bh->count == DETIDX_BLOCK_ENTRIES ||
+            (bh->count > 0 && time_ms - bh->min_time_ms > (int64_t)UINT32_MAX)) {
+            if (flush_block(idx) < 0) {
+                return -1;
+            }
+            start_block(idx, idx->block_index + 1);
+            bh = block_header(idx->block);
+        }
+        if (bh->count == 0) {
+            bh->min_time_ms = time_ms;
+        }
+        bh->max_time_ms = time_ms;
+
+        const detect_result_t *det = &group->results[i];
+        int class_id = det->class_id >= 0 && det->class_id < OBJ_CLASS_NUM ? det->class_id : 0;
+        if (!idx->header.names[class_id][0]) {
+            strncpy(idx->header.names[class_id], det->name, OBJ_NAME_MAX_SIZE - 1);
+            header_dirty = 1;
+        }
+        bh->class_bits[class_id / 64] |= 1ULL << (class_id % 64);
+
+        uint32_t n = bh->count;
+        ((uint32_t*)(idx->block + COL_TIME))[n] = (uint32_t)(time_ms - bh->min_time_ms);
+        idx->block[COL_CLASS + n] = (uint8_t)class_id;
+        float prop = det->prop < 0 ? 0 : (det->prop > 1 ? 1 : det->prop);
+        idx->block[COL_CONF + n] = (uint8_t)(prop * 255 + 0.5f);
+        uint16_t *box = (uint16_t*)(idx->block + COL_BOX) + n * 4;
+        box[0] = quantise(det->box.left, idx->header.width);
+        box[1] = quantise(det->box.top, idx->header.height);
+        box[2] = quantise(det->box.right, idx->header.width);
+        box[3] = quantise(det->box.bottom, idx->header.height);
+        bh->count++;
+        idx->entries++;
+    }
+    if (header_dirty) {
+        write_header(idx);
+    }
+    if (time_ms - idx->last_flush_ms >= DETIDX_FLUSH_MS) {
+        idx->last_flush_ms = time_ms;
+        return flush_block(idx);
+    }
+    return 0;
+}
+
+void detection_index_close(detection_index_t *idx) {
+    if (!idx) return;
+    if (idx->fd >= 0) {
+        if (idx->block) {
+            flush_block(idx);
+        }
+        close(idx->fd);
+    }
+    free(idx->block);
+    free(idx);
+}
+
+// ---- query ----
+
+static int parse_class_mask(const detidx_file_header_t *hdr, const char *classes, uint64_t mask[2]) {
+    mask[0] = mask[1] = 0;
+    if (!classes) {
+        mask[0] = mask[1] = ~0ULL;
+        return 0;
+    }
+    const char *p = classes;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        int found = 0;
+        for (int c = 0; c < OBJ_CLASS_NUM; c++) {
+            if (strlen(hdr->names[c]) == len && !strncmp(hdr->names[c], p, len)) {
+                mask[c / 64] |= 1ULL << (c % 64);
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Class '%.*s' never occurs in this index\n", (int)len, p);
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    return 0;
+}
+
+int detection_index_query(const char *path, int64_t from_ms, int64_t to_ms, const char *classes,
+                          detection_hit_cb cb, void *opaque, detection_query_stats_t *stats) {
+    detection_query_stats_t local_stats;
+    if (!stats) stats = &local_stats;
+    memset(stats, 0, sizeof(*stats));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < DETIDX_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a detection index\n", path);
+        close(fd);
+        return -1;
+    }
+    uint8_t *base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap detection index");
+        return -1;
+    }
+
+    const detidx_file_header_t *hdr = (const detidx_file_header_t*)base;
+    if (memcmp(hdr->magic, DETIDX_MAGIC, sizeof(DETIDX_MAGIC)) || hdr->version != DETIDX_VERSION ||
+        hdr->block_entries != DETIDX_BLOCK_ENTRIES || hdr->block_size != BLOCK_SIZE) {
+        fprintf(stderr, "%s: unsupported detection index layout\n", path);
+        munmap(base, st.st_size);
+        return -1;
+    }
+    uint64_t mask[2];
+    parse_class_mask(hdr, classes, mask);
+
+    int blocks = (int)((st.st_size - DETIDX_HEADER_SIZE) / BLOCK_SIZE);
+    stats->blocks_total = blocks;
+    // 块按时间有序: 二分查找第一个 max_time >= from 的块，只读取块头
+    int lo = 0;
+    int hi = blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const detidx_block_header_t *bh = (const detidx_block_header_t*)(base + block_offset(mid));
+        if (bh->count == 0 || bh->max_time_ms < from_ms) {
+            // 空块只可能是最后一个块
+            if (bh->count == 0) hi = mid; else lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int stop = 0;
+    for (int b = lo; b < blocks && !stop; b++) {
+        uint8_t *block = base + block_offset(b);
+        const detidx_block_header_t *bh = (const detidx_block_header_t*)block;
+        if (bh->magic != DETIDX_BLOCK_MAGIC || bh->count == 0 || bh->min_time_ms > to_ms) {
+            break;
+        }
+        if (!(bh->class_bits[0] & mask[0]) && !(bh->class_bits[1] & mask[1])) {
+            stats->blocks_skipped++;
+            continue;
+        }
+        stats->blocks_scanned++;
+        const uint32_t *times = (const uint32_t*)(block + COL_TIME);
+        const uint8_t *cls = block + COL_CLASS;
+        const uint8_t *conf = block + COL_CONF;
+        const uint16_t *box = (const uint16_t*)(block + COL_BOX);
+        uint32_t count = bh->count > DETIDX_BLOCK_ENTRIES ? DETIDX_BLOCK_ENTRIES : bh->count;
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t t = bh->min_time_ms + times[i];
+            if (t < from_ms) continue;
+            if (t > to_ms) {
+                stop = 1;
+                break;
+            }
+            int c = cls[i];
+            if (!(mask[c / 64] & (1ULL << (c % 64)))) continue;
+
+            detection_hit_t hit;
+            hit.time_ms = t;
+            hit.class_id = c;
+            hit.class_name = hdr->names[c][0] ? hdr->names[c] : "?";
+            hit.prop = conf[i] / 255.0f;
+            hit.box.left = dequantise(box[i * 4 + 0], hdr->width);
+            hit.box.top = dequantise(box[i * 4 + 1], hdr->height);
+            hit.box.right = dequantise(box[i * 4 + 2], hdr->width);
+            hit.box.bottom = dequantise(box[i * 4 + 3], hdr->height);
+            stats->hits++;
+            if (cb && cb(&hit, opaque)) {
+                stop = 1;
+                break;
+            }
+        }
+    }
+    munmap(base, st.st_size);
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "detector.h"
+#include "mock_detector.h"
+#include "rknn_model.h"
+#include "rknn_yolov5.h"
+
+// "mock[:LATENCY_MS[:JITTER_MS]]"，缺省20ms无抖动
+static int parse_mock(const char* backend, int* latency_ms, int* jitter_ms) {
+    *latency_ms = 20;
+    *jitter_ms = 0;
+    if (strncmp(backend, "mock", 4) != 0) {
+        return -1;
+    }
+    if (backend[4] == '\0') {
+        return 0;
+    }
+    if (backend[4] != ':' || sscanf(backend + 5, "%d:%d", latency_ms, jitter_ms) < 1 ||
+        *latency_ms < 0 || *jitter_ms < 0 || *jitter_ms > *latency_ms) {
+        return -1;
+    }
+    return 0;
+}
+
+int detector_backend_valid(const char* backend) {
+    int latency_ms, jitter_ms;
+    return !strcmp(backend, "rknn") || parse_mock(backend, &latency_ms, &jitter_ms) == 0;
+}
+
+Detector* detector_create(const char* backend) {
+    int latency_ms, jitter_ms;
+    if (!strcmp(backend, "rknn")) {
+        return new RknnYolov5();
+    }
+    if (parse_mock(backend, &latency_ms, &jitter_ms) == 0) {
+        return new MockDetector(latency_ms, jitter_ms);
+    }
+    fprintf(stderr, "Unknown detector backend '%s'\n", backend);
+    return NULL;
+}
+
+NpuModel* npu_model_create(const char* backend) {
+    int latency_ms, jitter_ms;
+    if (!strcmp(backend, "rknn")) {
+        return new RknnModel();
+    }
+    if (parse_mock(backend, &latency_ms, &jitter_ms) == 0) {
+        return new MockModel(latency_ms, jitter_ms);
+    }
+    fprintf(stderr, "Unknown model backend '%s'\n", backend);
+    return NULL;
+}
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/dma-heap.h>
+#include <drm_fourcc.h>
+#include "dma_frame_pool.h"
+
+extern "C" {
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_drm.h>
+#include <libavutil/mem.h>
+}
+
+// RGA on RK3568 can only address the low 4G, so prefer the dma32 heaps
+static const char *dma_heap_paths[] = {
+    "/dev/dma_heap/system-uncached-dma32",
+    "/dev/dma_heap/system-dma32",
+    "/dev/dma_heap/cma",
+    "/dev/dma_heap/system",
+};
+
+static inline int align_to(int v, int a) {
+    return (v + a - 1) & ~(a - 1);
+}
+
+static int alloc_dma_heap_buf(size_t size) {
+    for (size_t i = 0; i < sizeof(dma_heap_paths) / sizeof(dma_heap_paths[0]); i++) {
+        int heap_fd = open(dma_heap_paths[i], O_RDWR | O_CLOEXEC);
+        if (heap_fd < 0) {
+            continue;
+        }
+        struct dma_heap_allocation_data data;
+        memset(&data, 0, sizeof(data));
+        data.len = size;
+        data.fd_flags = O_RDWR | O_CLOEXEC;
+        int ret = ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data);
+        close(heap_fd);
+        if (ret == 0) {
+            return (int)data.fd;
+        }
+    }
+    return -1;
+}
+
+// memfd is mmap-able like a dma-buf, so av_hwframe_map() works on hosts without dma heaps
+static int alloc_memfd_buf(size_t size) {
+    int fd = memfd_create("dma_frame", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int init_hw_contexts(dma_frame_pool_t *pool) {
+    // The encoder only needs the frame descriptors, not a DRM master, so no device fd is required
+    pool->device_ref = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_DRM);
+    if (!pool->device_ref) {
+        return -1;
+    }
+    AVHWDeviceContext *device_ctx = (AVHWDeviceContext*)pool->device_ref->data;
+    AVDRMDeviceContext *drm_ctx = (AVDRMDeviceContext*)device_ctx->hwctx;
+    drm_ctx->fd = -1;
+    if (av_hwdevice_ctx_init(pool->device_ref) < 0) {
+        return -1;
+    }
+
+    pool->frames_ref = av_hwframe_ctx_alloc(pool->device_ref);
+    if (!pool->frames_ref) {
+        return -1;
+    }
+    AVHWFramesContext *frames_ctx = (AVHWFramesContext*)pool->frames_ref->data;
+    frames_ctx->format = AV_PIX_FMT_DRM_PRIME;
+    frames_ctx->sw_format = AV_PIX_FMT_NV12;
+    frames_ctx->width = pool->width;
+    frames_ctx->height = pool->height;
+    frames_ctx->initial_pool_size = 0; // frames are wrapped from our own slots
+    if (av_hwframe_ctx_init(pool->frames_ref) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+dma_frame_pool_t* init_dma_frame_pool(int count, int width, int height) {
+    dma_frame_pool_t *pool = (dma_frame_pool_t*)calloc(1, sizeof(dma_frame_pool_t));
+    if (!pool) {
+        perror("Failed to allocate DMA frame pool");
+        return NULL;
+    }
+    pool->slots = (dma_frame_slot_t*)calloc(count, sizeof(dma_frame_slot_t));
+    if (!pool->slots) {
+        perror("Failed to allocate DMA frame slots");
+        free(pool);
+        return NULL;
+    }
+    pool->count = count;
+    pool->width = width;
+    pool->height = height;
+    for (int i = 0; i < count; i++) {
+        pool->slots[i].fd = -1;
+    }
+
+    // MPP wants 16-aligned strides in both directions
+    int pitch = align_to(width, 16);
+    int vstride = align_to(height, 16);
+    size_t size = (size_t)pitch * vstride * 3 / 2;
+
+    for (int i = 0; i < count; i++) {
+        dma_frame_slot_t *slot = &pool->slots[i];
+        slot->fd = alloc_dma_heap_buf(size);
+        if (slot->fd < 0) {
+            slot->fd = alloc_memfd_buf(size);
+            pool->is_memfd = 1;
+        }
+        if (slot->fd < 0) {
+            fprintf(stderr, "Failed to allocate DMA frame buffer %d\n", i);
+            destroy_dma_frame_pool(pool);
+            return NULL;
+        }
+        if (pool->is_memfd) {
+            // RGA can't import a memfd, so the fallback fills it through a virtual address
+            slot->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+            if (slot->map == MAP_FAILED) {
+                slot->map = NULL;
+                fprintf(stderr, "Failed to map DMA frame buffer %d\n", i);
+                destroy_dma_frame_pool(pool);
+                return NULL;
+            }
+        }
+        slot->size = size;
+        slot->pitch = pitch;
+        slot->vstride = vstride;
+        slot->in_use = 0;
+    }
+    if (pool->is_memfd) {
+        printf("No DMA heap available, DMA frame pool falls back to memfd\n");
+    }
+
+    if (init_hw_contexts(pool) < 0) {
+        fprintf(stderr, "Failed to create DRM hw frames context\n");
+        destroy_dma_frame_pool(pool);
+        return NULL;
+    }
+
+    printf("DMA frame pool: %d x NV12 %dx%d (pitch %d, vstride %d)\n",
+           count, width, height, pitch, vstride);
+    return pool;
+}
+
+void destroy_dma_frame_pool(dma_frame_pool_t *pool) {
+    if (!pool) return;
+
+    av_buffer_unref(&pool->frames_ref);
+    av_buffer_unref(&pool->device_ref);
+
+    if (pool->slots) {
+        for (int i = 0; i < pool->count; i++) {
+            if (pool->slots[i].map) {
+                munmap(pool->slots[i].map, pool->slots[i].size);
+            }
+            if (pool->slots[i].fd >= 0) {
+                close(pool->slots[i].fd);
+            }
+        }
+        free(pool->slots);
+    }
+    free(pool);
+}
+
+int dma_frame_pool_acquire(dma_frame_pool_t *pool) {
+    for (int n = 0; n < pool->count; n++) {
+        int i = (pool->next + n) % pool->count;
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&pool->slots[i].in_use, &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            pool->next = (i + 1) % pool->count;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Called once the encoder drops its last reference
+typedef void (*dma_frame_free_cb)(void *opaque);
+
+typedef struct {
+    AVDRMFrameDescriptor desc;
+    dma_frame_free_cb free_cb;
+    void *opaque;
+} dma_frame_ref_t;
+
+static void free_dma_frame_ref(void *opaque, uint8_t *data) {
+    dma_frame_ref_t *ref = (dma_frame_ref_t*)opaque;
+    if (ref->free_cb) {
+        ref->free_cb(ref->opaque);
+    }
+    av_free(ref);
+}
+
+static AVFrame* wrap_dma_buf_frame(AVBufferRef *frames_ref, int fd, size_t size,
+                                   int width, int height, int pitch, int vstride,
+                                   dma_frame_free_cb free_cb, void *opaque) {
+    dma_frame_ref_t *ref = (dma_frame_ref_t*)av_mallocz(sizeof(dma_frame_ref_t));
+    if (!ref) {
+        return NULL;
+    }
+    ref->free_cb = free_cb;
+    ref->opaque = opaque;
+
+    AVDRMFrameDescriptor *desc = &ref->desc;
+    desc->nb_objects = 1;
+    desc->objects[0].fd = fd;
+    desc->objects[0].size = size;
+    desc->objects[0].format_modifier = DRM_FORMAT_MOD_LINEAR;
+    desc->nb_layers = 1;
+    desc->layers[0].format = DRM_FORMAT_NV12;
+    desc->layers[0].nb_planes = 2;
+    desc->layers[0].planes[0].object_index = 0;
+    desc->layers[0].planes[0].offset = 0;
+    desc->layers[0].planes[0].pitch = pitch;
+    desc->layers[0].planes[1].object_index = 0;
+    desc->layers[0].planes[1].offset = (ptrdiff_t)pitch * vstride;
+    desc->layers[0].planes[1].pitch = pitch;
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        av_free(ref);
+        return NULL;
+    }
+    frame->buf[0] = av_buffer_create((uint8_t*)desc, sizeof(*desc), free_dma_frame_ref, ref,
+                                     AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+        av_free(ref);
+        av_frame_free(&frame);
+        return NULL;
+    }
+    // From here on the descriptor is owned by frame->buf[0]
+    frame->data[0] = (uint8_t*)desc;
+    frame->format = AV_PIX_FMT_DRM_PRIME;
+    frame->width = width;
+    frame->height = height;
+    frame->hw_frames_ctx = av_buffer_ref(frames_ref);
+    if (!frame->hw_frames_ctx) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    return frame;
+}
+
+static void release_slot(void *opaque) {
+    dma_frame_slot_t *slot = (dma_frame_slot_t*)opaque;
+    __atomic_store_n(&slot->in_use, 0, __ATOMIC_RELEASE);
+}
+
+void dma_frame_pool_release(dma_frame_pool_t *pool, int slot) {
+    release_slot(&pool->slots[slot]);
+}
+
+AVFrame* dma_frame_pool_wrap(dma_frame_pool_t *pool, int slot) {
+    dma_frame_slot_t *s = &pool->slots[slot];
+    AVFrame *frame = wrap_dma_buf_frame(pool->frames_ref, s->fd, s->size,
+                                        pool->width, pool->height, s->pitch, s->vstride,
+                                        release_slot, s);
+    if (!frame) {
+        release_slot(s);
+    }
+    return frame;
+}
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "encoder.h"
+
+extern "C" {
+#include <libavutil/avstring.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+}
+
+// 低延迟模式的VBV只容纳一帧: 任何一帧都能在一个帧间隔内发完，不会在网络上排队
+static int64_t vbv_size(const encoder_config_t *cfg, int64_t bit_rate) {
+    if (cfg->low_latency) {
+        return bit_rate / cfg->fps;
+    }
+    return cfg->rc_mode == ENC_RC_VBR ? bit_rate : bit_rate / 2;
+}
+
+static void apply_rkmpp_options(AVCodecContext *ctx, AVDictionary **opts, const encoder_config_t *cfg) {
+    av_dict_set(opts, "rc_mode", encoder_rc_mode_name(cfg->rc_mode), 0);
+    if (cfg->rc_mode == ENC_RC_CQP) {
+        av_dict_set_int(opts, "qp_init", cfg->qp, 0);
+    } else if (cfg->rc_mode == ENC_RC_VBR) {
+        ctx->rc_max_rate = cfg->bit_rate * 3 / 2;
+    } else {
+        ctx->rc_max_rate = cfg->bit_rate;
+    }
+    // MPP 由硬件决定切片与线程，这两个参数没有对应选项
+    if (cfg->slices > 0 || cfg->threads > 0) {
+        printf("Encoder %s ignores slices/threads\n", ctx->codec->name);
+    }
+    // MPP本身没有lookahead，但周期帧内刷新没有通过libavcodec导出
+    if (cfg->low_latency) {
+        printf("Encoder %s has no intra refresh option, keeping IDR every %d frames\n",
+               ctx->codec->name, cfg->gop_size);
+    }
+}
+
+static void apply_x264_options(AVCodecContext *ctx, AVDictionary **opts, const encoder_config_t *cfg) {
+    av_dict_set(opts, "preset", "veryfast", 0);
+    av_dict_set(opts, "tune", "zerolatency", 0);
+    av_dict_set(opts, "forced-idr", "1", 0);
+    if (cfg->rc_mode == ENC_RC_CQP) {
+        av_dict_set_int(opts, "qp", cfg->qp, 0);
+        ctx->bit_rate = 0;
+    } else if (cfg->rc_mode == ENC_RC_VBR) {
+        ctx->rc_max_rate = cfg->bit_rate * 3 / 2;
+        ctx->rc_buffer_size = vbv_size(cfg, cfg->bit_rate);
+    } else {
+        av_dict_set(opts, "nal-hrd", "cbr", 0);
+        ctx->rc_min_rate = cfg->bit_rate;
+        ctx->rc_max_rate = cfg->bit_rate;
+        ctx->rc_buffer_size = vbv_size(cfg, cfg->bit_rate);
+    }
+    ctx->slices = cfg->slices;
+    if (cfg->low_latency) {
+        // 帧内刷新: I宏块列在gop_size帧内扫过画面，码率没有IDR尖峰；
+        // 刷新起点带恢复点SEI并标记为关键帧，但不是IDR。断线重连、录像分片
+        // 和事件片段开始时仍强制IDR，见nal_packet_is_idr()
+        av_dict_set(opts, "intra-refresh", "1", 0);
+        av_dict_set(opts, "rc-lookahead", "0", 0); // zerolatency已设置，这里显式固定
+        if (cfg->slices <= 0) {
+            // 每个切片可以独立解码，配合sliced-threads降低单帧编码时间
+            ctx->slices = 4;
+        }
+    }
+}
+
+static void apply_x265_options(AVCodecContext *ctx, AVDictionary **opts, const encoder_config_t *cfg) {
+    char params[128];
+    av_dict_set(opts, "preset", "ultrafast", 0);
+    av_dict_set(opts, "tune", "zerolatency", 0);
+    av_dict_set(opts, "forced-idr", "1", 0);
+    if (cfg->rc_mode == ENC_RC_CQP) {
+        snprintf(params, sizeof(params), "qp=%d:slices=%d", cfg->qp, cfg->slices > 0 ? cfg->slices : 1);
+        ctx->bit_rate = 0;
+    } else {
+        snprintf(params, sizeof(params), "slices=%d", cfg->slices > 0 ? cfg->slices : 1);
+        ctx->rc_max_rate = cfg->rc_mode == ENC_RC_VBR ? cfg->bit_rate * 3 / 2 : cfg->bit_rate;
+        ctx->rc_buffer_size = vbv_size(cfg, cfg->bit_rate);
+    }
+    if (cfg->low_latency) {
+        av_strlcat(params, ":intra-refresh=1:rc-lookahead=0:frame-threads=1", sizeof(params));
+    }
+    av_dict_set(opts, "x265-params", params, 0);
+}
+
+// FFmpeg native encoders (flv, mpeg4, ...) only understand the generic context fields
+static void apply_native_options(AVCodecContext *ctx, AVDictionary **opts, const encoder_config_t *cfg) {
+    // MPEG-4 Part 2/H.263 的时间基分母不能超过16位
+    if (ctx->time_base.den > 65535) {
+        ctx->time_base = (AVRational){1, 1000};
+    }
+    if (cfg->rc_mode == ENC_RC_CQP) {
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality = FF_QP2LAMBDA * cfg->qp;
+        ctx->bit_rate = 0;
+    } else if (cfg->rc_mode == ENC_RC_CBR) {
+        ctx->rc_min_rate = cfg->bit_rate;
+        ctx->rc_max_rate = cfg->bit_rate;
+        ctx->rc_buffer_size = vbv_size(cfg, cfg->bit_rate);
+    }
+    ctx->slices = cfg->slices;
+    if (cfg->slices > 1) {
+        ctx->thread_type = FF_THREAD_SLICE;
+    }
+}
+
+// auto 模式按表中顺序选择第一个可用的编码器
+// libx265和mpegvideo系(flv1/mpeg4)打开后不再读取bit_rate，码率只能重开编码器才能改
+static const encoder_backend_t encoder_backends[] = {
+    { "h264_rkmpp", "h264_rkmpp", 1, 1, apply_rkmpp_options },
+    { "hevc_rkmpp", "hevc_rkmpp", 1, 1, apply_rkmpp_options },
+    { "libx264",    "libx264",    0, 1, apply_x264_options },
+    { "libx265",    "libx265",    0, 0, apply_x265_options },
+    { "flv1",       "flv",        0, 0, apply_native_options },
+    { "mpeg4",      "mpeg4",      0, 0, apply_native_options },
+};
+#define ENCODER_BACKEND_NUM (int)(sizeof(encoder_backends) / sizeof(encoder_backends[0]))
+
+// hevc is never picked automatically: plain FLV/RTMP can't carry it
+static const char *auto_backend_order[] = { "h264_rkmpp", "libx264", "flv1" };
+
+// Any other libavcodec encoder name is accepted as a native backend
+static const encoder_backend_t generic_backend = { NULL, NULL, 0, 0, apply_native_options };
+
+void encoder_default_config(encoder_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->backend = "auto";
+    cfg->fps = 15;
+    cfg->bit_rate = 10000000;
+    cfg->gop_size = 10;
+    cfg->rc_mode = ENC_RC_CBR;
+    cfg->qp = 26;
+}
+
+const char* encoder_rc_mode_name(encoder_rc_mode_t mode) {
+    switch (mode) {
+    case ENC_RC_VBR: return "VBR";
+    case ENC_RC_CQP: return "CQP";
+    case ENC_RC_CBR:
+    default: return "CBR";
+    }
+}
+
+int encoder_parse_rc_mode(const char *name, encoder_rc_mode_t *mode) {
+    if (!strcasecmp(name, "cbr")) {
+        *mode = ENC_RC_CBR;
+    } else if (!strcasecmp(name, "vbr")) {
+        *mode = ENC_RC_VBR;
+    } else if (!strcasecmp(name, "cqp")) {
+        *mode = ENC_RC_CQP;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void encoder_list_backends(void) {
+    printf("Encoder backends:\n");
+    for (int i = 0; i < ENCODER_BACKEND_NUM; i++) {
+        const AVCodec *codec = avcodec_find_encoder_by_name(encoder_backends[i].codec_name);
+        printf("  %-12s %s\n", encoder_backends[i].name, codec ? "available" : "not built in");
+    }
+    printf("  any other libavcodec encoder name is used with the generic options\n");
+}
+
+static const encoder_backend_t* find_backend(const char *name, const AVCodec **codec) {
+    if (!name || !strcmp(name, "auto")) {
+        for (size_t i = 0; i < sizeof(auto_backend_order) / sizeof(auto_backend_order[0]); i++) {
+            const encoder_backend_t *b = find_backend(auto_backend_order[i], codec);
+            if (b) return b;
+        }
+        return NULL;
+    }
+    for (int i = 0; i < ENCODER_BACKEND_NUM; i++) {
+        if (!strcmp(encoder_backends[i].name, name)) {
+            *codec = avcodec_find_encoder_by_name(encoder_backends[i].codec_name);
+            return *codec ? &encoder_backends[i] : NULL;
+        }
+    }
+    *codec = avcodec_find_encoder_by_name(name);
+    return *codec ? &generic_backend : NULL;
+}
+
+encoder_t* encoder_open(const encoder_config_t *cfg, AVBufferRef *hw_frames_ref) {
+    const AVCodec *codec = NULL;
+    const encoder_backend_t *backend = find_backend(cfg->backend, &codec);
+    if (!backend) {
+        fprintf(stderr, "Encoder backend '%s' is not available\n", cfg->backend);
+        encoder_list_backends();
+        return NULL;
+    }
+
+    encoder_t *enc = (encoder_t*)calloc(1, sizeof(encoder_t));
+    if (!enc) {
+        perror("Failed to allocate encoder");
+        return NULL;
+    }
+    enc->backend = backend;
+    enc->codec = codec;
+    enc->cfg = *cfg;
+    enc->hw_input = backend->hw_input && hw_frames_ref;
+
+    enc->ctx = avcodec_alloc_context3(codec);
+    if (!enc->ctx) {
+        fprintf(stderr, "Could not allocate encoding context\n");
+        free(enc);
+        return NULL;
+    }
+    AVCodecContext *ctx = enc->ctx;
+    ctx->width = cfg->width;
+    ctx->height = cfg->height;
+    // PTS来自采集时间戳(90kHz)，帧率只是码控的标称值，实际为可变帧率
+    ctx->time_base = (AVRational){1, 90000};
+    ctx->framerate = (AVRational){cfg->fps, 1};
+    ctx->bit_rate = cfg->bit_rate;
+    ctx->gop_size = cfg->gop_size;
+    ctx->max_b_frames = 0; // 不使用B帧，更好的实时性
+    if (cfg->low_latency) {
+        // 编码器不为帧线程缓存输入帧，送入一帧就能取出一帧
+        ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        ctx->thread_type = FF_THREAD_SLICE;
+    }
+    ctx->thread_count = cfg->threads;
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // FLV/MP4需要全局头
+
+    if (enc->hw_input) {
+        // 编码器从hw_frames_ctx的sw_format得知实际像素格式(NV12)
+        ctx->pix_fmt = AV_PIX_FMT_DRM_PRIME;
+        ctx->hw_frames_ctx = av_buffer_ref(hw_frames_ref);
+    } else {
+        // 软件编码器优先直接吃NV12，否则取编码器支持的第一个格式
+        ctx->pix_fmt = codec->pix_fmts ? codec->pix_fmts[0] : AV_PIX_FMT_YUV420P;
+        for (const enum AVPixelFormat *p = codec->pix_fmts; p && *p != AV_PIX_FMT_NONE; p++) {
+            if (*p == AV_PIX_FMT_NV12) {
+                ctx->pix_fmt = AV_PIX_FMT_NV12;
+                break;
+            }
+        }
+    }
+
+    AVDictionary *opts = NULL;
+    backend->apply_options(ctx, &opts, cfg);
+    int ret = avcodec_open2(ctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        fprintf(stderr, "Could not open codec %s\n", codec->name);
+        encoder_close(enc);
+        return NULL;
+    }
+
+    if (!enc->hw_input && ctx->pix_fmt != AV_PIX_FMT_NV12) {
+        enc->sw_frame = av_frame_alloc();
+        enc->sws_ctx = sws_getContext(cfg->width, cfg->height, AV_PIX_FMT_NV12,
+                                      cfg->width, cfg->height, ctx->pix_fmt,
+                                      SWS_BILINEAR, NULL, NULL, NULL);
+        if (!enc->sw_frame || !enc->sws_ctx) {
+            fprintf(stderr, "Could not initialize the conversion context\n");
+            encoder_close(enc);
+            return NULL;
+        }
+        enc->sw_frame->format = ctx->pix_fmt;
+        enc->sw_frame->width = cfg->width;
+        enc->sw_frame->height = cfg->height;
+        if (av_frame_get_buffer(enc->sw_frame, 0) < 0) {
+            fprintf(stderr, "Could not allocate frame data\n");
+            encoder_close(enc);
+            return NULL;
+        }
+    }
+
+    printf("Encoder %s: %dx%d@%d %s %lld bps, %s %d, %s input\n",
+           codec->name, cfg->width, cfg->height, cfg->fps, encoder_rc_mode_name(cfg->rc_mode),
+           (long long)cfg->bit_rate, cfg->low_latency ? "intra refresh" : "gop", cfg->gop_size,
+           enc->hw_input ? "DRM_PRIME" : av_get_pix_fmt_name(ctx->pix_fmt));
+    return enc;
+}
+
+void encoder_close(encoder_t *enc) {
+    if (!enc) return;
+    sws_freeContext(enc->sws_ctx);
+    av_frame_free(&enc->sw_frame);
+    avcodec_free_context(&enc->ctx);
+    free(enc);
+}
+
+void encoder_force_idr(encoder_t *enc) {
+    enc->force_idr = 1;
+}
+
+int encoder_can_set_bitrate(const encoder_t *enc) {
+    return enc->backend->live_bitrate && enc->cfg.rc_mode != ENC_RC_CQP;
+}
+
+int encoder_set_bitrate(encoder_t *enc, int64_t bit_rate) {
+    if (bit_rate == enc->cfg.bit_rate) {
+        return 0;
+    }
+    if (!encoder_can_set_bitrate(enc)) {
+        if (!enc->bitrate_warned) {
+            fprintf(stderr, "Encoder %s (%s) cannot change its bitrate while running\n",
+                    enc->codec->name, encoder_rc_mode_name(enc->cfg.rc_mode));
+            enc->bitrate_warned = 1;
+        }
+        return AVERROR(ENOSYS);
+    }
+    // libx264 and MPP re-read these fields on every frame and reconfigure the rate control
+    AVCodecContext *ctx = enc->ctx;
+    enc->cfg.bit_rate = bit_rate;
+    ctx->bit_rate = bit_rate;
+    if (enc->cfg.rc_mode == ENC_RC_VBR) {
+        ctx->rc_max_rate = bit_rate * 3 / 2;
+    } else {
+        ctx->rc_max_rate = bit_rate;
+        if (ctx->rc_min_rate > 0) {
+            ctx->rc_min_rate = bit_rate;
+        }
+    }
+    if (ctx->rc_buffer_size > 0) {
+        ctx->rc_buffer_size = vbv_size(&enc->cfg, bit_rate);
+    }
+    return 0;
+}
+
+// ROI等按帧的编码参数随侧数据传递，映射和转换后的帧要带上
+static int copy_frame_side_data(AVFrame *dst, const AVFrame *src) {
+    av_frame_remove_side_data(dst, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+    const AVFrameSideData *sd = av_frame_get_side_data(src, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+    if (!sd) {
+        return 0;
+    }
+    AVFrameSideData *copy = av_frame_new_side_data(dst, sd->type, sd->size);
+    if (!copy) {
+        return AVERROR(ENOMEM);
+    }
+    memcpy(copy->data, sd->data, sd->size);
+    return 0;
+}
+
+int encoder_send_frame(encoder_t *enc, AVFrame *frame) {
+    if (frame) {
+        // 编码器把pict_type为I的输入帧编码为IDR
+        frame->pict_type = enc->force_idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        enc->force_idr = 0;
+    }
+    if (!frame || enc->hw_input) {
+        return avcodec_send_frame(enc->ctx, frame);
+    }
+
+    // 软件路径: DRM_PRIME帧映射为NV12，必要时再转换
+    AVFrame *mapped = av_frame_alloc();
+    if (!mapped) {
+        return AVERROR(ENOMEM);
+    }
+    mapped->format = AV_PIX_FMT_NV12;
+    int ret = av_hwframe_map(mapped, frame, AV_HWFRAME_MAP_READ);
+    if (ret < 0) {
+        fprintf(stderr, "Could not map DRM_PRIME frame\n");
+        av_frame_free(&mapped);
+        return ret;
+    }
+    mapped->pts = frame->pts;
+    mapped->pict_type = frame->pict_type;
+    copy_frame_side_data(mapped, frame);
+
+    AVFrame *input = mapped;
+    if (enc->sws_ctx) {
+        ret = av_frame_make_writable(enc->sw_frame);
+        if (ret < 0) {
+            fprintf(stderr, "Could not make frame writable\n");
+            av_frame_free(&mapped);
+            return ret;
+        }
+        sws_scale(enc->sws_ctx, (const uint8_t * const*)mapped->data, mapped->linesize, 0,
+                  enc->cfg.height, enc->sw_frame->data, enc->sw_frame->linesize);
+        enc->sw_frame->pts = frame->pts;
+        enc->sw_frame->pict_type = frame->pict_type;
+        copy_frame_side_data(enc->sw_frame, frame);
+        input = enc->sw_frame;
+    }
+    ret = avcodec_send_frame(enc->ctx, input);
+    av_frame_free(&mapped);
+    return ret;
+}
+
+int encoder_receive_packet(encoder_t *enc, AVPacket *pkt) {
+    return avcodec_receive_packet(enc->ctx, pkt);
+}
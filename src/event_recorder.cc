@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "event_recorder.h"
+#include "packet_queue.h"
+#include "nal_utils.h"
+
+#define EVENT_RETRY_US 5000000
+// 分片MP4: 录像中途断电，已写入的部分依然可以播放
+#define EVENT_MUX_OPTIONS "movflags=+frag_keyframe+empty_moov+default_base_moof"
+
+void event_config_default(event_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->classes = "person";
+    cfg->pre_roll_s = 5;
+    cfg->post_roll_s = 10;
+}
+
+static void parse_classes(event_recorder_t *rec, const char *list) {
+    const char *p = list;
+    while (*p && rec->class_count < EVENT_MAX_CLASSES) {
+        size_t len = strcspn(p, ",");
+        if (len > 0 && len < OBJ_NAME_MAX_SIZE) {
+            memcpy(rec->classes[rec->class_count], p, len);
+            rec->classes[rec->class_count][len] = '\0';
+            rec->class_count++;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+}
+
+event_recorder_t* event_recorder_create(const event_config_t *cfg, int fps, int gop_size) {
+    event_recorder_t *rec = (event_recorder_t*)calloc(1, sizeof(event_recorder_t));
+    if (!rec) {
+        perror("Failed to allocate event recorder");
+        return NULL;
+    }
+    rec->cfg = *cfg;
+    parse_classes(rec, cfg->classes);
+    if (rec->class_count == 0) {
+        fprintf(stderr, "No event classes in '%s'\n", cfg->classes);
+        free(rec);
+        return NULL;
+    }
+
+    // 低延迟模式的IDR是按预录时长请求来的，两个IDR之间最多要存两倍的预录时长
+    rec->capacity = fps * (cfg->pre_roll_s * 2 + 1) + gop_size * 2;
+    rec->ring = (AVPacket**)calloc(rec->capacity, sizeof(AVPacket*));
+    if (!rec->ring) {
+        perror("Failed to allocate pre-roll ring");
+        free(rec);
+        return NULL;
+    }
+    printf("Event recording to %s: %d classes, pre-roll %d s, post-roll %d s, ring %d packets\n",
+           cfg->dir, rec->class_count, cfg->pre_roll_s, cfg->post_roll_s, rec->capacity);
+    return rec;
+}
+
+static AVPacket* ring_at(event_recorder_t *rec, int i) {
+    return rec->ring[(rec->head + i) % rec->capacity];
+}
+
+// Drops packets from the head up to (not including) index n
+static void ring_drop(event_recorder_t *rec, int n) {
+    for (int i = 0; i < n; i++) {
+        av_packet_free(&rec->ring[rec->head]);
+        rec->head = (rec->head + 1) % rec->capacity;
+        rec->count--;
+    }
+}
+
+static void ring_clear(event_recorder_t *rec) {
+    ring_drop(rec, rec->count);
+    rec->head = 0;
+}
+
+// 片段只能从IDR开始，帧内刷新的恢复点虽然带关键帧标记也不行
+static int is_keyframe(const event_recorder_t *rec, const AVPacket *pkt) {
+    return nal_packet_is_idr(rec->codecpar ? rec->codecpar->codec_id : AV_CODEC_ID_NONE, pkt);
+}
+
+// Index of the first keyframe after the head, or count if there is none
+static int ring_next_keyframe(event_recorder_t *rec) {
+    int n = 1;
+    while (n < rec->count && !is_keyframe(rec, ring_at(rec, n))) {
+        n++;
+    }
+    return n;
+}
+
+static int64_t packet_time_us(event_recorder_t *rec, const AVPacket *pkt) {
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    return av_rescale_q(ts, rec->time_base, (AVRational){1, 1000000});
+}
+
+// 低延迟模式没有周期IDR: 距上一个IDR超过预录时长就向编码器要一个，
+// 预录缓冲区里总有可以开始片段的位置
+static void track_idr(event_recorder_t *rec, const AVPacket *pkt, int key) {
+    int64_t now_us = packet_time_us(rec, pkt);
+    int64_t interval_us = (int64_t)(rec->cfg.pre_roll_s > 0 ? rec->cfg.pre_roll_s : 1) * 1000000;
+    if (key) {
+        rec->last_idr_us = now_us;
+        rec->idr_requested = 0;
+    } else if (!rec->idr_requested && (rec->count == 0 || now_us - rec->last_idr_us >= interval_us)) {
+        __atomic_store_n(&rec->keyframe_request, 1, __ATOMIC_RELEASE);
+        rec->idr_requested = 1;
+    }
+}
+
+static void ring_push(event_recorder_t *rec, const AVPacket *pkt) {
+    int key = is_keyframe(rec, pkt);
+    track_idr(rec, pkt, key);
+    // 环形缓冲区始终从关键帧开始
+    if (rec->count == 0 && !key) {
+        return;
+    }
+    if (rec->count == rec->capacity) {
+        ring_drop(rec, ring_next_keyframe(rec));
+        if (rec->count == 0 && !key) {
+            return;
+        }
+    }
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref) {
+        return;
+    }
+    rec->ring[(rec->head + rec->count) % rec->capacity] = ref;
+    rec->count++;
+
+    // 只要第二个关键帧之后仍有足够的预录时长，就整GOP丢弃最旧的数据
+    int64_t newest_us = packet_time_us(rec, pkt);
+    int64_t pre_roll_us = (int64_t)rec->cfg.pre_roll_s * 1000000;
+    for (;;) {
+        int n = ring_next_keyframe(rec);
+        if (n >= rec->count || newest_us - packet_time_us(rec, ring_at(rec, n)) < pre_roll_us) {
+            break;
+        }
+        ring_drop(rec, n);
+    }
+}
+
+// 回收已经写完退出的写入器; 还在写的不等待，也不能中断，否则片段尾部丢失
+static void reap_finished(event_recorder_t *rec) {
+    int n = 0;
+    for (int i = 0; i < rec->finishing_count; i++) {
+        if (stream_writer_finished(rec->finishing[i])) {
+            stream_writer_close(rec->finishing[i]);
+        } else {
+            rec->finishing[n++] = rec->finishing[i];
+        }
+    }
+    rec->finishing_count = n;
+}
+
+static void finish_event(event_recorder_t *rec) {
+    if (!rec->writer) return;
+    // 写线程把队列中剩余的数据写完后自行退出，之后由reap_finished回收
+    stream_writer_finish(rec->writer);
+    if (rec->finishing_count == rec->finishing_capacity) {
+        int capacity = rec->finishing_capacity ? rec->finishing_capacity * 2 : 4;
+        stream_writer_t **grown = (stream_writer_t**)realloc(rec->finishing, capacity * sizeof(*grown));
+        if (!grown) {
+            // 没有内存记录它时只能在这里等它写完
+            stream_writer_close(rec->writer);
+            rec->writer = NULL;
+            return;
+        }
+        rec->finishing = grown;
+        rec->finishing_capacity = capacity;
+    }
+    rec->finishing[rec->finishing_count++] = rec->writer;
+    rec->writer = NULL;
+    printf("Event %llu finished\n", (unsigned long long)rec->events);
+}
+
+static int begin_event(event_recorder_t *rec) {
+    char path[512];
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    snprintf(path, sizeof(path), "%s/event_%s_%llu.mp4", rec->cfg.dir, stamp,
+             (unsigned long long)rec->events + 1);
+
+    // 队列足够放下整个预录缓冲区，写盘期间不会丢帧
+    rec->writer = stream_writer_open(path, "mp4", EVENT_MUX_OPTIONS, rec->codecpar, rec->time_base,
+                                     rec->capacity * 2);
+    if (!rec->writer || stream_writer_start(rec->writer) < 0) {
+        fprintf(stderr, "Could not start event recording '%s'\n", path);
+        stream_writer_close(rec->writer);
+        rec->writer = NULL;
+        rec->retry_after_us = monotonic_us() + EVENT_RETRY_US;
+        return -1;
+    }
+    for (int i = 0; i < rec->count; i++) {
+        stream_writer_send(rec->writer, ring_at(rec, i));
+    }
+    rec->events++;
+    printf("Event %llu: recording %s with %.1f s pre-roll\n", (unsigned long long)rec->events, path,
+           rec->count > 1 ? (packet_time_us(rec, ring_at(rec, rec->count - 1)) -
+                             packet_time_us(rec, ring_at(rec, 0))) / 1000000.0 : 0.0);
+    return 0;
+}
+
+int event_recorder_match(event_recorder_t *rec, const detect_result_group_t *group) {
+    for (int i = 0; i < group->count; i++) {
+        for (int c = 0; c < rec->class_count; c++) {
+            if (!strcmp(group->results[i].name, rec->classes[c])) {
+                __atomic_store_n(&rec->last_trigger_us, monotonic_us(), __ATOMIC_RELEASE);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int event_recorder_start(event_recorder_t *rec, const AVCodecParameters *codecpar, AVRational time_base) {
+    rec->codecpar = avcodec_parameters_alloc();
+    if (!rec->codecpar || avcodec_parameters_copy(rec->codecpar, codecpar) < 0) {
+        avcodec_parameters_free(&rec->codecpar);
+        return -1;
+    }
+    rec->time_base = time_base;
+    return 0;
+}
+
+void event_recorder_push(event_recorder_t *rec, const AVPacket *pkt) {
+    ring_push(rec, pkt);
+    reap_finished(rec);
+
+    int64_t trigger_us = __atomic_load_n(&rec->last_trigger_us, __ATOMIC_ACQUIRE);
+    int active = trigger_us != 0 &&
+                 monotonic_us() - trigger_us < (int64_t)rec->cfg.post_roll_s * 1000000;
+    if (rec->writer) {
+        if (active) {
+            stream_writer_send(rec->writer, pkt);
+        } else {
+            finish_event(rec);
+        }
+    } else if (active && rec->count > 0 && monotonic_us() >= rec->retry_after_us) {
+        // 当前包已在环形缓冲区中，随预录数据一起写入
+        begin_event(rec);
+    }
+}
+
+int event_recorder_keyframe_requested(event_recorder_t *rec) {
+    return __atomic_exchange_n(&rec->keyframe_request, 0, __ATOMIC_ACQ_REL);
+}
+
+void event_recorder_reset(event_recorder_t *rec, const AVCodecParameters *codecpar) {
+    finish_event(rec);
+    ring_clear(rec);
+    if (rec->codecpar) {
+        avcodec_parameters_copy(rec->codecpar, codecpar);
+    }
+}
+
+void event_recorder_destroy(event_recorder_t *rec) {
+    if (!rec) return;
+    finish_event(rec);
+    // 退出时等所有片段写完
+    for (int i = 0; i < rec->finishing_count; i++) {
+        stream_writer_close(rec->finishing[i]);
+    }
+    free(rec->finishing);
+    ring_clear(rec);
+    free(rec->ring);
+    avcodec_parameters_free(&rec->codecpar);
+    free(rec);
+}
@@ -0,0 +1,139 @@
+#include <string.h>
+#include "flv_tag.h"
+#include "nal_utils.h"
+
+extern "C" {
+#include <libavutil/intfloat.h>
+#include <libavutil/mathematics.h>
+}
+
+#define FLV_CODEC_AVC 7
+#define FLV_CODEC_AAC 10
+// AAC固定写44kHz/16bit/立体声，实际参数在AudioSpecificConfig里
+#define FLV_AAC_FLAGS ((FLV_CODEC_AAC << 4) | (3 << 2) | (1 << 1) | 1)
+
+// Returns the offset of the tag; the body follows the 11 byte header
+static size_t begin_tag(byte_buf_t *b, int type, int64_t ts_ms) {
+    size_t start = b->size;
+    uint32_t ts = (uint32_t)ts_ms;
+    byte_buf_u8(b, type);
+    byte_buf_be24(b, 0);                // DataSize, patched in end_tag
+    byte_buf_be24(b, ts & 0xffffff);
+    byte_buf_u8(b, ts >> 24);           // TimestampExtended
+    byte_buf_be24(b, 0);                // StreamID
+    return start;
+}
+
+static void end_tag(byte_buf_t *b, size_t start) {
+    uint32_t size = b->size - start;
+    byte_buf_patch_be24(b, start + 1, size - FLV_TAG_HEADER_SIZE);
+    byte_buf_be32(b, size);
+}
+
+void flv_write_file_header(byte_buf_t *b, int has_audio) {
+    static const uint8_t sig[] = { 'F', 'L', 'V', 1 };
+    byte_buf_append(b, sig, sizeof(sig));
+    byte_buf_u8(b, has_audio ? 0x05 : 0x01);
+    byte_buf_be32(b, 9);
+    byte_buf_be32(b, 0);
+}
+
+static void amf_string(byte_buf_t *b, const char *s) {
+    byte_buf_be16(b, strlen(s));
+    byte_buf_append(b, s, strlen(s));
+}
+
+static void amf_number_prop(byte_buf_t *b, const char *name, double v) {
+    uint64_t bits = av_double2int(v);
+    amf_string(b, name);
+    byte_buf_u8(b, 0);                  // AMF0 number
+    byte_buf_be32(b, bits >> 32);
+    byte_buf_be32(b, (uint32_t)bits);
+}
+
+void flv_write_metadata(byte_buf_t *b, const AVCodecParameters *video, int fps,
+                        const AVCodecParameters *audio) {
+    size_t start = begin_tag(b, FLV_TAG_SCRIPT, 0);
+    byte_buf_u8(b, 2);                  // AMF0 string
+    amf_string(b, "onMetaData");
+    byte_buf_u8(b, 8);                  // ECMA array
+    byte_buf_be32(b, audio ? 7 : 5);
+    amf_number_prop(b, "width", video->width);
+    amf_number_prop(b, "height", video->height);
+    amf_number_prop(b, "framerate", fps);
+    amf_number_prop(b, "videocodecid", FLV_CODEC_AVC);
+    amf_number_prop(b, "videodatarate", video->bit_rate / 1000.0);
+    if (audio) {
+        amf_number_prop(b, "audiocodecid", FLV_CODEC_AAC);
+        amf_number_prop(b, "audiosamplerate", audio->sample_rate);
+    }
+    byte_buf_be24(b, 9);                // object end
+    end_tag(b, start);
+}
+
+int flv_write_avc_config(byte_buf_t *b, const AVCodecParameters *par) {
+    nal_unit_t sps, pps;
+    if (nal_h264_parameter_sets(par->extradata, par->extradata_size, &sps, &pps) < 0 || sps.size < 4) {
+        return -1;
+    }
+    size_t start = begin_tag(b, FLV_TAG_VIDEO, 0);
+    byte_buf_u8(b, (1 << 4) | FLV_CODEC_AVC);
+    byte_buf_u8(b, 0);                  // AVC sequence header
+    byte_buf_be24(b, 0);
+    if (par->extradata[0] == 1) {
+        byte_buf_append(b, par->extradata, par->extradata_size);
+    } else {
+        // Annex-B的SPS/PPS组装成AVCDecoderConfigurationRecord
+        byte_buf_u8(b, 1);
+        byte_buf_append(b, sps.data + 1, 3);    // profile, compatibility, level
+        byte_buf_u8(b, 0xff);                   // 4 byte NAL lengths
+        byte_buf_u8(b, 0xe1);                   // one SPS
+        byte_buf_be16(b, sps.size);
+        byte_buf_append(b, sps.data, sps.size);
+        byte_buf_u8(b, 1);
+        byte_buf_be16(b, pps.size);
+        byte_buf_append(b, pps.data, pps.size);
+    }
+    end_tag(b, start);
+    return 0;
+}
+
+int flv_write_aac_config(byte_buf_t *b, const AVCodecParameters *par) {
+    if (!par->extradata || par->extradata_size < 2) {
+        return -1;
+    }
+    size_t start = begin_tag(b, FLV_TAG_AUDIO, 0);
+    byte_buf_u8(b, FLV_AAC_FLAGS);
+    byte_buf_u8(b, 0);                  // AudioSpecificConfig
+    byte_buf_append(b, par->extradata, par->extradata_size);
+    end_tag(b, start);
+    return 0;
+}
+
+void flv_write_video(byte_buf_t *b, const AVPacket *pkt, AVRational time_base) {
+    int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int64_t dts_ms = av_rescale_q(dts, time_base, (AVRational){1, 1000});
+    int64_t cts_ms = av_rescale_q(pkt->pts - dts, time_base, (AVRational){1, 1000});
+
+    size_t start = begin_tag(b, FLV_TAG_VIDEO, dts_ms);
+    byte_buf_u8(b, ((pkt->flags & AV_PKT_FLAG_KEY) ? 1 << 4 : 2 << 4) | FLV_CODEC_AVC);
+    byte_buf_u8(b, 1);                  // AVC NALU
+    byte_buf_be24(b, (uint32_t)cts_ms & 0xffffff);
+    byte_buf_reserve(b, pkt->size + 64);
+    size_t pos = 0;
+    nal_unit_t nal;
+    while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+        byte_buf_be32(b, nal.size);
+        byte_buf_append(b, nal.data, nal.size);
+    }
+    end_tag(b, start);
+}
+
+void flv_write_audio(byte_buf_t *b, const AVPacket *pkt, AVRational time_base) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    size_t start = begin_tag(b, FLV_TAG_AUDIO, av_rescale_q(ts, time_base, (AVRational){1, 1000}));
+    byte_buf_u8(b, FLV_AAC_FLAGS);
+    byte_buf_u8(b, 1);                  // raw AAC frame
+    byte_buf_append(b, pkt->data, pkt->size);
+    end_tag(b, start);
+}
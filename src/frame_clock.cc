@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <string.h>
+#include "frame_clock.h"
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+// 真实的采集停顿保留为时间轴上的空隙，超过该值才认为时间戳本身出错
+#define FRAME_CLOCK_MAX_GAP_US 10000000
+#define FRAME_CLOCK_MAX_BACKSTEP_US 100000
+
+void frame_clock_init(frame_clock_t *clock, AVRational time_base, int nominal_fps) {
+    memset(clock, 0, sizeof(*clock));
+    clock->time_base = time_base;
+    clock->interval_us = 1000000.0 / (nominal_fps > 0 ? nominal_fps : 30);
+}
+
+int64_t frame_clock_pts(frame_clock_t *clock, int64_t capture_us) {
+    if (!clock->started) {
+        clock->started = 1;
+        clock->first_us = clock->base_us = clock->last_us = capture_us;
+        clock->frames = 1;
+        return 0;
+    }
+
+    int64_t delta = capture_us - clock->last_us;
+    if (delta < -FRAME_CLOCK_MAX_BACKSTEP_US || delta > FRAME_CLOCK_MAX_GAP_US) {
+        // 时间戳跳变: 从上一帧之后一个帧间隔处继续
+        clock->base_us = capture_us;
+        clock->base_pts = clock->last_pts + av_rescale_q((int64_t)clock->interval_us,
+                                                         (AVRational){1, 1000000}, clock->time_base);
+        clock->rebases++;
+        printf("Capture timestamp jumped by %lld us, rebasing stream time\n", (long long)delta);
+    } else if (delta > 0) {
+        // 平滑的帧间隔用于估计包时长，摄像头切换帧率时几帧内跟上
+        clock->interval_us += (delta - clock->interval_us) / 8;
+    }
+    clock->last_us = capture_us;
+    clock->frames++;
+
+    int64_t pts = clock->base_pts + av_rescale_q(capture_us - clock->base_us,
+                                                 (AVRational){1, 1000000}, clock->time_base);
+    if (pts <= clock->last_pts) {
+        pts = clock->last_pts + 1;
+        clock->bumped++;
+    }
+    clock->last_pts = pts;
+    return pts;
+}
+
+int64_t frame_clock_map(const frame_clock_t *clock, int64_t capture_us) {
+    return clock->base_pts + av_rescale_q(capture_us - clock->base_us, (AVRational){1, 1000000},
+                                          clock->time_base);
+}
+
+int64_t frame_clock_capture_us(const frame_clock_t *clock, int64_t pts) {
+    return clock->base_us + av_rescale_q(pts - clock->base_pts, clock->time_base,
+                                         (AVRational){1, 1000000});
+}
+
+int64_t frame_clock_duration(const frame_clock_t *clock, int n) {
+    int64_t d = av_rescale_q((int64_t)(clock->interval_us * n), (AVRational){1, 1000000}, clock->time_base);
+    return d > 0 ? d : 1;
+}
+
+int64_t frame_clock_drift_us(const frame_clock_t *clock) {
+    return (clock->last_us - clock->first_us) -
+           av_rescale_q(clock->last_pts, clock->time_base, (AVRational){1, 1000000});
+}
@@ -99,3 +99,36 @@ int convert_color(char *src_data, char *dst_data, int width, int height , int sr
 
   return ret;
 }
+
+// RGB -> NV12 straight into a DMA-BUF the encoder imports, no CPU copy.
+// dst_map is only used when the buffer is not a real dma-buf (memfd fallback).
+int convert_RGB_to_NV12_dma_buf(char *src_data, int dst_fd, void *dst_map, int width, int height,
+                                int dst_width, int dst_height, int wstride, int hstride) {
+  int ret = 0;
+  rga_buffer_t src = {0};
+  rga_buffer_t dst = {0};
+
+  if (dst_fd < 0 && !dst_map) {
+    fprintf(stderr, "Invalid DMA-BUF fd for NV12 output\n");
+    return -1;
+  }
+
+  src = wrapbuffer_virtualaddr(src_data, width, height, RK_FORMAT_RGB_888);
+  if (dst_map) {
+    dst = wrapbuffer_virtualaddr(dst_map, dst_width, dst_height, RK_FORMAT_YCbCr_420_SP, wstride, hstride);
+  } else {
+    dst = wrapbuffer_fd(dst_fd, dst_width, dst_height, RK_FORMAT_YCbCr_420_SP, wstride, hstride);
+  }
+
+  if (dst_width == width && dst_height == height) {
+    ret = imcvtcolor(src, dst, RK_FORMAT_RGB_888, RK_FORMAT_YCbCr_420_SP);
+  } else {
+    // 缩放与色彩转换在RGA的同一次操作中完成
+    ret = imresize(src, dst);
+  }
+  if (ret != IM_STATUS_SUCCESS) {
+    printf("RGB to NV12 dma-buf conversion failed, %s\n", imStrError((IM_STATUS)ret));
+  }
+
+  return ret;
+}
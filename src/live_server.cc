@@ -0,0 +1,799 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "live_server.h"
+#include "flv_tag.h"
+#include "packet_queue.h"
+
+#define LIVE_EPOLL_EVENTS 64
+#define LIVE_IOV_MAX 32
+
+static const char *proto_name(live_proto_t proto) {
+    return proto == LIVE_RTSP ? "rtsp" : "http";
+}
+
+void live_config_default(live_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->max_clients = 32;
+    cfg->fps = 15;
+}
+
+static live_item_t* item_new(int control) {
+    live_item_t *it = (live_item_t*)calloc(1, sizeof(live_item_t));
+    if (it) {
+        it->refs = 1;
+        it->control = control;
+    }
+    return it;
+}
+
+static void item_unref(live_item_t *it) {
+    if (it && --it->refs == 0) {
+        byte_buf_free(&it->buf);
+        free(it);
+    }
+}
+
+// ---- client queues, called with the mutex held ----
+
+static void client_push(live_client_t *c, live_item_t *it) {
+    if (c->count >= LIVE_CLIENT_QUEUE) {
+        c->dropped_items++;
+        return;
+    }
+    it->refs++;
+    c->queue[(c->head + c->count) % LIVE_CLIENT_QUEUE] = it;
+    c->count++;
+    c->queued_bytes += it->buf.size;
+}
+
+static void client_pop(live_client_t *c) {
+    live_item_t *it = c->queue[c->head];
+    c->queued_bytes -= it->buf.size;
+    c->head = (c->head + 1) % LIVE_CLIENT_QUEUE;
+    c->count--;
+    c->offset = 0;
+    item_unref(it);
+}
+
+// Drops queued stream items, keeping a partly sent head and control items,
+// so the byte stream stays well formed
+static void drop_backlog(live_client_t *c) {
+    int kept = 0;
+    for (int i = 0; i < c->count; i++) {
+        live_item_t *it = c->queue[(c->head + i) % LIVE_CLIENT_QUEUE];
+        if ((i == 0 && c->offset > 0) || it->control) {
+            c->queue[(c->head + kept++) % LIVE_CLIENT_QUEUE] = it;
+        } else {
+            c->queued_bytes -= it->buf.size;
+            c->dropped_items++;
+            item_unref(it);
+        }
+    }
+    c->count = kept;
+}
+
+// 慢速观众只丢自己的积压，之后从下一个关键帧恢复
+static void client_queue_stream(live_client_t *c, live_item_t *it) {
+    if (c->wait_key) {
+        if (!it->key) {
+            c->dropped_items++;
+            return;
+        }
+        c->wait_key = 0;
+    }
+    if (c->count >= LIVE_CLIENT_QUEUE || c->queued_bytes + it->buf.size > LIVE_CLIENT_MAX_BYTES) {
+        drop_backlog(c);
+        if (!it->key || c->count >= LIVE_CLIENT_QUEUE) {
+            c->wait_key = 1;
+            c->dropped_items++;
+            return;
+        }
+    }
+    client_push(c, it);
+}
+
+static void start_playing(live_server_t *s, live_client_t *c) {
+    for (int i = 0; i < s->gop_count[c->proto]; i++) {
+        client_push(c, s->gop[c->proto][i]);
+    }
+    // 还没有缓存的GOP时从下一个关键帧开始
+    c->wait_key = s->gop_count[c->proto] == 0;
+    c->playing = 1;
+}
+
+static void clear_gop(live_server_t *s, int proto) {
+    for (int i = 0; i < s->gop_count[proto]; i++) {
+        item_unref(s->gop[proto][i]);
+    }
+    s->gop_count[proto] = 0;
+}
+
+// Caches the item and queues it on every playing viewer of proto; takes the
+// caller's reference
+static void publish(live_server_t *s, live_proto_t proto, live_item_t *it) {
+    if (!it) {
+        return;
+    }
+    if (it->buf.error || it->buf.size == 0) {
+        item_unref(it);
+        return;
+    }
+    if (it->key) {
+        clear_gop(s, proto);
+    }
+    if (it->key || s->gop_count[proto] > 0) {
+        if (s->gop_count[proto] < LIVE_GOP_MAX) {
+            it->refs++;
+            s->gop[proto][s->gop_count[proto]++] = it;
+        } else {
+            // GOP太长放不下时不缓存残缺的GOP，新观众等下一个关键帧
+            clear_gop(s, proto);
+        }
+    }
+    for (int i = 0; i < s->client_count; i++) {
+        live_client_t *c = s->clients[i];
+        if (c->proto == proto && c->playing && !c->dead && !c->closing) {
+            client_queue_stream(c, it);
+        }
+    }
+    item_unref(it);
+}
+
+// ---- requests ----
+
+static void consume_input(live_client_t *c, size_t n) {
+    memmove(c->in, c->in + n, c->in_len - n);
+    c->in_len -= n;
+}
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s);
+    size_t m = strlen(suffix);
+    return n >= m && !strcasecmp(s + n - m, suffix);
+}
+
+// Copies the value of header name into out; returns 1 if present
+static int header_value(const char *req, const char *name, char *out, size_t size) {
+    size_t len = strlen(name);
+    for (const char *line = strstr(req, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, len) || line[len] != ':') {
+            continue;
+        }
+        const char *v = line + len + 1;
+        while (*v == ' ' || *v == '\t') {
+            v++;
+        }
+        size_t n = strcspn(v, "\r\n");
+        if (n >= size) {
+            n = size - 1;
+        }
+        memcpy(out, v, n);
+        out[n] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+static int queue_text(live_client_t *c, const char *text, const char *body) {
+    live_item_t *it = item_new(1);
+    if (!it) {
+        return -1;
+    }
+    byte_buf_append(&it->buf, text, strlen(text));
+    if (body) {
+        byte_buf_append(&it->buf, body, strlen(body));
+    }
+    int ret = it->buf.error ? -1 : 0;
+    if (ret == 0) {
+        client_push(c, it);
+    }
+    item_unref(it);
+    return ret;
+}
+
+static int http_reply(live_client_t *c, const char *status) {
+    char text[256];
+    snprintf(text, sizeof(text), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+    c->closing = 1;
+    return queue_text(c, text, NULL);
+}
+
+static int http_request(live_server_t *s, live_client_t *c, char *req) {
+    char method[16];
+    char path[256];
+    if (sscanf(req, "%15s %255s", method, path) != 2) {
+        return -1;
+    }
+    path[strcspn(path, "?")] = '\0';
+    if (strcmp(method, "GET")) {
+        return http_reply(c, "405 Method Not Allowed");
+    }
+    if (!has_suffix(path, ".flv")) {
+        return http_reply(c, "404 Not Found");
+    }
+    if (!s->flv_header) {
+        return http_reply(c, "503 Service Unavailable");
+    }
+    // 长连接流式输出，没有Content-Length，断开即结束
+    if (queue_text(c, "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: video/x-flv\r\n"
+                      "Cache-Control: no-cache\r\n"
+                      "Connection: close\r\n"
+                      "Access-Control-Allow-Origin: *\r\n\r\n", NULL) < 0) {
+        return -1;
+    }
+    client_push(c, s->flv_header);
+    start_playing(s, c);
+    printf("Live: HTTP-FLV viewer %s %s\n", c->addr, path);
+    return 0;
+}
+
+static int rtsp_reply(live_client_t *c, const char *status, const char *cseq,
+                      const char *headers, const char *body) {
+    char text[1024];
+    int n = snprintf(text, sizeof(text), "RTSP/1.0 %s\r\nCSeq: %s\r\n%s", status, cseq,
+                     headers ? headers : "");
+    if (n < 0 || (size_t)n >= sizeof(text)) {
+        return -1;
+    }
+    if (body) {
+        snprintf(text + n, sizeof(text) - n, "Content-Length: %zu\r\n\r\n", strlen(body));
+    } else {
+        snprintf(text + n, sizeof(text) - n, "\r\n");
+    }
+    return queue_text(c, text, body);
+}
+
+static int rtsp_request(live_server_t *s, live_client_t *c, char *req) {
+    char method[32];
+    char url[256];
+    char cseq[16] = "0";
+    char value[256];
+    char headers[512];
+    if (sscanf(req, "%31s %255s", method, url) != 2) {
+        return -1;
+    }
+    header_value(req, "CSeq", cseq, sizeof(cseq));
+
+    if (!strcmp(method, "OPTIONS")) {
+        return rtsp_reply(c, "200 OK", cseq,
+                          "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    }
+    if (!strcmp(method, "DESCRIBE")) {
+        if (!s->sdp) {
+            return rtsp_reply(c, "503 Service Unavailable", cseq, NULL, NULL);
+        }
+        snprintf(headers, sizeof(headers), "Content-Base: %s%s\r\nContent-Type: application/sdp\r\n",
+                 url, has_suffix(url, "/") ? "" : "/");
+        return rtsp_reply(c, "200 OK", cseq, headers, s->sdp);
+    }
+    if (!strcmp(method, "SETUP")) {
+        // 所有观众共享同一份打包好的数据，只支持TCP交织，通道固定为0-1
+        if (!header_value(req, "Transport", value, sizeof(value)) || !strstr(value, "TCP")) {
+            return rtsp_reply(c, "461 Unsupported Transport", cseq, NULL, NULL);
+        }
+        if (!c->session) {
+            c->session = (uint32_t)(monotonic_us() * 2654435761u) ^ (uint32_t)c->fd;
+        }
+        snprintf(headers, sizeof(headers),
+                 "Transport: RTP/AVP/TCP;unicast;interleaved=0-1;ssrc=%08X\r\nSession: %08X;timeout=60\r\n",
+                 s->rtp.ssrc, c->session);
+        return rtsp_reply(c, "200 OK", cseq, headers, NULL);
+    }
+    if (!strcmp(method, "PLAY")) {
+        if (!c->session || !s->sdp) {
+            return rtsp_reply(c, "455 Method Not Valid in This State", cseq, NULL, NULL);
+        }
+        // RTP-Info给出观众收到的第一个包，也就是缓存GOP的开头
+        uint16_t seq = s->rtp_next_seq;
+        uint32_t rtptime = s->rtp_next_time;
+        if (s->gop_count[LIVE_RTSP] > 0) {
+            seq = s->gop[LIVE_RTSP][0]->rtp_seq;
+            rtptime = s->gop[LIVE_RTSP][0]->rtp_time;
+        }
+        snprintf(headers, sizeof(headers),
+                 "Session: %08X\r\nRange: npt=0.000-\r\nRTP-Info: url=%s%strackID=0;seq=%u;rtptime=%u\r\n",
+                 c->session, url, has_suffix(url, "/") ? "" : "/", seq, rtptime);
+        if (rtsp_reply(c, "200 OK", cseq, headers, NULL) < 0) {
+            return -1;
+        }
+        if (!c->playing) {
+            start_playing(s, c);
+            printf("Live: RTSP viewer %s %s\n", c->addr, url);
+        }
+        return 0;
+    }
+    if (!strcmp(method, "TEARDOWN")) {
+        c->playing = 0;
+        c->closing = 1;
+        return rtsp_reply(c, "200 OK", cseq, NULL, NULL);
+    }
+    if (!strcmp(method, "GET_PARAMETER") || !strcmp(method, "SET_PARAMETER")) {
+        // 保活
+        return rtsp_reply(c, "200 OK", cseq, NULL, NULL);
+    }
+    return rtsp_reply(c, "501 Not Implemented", cseq, NULL, NULL);
+}
+
+static int client_parse(live_server_t *s, live_client_t *c) {
+    while (c->in_len > 0) {
+        if (c->in_skip > 0) {
+            size_t n = c->in_skip < c->in_len ? c->in_skip : c->in_len;
+            consume_input(c, n);
+            c->in_skip -= n;
+            continue;
+        }
+        // HTTP只处理一个请求，之后的输入丢弃
+        if (c->proto == LIVE_HTTP && (c->playing || c->closing)) {
+            c->in_len = 0;
+            break;
+        }
+        // 播放中客户端经TCP交织发来的RTCP
+        if (c->in[0] == '$') {
+            if (c->in_len < 4) {
+                break;
+            }
+            c->in_skip = 4 + (((size_t)(uint8_t)c->in[2] << 8) | (uint8_t)c->in[3]);
+            continue;
+        }
+        char *end = (char*)memmem(c->in, c->in_len, "\r\n\r\n", 4);
+        if (!end) {
+            break;
+        }
+        size_t len = end + 4 - c->in;
+        char req[LIVE_IN_SIZE + 1];
+        memcpy(req, c->in, len);
+        req[len] = '\0';
+        consume_input(c, len);
+
+        char value[32];
+        if (header_value(req, "Content-Length", value, sizeof(value))) {
+            c->in_skip = strtoul(value, NULL, 10);
+        }
+        int ret = c->proto == LIVE_HTTP ? http_request(s, c, req) : rtsp_request(s, c, req);
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int client_read(live_server_t *s, live_client_t *c) {
+    for (;;) {
+        if (c->in_len == sizeof(c->in)) {
+            return -1;                  // request header too large
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->in_len += n;
+        if (client_parse(s, c) < 0) {
+            return -1;
+        }
+    }
+}
+
+// Writes as much of the queue as the socket takes, several items per syscall
+static int client_flush(live_client_t *c) {
+    while (c->count > 0) {
+        struct iovec iov[LIVE_IOV_MAX];
+        int n = 0;
+        for (int i = 0; i < c->count && n < LIVE_IOV_MAX; i++) {
+            live_item_t *it = c->queue[(c->head + i) % LIVE_CLIENT_QUEUE];
+            size_t off = i == 0 ? c->offset : 0;
+            iov[n].iov_base = it->buf.data + off;
+            iov[n].iov_len = it->buf.size - off;
+            n++;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        ssize_t sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->sent_bytes += sent;
+        size_t left = sent;
+        while (left > 0 && c->count > 0) {
+            live_item_t *it = c->queue[c->head];
+            size_t remain = it->buf.size - c->offset;
+            if (left < remain) {
+                c->offset += left;
+                left = 0;
+            } else {
+                left -= remain;
+                client_pop(c);
+            }
+        }
+    }
+    return 0;
+}
+
+static void client_free(live_server_t *s, live_client_t *c) {
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    while (c->count > 0) {
+        client_pop(c);
+    }
+    free(c);
+}
+
+// ---- server thread ----
+
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Live server socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        fprintf(stderr, "Live server cannot listen on port %d: %s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void accept_clients(live_server_t *s, int fd, live_proto_t proto) {
+    for (;;) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int cfd = accept4(fd, (struct sockaddr*)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Live server accept");
+            }
+            return;
+        }
+        char ip[INET_ADDRSTRLEN] = "?";
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        if (s->client_count >= s->cfg.max_clients || s->client_count >= LIVE_MAX_CLIENTS) {
+            fprintf(stderr, "Live server full, refusing %s\n", ip);
+            close(cfd);
+            continue;
+        }
+        live_client_t *c = (live_client_t*)calloc(1, sizeof(live_client_t));
+        if (!c) {
+            close(cfd);
+            continue;
+        }
+        c->fd = cfd;
+        c->proto = proto;
+        snprintf(c->addr, sizeof(c->addr), "%s:%d", ip, ntohs(addr.sin_port));
+        int one = 1;
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, cfd, &ev) < 0) {
+            perror("Live server epoll_ctl");
+            close(cfd);
+            free(c);
+            continue;
+        }
+        s->clients[s->client_count++] = c;
+        s->clients_served++;
+    }
+}
+
+static void* live_server_thread(void *arg) {
+    live_server_t *s = (live_server_t*)arg;
+    struct epoll_event events[LIVE_EPOLL_EVENTS];
+
+    while (!__atomic_load_n(&s->abort, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(s->epoll_fd, events, LIVE_EPOLL_EVENTS, 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("Live server epoll_wait");
+            break;
+        }
+
+        pthread_mutex_lock(&s->mutex);
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &s->wake_fd) {
+                uint64_t v;
+                while (read(s->wake_fd, &v, sizeof(v)) > 0) {
+                }
+            } else if (ptr == &s->http_fd) {
+                accept_clients(s, s->http_fd, LIVE_HTTP);
+            } else if (ptr == &s->rtsp_fd) {
+                accept_clients(s, s->rtsp_fd, LIVE_RTSP);
+            } else {
+                live_client_t *c = (live_client_t*)ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    c->dead = 1;
+                } else if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && client_read(s, c) < 0) {
+                    c->dead = 1;
+                }
+            }
+        }
+
+        // 新数据包通过eventfd唤醒，这里统一写出；写不完的等EPOLLOUT
+        for (int i = 0; i < s->client_count; i++) {
+            live_client_t *c = s->clients[i];
+            if (!c->dead && client_flush(c) < 0) {
+                c->dead = 1;
+            }
+        }
+        for (int i = 0; i < s->client_count;) {
+            live_client_t *c = s->clients[i];
+            if (c->dead || (c->closing && c->count == 0)) {
+                if (c->playing) {
+                    printf("Live: %s viewer %s left, sent %llu KB, dropped %llu\n", proto_name(c->proto),
+                           c->addr, (unsigned long long)c->sent_bytes / 1024,
+                           (unsigned long long)c->dropped_items);
+                }
+                client_free(s, c);
+                s->clients[i] = s->clients[--s->client_count];
+            } else {
+                i++;
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+static void wake(live_server_t *s) {
+    uint64_t one = 1;
+    if (write(s->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("Live server wake");
+    }
+}
+
+static int watch_fd(live_server_t *s, int *fd) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = fd;
+    return epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, *fd, &ev);
+}
+
+// ---- public API ----
+
+live_server_t* live_server_open(const live_config_t *cfg) {
+    live_server_t *s = (live_server_t*)calloc(1, sizeof(live_server_t));
+    if (!s) {
+        perror("Failed to allocate live server");
+        return NULL;
+    }
+    s->cfg = *cfg;
+    s->http_fd = -1;
+    s->rtsp_fd = -1;
+    pthread_mutex_init(&s->mutex, NULL);
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (s->epoll_fd < 0 || s->wake_fd < 0 || watch_fd(s, &s->wake_fd) < 0) {
+        perror("Live server epoll");
+        live_server_close(s);
+        return NULL;
+    }
+    if ((cfg->http_port > 0 && ((s->http_fd = listen_on(cfg->http_port)) < 0 || watch_fd(s, &s->http_fd) < 0)) ||
+        (cfg->rtsp_port > 0 && ((s->rtsp_fd = listen_on(cfg->rtsp_port)) < 0 || watch_fd(s, &s->rtsp_fd) < 0))) {
+        live_server_close(s);
+        return NULL;
+    }
+
+    uint32_t ssrc = (uint32_t)(monotonic_us() * 2654435761u) ^ (uint32_t)getpid();
+    rtp_packetizer_init(&s->rtp, RTP_H264_PAYLOAD_TYPE, ssrc, RTP_DEFAULT_PAYLOAD);
+    s->rtp_next_seq = s->rtp.seq;
+
+    if (pthread_create(&s->thread, NULL, live_server_thread, s) != 0) {
+        perror("Failed to create live server thread");
+        live_server_close(s);
+        return NULL;
+    }
+    s->thread_started = 1;
+    if (s->http_fd >= 0) {
+        printf("Live server: HTTP-FLV on http://<host>:%d/live.flv\n", cfg->http_port);
+    }
+    if (s->rtsp_fd >= 0) {
+        printf("Live server: RTSP on rtsp://<host>:%d/live\n", cfg->rtsp_port);
+    }
+    return s;
+}
+
+int live_server_set_audio(live_server_t *s, const AVCodecParameters *codecpar, AVRational time_base) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par || avcodec_parameters_copy(par, codecpar) < 0) {
+        avcodec_parameters_free(&par);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_lock(&s->mutex);
+    avcodec_parameters_free(&s->audio_codecpar);
+    s->audio_codecpar = par;
+    s->audio_time_base = time_base;
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+static char* build_sdp(live_server_t *s, const AVCodecParameters *par) {
+    char media[1024];
+    if (rtp_h264_sdp_media(par, s->rtp.payload_type, 0, media, sizeof(media)) < 0) {
+        return NULL;
+    }
+    byte_buf_t b;
+    memset(&b, 0, sizeof(b));
+    byte_buf_printf(&b, "v=0\r\no=- %u 1 IN IP4 0.0.0.0\r\ns=live\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\n"
+                        "a=control:*\r\n%sa=control:trackID=0\r\n", s->rtp.ssrc, media);
+    if (b.error) {
+        byte_buf_free(&b);
+        return NULL;
+    }
+    return (char*)b.data;
+}
+
+int live_server_start(live_server_t *s, const AVCodecParameters *codecpar, AVRational time_base) {
+    if (codecpar->codec_id != AV_CODEC_ID_H264) {
+        fprintf(stderr, "Live server only serves H.264, viewers are refused\n");
+        return -1;
+    }
+    // 新观众: 文件头 + 元数据 + 序列头；已在播放的观众只需要新的元数据和序列头
+    live_item_t *header = item_new(1);
+    live_item_t *update = item_new(1);
+    char *sdp = build_sdp(s, codecpar);
+    int ret = header && update && sdp ? 0 : -1;
+    if (ret == 0) {
+        flv_write_file_header(&header->buf, s->audio_codecpar != NULL);
+        for (int i = 0; i < 2 && ret == 0; i++) {
+            live_item_t *it = i == 0 ? header : update;
+            flv_write_metadata(&it->buf, codecpar, s->cfg.fps, s->audio_codecpar);
+            ret = flv_write_avc_config(&it->buf, codecpar);
+            if (ret == 0 && s->audio_codecpar) {
+                ret = flv_write_aac_config(&it->buf, s->audio_codecpar);
+            }
+            if (it->buf.error) {
+                ret = -1;
+            }
+        }
+    }
+    if (ret < 0) {
+        fprintf(stderr, "Live server: no usable SPS/PPS in the encoder extradata\n");
+        item_unref(header);
+        item_unref(update);
+        free(sdp);
+        return -1;
+    }
+
+    pthread_mutex_lock(&s->mutex);
+    int restart = s->codecpar != NULL;
+    if (!s->codecpar) {
+        s->codecpar = avcodec_parameters_alloc();
+    }
+    if (!s->codecpar || avcodec_parameters_copy(s->codecpar, codecpar) < 0) {
+        ret = -1;
+    }
+    s->time_base = time_base;
+    item_unref(s->flv_header);
+    s->flv_header = header;
+    free(s->sdp);
+    s->sdp = sdp;
+    clear_gop(s, LIVE_HTTP);
+    clear_gop(s, LIVE_RTSP);
+    // 分辨率变化: FLV观众收到新的序列头继续播放；RTSP关键帧前带有新的SPS/PPS
+    for (int i = 0; restart && i < s->client_count; i++) {
+        live_client_t *c = s->clients[i];
+        if (c->proto == LIVE_HTTP && c->playing) {
+            client_push(c, update);
+        }
+    }
+    pthread_mutex_unlock(&s->mutex);
+    item_unref(update);
+    wake(s);
+    return ret;
+}
+
+static int append_interleaved(void *opaque, const uint8_t *header, size_t header_size,
+                              const uint8_t *payload, size_t payload_size) {
+    byte_buf_t *b = (byte_buf_t*)opaque;
+    byte_buf_u8(b, '$');
+    byte_buf_u8(b, 0);                  // RTP channel
+    byte_buf_be16(b, header_size + payload_size);
+    byte_buf_append(b, header, header_size);
+    byte_buf_append(b, payload, payload_size);
+    return b->error ? -1 : 0;
+}
+
+void live_server_send(live_server_t *s, const AVPacket *pkt) {
+    // codecpar只在编码线程中修改，这里读取不需要加锁
+    if (!s->codecpar) {
+        return;
+    }
+    int video = pkt->stream_index == 0;
+    if (!video && !s->audio_codecpar) {
+        return;
+    }
+    live_item_t *flv = NULL;
+    live_item_t *rtp = NULL;
+    // 每个包每种协议只序列化一次，所有观众共享引用
+    if (s->http_fd >= 0 && (flv = item_new(0))) {
+        flv->key = video && (pkt->flags & AV_PKT_FLAG_KEY);
+        if (video) {
+            flv_write_video(&flv->buf, pkt, s->time_base);
+        } else {
+            flv_write_audio(&flv->buf, pkt, s->audio_time_base);
+        }
+    }
+    if (s->rtsp_fd >= 0 && video && (rtp = item_new(0))) {
+        rtp->key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+        rtp->rtp_seq = s->rtp.seq;
+        rtp->rtp_time = rtp_timestamp(pkt->pts, s->time_base);
+        rtp_packetize_h264(&s->rtp, pkt, s->time_base, s->codecpar, append_interleaved, &rtp->buf);
+    }
+
+    pthread_mutex_lock(&s->mutex);
+    publish(s, LIVE_HTTP, flv);
+    if (rtp) {
+        s->rtp_next_seq = s->rtp.seq;
+        s->rtp_next_time = rtp->rtp_time;
+        publish(s, LIVE_RTSP, rtp);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    wake(s);
+}
+
+void live_server_list(live_server_t *s) {
+    pthread_mutex_lock(&s->mutex);
+    printf("%d live viewer(s), %llu served, GOP cache %d/%d items:\n", s->client_count,
+           (unsigned long long)s->clients_served, s->gop_count[LIVE_HTTP], s->gop_count[LIVE_RTSP]);
+    for (int i = 0; i < s->client_count; i++) {
+        live_client_t *c = s->clients[i];
+        printf("  %-4s %s: %s, queue %d (%zu KB), sent %llu KB, dropped %llu\n", proto_name(c->proto),
+               c->addr, c->playing ? "playing" : "setup", c->count, c->queued_bytes / 1024,
+               (unsigned long long)c->sent_bytes / 1024, (unsigned long long)c->dropped_items);
+    }
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void live_server_close(live_server_t *s) {
+    if (!s) return;
+    if (s->thread_started) {
+        __atomic_store_n(&s->abort, 1, __ATOMIC_RELEASE);
+        wake(s);
+        pthread_join(s->thread, NULL);
+    }
+    for (int i = 0; i < s->client_count; i++) {
+        client_free(s, s->clients[i]);
+    }
+    clear_gop(s, LIVE_HTTP);
+    clear_gop(s, LIVE_RTSP);
+    item_unref(s->flv_header);
+    free(s->sdp);
+    avcodec_parameters_free(&s->codecpar);
+    avcodec_parameters_free(&s->audio_codecpar);
+    if (s->http_fd >= 0) close(s->http_fd);
+    if (s->rtsp_fd >= 0) close(s->rtsp_fd);
+    if (s->wake_fd >= 0) close(s->wake_fd);
+    if (s->epoll_fd >= 0) close(s->epoll_fd);
+    pthread_mutex_destroy(&s->mutex);
+    free(s);
+}
@@ -1,5 +1,7 @@
+#include <stdio.h>
 #include "camera.h"
 #include "buffer_manager.h"
+#include "app_config.h"
 
 struct v4l2_dev im335 = {
     .fd = -1,
@@ -20,17 +22,42 @@ struct v4l2_dev im335 = {
     .out_data = NULL,
 };
 
-int main()
+int main(int argc, char **argv)
 {
-    struct v4l2_dev *camdev = &im335;
-    // 初始化摄像头
-    camera_init(camdev);
+    app_config_t config;
+    app_config_default(&config);
+    int ret = app_config_parse(&config, argc, argv);
+    if (ret != 0) {
+        return ret < 0 ? 1 : 0;
+    }
 
-    // 启动多线程
-    main_multithreaded(camdev, camdev->width, camdev->height);
+    // 每个摄像头复制一份im335的设置，只替换设备节点
+    static struct v4l2_dev cameras[APP_MAX_CAMERAS];
+    static char subdev_paths[APP_MAX_CAMERAS][32];
+    struct v4l2_dev *camdevs[APP_MAX_CAMERAS];
+    int camera_count = 1 + config.camera_count;
+    for (int i = 0; i < camera_count; i++) {
+        cameras[i] = im335;
+        if (i == 0) {
+            cameras[i].path = config.source;
+        } else {
+            const camera_config_t *cam = &config.cameras[i - 1];
+            snprintf(subdev_paths[i], sizeof(subdev_paths[i]), "/dev/v4l-subdev%d", i);
+            cameras[i].path = cam->source;
+            cameras[i].subdev_path = cam->subdev ? cam->subdev : subdev_paths[i];
+        }
+        camdevs[i] = &cameras[i];
+        // 初始化摄像头
+        camera_init(camdevs[i]);
+    }
+
+    // 启动多线程，管线出现致命错误时以非零状态退出
+    ret = main_multithreaded(camdevs, camera_count, &config);
 
     // 清理资源
-    camera_deinit(camdev);
+    for (int i = 0; i < camera_count; i++) {
+        camera_deinit(camdevs[i]);
+    }
 
-    return 0;
+    return ret < 0 ? 1 : 0;
 }
@@ -0,0 +1,81 @@
+#include "mock_detector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// 模拟NPU耗时，jitter让各worker的完成顺序交错
+static void mock_sleep(int latency_ms, int jitter_ms, unsigned int *seed) {
+    int us = latency_ms * 1000;
+    if (jitter_ms > 0) {
+        us += (int)(rand_r(seed) % (2 * jitter_ms * 1000 + 1)) - jitter_ms * 1000;
+    }
+    if (us > 0) {
+        usleep(us);
+    }
+}
+
+static unsigned int mock_seed(const void *instance) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    // 每个实例不同的随机序列
+    return (unsigned int)(now.tv_nsec ^ (uintptr_t)instance);
+}
+
+MockDetector::MockDetector(int latency_ms, int jitter_ms)
+    : latency_ms(latency_ms), jitter_ms(jitter_ms), seed(0) {
+}
+
+int MockDetector::Init(const char* model_path, int width, int height) {
+    seed = mock_seed(this);
+    printf("Mock detector for %s: %d ms +- %d ms per run\n", model_path, latency_ms, jitter_ms);
+    return 0;
+}
+
+int MockDetector::SetCoreMask(int core_mask) {
+    return 0;
+}
+
+int MockDetector::InferenceBatch(unsigned char* const* input_data, const int* img_width, const int* img_height,
+                                 int count, detect_result_group_t* detect_results) {
+    if (count != 1) {
+        return -1;
+    }
+    mock_sleep(latency_ms, jitter_ms, &seed);
+    // 画面中央一个固定的"person"，第二级和叠加在主机上也有框可用
+    memset(detect_results, 0, sizeof(*detect_results));
+    detect_result_t *det = &detect_results->results[0];
+    snprintf(det->name, sizeof(det->name), "person");
+    det->box.left = img_width[0] / 4;
+    det->box.top = img_height[0] / 4;
+    det->box.right = img_width[0] * 3 / 4;
+    det->box.bottom = img_height[0] * 3 / 4;
+    det->prop = 0.9f;
+    detect_results->count = 1;
+    return 0;
+}
+
+MockModel::MockModel(int latency_ms, int jitter_ms)
+    : latency_ms(latency_ms), jitter_ms(jitter_ms), seed(0) {
+}
+
+int MockModel::Init(const char* model_path) {
+    seed = mock_seed(this);
+    printf("Mock second-stage model for %s: %d ms +- %d ms per run\n", model_path, latency_ms, jitter_ms);
+    return 0;
+}
+
+int MockModel::Run(const unsigned char* input, int count, float* output) {
+    if (count < 1 || count > BatchSize()) {
+        return -1;
+    }
+    mock_sleep(latency_ms, jitter_ms, &seed);
+    // 输入第一个字节决定"类别"，调用方能核对结果没有对错位置
+    memset(output, 0, (size_t)count * OutputSize() * sizeof(float));
+    size_t input_bytes = (size_t)InputWidth() * InputHeight() * 3;
+    for (int i = 0; i < count; i++) {
+        output[i * OutputSize() + input[i * input_bytes] % OutputSize()] = 1.0f;
+    }
+    return 0;
+}
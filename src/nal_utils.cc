@@ -0,0 +1,178 @@
+#include <string.h>
+#include "nal_utils.h"
+
+static int is_annexb(const uint8_t *buf, size_t size) {
+    return (size >= 3 && buf[0] == 0 && buf[1] == 0 && buf[2] == 1) ||
+           (size >= 4 && buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] == 1);
+}
+
+static size_t find_start_code(const uint8_t *buf, size_t size, size_t pos) {
+    for (size_t i = pos; i + 3 <= size; i++) {
+        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1) {
+            return i;
+        }
+    }
+    return size;
+}
+
+int nal_next(const uint8_t *buf, size_t size, size_t *pos, nal_unit_t *nal) {
+    if (!buf || *pos >= size) {
+        return 0;
+    }
+
+    if (is_annexb(buf, size)) {
+        size_t start = find_start_code(buf, size, *pos);
+        if (start >= size) {
+            *pos = size;
+            return 0;
+        }
+        start += 3;
+        size_t end = find_start_code(buf, size, start);
+        *pos = end;
+        // 4字节起始码的前导0属于下一个起始码，不属于本NAL
+        while (end > start && end < size && buf[end - 1] == 0) {
+            end--;
+        }
+        nal->data = buf + start;
+        nal->size = end - start;
+        return nal->size > 0 ? 1 : nal_next(buf, size, pos, nal);
+    }
+
+    if (*pos + 4 > size) {
+        *pos = size;
+        return 0;
+    }
+    uint32_t len = ((uint32_t)buf[*pos] << 24) | ((uint32_t)buf[*pos + 1] << 16) |
+                   ((uint32_t)buf[*pos + 2] << 8) | buf[*pos + 3];
+    if (len == 0 || *pos + 4 + len > size) {
+        *pos = size;
+        return 0;
+    }
+    nal->data = buf + *pos + 4;
+    nal->size = len;
+    *pos += 4 + len;
+    return 1;
+}
+
+int nal_type(enum AVCodecID codec_id, const nal_unit_t *nal) {
+    if (nal->size < 1) {
+        return -1;
+    }
+    if (codec_id == AV_CODEC_ID_HEVC) {
+        return (nal->data[0] >> 1) & 0x3f;
+    }
+    return nal->data[0] & 0x1f;
+}
+
+int nal_is_vcl(enum AVCodecID codec_id, int type) {
+    if (codec_id == AV_CODEC_ID_HEVC) {
+        return type >= 0 && type <= 31;
+    }
+    return type >= 1 && type <= 5;
+}
+
+int nal_is_idr(enum AVCodecID codec_id, int type) {
+    if (codec_id == AV_CODEC_ID_HEVC) {
+        return type >= 16 && type <= 21; // BLA/IDR/CRA
+    }
+    return type == 5;
+}
+
+// avcC: version, profile, compat, level, length size, SPS count + (u16 size, SPS)..., PPS count + ...
+static int parse_avcc(const uint8_t *buf, size_t size, nal_unit_t *sps, nal_unit_t *pps) {
+    size_t pos = 5;
+    for (int list = 0; list < 2; list++) {
+        if (pos >= size) {
+            return -1;
+        }
+        int count = list == 0 ? (buf[pos] & 0x1f) : buf[pos];
+        pos++;
+        for (int i = 0; i < count; i++) {
+            if (pos + 2 > size) {
+                return -1;
+            }
+            size_t len = ((size_t)buf[pos] << 8) | buf[pos + 1];
+            pos += 2;
+            if (pos + len > size) {
+                return -1;
+            }
+            nal_unit_t *dst = list == 0 ? sps : pps;
+            if (i == 0) {
+                dst->data = buf + pos;
+                dst->size = len;
+            }
+            pos += len;
+        }
+    }
+    return sps->size > 0 && pps->size > 0 ? 0 : -1;
+}
+
+int nal_h264_parameter_sets(const uint8_t *extradata, size_t size, nal_unit_t *sps, nal_unit_t *pps) {
+    memset(sps, 0, sizeof(*sps));
+    memset(pps, 0, sizeof(*pps));
+    if (!extradata || size < 4) {
+        return -1;
+    }
+    if (extradata[0] == 1) {
+        return parse_avcc(extradata, size, sps, pps);
+    }
+
+    size_t pos = 0;
+    nal_unit_t nal;
+    while (nal_next(extradata, size, &pos, &nal)) {
+        int type = nal_type(AV_CODEC_ID_H264, &nal);
+        if (type == 7 && !sps->size) {
+            *sps = nal;
+        } else if (type == 8 && !pps->size) {
+            *pps = nal;
+        }
+    }
+    return sps->size > 0 && pps->size > 0 ? 0 : -1;
+}
+
+int nal_packet_is_idr(enum AVCodecID codec_id, const AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+        return 0;
+    }
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC) {
+        return 1;
+    }
+
+    // 第一个VCL NAL决定整帧的类型，前面的SPS/PPS/SEI跳过
+    size_t pos = 0;
+    nal_unit_t nal;
+    while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+        int type = nal_type(codec_id, &nal);
+        if (nal_is_vcl(codec_id, type)) {
+            return nal_is_idr(codec_id, type);
+        }
+    }
+    return 0;
+}
+
+int nal_packet_is_disposable(enum AVCodecID codec_id, const AVPacket *pkt) {
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        return 0;
+    }
+    if (pkt->flags & AV_PKT_FLAG_DISPOSABLE) {
+        return 1;
+    }
+    if (codec_id != AV_CODEC_ID_H264 && codec_id != AV_CODEC_ID_HEVC) {
+        return 0;
+    }
+
+    size_t pos = 0;
+    nal_unit_t nal;
+    while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+        int type = nal_type(codec_id, &nal);
+        if (!nal_is_vcl(codec_id, type)) {
+            continue;
+        }
+        if (codec_id == AV_CODEC_ID_HEVC) {
+            // TRAIL_N/TSA_N/STSA_N/RADL_N/RASL_N/RSV_VCL_N1x: even types below 16
+            return type < 16 && (type % 2) == 0;
+        }
+        return ((nal.data[0] >> 5) & 0x3) == 0; // nal_ref_idc
+    }
+    return 0;
+}
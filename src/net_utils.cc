@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "net_utils.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+static int same_peer(const struct sockaddr_storage *a, const struct addrinfo *ai) {
+    if (a->ss_family != ai->ai_family) {
+        return 0;
+    }
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *x = (const struct sockaddr_in*)a;
+        const struct sockaddr_in *y = (const struct sockaddr_in*)ai->ai_addr;
+        return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *x = (const struct sockaddr_in6*)a;
+        const struct sockaddr_in6 *y = (const struct sockaddr_in6*)ai->ai_addr;
+        return x->sin6_port == y->sin6_port &&
+               !memcmp(&x->sin6_addr, &y->sin6_addr, sizeof(x->sin6_addr));
+    }
+    return 0;
+}
+
+// Calls fn for every socket fd of the process until it returns non-zero
+static void for_each_socket(int (*fn)(void *opaque, int fd, const struct stat *st), void *opaque) {
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        int fd = atoi(de->d_name);
+        struct stat st;
+        if (de->d_name[0] == '.' || fd == dirfd(dir) ||
+            fstat(fd, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+            continue;
+        }
+        if (fn(opaque, fd, &st)) {
+            break;
+        }
+    }
+    closedir(dir);
+}
+
+static int add_inode(void *opaque, int fd, const struct stat *st) {
+    net_socket_set_t *set = (net_socket_set_t*)opaque;
+    if (set->count % 32 == 0) {
+        ino_t *grown = (ino_t*)realloc(set->inodes, (set->count + 32) * sizeof(ino_t));
+        if (!grown) {
+            return 1;
+        }
+        set->inodes = grown;
+    }
+    set->inodes[set->count++] = st->st_ino;
+    return 0;
+}
+
+int net_socket_snapshot(net_socket_set_t *set) {
+    set->inodes = NULL;
+    set->count = 0;
+    for_each_socket(add_inode, set);
+    return 0;
+}
+
+void net_socket_set_free(net_socket_set_t *set) {
+    free(set->inodes);
+    set->inodes = NULL;
+    set->count = 0;
+}
+
+typedef struct {
+    const net_socket_set_t *before;
+    struct addrinfo *peers;
+    int found;
+    int matches;
+} peer_search_t;
+
+static int match_new_peer(void *opaque, int fd, const struct stat *st) {
+    peer_search_t *search = (peer_search_t*)opaque;
+    for (int i = 0; i < search->before->count; i++) {
+        if (search->before->inodes[i] == st->st_ino) {
+            return 0;
+        }
+    }
+    struct sockaddr_storage peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr*)&peer, &len) < 0) {
+        return 0;
+    }
+    for (struct addrinfo *ai = search->peers; ai; ai = ai->ai_next) {
+        if (same_peer(&peer, ai)) {
+            search->found = fd;
+            search->matches++;
+            break;
+        }
+    }
+    return 0;
+}
+
+int net_find_new_peer_socket(const net_socket_set_t *before, const char *url, int default_port) {
+    char host[256] = {0};
+    char port_str[16];
+    int port = -1;
+    av_url_split(NULL, 0, NULL, 0, host, sizeof(host), &port, NULL, 0, url);
+    if (!host[0]) {
+        return -1;
+    }
+    snprintf(port_str, sizeof(port_str), "%d", port > 0 ? port : default_port);
+
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) {
+        return -1;
+    }
+    peer_search_t search = { before, res, -1, 0 };
+    for_each_socket(match_new_peer, &search);
+    freeaddrinfo(res);
+    // 同时有别的输出连上了同一个服务器，分不清哪个是自己的，宁可不用
+    return search.matches == 1 ? search.found : -1;
+}
+
+int net_get_tcp_info(int fd, struct tcp_info *info) {
+    socklen_t len = sizeof(*info);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(info, 0, sizeof(*info));
+    return getsockopt(fd, IPPROTO_TCP, TCP_INFO, info, &len) < 0 ? -1 : 0;
+}
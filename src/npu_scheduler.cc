@@ -0,0 +1,1108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "npu_scheduler.h"
+#include "packet_queue.h"
+#include "detector.h"
+#include "npu_model.h"
+
+void npu_config_default(npu_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->model_path = NPU_DEFAULT_MODEL;
+    cfg->batch_window_ms = 5;
+    cfg->deadline_ms = 100;
+    cfg->policy = NPU_POLICY_WFQ;
+    cfg->backend = "rknn";
+    cfg->workers = 1;
+}
+
+const char* npu_policy_name(npu_policy_t policy) {
+    return policy == NPU_POLICY_RR ? "rr" : "wfq";
+}
+
+int npu_parse_policy(const char *name, npu_policy_t *policy) {
+    if (!strcasecmp(name, "rr")) {
+        *policy = NPU_POLICY_RR;
+    } else if (!strcasecmp(name, "wfq")) {
+        *policy = NPU_POLICY_WFQ;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int npu_parse_core_masks(const char *list, npu_config_t *cfg) {
+    int count = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long mask = strtol(p, &end, 0);
+        if (end == p || mask < 0 || mask > 7 || count >= NPU_MAX_WORKERS || (*end && *end != ',')) {
+            return -1;
+        }
+        cfg->core_masks[count++] = (int)mask;
+        p = *end ? end + 1 : end;
+    }
+    if (count == 0) {
+        return -1;
+    }
+    cfg->core_mask_count = count;
+    return 0;
+}
+
+// 这个摄像头还能再派发一帧: 重排环里没结果的帧不能超过worker数
+static int client_can_dispatch(const npu_scheduler_t *s, const npu_client_t *c) {
+    return c->pending && !c->filling && c->dispatch_seq - c->emit_seq < (uint64_t)s->worker_count;
+}
+
+// 按调度策略排序的待推理摄像头，最多max个，调用时持有mutex
+static int collect_clients(npu_scheduler_t *s, npu_client_t **picked, double *tags, int max) {
+    int count = 0;
+    for (int n = 0; n < s->client_count; n++) {
+        npu_client_t *c = s->clients[(s->rr_next + n) % s->client_count];
+        if (!client_can_dispatch(s, c)) {
+            continue;
+        }
+        // 加权公平排队: 开始标签 = max(上次完成标签, 系统虚拟时间)，小的先服务;
+        // 轮询保持从rr_next开始的顺序。标签相同时也按轮转顺序
+        double tag = c->vtime > s->vclock ? c->vtime : s->vclock;
+        int pos = count;
+        if (s->cfg.policy == NPU_POLICY_WFQ) {
+            while (pos > 0 && tags[pos - 1] > tag) {
+                pos--;
+            }
+        }
+        if (pos >= max) {
+            continue;
+        }
+        for (int k = (count < max ? count : max - 1); k > pos; k--) {
+            picked[k] = picked[k - 1];
+            tags[k] = tags[k - 1];
+        }
+        picked[pos] = c;
+        tags[pos] = tag;
+        if (count < max) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// 凑批是否值得等: 还有摄像头可能送帧，且再多一帧时批量比逐帧快
+static int batch_worth_waiting(const npu_scheduler_t *s, int batch_size, int count) {
+    if (batch_size <= 1 || count >= batch_size || count >= s->client_count) {
+        return 0;
+    }
+    return s->batch_ms <= 0 || s->single_ms <= 0 || s->batch_ms < (count + 1) * s->single_ms;
+}
+
+static void timed_wait_until(npu_scheduler_t *s, int64_t until_us) {
+    int64_t wait_us = until_us - monotonic_us();
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_us / 1000000;
+    deadline.tv_nsec += (long)(wait_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&s->cond, &s->mutex, &deadline);
+}
+
+// 按序号顺序交出结果: 先完成的新帧等旧帧出来后才可见，调用时持有mutex
+static void emit_in_order(npu_client_t *c) {
+    while (c->emit_seq < c->dispatch_seq) {
+        npu_reorder_slot_t *slot = &c->ring[c->emit_seq % NPU_MAX_WORKERS];
+        if (!slot->done) {
+            break;
+        }
+        if (slot->ok) {
+            c->result = slot->result;
+            c->result.id = (int)slot->seq;
+            c->result_seq++;
+        }
+        slot->done = 0;
+        c->emit_seq++;
+    }
+}
+
+typedef struct {
+    npu_client_t *client;
+    int frame;                  // index into client->frames
+    uint64_t seq;
+    double tag;                 // WFQ start tag
+    double charge_ms;           // NPU time charged at dispatch, corrected on completion
+    int64_t submit_us;          // when the camera queued the frame
+} npu_dispatch_t;
+
+#define NPU_ADAPT_HOLD_US 2000000   // a new level runs this long before the next decision
+
+static const char* level_path(const npu_scheduler_t *s, int level) {
+    return level == 0 ? s->cfg.model_path : s->cfg.lite_models[level - 1];
+}
+
+// 按实测的端到端延迟在各个分辨率的模型之间切换，调用时持有mutex
+static void adapt_level(npu_scheduler_t *s, int64_t now) {
+    if (s->level_count <= 1 || s->e2e_ms <= 0 || now - s->level_since_us < NPU_ADAPT_HOLD_US) {
+        return;
+    }
+    double budget = s->cfg.deadline_ms;
+    int level = s->level;
+    if (s->e2e_ms > budget && level < s->level_count - 1) {
+        level++;
+    } else if (level > 0 && s->level_ms[level] > 0 && s->level_ms[level - 1] > 0 &&
+               s->e2e_ms * s->level_ms[level - 1] / s->level_ms[level] < budget * 0.8) {
+        // 换回大模型后的延迟按两个模型的耗时比例估计，留两成余量防止来回切换
+        level--;
+    }
+    if (level == s->level) {
+        return;
+    }
+    printf("Detection model: %s -> %s, end-to-end %.1f ms against a %d ms budget\n",
+           level_path(s, s->level), level_path(s, level), s->e2e_ms, s->cfg.deadline_ms);
+    s->level = level;
+    s->level_since_us = now;
+    s->level_switches++;
+    s->single_ms = s->level_ms[level];
+    // 旧模型下的延迟不再有参考价值
+    s->e2e_ms = 0;
+}
+
+// 离下一帧检测任务到来还有多久。停了的摄像头(超过一个帧间隔没送帧)不算;
+// *recheck_us是最早的"算停了"的时刻，到时如果帧还没来就重新评估
+static int64_t detection_slack(const npu_scheduler_t *s, int64_t now, int64_t *recheck_us) {
+    int64_t slack = INT64_MAX;
+    for (int i = 0; i < s->client_count; i++) {
+        const npu_client_t *c = s->clients[i];
+        if (c->interval_us <= 0) {
+            continue;
+        }
+        int64_t next = c->last_call_us + c->interval_us;
+        if (c->max_fps > 0 && c->next_due_us > next) {
+            next = c->next_due_us;
+        }
+        int64_t stall = next + c->interval_us;
+        if (now >= stall) {
+            continue;
+        }
+        if (next - now < slack) {
+            slack = next - now;
+        }
+        if (*recheck_us == 0 || stall < *recheck_us) {
+            *recheck_us = stall;
+        }
+    }
+    return slack < 0 ? 0 : slack;
+}
+
+// 过了截止时间还没跑完的任务，调用时持有mutex
+static npu_job_t* expired_job(npu_scheduler_t *s, int64_t now) {
+    for (int m = 0; m < s->model_count; m++) {
+        for (int j = 0; j < NPU_MODEL_QUEUE; j++) {
+            npu_job_t *job = &s->models[m].jobs[j];
+            if (job->state == NPU_JOB_QUEUED && !job->running && job->deadline_us && now > job->deadline_us) {
+                job->failed = 1;
+                s->models[m].expired++;
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 优先级高的模型先跑，同优先级先到截止时间的先跑，再按提交顺序。
+// 只有这一片能在下一帧检测到来之前跑完，或者有别的worker空着能接检测帧时才跑
+static npu_job_t* pick_job(npu_scheduler_t *s, int64_t now, int64_t *recheck_us) {
+    npu_job_t *best = NULL;
+    for (int m = 0; m < s->model_count; m++) {
+        for (int j = 0; j < NPU_MODEL_QUEUE; j++) {
+            npu_job_t *job = &s->models[m].jobs[j];
+            if (job->state != NPU_JOB_QUEUED || job->running) {
+                continue;
+            }
+            if (job->deadline_us && (*recheck_us == 0 || job->deadline_us < *recheck_us)) {
+                *recheck_us = job->deadline_us + 1;
+            }
+            if (!best) {
+                best = job;
+                continue;
+            }
+            int prio = s->models[m].cfg.priority;
+            int best_prio = s->models[best->model].cfg.priority;
+            int64_t deadline = job->deadline_us ? job->deadline_us : INT64_MAX;
+            int64_t best_deadline = best->deadline_us ? best->deadline_us : INT64_MAX;
+            if (prio > best_prio || (prio == best_prio && (deadline < best_deadline ||
+                (deadline == best_deadline && job->seq < best->seq)))) {
+                best = job;
+            }
+        }
+    }
+    if (!best || s->idle_workers > 0) {
+        return best;
+    }
+    int64_t slack = detection_slack(s, now, recheck_us);
+    // 还没测过耗时的模型先跑一片量一下
+    double run_ms = s->models[best->model].run_ms;
+    return run_ms <= 0 || slack >= (int64_t)(run_ms * 1000) ? best : NULL;
+}
+
+// 任务结束: 不持锁回调，回调返回后槽位才能复用
+static void finish_job(npu_scheduler_t *s, npu_job_t *job) {
+    npu_model_t *m = &s->models[job->model];
+    job->state = NPU_JOB_DONE;
+    if (!job->failed) {
+        m->completed++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    if (job->done) {
+        job->done(job->opaque, job->failed ? NULL : job->output, job->count, m->output_size);
+    }
+    pthread_mutex_lock(&s->mutex);
+    job->state = NPU_JOB_FREE;
+}
+
+// 跑任务的一片(最多一个batch)，然后回到检测优先的调度，调用时持有mutex
+static void run_slice(npu_scheduler_t *s, npu_worker_t *w, npu_job_t *job, NpuModel *model) {
+    npu_model_t *m = &s->models[job->model];
+    int first = job->next;
+    int n = job->count - first < m->batch ? job->count - first : m->batch;
+    job->running = 1;
+    job->next += n;
+    pthread_mutex_unlock(&s->mutex);
+
+    int64_t t0 = monotonic_us();
+    int ret = model->Run(job->input + first * m->input_size, n, job->output + (size_t)first * m->output_size);
+    int64_t t1 = monotonic_us();
+
+    pthread_mutex_lock(&s->mutex);
+    double ms = (t1 - t0) / 1000.0;
+    m->run_ms = m->run_ms > 0 ? m->run_ms * 0.9 + ms * 0.1 : ms;
+    m->runs++;
+    m->inputs += n;
+    m->busy_us += t1 - t0;
+    w->runs++;
+    w->busy_us += t1 - t0;
+    job->running = 0;
+    if (ret < 0) {
+        printf("Second-stage model %s failed!\n", m->cfg.name);
+        job->failed = 1;
+    }
+    if (job->failed || job->next >= job->count) {
+        finish_job(s, job);
+    }
+    // 别的worker可能在等这个任务或者等检测帧
+    pthread_cond_broadcast(&s->cond);
+}
+
+static Detector* load_detector(npu_worker_t *w, const char *model_path, const char *labels_path) {
+    Detector *det = detector_create(w->s->cfg.backend);
+    if (!det) {
+        return NULL;
+    }
+    if (det->Init(model_path) < 0 || (labels_path && det->SetLabels(labels_path) < 0)) {
+        delete det;
+        return NULL;
+    }
+    // 0 = RKNN_NPU_CORE_AUTO，交给驱动
+    if (w->core_mask) {
+        det->SetCoreMask(w->core_mask);
+    }
+    return det;
+}
+
+// 空跑两次，正式推理时不用付首次推理的代价；返回第二次的耗时，-1 = 没跑成
+static double warm_up(Detector *det) {
+    int warm_w = 640, warm_h = 640;
+    unsigned char *warm = (unsigned char*)malloc(warm_w * warm_h * 3 / 2);
+    if (!warm) {
+        return -1;
+    }
+    memset(warm, 128, warm_w * warm_h * 3 / 2);
+    double ms = -1;
+    for (int k = 0; k < 2; k++) {
+        detect_result_group_t r;
+        int64_t t0 = monotonic_us();
+        int ret = det->InferenceBatch(&warm, &warm_w, &warm_h, 1, &r);
+        ms = ret < 0 ? -1 : (monotonic_us() - t0) / 1000.0;
+    }
+    free(warm);
+    return ms;
+}
+
+static void* npu_worker(void *arg) {
+    npu_worker_t *w = (npu_worker_t*)arg;
+    npu_scheduler_t *s = w->s;
+    // 每个worker有自己的上下文，只在这个线程中使用
+    Detector *det = load_detector(w, s->cfg.model_path, s->cfg.labels_path);
+    Detector *dets[NPU_MAX_LEVELS] = { det };
+    for (int i = 0; i < s->cfg.lite_count && det; i++) {
+        dets[i + 1] = load_detector(w, s->cfg.lite_models[i], s->cfg.labels_path);
+        if (!dets[i + 1]) {
+            fprintf(stderr, "Failed to load lite model %s\n", s->cfg.lite_models[i]);
+            det = NULL;
+        }
+    }
+    // 切换分辨率时不用付首次推理的代价，预热的耗时作为初始估计
+    double warm_ms[NPU_MAX_LEVELS] = { 0 };
+    for (int i = 0; i < s->level_count && det && s->level_count > 1; i++) {
+        warm_ms[i] = warm_up(dets[i]);
+    }
+    Detector *batch_det = NULL;
+    int batch_size = 1;
+    if (det && s->cfg.batch_model_path) {
+        batch_det = load_detector(w, s->cfg.batch_model_path, s->cfg.labels_path);
+        if (!batch_det || batch_det->BatchSize() < 2) {
+            fprintf(stderr, "%s is not a usable batch model, batching disabled on worker %d\n",
+                    s->cfg.batch_model_path, w->index);
+            delete batch_det;
+            batch_det = NULL;
+        } else {
+            batch_size = batch_det->BatchSize() < NPU_MAX_BATCH ? batch_det->BatchSize() : NPU_MAX_BATCH;
+        }
+    }
+    NpuModel *models[NPU_MAX_MODELS] = { NULL };
+    int ok = det != NULL;
+    for (int i = 0; i < s->model_count && ok; i++) {
+        const npu_model_config_t *mc = &s->cfg.models[i];
+        models[i] = npu_model_create(mc->backend ? mc->backend : s->cfg.backend);
+        if (!models[i] || models[i]->Init(mc->path) < 0) {
+            fprintf(stderr, "Failed to load model %s from %s\n", mc->name, mc->path);
+            ok = 0;
+        } else if (w->core_mask) {
+            models[i]->SetCoreMask(w->core_mask);
+        }
+    }
+    pthread_mutex_lock(&s->mutex);
+    s->loaded++;
+    if (!ok) {
+        s->load_failed = 1;
+    }
+    for (int i = 0; i < s->level_count && ok; i++) {
+        if (warm_ms[i] > s->level_ms[i]) {
+            s->level_ms[i] = warm_ms[i];
+        }
+    }
+    for (int i = 0; i < s->model_count && ok; i++) {
+        npu_model_t *m = &s->models[i];
+        if (m->batch == 0) {
+            m->input_width = models[i]->InputWidth();
+            m->input_height = models[i]->InputHeight();
+            m->input_size = (size_t)m->input_width * m->input_height * 3;
+            m->output_size = models[i]->OutputSize();
+            m->batch = models[i]->BatchSize() < NPU_JOB_MAX_INPUTS ? models[i]->BatchSize() : NPU_JOB_MAX_INPUTS;
+        }
+    }
+    if (batch_size > s->batch_size) {
+        s->batch_size = batch_size;
+    }
+    pthread_cond_broadcast(&s->cond);
+    if (!ok) {
+        pthread_mutex_unlock(&s->mutex);
+        for (int i = 0; i < s->model_count; i++) {
+            delete models[i];
+        }
+        delete batch_det;
+        for (int i = 0; i < NPU_MAX_LEVELS; i++) {
+            delete dets[i];
+        }
+        return NULL;
+    }
+
+    npu_client_t *picked[NPU_MAX_BATCH];
+    double tags[NPU_MAX_BATCH];
+    npu_dispatch_t dispatched[NPU_MAX_BATCH];
+    unsigned char *frames[NPU_MAX_BATCH];
+    int widths[NPU_MAX_BATCH];
+    int heights[NPU_MAX_BATCH];
+    detect_result_group_t results[NPU_MAX_BATCH];
+    int64_t gather_until = 0;   // 当前这批最晚的发车时间，0 = 还没开始凑批
+    int ret;
+    while (s->running) {
+        if (w->standby[0]) {
+            // 两帧之间把重新加载的各个版本一起换上，旧的上下文交给重载线程释放
+            for (int i = 0; i < NPU_MAX_LEVELS; i++) {
+                if (dets[i]) {
+                    w->retired[w->retired_count++] = dets[i];
+                }
+                dets[i] = w->standby[i];
+                w->standby[i] = NULL;
+            }
+            if (batch_det) {
+                w->retired[w->retired_count++] = batch_det;
+            }
+            batch_det = w->standby_batch;
+            w->standby_batch = NULL;
+            batch_size = batch_det ? batch_det->BatchSize() : 1;
+            if (batch_size > NPU_MAX_BATCH) {
+                batch_size = NPU_MAX_BATCH;
+            }
+            s->reload_swapped++;
+            pthread_cond_broadcast(&s->cond);
+        }
+        // 批量模型只有全分辨率的版本，用小模型时逐帧推理
+        int level = s->level;
+        int max_batch = level == 0 ? batch_size : 1;
+        int count = collect_clients(s, picked, tags, max_batch);
+        if (count == 0) {
+            // 没有检测帧可跑时才轮到第二级模型
+            int64_t now = monotonic_us();
+            npu_job_t *job = expired_job(s, now);
+            if (job) {
+                finish_job(s, job);
+                continue;
+            }
+            int64_t recheck_us = 0;
+            job = pick_job(s, now, &recheck_us);
+            if (job) {
+                run_slice(s, w, job, models[job->model]);
+                continue;
+            }
+            s->idle_workers++;
+            if (recheck_us) {
+                timed_wait_until(s, recheck_us);
+            } else {
+                pthread_cond_wait(&s->cond, &s->mutex);
+            }
+            s->idle_workers--;
+            continue;
+        }
+        if (batch_worth_waiting(s, max_batch, count)) {
+            int64_t now = monotonic_us();
+            if (gather_until == 0) {
+                // 窗口不能让最老的帧超过截止时间: 留出一次批量推理的时间
+                int64_t oldest = picked[0]->submit_us;
+                for (int i = 1; i < count; i++) {
+                    if (picked[i]->submit_us < oldest) {
+                        oldest = picked[i]->submit_us;
+                    }
+                }
+                gather_until = now + s->cfg.batch_window_ms * 1000;
+                int64_t latest = oldest + s->cfg.deadline_ms * 1000 - (int64_t)(s->batch_ms * 1000);
+                if (latest < gather_until) {
+                    gather_until = latest;
+                }
+            }
+            if (now < gather_until) {
+                timed_wait_until(s, gather_until);
+                continue;
+            }
+        }
+        gather_until = 0;
+
+        // 批量只在实测比逐帧快时使用，负载低时退回batch-1模型
+        int use_batch = 0;
+        if (count >= 2) {
+            if (s->single_ms <= 0) {
+                use_batch = 0;
+            } else if (s->batch_ms <= 0) {
+                use_batch = 1;
+            } else {
+                use_batch = s->batch_ms < count * s->single_ms;
+            }
+            // 偶尔反过来试一次，NPU频率或负载变化后两个耗时估计不会一直过时
+            if (++s->decisions % 64 == 0) {
+                use_batch = !use_batch;
+            }
+        }
+        int n = use_batch ? count : 1;
+        double est_ms = (use_batch ? s->batch_ms : s->single_ms) / n;
+        for (int i = 0; i < n; i++) {
+            // 排队的帧交给这个worker，摄像头换一个空闲缓冲区继续写
+            npu_client_t *c = picked[i];
+            npu_dispatch_t *d = &dispatched[i];
+            d->client = c;
+            d->frame = c->write_idx;
+            d->seq = c->dispatch_seq++;
+            d->tag = tags[i];
+            // 先按估计耗时计费，其它worker紧接着给这个摄像头派帧时标签已经往后推了
+            d->charge_ms = est_ms > 0 ? est_ms : 0;
+            d->submit_us = c->submit_us;
+            c->vtime = tags[i] + d->charge_ms / c->weight;
+            c->in_flight[d->frame] = 1;
+            for (int k = 0; k < c->frame_count; k++) {
+                if (!c->in_flight[k]) {
+                    c->write_idx = k;
+                    break;
+                }
+            }
+            c->pending = 0;
+            c->ring[d->seq % NPU_MAX_WORKERS].seq = d->seq;
+            c->ring[d->seq % NPU_MAX_WORKERS].done = 0;
+            frames[i] = c->frames[d->frame];
+            widths[i] = c->width;
+            heights[i] = c->height;
+        }
+        // 几个worker并行时系统虚拟时间只往前走
+        if (tags[0] > s->vclock) {
+            s->vclock = tags[0];
+        }
+        for (int i = 0; i < s->client_count; i++) {
+            if (s->clients[i] == picked[n - 1]) {
+                s->rr_next = (i + 1) % s->client_count;
+            }
+        }
+        pthread_mutex_unlock(&s->mutex);
+
+        int64_t t0 = monotonic_us();
+        memset(results, 0, sizeof(results));
+        if (use_batch) {
+            ret = batch_det->InferenceBatch(frames, widths, heights, n, results);
+        } else {
+            ret = dets[level]->InferenceBatch(frames, widths, heights, 1, results);
+        }
+        int64_t t1 = monotonic_us();
+        double ms = (t1 - t0) / 1000.0;
+        // 帧缓冲区还标着in_flight，钩子可以从原始分辨率的帧上取图
+        for (int i = 0; i < n && ret >= 0; i++) {
+            npu_client_t *c = dispatched[i].client;
+            if (c->result_hook) {
+                c->result_hook(c->hook_opaque, frames[i], widths[i], heights[i], &results[i], dispatched[i].seq);
+            }
+        }
+
+        pthread_mutex_lock(&s->mutex);
+        w->runs++;
+        w->frames += n;
+        w->busy_us += t1 - t0;
+        s->det_busy_us += t1 - t0;
+        double *cost = use_batch ? &s->batch_ms : &s->single_ms;
+        if (use_batch || level == s->level) {
+            *cost = *cost > 0 ? *cost * 0.9 + ms * 0.1 : ms;
+        }
+        if (use_batch) {
+            s->batch_runs++;
+            s->batch_frames += n;
+        } else {
+            s->single_runs++;
+            s->level_ms[level] = s->level_ms[level] > 0 ? s->level_ms[level] * 0.9 + ms * 0.1 : ms;
+        }
+        s->level_frames[level] += n;
+        for (int i = 0; i < n; i++) {
+            npu_dispatch_t *d = &dispatched[i];
+            npu_client_t *c = d->client;
+            npu_reorder_slot_t *slot = &c->ring[d->seq % NPU_MAX_WORKERS];
+            if (ret < 0) {
+                printf("Inference failed on camera %d!\n", c->id);
+            } else {
+                slot->result = results[i];
+            }
+            slot->ok = ret >= 0;
+            slot->done = 1;
+            if (d->seq != c->emit_seq) {
+                c->reordered++;
+            }
+            c->in_flight[d->frame] = 0;
+            emit_in_order(c);
+            c->inferred++;
+            c->infer_ms_avg = c->infer_ms_avg > 0 ? c->infer_ms_avg * 0.9 + ms * 0.1 : ms;
+            // 用实际占用的NPU时间修正计费，批量时平摊，大分辨率的摄像头不会白占便宜
+            c->vtime += (ms / n - d->charge_ms) / c->weight;
+            // 切换前派发的帧不计入新模型的延迟
+            if (level == s->level) {
+                double e2e = (t1 - d->submit_us) / 1000.0;
+                s->e2e_ms = s->e2e_ms > 0 ? s->e2e_ms * 0.9 + e2e * 0.1 : e2e;
+            }
+        }
+        adapt_level(s, t1);
+        // 重排环腾出了位置，等着给这些摄像头派帧的worker可以继续
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    for (int i = 0; i < s->model_count; i++) {
+        delete models[i];
+    }
+    delete batch_det;
+    for (int i = 0; i < NPU_MAX_LEVELS; i++) {
+        delete dets[i];
+    }
+    return NULL;
+}
+
+npu_scheduler_t* npu_scheduler_create(const npu_config_t *cfg) {
+    if (cfg->workers < 1 || cfg->workers > NPU_MAX_WORKERS || cfg->model_count > NPU_MAX_MODELS ||
+        cfg->lite_count > NPU_MAX_LEVELS - 1) {
+        fprintf(stderr, "NPU workers must be 1..%d, second-stage models at most %d, lite models at most %d\n",
+                NPU_MAX_WORKERS, NPU_MAX_MODELS, NPU_MAX_LEVELS - 1);
+        return NULL;
+    }
+    npu_scheduler_t *s = (npu_scheduler_t*)calloc(1, sizeof(npu_scheduler_t));
+    if (!s) {
+        perror("Failed to allocate NPU scheduler");
+        return NULL;
+    }
+    s->cfg = *cfg;
+    s->running = 1;
+    s->batch_size = 1;
+    s->start_us = monotonic_us();
+    s->level_count = 1 + cfg->lite_count;
+    s->level_since_us = s->start_us;
+    s->model_count = cfg->model_count;
+    for (int i = 0; i < cfg->model_count; i++) {
+        s->models[i].cfg = cfg->models[i];
+    }
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    for (int i = 0; i < cfg->workers; i++) {
+        npu_worker_t *w = &s->workers[i];
+        w->s = s;
+        w->index = i;
+        // RK3588有三个NPU核: 缺省每个worker绑一个核(1/2/4)，单worker交给驱动
+        if (cfg->core_mask_count > 0) {
+            w->core_mask = cfg->core_masks[i % cfg->core_mask_count];
+        } else {
+            w->core_mask = cfg->workers > 1 ? 1 << (i % 3) : 0;
+        }
+        if (pthread_create(&w->thread, NULL, npu_worker, w) != 0) {
+            perror("Failed to start NPU worker");
+            break;
+        }
+        s->worker_count++;
+    }
+    pthread_mutex_lock(&s->mutex);
+    while (s->loaded < s->worker_count) {
+        pthread_cond_wait(&s->cond, &s->mutex);
+    }
+    int failed = s->load_failed || s->worker_count < cfg->workers;
+    pthread_mutex_unlock(&s->mutex);
+    // 任务缓冲区按模型输入大小分配，模型加载完才知道
+    for (int i = 0; i < s->model_count && !failed; i++) {
+        npu_model_t *m = &s->models[i];
+        for (int j = 0; j < NPU_MODEL_QUEUE; j++) {
+            m->jobs[j].model = i;
+            m->jobs[j].input = (unsigned char*)malloc(NPU_JOB_MAX_INPUTS * m->input_size);
+            m->jobs[j].output = (float*)malloc(NPU_JOB_MAX_INPUTS * m->output_size * sizeof(float));
+            if (!m->jobs[j].input || !m->jobs[j].output) {
+                perror("Failed to allocate second-stage job buffers");
+                failed = 1;
+                break;
+            }
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "Failed to initialize the detection model\n");
+        npu_scheduler_destroy(s);
+        return NULL;
+    }
+    printf("NPU scheduler: %s, policy %s, %d worker%s", s->cfg.model_path, npu_policy_name(s->cfg.policy),
+           s->worker_count, s->worker_count > 1 ? "s" : "");
+    if (strcmp(s->cfg.backend, "rknn")) {
+        printf(" (%s)", s->cfg.backend);
+    }
+    if (s->batch_size > 1) {
+        printf(", batches of up to %d within %d ms", s->batch_size, s->cfg.batch_window_ms);
+    }
+    printf("\n");
+    for (int i = 1; i < s->level_count; i++) {
+        printf("  lite model %s (%.1f ms vs %.1f ms) while detection exceeds %d ms\n", level_path(s, i),
+               s->level_ms[i], s->level_ms[0], s->cfg.deadline_ms);
+    }
+    for (int i = 0; i < s->model_count; i++) {
+        npu_model_t *m = &s->models[i];
+        printf("  second stage %s: %s, %dx%d input, batch %d, priority %d\n", m->cfg.name, m->cfg.path,
+               m->input_width, m->input_height, m->batch, m->cfg.priority);
+    }
+    return s;
+}
+
+void npu_scheduler_destroy(npu_scheduler_t *s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->mutex);
+    s->running = 0;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    for (int i = 0; i < s->worker_count; i++) {
+        pthread_join(s->workers[i].thread, NULL);
+    }
+    // running清零后重载线程不再等worker，自己释放备用上下文后退出
+    if (s->reload_joinable) {
+        pthread_join(s->reload_thread, NULL);
+    }
+    // 还在排队的任务也要回调，提交方好释放自己的状态
+    for (int i = 0; i < s->model_count; i++) {
+        for (int j = 0; j < NPU_MODEL_QUEUE; j++) {
+            npu_job_t *job = &s->models[i].jobs[j];
+            if (job->state == NPU_JOB_QUEUED && job->done) {
+                job->done(job->opaque, NULL, job->count, s->models[i].output_size);
+            }
+            free(job->input);
+            free(job->output);
+        }
+    }
+    for (int i = 0; i < s->client_count; i++) {
+        for (int k = 0; k < s->clients[i]->frame_count; k++) {
+            free(s->clients[i]->frames[k]);
+        }
+        free(s->clients[i]);
+    }
+    pthread_mutex_destroy(&s->mutex);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+npu_client_t* npu_scheduler_add_client(npu_scheduler_t *s, int id, int width, int height,
+                                       int weight, int max_fps) {
+    npu_client_t *c = (npu_client_t*)calloc(1, sizeof(npu_client_t));
+    if (!c) {
+        perror("Failed to allocate NPU client");
+        return NULL;
+    }
+    c->id = id;
+    c->width = width;
+    c->height = height;
+    c->weight = weight > 0 ? weight : 1;
+    c->max_fps = max_fps > 0 ? max_fps : 0;
+    c->frame_size = (size_t)width * height * 3 / 2;
+    // 每个worker手里最多一帧，再加一个排队/写入的缓冲区
+    for (int k = 0; k < s->worker_count + 1; k++) {
+        c->frames[k] = (unsigned char*)malloc(c->frame_size);
+        if (!c->frames[k]) {
+            perror("Failed to allocate NPU frame buffers");
+            break;
+        }
+        c->frame_count++;
+    }
+    pthread_mutex_lock(&s->mutex);
+    if (c->frame_count < s->worker_count + 1 || s->client_count >= NPU_MAX_CLIENTS) {
+        pthread_mutex_unlock(&s->mutex);
+        if (c->frame_count == s->worker_count + 1) {
+            fprintf(stderr, "Too many NPU clients (max %d)\n", NPU_MAX_CLIENTS);
+        }
+        for (int k = 0; k < c->frame_count; k++) {
+            free(c->frames[k]);
+        }
+        free(c);
+        return NULL;
+    }
+    // 新加入的摄像头从当前虚拟时间开始排队，不补偿之前没用的份额
+    c->vtime = s->vclock;
+    s->clients[s->client_count++] = c;
+    pthread_mutex_unlock(&s->mutex);
+    return c;
+}
+
+void npu_client_set_result_hook(npu_client_t *c, npu_result_hook_fn fn, void *opaque) {
+    c->result_hook = fn;
+    c->hook_opaque = opaque;
+}
+
+int npu_scheduler_submit(npu_scheduler_t *s, npu_client_t *c, const unsigned char *nv12, int64_t now_us) {
+    pthread_mutex_lock(&s->mutex);
+    // 摄像头的帧间隔，第二级模型据此判断能插进多长的空闲
+    if (c->last_call_us) {
+        int64_t interval = now_us - c->last_call_us;
+        c->interval_us = c->interval_us > 0 ? (c->interval_us * 7 + interval) / 8 : interval;
+    }
+    c->last_call_us = now_us;
+    if (c->max_fps > 0 && now_us < c->next_due_us) {
+        c->skipped++;
+        pthread_mutex_unlock(&s->mutex);
+        return 0;
+    }
+    // 排队中的旧帧被新帧替换，推理的总是最新画面; 正在推理的帧在别的缓冲区
+    if (c->pending) {
+        c->replaced++;
+    }
+    c->pending = 0;
+    c->filling = 1;
+    unsigned char *dst = c->frames[c->write_idx];
+    pthread_mutex_unlock(&s->mutex);
+
+    // 拷贝在锁外进行，调度线程不会取走filling的缓冲区
+    memcpy(dst, nv12, c->frame_size);
+
+    pthread_mutex_lock(&s->mutex);
+    c->filling = 0;
+    c->pending = 1;
+    c->submit_us = now_us;
+    c->submitted++;
+    if (c->max_fps > 0) {
+        int64_t interval = 1000000 / c->max_fps;
+        // 长时间没有提交(如NPU很慢)时重新对齐，不攒额度
+        if (now_us - c->next_due_us > interval) {
+            c->next_due_us = now_us;
+        }
+        c->next_due_us += interval;
+    }
+    // 空闲的和正在凑批的worker都要知道
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return 1;
+}
+
+int npu_client_poll(npu_scheduler_t *s, npu_client_t *c, detect_result_group_t *out, uint64_t *seq) {
+    int updated = 0;
+    pthread_mutex_lock(&s->mutex);
+    if (c->result_seq != *seq) {
+        *out = c->result;
+        *seq = c->result_seq;
+        updated = 1;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return updated;
+}
+
+void npu_scheduler_print_stats(npu_scheduler_t *s) {
+    pthread_mutex_lock(&s->mutex);
+    double elapsed_s = (monotonic_us() - s->start_us) / 1000000.0;
+    printf("NPU policy %s, %d cameras\n", npu_policy_name(s->cfg.policy), s->client_count);
+    for (int i = 0; i < s->worker_count; i++) {
+        npu_worker_t *w = &s->workers[i];
+        printf("  worker %d (core mask %d): %llu runs, %llu frames, %.0f%% busy\n", w->index, w->core_mask,
+               (unsigned long long)w->runs, (unsigned long long)w->frames,
+               elapsed_s > 0 ? w->busy_us / 10000.0 / elapsed_s : 0.0);
+    }
+    if (s->batch_size > 1) {
+        printf("  %llu single runs (%.1f ms), %llu batches (%.1f ms, %.2f frames avg)\n",
+               (unsigned long long)s->single_runs, s->single_ms, (unsigned long long)s->batch_runs,
+               s->batch_ms, s->batch_runs ? (double)s->batch_frames / s->batch_runs : 0.0);
+    }
+    double capacity_us = elapsed_s * 1000000.0 * s->worker_count;
+    if (s->reloads) {
+        printf("  detection model %s, reloaded %llu times\n", s->cfg.model_path, (unsigned long long)s->reloads);
+    }
+    if (s->level_count > 1) {
+        printf("  detection model %s, %.1f ms end-to-end, %llu switches\n", level_path(s, s->level), s->e2e_ms,
+               (unsigned long long)s->level_switches);
+        for (int i = 0; i < s->level_count; i++) {
+            printf("    %s: %llu frames, %.1f ms/run\n", level_path(s, i),
+                   (unsigned long long)s->level_frames[i], s->level_ms[i]);
+        }
+    }
+    if (s->model_count > 0) {
+        printf("  detection: %.0f%% of NPU time\n", capacity_us > 0 ? s->det_busy_us * 100.0 / capacity_us : 0.0);
+    }
+    for (int i = 0; i < s->model_count; i++) {
+        npu_model_t *m = &s->models[i];
+        printf("  %s (priority %d): %.0f%% of NPU time, %llu runs of %.1f ms, %llu inputs, "
+               "%llu jobs done, %llu expired, %llu rejected\n",
+               m->cfg.name, m->cfg.priority, capacity_us > 0 ? m->busy_us * 100.0 / capacity_us : 0.0,
+               (unsigned long long)m->runs, m->run_ms, (unsigned long long)m->inputs,
+               (unsigned long long)m->completed, (unsigned long long)m->expired, (unsigned long long)m->rejected);
+    }
+    for (int i = 0; i < s->client_count; i++) {
+        npu_client_t *c = s->clients[i];
+        printf("  camera %d: weight %d, cap %d fps, %.1f det/s, %.1f ms/inference, "
+               "%llu frames paced out, %llu replaced in the queue, %llu finished out of order\n",
+               c->id, c->weight, c->max_fps, elapsed_s > 0 ? c->inferred / elapsed_s : 0.0,
+               c->infer_ms_avg, (unsigned long long)c->skipped, (unsigned long long)c->replaced,
+               (unsigned long long)c->reordered);
+    }
+    pthread_mutex_unlock(&s->mutex);
+}
+
+// 后台加载新模型: 每个worker一套备用上下文，按worker的核绑定并预热，
+// 全部就绪后才交给worker，任何一个加载失败都继续用原来的模型。
+// 模型路径没变时小模型和批量模型也重新加载，文件可能一起被替换了
+static void* npu_reloader(void *arg) {
+    npu_scheduler_t *s = (npu_scheduler_t*)arg;
+    const char *labels = s->reload_labels[0] ? s->reload_labels : NULL;
+    Detector *standby[NPU_MAX_WORKERS][NPU_MAX_LEVELS];
+    Detector *standby_batch[NPU_MAX_WORKERS] = { NULL };
+    memset(standby, 0, sizeof(standby));
+    pthread_mutex_lock(&s->mutex);
+    int level_count = s->reload_all_builds ? s->level_count : 1;
+    int with_batch = s->reload_all_builds && s->batch_size > 1;
+    pthread_mutex_unlock(&s->mutex);
+
+    double warm_ms[NPU_MAX_LEVELS] = { 0 };
+    int batch_size = 1;
+    int ok = 1;
+    for (int i = 0; i < s->worker_count && ok; i++) {
+        for (int l = 0; l < level_count && ok; l++) {
+            const char *path = l == 0 ? s->reload_model : s->cfg.lite_models[l - 1];
+            standby[i][l] = load_detector(&s->workers[i], path, labels);
+            double ms = standby[i][l] ? warm_up(standby[i][l]) : -1;
+            if (ms < 0) {
+                fprintf(stderr, "Failed to reload %s\n", path);
+                ok = 0;
+            }
+            if (ms > warm_ms[l]) {
+                warm_ms[l] = ms;
+            }
+        }
+        if (ok && with_batch) {
+            standby_batch[i] = load_detector(&s->workers[i], s->cfg.batch_model_path, labels);
+            if (!standby_batch[i] || standby_batch[i]->BatchSize() < 2) {
+                fprintf(stderr, "Failed to reload the batch model %s\n", s->cfg.batch_model_path);
+                ok = 0;
+            } else if (standby_batch[i]->BatchSize() > batch_size) {
+                batch_size = standby_batch[i]->BatchSize() < NPU_MAX_BATCH ? standby_batch[i]->BatchSize()
+                                                                           : NPU_MAX_BATCH;
+            }
+        }
+    }
+
+    Detector *release[NPU_MAX_WORKERS * (2 * NPU_MAX_LEVELS + 2)];
+    int release_count = 0;
+    pthread_mutex_lock(&s->mutex);
+    if (ok && s->running) {
+        for (int i = 0; i < s->worker_count; i++) {
+            memcpy(s->workers[i].standby, standby[i], sizeof(standby[i]));
+            memset(standby[i], 0, sizeof(standby[i]));
+            s->workers[i].standby_batch = standby_batch[i];
+            standby_batch[i] = NULL;
+        }
+        s->reload_swapped = 0;
+        // 换了模型时小模型和批量模型是旧模型的另外两种编译版本，和新模型对不上，一起停用
+        if (level_count < s->level_count) {
+            s->level = 0;
+            s->level_count = level_count;
+        }
+        s->batch_size = batch_size;
+        pthread_cond_broadcast(&s->cond);
+        while (s->running && s->reload_swapped < s->worker_count) {
+            pthread_cond_wait(&s->cond, &s->mutex);
+        }
+        for (int i = 0; i < s->worker_count; i++) {
+            npu_worker_t *w = &s->workers[i];
+            for (int k = 0; k < w->retired_count; k++) {
+                release[release_count++] = w->retired[k];
+            }
+            w->retired_count = 0;
+            // 调度器正在停止，没来得及换上的备用上下文
+            for (int l = 0; l < NPU_MAX_LEVELS; l++) {
+                if (w->standby[l]) {
+                    release[release_count++] = w->standby[l];
+                    w->standby[l] = NULL;
+                }
+            }
+            if (w->standby_batch) {
+                release[release_count++] = w->standby_batch;
+                w->standby_batch = NULL;
+            }
+        }
+        if (s->reload_swapped == s->worker_count) {
+            strcpy(s->model_path, s->reload_model);
+            strcpy(s->labels_path, s->reload_labels);
+            s->cfg.model_path = s->model_path;
+            s->cfg.labels_path = labels ? s->labels_path : NULL;
+            s->single_ms = warm_ms[0];
+            s->batch_ms = 0;
+            for (int l = 0; l < level_count; l++) {
+                s->level_ms[l] = warm_ms[l];
+            }
+            s->e2e_ms = 0;
+            s->reloads++;
+            printf("Detection model reloaded: %s, labels %s, %.1f ms/run", s->cfg.model_path,
+                   labels ? labels : "(default)", warm_ms[0]);
+            if (level_count > 1) {
+                printf(", %d lite model%s", level_count - 1, level_count > 2 ? "s" : "");
+            }
+            if (batch_size > 1) {
+                printf(", batch %d", batch_size);
+            }
+            printf("\n");
+        }
+    } else if (!ok) {
+        fprintf(stderr, "Failed to reload the detection model from %s, keeping %s\n", s->reload_model,
+                s->cfg.model_path);
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    // 释放RKNN上下文要几十毫秒，放在这里做，worker不用停
+    for (int i = 0; i < s->worker_count; i++) {
+        for (int l = 0; l < NPU_MAX_LEVELS; l++) {
+            delete standby[i][l];
+        }
+        delete standby_batch[i];
+    }
+    for (int i = 0; i < release_count; i++) {
+        delete release[i];
+    }
+    pthread_mutex_lock(&s->mutex);
+    s->reloading = 0;
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+int npu_scheduler_reload(npu_scheduler_t *s, const char *model_path, const char *labels_path) {
+    pthread_mutex_lock(&s->mutex);
+    if (s->reloading) {
+        pthread_mutex_unlock(&s->mutex);
+        fprintf(stderr, "A detection model reload is already running\n");
+        return -1;
+    }
+    if (!model_path) {
+        model_path = s->cfg.model_path;
+    }
+    if (!labels_path) {
+        labels_path = s->cfg.labels_path ? s->cfg.labels_path : "";
+    }
+    if (strlen(model_path) >= NPU_PATH_MAX || strlen(labels_path) >= NPU_PATH_MAX) {
+        pthread_mutex_unlock(&s->mutex);
+        fprintf(stderr, "Model path too long\n");
+        return -1;
+    }
+    // 只有换了模型才停用小模型和批量模型
+    s->reload_all_builds = !strcmp(model_path, s->cfg.model_path);
+    // 先拷贝: 参数可能就指向当前配置，重载完成时会被改写
+    strcpy(s->reload_model, model_path);
+    strcpy(s->reload_labels, labels_path);
+    // 上一次的线程清掉reloading后就不再碰锁，持锁回收不会死等
+    if (s->reload_joinable) {
+        pthread_join(s->reload_thread, NULL);
+        s->reload_joinable = 0;
+    }
+    if (pthread_create(&s->reload_thread, NULL, npu_reloader, s) != 0) {
+        pthread_mutex_unlock(&s->mutex);
+        perror("Failed to start the model reload");
+        return -1;
+    }
+    s->reloading = 1;
+    s->reload_joinable = 1;
+    printf("Reloading the detection model from %s\n", s->reload_model);
+    pthread_mutex_unlock(&s->mutex);
+    return 0;
+}
+
+int npu_scheduler_find_model(npu_scheduler_t *s, const char *name) {
+    for (int i = 0; i < s->model_count; i++) {
+        if (!strcmp(s->models[i].cfg.name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+npu_job_t* npu_job_begin(npu_scheduler_t *s, int model, int count) {
+    if (model < 0 || model >= s->model_count || count < 1 || count > NPU_JOB_MAX_INPUTS) {
+        return NULL;
+    }
+    npu_model_t *m = &s->models[model];
+    npu_job_t *job = NULL;
+    pthread_mutex_lock(&s->mutex);
+    for (int j = 0; j < NPU_MODEL_QUEUE; j++) {
+        if (m->jobs[j].state == NPU_JOB_FREE) {
+            job = &m->jobs[j];
+            job->state = NPU_JOB_FILLING;
+            job->count = count;
+            job->next = 0;
+            job->running = 0;
+            job->failed = 0;
+            break;
+        }
+    }
+    if (!job) {
+        m->rejected++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return job;
+}
+
+void npu_job_commit(npu_scheduler_t *s, npu_job_t *job, int64_t deadline_us, npu_job_done_fn done, void *opaque) {
+    pthread_mutex_lock(&s->mutex);
+    job->deadline_us = deadline_us;
+    job->done = done;
+    job->opaque = opaque;
+    job->seq = s->models[job->model].next_seq++;
+    job->state = NPU_JOB_QUEUED;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void npu_job_cancel(npu_scheduler_t *s, npu_job_t *job) {
+    pthread_mutex_lock(&s->mutex);
+    job->state = NPU_JOB_FREE;
+    pthread_mutex_unlock(&s->mutex);
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "packet_queue.h"
+#include "nal_utils.h"
+
+int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+packet_queue_t* packet_queue_create(int capacity, enum AVCodecID codec_id) {
+    packet_queue_t *q = (packet_queue_t*)calloc(1, sizeof(packet_queue_t));
+    if (!q) {
+        perror("Failed to allocate packet queue");
+        return NULL;
+    }
+    q->entries = (queued_packet_t*)calloc(capacity, sizeof(queued_packet_t));
+    if (!q->entries) {
+        perror("Failed to allocate packet queue entries");
+        free(q);
+        return NULL;
+    }
+    q->capacity = capacity;
+    q->high_watermark = capacity / 2 > 0 ? capacity / 2 : 1;
+    q->codec_id = codec_id;
+    q->wait_keyframe = 1; // 第一个包必须是关键帧
+    q->flushed = 1;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return q;
+}
+
+void packet_queue_set_policy(packet_queue_t *q, queue_policy_t policy) {
+    pthread_mutex_lock(&q->mutex);
+    q->policy = policy;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static int is_video_keyframe(const AVPacket *pkt) {
+    return pkt->stream_index == 0 && (pkt->flags & AV_PKT_FLAG_KEY);
+}
+
+static int is_disposable(const packet_queue_t *q, const AVPacket *pkt) {
+    return pkt->stream_index == 0 && nal_packet_is_disposable(q->codec_id, pkt);
+}
+
+static queued_packet_t* entry_at(packet_queue_t *q, int i) {
+    return &q->entries[(q->head + i) % q->capacity];
+}
+
+static void drop_all_locked(packet_queue_t *q) {
+    for (int i = 0; i < q->count; i++) {
+        av_packet_free(&entry_at(q, i)->pkt);
+    }
+    q->flushed_packets += q->count;
+    q->head = 0;
+    q->count = 0;
+    q->bytes = 0;
+}
+
+void packet_queue_destroy(packet_queue_t *q) {
+    if (!q) return;
+    drop_all_locked(q);
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->cond);
+    free(q->entries);
+    free(q);
+}
+
+// Removes queued disposable frames, keeping order. Returns how many were dropped.
+static int drop_nonref_locked(packet_queue_t *q) {
+    int kept = 0;
+    int dropped = 0;
+    for (int i = 0; i < q->count; i++) {
+        queued_packet_t e = *entry_at(q, i);
+        if (is_disposable(q, e.pkt)) {
+            q->bytes -= e.pkt->size;
+            av_packet_free(&e.pkt);
+            dropped++;
+        } else {
+            *entry_at(q, kept++) = e;
+        }
+    }
+    q->count = kept;
+    q->dropped_packets += dropped;
+    q->dropped_nonref += dropped;
+    return dropped;
+}
+
+// Drops from the head up to the next queued keyframe. Returns 0 if the queue
+// now starts on a keyframe, -1 if no keyframe was queued and it is now empty.
+static int drop_oldest_gop_locked(packet_queue_t *q) {
+    int n = 1;
+    while (n < q->count && !is_video_keyframe(entry_at(q, n)->pkt)) {
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        queued_packet_t *e = entry_at(q, 0);
+        q->bytes -= e->pkt->size;
+        av_packet_free(&e->pkt);
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+    }
+    q->dropped_packets += n;
+    q->dropped_gops++;
+    return q->count > 0 ? 0 : -1;
+}
+
+int packet_queue_put(packet_queue_t *q, const AVPacket *pkt) {
+    int is_key = is_video_keyframe(pkt);
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->abort || q->finished) {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+
+    // 丢过GOP后只能从IDR恢复
+    if (q->wait_keyframe) {
+        if (!is_key) {
+            if (q->flushed) {
+                q->flushed_packets++;
+            } else {
+                q->dropped_packets++;
+            }
+            pthread_mutex_unlock(&q->mutex);
+            return 1;
+        }
+        q->wait_keyframe = 0;
+        q->flushed = 0;
+    }
+
+    if (q->policy == QUEUE_DROP_GOP && q->count >= q->high_watermark && !is_key && is_disposable(q, pkt)) {
+        q->dropped_packets++;
+        q->dropped_nonref++;
+        pthread_mutex_unlock(&q->mutex);
+        return 1;
+    }
+
+    // 录像队列不挑非参考帧丢，满了才整GOP丢弃
+    if (q->count >= q->capacity && (q->policy == QUEUE_NO_DROP || drop_nonref_locked(q) == 0)) {
+        if (drop_oldest_gop_locked(q) < 0 && !is_key) {
+            // 队列里已经没有可用的关键帧，当前GOP剩余部分也无法解码
+            q->wait_keyframe = 1;
+            q->dropped_packets++;
+            pthread_mutex_unlock(&q->mutex);
+            return 1;
+        }
+    }
+
+    AVPacket *ref = av_packet_clone(pkt);
+    if (!ref) {
+        pthread_mutex_unlock(&q->mutex);
+        return AVERROR(ENOMEM);
+    }
+    queued_packet_t *e = entry_at(q, q->count);
+    e->pkt = ref;
+    e->enqueue_us = monotonic_us();
+    q->count++;
+    q->bytes += ref->size;
+    q->queued_packets++;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+int packet_queue_get(packet_queue_t *q, AVPacket *pkt, int64_t *enqueue_us) {
+    pthread_mutex_lock(&q->mutex);
+    while (!q->abort && !q->finished && q->count == 0) {
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    if (q->abort || q->count == 0) {
+        pthread_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    queued_packet_t *e = entry_at(q, 0);
+    av_packet_move_ref(pkt, e->pkt);
+    av_packet_free(&e->pkt);
+    if (enqueue_us) {
+        *enqueue_us = e->enqueue_us;
+    }
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    q->bytes -= pkt->size;
+    pthread_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+void packet_queue_flush(packet_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    drop_all_locked(q);
+    q->wait_keyframe = 1;
+    q->flushed = 1;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void packet_queue_abort(packet_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->abort = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void packet_queue_finish(packet_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    q->finished = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+int packet_queue_depth(packet_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    int depth = q->count;
+    pthread_mutex_unlock(&q->mutex);
+    return depth;
+}
+
+uint64_t packet_queue_dropped_gops(packet_queue_t *q) {
+    pthread_mutex_lock(&q->mutex);
+    uint64_t gops = q->dropped_gops;
+    pthread_mutex_unlock(&q->mutex);
+    return gops;
+}
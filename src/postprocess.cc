@@ -25,8 +25,6 @@
 #include <vector>
 #define LABEL_NALE_TXT_PATH "./model/coco_80_labels_list.txt"
 
-static char* labels[OBJ_CLASS_NUM];
-
 const int anchor0[6] = {10, 13, 16, 30, 33, 23};
 const int anchor1[6] = {30, 61, 62, 45, 59, 119};
 const int anchor2[6] = {116, 90, 156, 198, 373, 326};
@@ -91,8 +89,7 @@ int readLines(const char* fileName, char* lines[], int max_line)
 int loadLabelName(const char* locationFilename, char* label[])
 {
   printf("loadLabelName %s\n", locationFilename);
-  readLines(locationFilename, label, OBJ_CLASS_NUM);
-  return 0;
+  return readLines(locationFilename, label, OBJ_CLASS_NUM) < 0 ? -1 : 0;
 }
 
 static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
@@ -236,20 +233,16 @@ static int process(int8_t* input, int* anchor, int grid_h, int grid_w, int heigh
   return validCount;
 }
 
-int post_process(int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h, int model_in_w, float conf_threshold,
+int initPostProcess(postprocess_ctx_t* ctx, const char* label_path)
+{
+  memset(ctx, 0, sizeof(*ctx));
+  return loadLabelName(label_path ? label_path : LABEL_NALE_TXT_PATH, ctx->labels);
+}
+
+int post_process(postprocess_ctx_t* ctx, int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h, int model_in_w, float conf_threshold,
                  float nms_threshold, float scale_w, float scale_h, std::vector<int32_t>& qnt_zps,
                  std::vector<float>& qnt_scales, detect_result_group_t* group)
 {
-  static int init = -1;
-  if (init == -1) {
-    int ret = 0;
-    ret     = loadLabelName(LABEL_NALE_TXT_PATH, labels);
-    if (ret < 0) {
-      return -1;
-    }
-
-    init = 0;
-  }
   memset(group, 0, sizeof(detect_result_group_t));
 
   std::vector<float> filterBoxes;
@@ -320,8 +313,11 @@ int post_process(int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h,
     group->results[last_count].box.right  = (int)(clamp(x2, 0, model_in_w) / scale_w);
     group->results[last_count].box.bottom = (int)(clamp(y2, 0, model_in_h) / scale_h);
     group->results[last_count].prop       = obj_conf;
-    char* label                           = labels[id];
+    group->results[last_count].class_id   = id;
+    const char* label                     = ctx->labels[id] ? ctx->labels[id] : "unknown";
     strncpy(group->results[last_count].name, label, OBJ_NAME_MAX_SIZE);
+    group->results[last_count].attr_name[0] = '\0';
+    group->results[last_count].attr_prop    = 0;
 
     // printf("result %2d: (%4d, %4d, %4d, %4d), %s\n", i, group->results[last_count].box.left,
     // group->results[last_count].box.top,
@@ -333,12 +329,12 @@ int post_process(int8_t* input0, int8_t* input1, int8_t* input2, int model_in_h,
   return 0;
 }
 
-void deinitPostProcess()
+void deinitPostProcess(postprocess_ctx_t* ctx)
 {
   for (int i = 0; i < OBJ_CLASS_NUM; i++) {
-    if (labels[i] != nullptr) {
-      free(labels[i]);
-      labels[i] = nullptr;
+    if (ctx->labels[i] != nullptr) {
+      free(ctx->labels[i]);
+      ctx->labels[i] = nullptr;
     }
   }
 }
@@ -0,0 +1,144 @@
+#include "rknn_model.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+RknnModel::RknnModel() : ctx(0), width(0), height(0), channel(3), batch(1), output_size(0), input_buffer(nullptr) {
+}
+
+RknnModel::~RknnModel() {
+    Release();
+}
+
+int RknnModel::Init(const char* model_path) {
+    printf("Loading second-stage model: %s\n", model_path);
+    FILE* fp = fopen(model_path, "rb");
+    if (!fp) {
+        printf("Failed to open model file: %s\n", model_path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t model_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char* model = (unsigned char*)malloc(model_size);
+    if (!model || fread(model, 1, model_size, fp) != model_size) {
+        free(model);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    int ret = rknn_init(&ctx, model, model_size, 0, NULL);
+    free(model);
+    if (ret < 0) {
+        printf("rknn_init fail! ret=%d\n", ret);
+        ctx = 0;
+        return -1;
+    }
+
+    rknn_input_output_num io_num;
+    ret = rknn_query(ctx, RKNN_QUERY_IN_OUT_NUM, &io_num, sizeof(io_num));
+    if (ret != RKNN_SUCC || io_num.n_input != 1 || io_num.n_output < 1) {
+        printf("%s: expected one input and at least one output\n", model_path);
+        return -1;
+    }
+    rknn_tensor_attr input_attr;
+    memset(&input_attr, 0, sizeof(input_attr));
+    input_attr.index = 0;
+    if (rknn_query(ctx, RKNN_QUERY_INPUT_ATTR, &input_attr, sizeof(input_attr)) != RKNN_SUCC) {
+        printf("rknn_query input_attr fail!\n");
+        return -1;
+    }
+    batch = input_attr.dims[0] > 0 ? input_attr.dims[0] : 1;
+    if (input_attr.fmt == RKNN_TENSOR_NCHW) {
+        channel = input_attr.dims[1];
+        height = input_attr.dims[2];
+        width = input_attr.dims[3];
+    } else {
+        height = input_attr.dims[1];
+        width = input_attr.dims[2];
+        channel = input_attr.dims[3];
+    }
+    if (channel != 3) {
+        printf("%s: expected an RGB input, got %d channels\n", model_path, channel);
+        return -1;
+    }
+
+    rknn_tensor_attr output_attr;
+    memset(&output_attr, 0, sizeof(output_attr));
+    output_attr.index = 0;
+    if (rknn_query(ctx, RKNN_QUERY_OUTPUT_ATTR, &output_attr, sizeof(output_attr)) != RKNN_SUCC) {
+        printf("rknn_query output_attr fail!\n");
+        return -1;
+    }
+    output_size = output_attr.n_elems / batch;
+
+    input_buffer = (unsigned char*)malloc((size_t)batch * width * height * channel);
+    if (!input_buffer) {
+        printf("Malloc input buffer failed!\n");
+        return -1;
+    }
+    printf("  input %dx%dx%d, batch %d, %d outputs per input\n", width, height, channel, batch, output_size);
+    return 0;
+}
+
+int RknnModel::SetCoreMask(int core_mask) {
+    int ret = rknn_set_core_mask(ctx, (rknn_core_mask)core_mask);
+    if (ret < 0) {
+        printf("rknn_set_core_mask(%d) not supported, ret=%d\n", core_mask, ret);
+        return -1;
+    }
+    return 0;
+}
+
+int RknnModel::Run(const unsigned char* input, int count, float* output) {
+    if (count < 1 || count > batch) {
+        return -1;
+    }
+    size_t input_bytes = (size_t)width * height * channel;
+    // 批量模型每次都算满batch，不足时补到自己的缓冲区里
+    const unsigned char* buf = input;
+    if (count < batch) {
+        memcpy(input_buffer, input, count * input_bytes);
+        buf = input_buffer;
+    }
+    rknn_input in;
+    memset(&in, 0, sizeof(in));
+    in.index = 0;
+    in.type = RKNN_TENSOR_UINT8;
+    in.fmt = RKNN_TENSOR_NHWC;
+    in.size = batch * input_bytes;
+    in.buf = (void*)buf;
+    int ret = rknn_inputs_set(ctx, 1, &in);
+    if (ret < 0) {
+        printf("rknn_input_set fail! ret=%d\n", ret);
+        return -1;
+    }
+    ret = rknn_run(ctx, NULL);
+    if (ret < 0) {
+        printf("rknn_run fail! ret=%d\n", ret);
+        return -1;
+    }
+    rknn_output out;
+    memset(&out, 0, sizeof(out));
+    out.index = 0;
+    out.want_float = 1;
+    ret = rknn_outputs_get(ctx, 1, &out, NULL);
+    if (ret < 0) {
+        printf("rknn_outputs_get fail! ret=%d\n", ret);
+        return -1;
+    }
+    memcpy(output, out.buf, (size_t)count * output_size * sizeof(float));
+    rknn_outputs_release(ctx, 1, &out);
+    return 0;
+}
+
+void RknnModel::Release() {
+    if (ctx > 0) {
+        rknn_destroy(ctx);
+        ctx = 0;
+    }
+    free(input_buffer);
+    input_buffer = nullptr;
+}
@@ -6,7 +6,8 @@
 #include "rga/im2d.h"
 #include "rga/rga.h"
 
-RknnYolov5::RknnYolov5() : ctx(0), input_buffer(nullptr) {
+RknnYolov5::RknnYolov5() : ctx(0), batch(1), input_buffer(nullptr) {
+    memset(&pp, 0, sizeof(pp));
     for (int i = 0; i < 3; i++) {
         output_buffer[i] = nullptr;
     }
@@ -32,6 +33,10 @@ static void dump_tensor_attr(rknn_tensor_attr* attr) {
 int RknnYolov5::Init(const char* model_path, int width, int height) {
     printf("Loading model: %s\n", model_path);
     
+    if (initPostProcess(&pp, NULL) < 0) {
+        return -1;
+    }
+
     // Load RKNN Model
     FILE* fp = fopen(model_path, "rb");
     if (!fp) {
@@ -98,16 +103,21 @@ int RknnYolov5::Init(const char* model_path, int width, int height) {
     // Determine input format
     if (input_attrs[0].fmt == RKNN_TENSOR_NCHW) {
         printf("model is NCHW input fmt\n");
+        batch = input_attrs[0].dims[0];
         channel = input_attrs[0].dims[1];
         model_height = input_attrs[0].dims[2];
         model_width = input_attrs[0].dims[3];
     } else {
         printf("model is NHWC input fmt\n");
+        batch = input_attrs[0].dims[0];
         model_height = input_attrs[0].dims[1];
         model_width = input_attrs[0].dims[2];
         channel = input_attrs[0].dims[3];
     }
-    printf("model input height=%d, width=%d, channel=%d\n", model_height, model_width, channel);
+    if (batch < 1) {
+        batch = 1;
+    }
+    printf("model input batch=%d, height=%d, width=%d, channel=%d\n", batch, model_height, model_width, channel);
     
     // Get Output Tensor Info
     rknn_tensor_attr output_attrs[io_num.n_output];
@@ -125,6 +135,8 @@ int RknnYolov5::Init(const char* model_path, int width, int height) {
         
         // Pre-allocate output buffers
         int buffer_size = output_attrs[i].size_with_stride;
+        // 多batch模型的输出按batch连续排列
+        output_stride[i] = buffer_size / batch;
         output_buffer[i] = (int8_t*)malloc(buffer_size);
         if (!output_buffer[i]) {
             printf("Malloc output buffer %d failed!\n", i);
@@ -140,7 +152,7 @@ int RknnYolov5::Init(const char* model_path, int width, int height) {
     }
     
     // Pre-allocate input buffer
-    input_buffer = (unsigned char*)malloc(model_width * model_height * channel);
+    input_buffer = (unsigned char*)malloc((size_t)batch * model_width * model_height * channel);
     if (!input_buffer) {
         printf("Malloc input buffer failed!\n");
         return -1;
@@ -149,7 +161,30 @@ int RknnYolov5::Init(const char* model_path, int width, int height) {
     return 0;
 }
 
-int RknnYolov5::PreProcess(unsigned char* input_data, int img_width, int img_height) {
+int RknnYolov5::SetCoreMask(int core_mask) {
+    int ret = rknn_set_core_mask(ctx, (rknn_core_mask)core_mask);
+    if (ret < 0) {
+        // RK3568等单核NPU不支持，继续用驱动的默认调度
+        printf("rknn_set_core_mask(%d) not supported, ret=%d\n", core_mask, ret);
+        return -1;
+    }
+    return 0;
+}
+
+int RknnYolov5::SetLabels(const char* label_path) {
+    // 先读新的，读不到时保留原来的标签
+    postprocess_ctx_t labels;
+    if (initPostProcess(&labels, label_path) < 0) {
+        deinitPostProcess(&labels);
+        printf("Failed to load labels: %s\n", label_path ? label_path : "(default)");
+        return -1;
+    }
+    deinitPostProcess(&pp);
+    pp = labels;
+    return 0;
+}
+
+int RknnYolov5::PreProcess(unsigned char* input_data, int img_width, int img_height, unsigned char* dst_buffer) {
     rga_buffer_t src = {0};
     rga_buffer_t dst = {0};
     im_rect src_rect = {0, 0, img_width, img_height};
@@ -157,33 +192,44 @@ int RknnYolov5::PreProcess(unsigned char* input_data, int img_width, int img_hei
 
     src = wrapbuffer_virtualaddr((void*)input_data, img_width, img_height, RK_FORMAT_YCbCr_420_SP);
 
-    dst = wrapbuffer_virtualaddr((void*)input_buffer, model_width, model_height, RK_FORMAT_RGB_888);
+    dst = wrapbuffer_virtualaddr((void*)dst_buffer, model_width, model_height, RK_FORMAT_RGB_888);
     int ret = imresize(src, dst);
     if (ret != IM_STATUS_SUCCESS) {
         printf("Pre-process failed: %s\n", imStrError((IM_STATUS)ret));
         return -1;
     }
     
-    // Set input tensor
-    inputs[0].index = 0;
-    inputs[0].type = RKNN_TENSOR_UINT8;
-    inputs[0].size = model_width * model_height * channel;
-    inputs[0].fmt = RKNN_TENSOR_NHWC;
-    inputs[0].buf = input_buffer;
-    
     return 0;
 }
 
 int RknnYolov5::Inference(unsigned char* input_data, int img_width, int img_height, detect_result_group_t* detect_result) {
+    return InferenceBatch(&input_data, &img_width, &img_height, 1, detect_result);
+}
+
+int RknnYolov5::InferenceBatch(unsigned char* const* input_data, const int* img_width, const int* img_height,
+                               int count, detect_result_group_t* detect_results) {
 
     // struct timeval start_time, end_time;
     // gettimeofday(&start_time, NULL);
-    int ret = PreProcess(input_data, img_width, img_height);
-    if (ret < 0) {
+    if (count < 1 || count > batch) {
+        printf("Batch of %d frames does not fit the model (batch=%d)\n", count, batch);
         return -1;
     }
+    size_t frame_bytes = (size_t)model_width * model_height * channel;
+    for (int i = 0; i < count; i++) {
+        if (PreProcess(input_data[i], img_width[i], img_height[i], input_buffer + i * frame_bytes) < 0) {
+            return -1;
+        }
+    }
+    
+    // Set input tensor
+    inputs[0].index = 0;
+    inputs[0].type = RKNN_TENSOR_UINT8;
+    inputs[0].size = batch * frame_bytes;
+    inputs[0].fmt = RKNN_TENSOR_NHWC;
+    inputs[0].buf = input_buffer;
     
-    ret = rknn_inputs_set(ctx, 1, inputs);
+    int ret = rknn_inputs_set(ctx, 1, inputs);
     if (ret < 0) {
         printf("rknn_input_set fail! ret=%d\n", ret);
         return -1;
@@ -206,12 +252,16 @@ int RknnYolov5::Inference(unsigned char* input_data, int img_width, int img_heig
 
     
     // Post Process
-    float scale_w = (float)model_width / img_width;
-    float scale_h = (float)model_height / img_height;
-    
-    ret = post_process((int8_t*)outputs[0].buf, (int8_t*)outputs[1].buf, (int8_t*)outputs[2].buf,
-                       model_height, model_width, BOX_THRESH, NMS_THRESH, scale_w, scale_h,
-                       qnt_zps, qnt_scales, detect_result);
+    for (int i = 0; i < count && ret >= 0; i++) {
+        float scale_w = (float)model_width / img_width[i];
+        float scale_h = (float)model_height / img_height[i];
+        
+        ret = post_process(&pp, (int8_t*)outputs[0].buf + i * output_stride[0],
+                           (int8_t*)outputs[1].buf + i * output_stride[1],
+                           (int8_t*)outputs[2].buf + i * output_stride[2],
+                           model_height, model_width, BOX_THRESH, NMS_THRESH, scale_w, scale_h,
+                           qnt_zps, qnt_scales, &detect_results[i]);
+    }
     
     // gettimeofday(&end_time, NULL);
     // float inference_time = ((end_time.tv_sec - start_time.tv_sec) * 1000000 + (end_time.tv_usec - start_time.tv_usec)) / 1000.0f;
@@ -238,4 +288,6 @@ void RknnYolov5::Release() {
             output_buffer[i] = nullptr;
         }
     }
+
+    deinitPostProcess(&pp);
 }
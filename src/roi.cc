@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "roi.h"
+
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+// 检测框向外扩展1/8，避免目标边缘落在低质量区域
+#define ROI_EXPAND_DIV 8
+#define ROI_ALIGN 16
+
+// Encoders in libavcodec that read AV_FRAME_DATA_REGIONS_OF_INTEREST
+static const char *roi_encoders[] = {
+    "libx264", "libx265", "libvpx", "libvpx-vp9",
+    "h264_vaapi", "hevc_vaapi", "h264_qsv", "hevc_qsv", "h264_nvenc", "hevc_nvenc",
+};
+
+void roi_config_default(roi_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->classes = "person,car,bus,truck,motorbike,bicycle";
+    cfg->qoffset = -0.3;
+    cfg->bg_qoffset = 0.2;
+}
+
+static void parse_classes(roi_state_t *roi, const char *list) {
+    const char *p = list;
+    while (*p && roi->class_count < ROI_MAX_CLASSES) {
+        size_t len = strcspn(p, ",");
+        if (len > 0 && len < OBJ_NAME_MAX_SIZE) {
+            memcpy(roi->classes[roi->class_count], p, len);
+            roi->classes[roi->class_count][len] = '\0';
+            roi->class_count++;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+}
+
+roi_state_t* roi_create(const roi_config_t *cfg) {
+    roi_state_t *roi = (roi_state_t*)calloc(1, sizeof(roi_state_t));
+    if (!roi) {
+        perror("Failed to allocate ROI state");
+        return NULL;
+    }
+    roi->cfg = *cfg;
+    parse_classes(roi, cfg->classes);
+    if (roi->class_count == 0) {
+        fprintf(stderr, "No ROI classes in '%s'\n", cfg->classes);
+        free(roi);
+        return NULL;
+    }
+    if (cfg->log_path) {
+        roi->log = fopen(cfg->log_path, "w");
+        if (!roi->log) {
+            perror("Failed to open ROI log");
+            free(roi);
+            return NULL;
+        }
+        fprintf(roi->log, "pts,roi,key,size,regions\n");
+    }
+    printf("ROI encoding: %d classes, qoffset %.2f, background %.2f%s\n",
+           roi->class_count, cfg->qoffset, cfg->bg_qoffset,
+           roi->log ? ", measuring (ROI toggles every GOP)" : "");
+    return roi;
+}
+
+void roi_set_encoder(roi_state_t *roi, const AVCodecContext *ctx) {
+    roi->supported = 0;
+    for (size_t i = 0; i < sizeof(roi_encoders) / sizeof(roi_encoders[0]); i++) {
+        if (!strcmp(ctx->codec->name, roi_encoders[i])) {
+            roi->supported = 1;
+            break;
+        }
+    }
+    // rkmpp 编码器没有把 MPP 的 ROI 接口暴露给 libavcodec，侧数据会被忽略
+    if (!roi->supported) {
+        printf("Encoder %s does not read ROI side data, regions are attached but have no effect\n",
+               ctx->codec->name);
+    }
+}
+
+static int class_matches(const roi_state_t *roi, const char *name) {
+    for (int c = 0; c < roi->class_count; c++) {
+        if (!strcmp(name, roi->classes[c])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int clamp_align(int v, int max, int round_up) {
+    v = round_up ? (v + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN : v / ROI_ALIGN * ROI_ALIGN;
+    if (v < 0) return 0;
+    return v > max ? max : v;
+}
+
+int roi_attach(roi_state_t *roi, AVFrame *frame, const detect_result_group_t *group,
+               int src_w, int src_h, int gop_size) {
+    uint64_t n = roi->frames++;
+    int on = 1;
+    if (roi->log && gop_size > 0) {
+        // 测量模式: 按GOP交替开关，两组帧的场景条件基本一致
+        on = (n / gop_size) % 2 == 0;
+    }
+
+    // 推理线程随时会覆盖结果，先拷贝一份
+    detect_result_group_t det;
+    memcpy(&det, group, sizeof(det));
+    if (det.count < 0 || det.count > OBJ_NUMB_MAX_SIZE) {
+        det.count = 0;
+    }
+
+    AVRegionOfInterest regions[OBJ_NUMB_MAX_SIZE + 1];
+    int count = 0;
+    for (int i = 0; on && i < det.count; i++) {
+        const detect_result_t *r = &det.results[i];
+        if (!class_matches(roi, r->name)) {
+            continue;
+        }
+        int left = (int)((int64_t)r->box.left * frame->width / src_w);
+        int right = (int)((int64_t)r->box.right * frame->width / src_w);
+        int top = (int)((int64_t)r->box.top * frame->height / src_h);
+        int bottom = (int)((int64_t)r->box.bottom * frame->height / src_h);
+        int dx = (right - left) / ROI_EXPAND_DIV;
+        int dy = (bottom - top) / ROI_EXPAND_DIV;
+
+        AVRegionOfInterest *roi_box = &regions[count];
+        roi_box->self_size = sizeof(AVRegionOfInterest);
+        roi_box->left = clamp_align(left - dx, frame->width, 0);
+        roi_box->right = clamp_align(right + dx, frame->width, 1);
+        roi_box->top = clamp_align(top - dy, frame->height, 0);
+        roi_box->bottom = clamp_align(bottom + dy, frame->height, 1);
+        roi_box->qoffset = av_d2q(roi->cfg.qoffset, 100);
+        if (roi_box->right > roi_box->left && roi_box->bottom > roi_box->top) {
+            count++;
+        }
+    }
+    // 背景区域放在最后，只作用于没有被检测框覆盖的宏块
+    if (on && roi->cfg.bg_qoffset != 0.0) {
+        AVRegionOfInterest *bg = &regions[count++];
+        bg->self_size = sizeof(AVRegionOfInterest);
+        bg->left = 0;
+        bg->top = 0;
+        bg->right = frame->width;
+        bg->bottom = frame->height;
+        bg->qoffset = av_d2q(roi->cfg.bg_qoffset, 100);
+    }
+
+    int slot = (int)(n % ROI_HISTORY);
+    roi->roi_pts[slot] = frame->pts;
+    roi->roi_on[slot] = on;
+    roi->roi_count[slot] = count;
+    if (count == 0) {
+        return 0;
+    }
+
+    AVFrameSideData *sd = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST,
+                                                 count * sizeof(AVRegionOfInterest));
+    if (!sd) {
+        fprintf(stderr, "Could not attach ROI side data\n");
+        return -1;
+    }
+    memcpy(sd->data, regions, count * sizeof(AVRegionOfInterest));
+    return count;
+}
+
+// 编码器按输入顺序输出，从最近的帧往前找
+static int find_frame(const roi_state_t *roi, int64_t pts) {
+    for (int i = 1; i <= ROI_HISTORY && (uint64_t)i <= roi->frames; i++) {
+        int slot = (int)((roi->frames - i) % ROI_HISTORY);
+        if (roi->roi_pts[slot] == pts) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void roi_log_packet(roi_state_t *roi, const AVPacket *pkt) {
+    if (!roi->log || pkt->pts == AV_NOPTS_VALUE) {
+        return;
+    }
+    int slot = find_frame(roi, pkt->pts);
+    if (slot < 0) {
+        return;
+    }
+    int on = roi->roi_on[slot];
+    int key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+    roi->packets[on]++;
+    roi->bytes[on] += pkt->size;
+    if (key) {
+        roi->key_packets[on]++;
+        roi->key_bytes[on] += pkt->size;
+    }
+    fprintf(roi->log, "%lld,%d,%d,%d,%d\n", (long long)pkt->pts, on, key, pkt->size,
+            roi->roi_count[slot]);
+}
+
+static double average(uint64_t bytes, uint64_t count) {
+    return count ? (double)bytes / count : 0.0;
+}
+
+void roi_destroy(roi_state_t *roi) {
+    if (!roi) return;
+    if (roi->log) {
+        double off = average(roi->bytes[0], roi->packets[0]);
+        double on = average(roi->bytes[1], roi->packets[1]);
+        printf("ROI measurement: off %llu frames %.0f B/frame (key %.0f B), "
+               "on %llu frames %.0f B/frame (key %.0f B), %+.1f%%\n",
+               (unsigned long long)roi->packets[0], off,
+               average(roi->key_bytes[0], roi->key_packets[0]),
+               (unsigned long long)roi->packets[1], on,
+               average(roi->key_bytes[1], roi->key_packets[1]),
+               off > 0 ? (on - off) * 100.0 / off : 0.0);
+        fclose(roi->log);
+    }
+    free(roi);
+}
@@ -0,0 +1,710 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "rtmp_client.h"
+#include "flv_tag.h"
+#include "nal_utils.h"
+
+extern "C" {
+#include <libavutil/intfloat.h>
+#include <libavutil/mathematics.h>
+}
+
+// 与libavformat的rtmp协议一致的chunk stream分配
+#define CSID_CONTROL 2
+#define CSID_COMMAND 3
+#define CSID_AUDIO 4
+#define CSID_DATA 5
+#define CSID_VIDEO 6
+
+#define RTMP_EXT_TS 0xffffff
+#define RTMP_MAX_MESSAGE (16 * 1024 * 1024)
+
+#define TXN_CONNECT 1
+#define TXN_CREATE_STREAM 4
+
+int rtmp_write_full(int fd, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int rtmp_read_full(int fd, void *data, size_t size) {
+    uint8_t *p = (uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = ECONNRESET;
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static uint32_t rd_be24(const uint8_t *p) {
+    return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+}
+
+static uint32_t rd_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | rd_be24(p + 1);
+}
+
+int rtmp_read_message(rtmp_reader_t *r, rtmp_message_t *msg) {
+    for (;;) {
+        uint8_t b[11];
+        if (rtmp_read_full(r->fd, b, 1) < 0) return -1;
+        int fmt = b[0] >> 6;
+        int csid = b[0] & 0x3f;
+        if (csid < 2) {
+            // 2/3字节的basic header, 这里用不到那么多chunk stream
+            uint8_t ext[2];
+            if (rtmp_read_full(r->fd, ext, csid + 1) < 0) return -1;
+            csid = 64 + ext[0] + (csid == 1 ? ext[1] * 256 : 0);
+        }
+        if (csid >= RTMP_MAX_CSID) {
+            fprintf(stderr, "RTMP: unsupported chunk stream id %d\n", csid);
+            return -1;
+        }
+        rtmp_chunk_stream_t *cs = &r->streams[csid];
+        static const int header_sizes[4] = { 11, 7, 3, 0 };
+        if (rtmp_read_full(r->fd, b, header_sizes[fmt]) < 0) return -1;
+
+        uint32_t ts = fmt < 3 ? rd_be24(b) : 0;
+        if (fmt <= 1) {
+            cs->length = rd_be24(b + 3);
+            cs->type = b[6];
+        }
+        if (fmt == 0) {
+            cs->stream_id = b[7] | (b[8] << 8) | (b[9] << 16) | ((uint32_t)b[10] << 24);
+        }
+        if (fmt < 3) {
+            cs->ext_ts = ts == RTMP_EXT_TS;
+        }
+        if (cs->ext_ts) {
+            // type 3的chunk也会重复扩展时间戳
+            uint8_t ext[4];
+            if (rtmp_read_full(r->fd, ext, 4) < 0) return -1;
+            if (fmt < 3) ts = rd_be32(ext);
+        }
+        if (cs->received == 0) {
+            if (fmt == 0) {
+                cs->timestamp = ts;
+                cs->delta = 0;
+            } else {
+                if (fmt < 3) cs->delta = ts;
+                cs->timestamp += cs->delta;
+            }
+            if (cs->length > RTMP_MAX_MESSAGE) {
+                fprintf(stderr, "RTMP: message of %u bytes\n", cs->length);
+                return -1;
+            }
+            byte_buf_reset(&cs->payload);
+            if (byte_buf_reserve(&cs->payload, cs->length) < 0) return -1;
+        }
+
+        uint32_t n = cs->length - cs->received;
+        if (n > r->chunk_size) n = r->chunk_size;
+        if (rtmp_read_full(r->fd, cs->payload.data + cs->received, n) < 0) return -1;
+        cs->received += n;
+        cs->payload.size = cs->received;
+        if (cs->received < cs->length) {
+            continue;
+        }
+
+        cs->received = 0;
+        msg->type = cs->type;
+        msg->stream_id = cs->stream_id;
+        msg->timestamp = cs->timestamp;
+        msg->data = cs->payload.data;
+        msg->size = cs->length;
+        if (msg->type == RTMP_MSG_SET_CHUNK_SIZE && msg->size >= 4) {
+            r->chunk_size = rd_be32(msg->data) & 0x7fffffff;
+            if (r->chunk_size < 1) r->chunk_size = 1;
+        }
+        return 0;
+    }
+}
+
+void rtmp_reader_free(rtmp_reader_t *r) {
+    for (int i = 0; i < RTMP_MAX_CSID; i++) {
+        byte_buf_free(&r->streams[i].payload);
+    }
+}
+
+// ---- AMF0 ----
+
+void rtmp_amf_string(byte_buf_t *b, const char *s) {
+    byte_buf_u8(b, 2);
+    byte_buf_be16(b, strlen(s));
+    byte_buf_append(b, s, strlen(s));
+}
+
+void rtmp_amf_number(byte_buf_t *b, double v) {
+    uint64_t bits = av_double2int(v);
+    byte_buf_u8(b, 0);
+    byte_buf_be32(b, bits >> 32);
+    byte_buf_be32(b, (uint32_t)bits);
+}
+
+void rtmp_amf_null(byte_buf_t *b) {
+    byte_buf_u8(b, 5);
+}
+
+void rtmp_amf_object_begin(byte_buf_t *b) {
+    byte_buf_u8(b, 3);
+}
+
+static void amf_key(byte_buf_t *b, const char *key) {
+    byte_buf_be16(b, strlen(key));
+    byte_buf_append(b, key, strlen(key));
+}
+
+void rtmp_amf_prop_string(byte_buf_t *b, const char *key, const char *value) {
+    amf_key(b, key);
+    rtmp_amf_string(b, value);
+}
+
+void rtmp_amf_prop_number(byte_buf_t *b, const char *key, double v) {
+    amf_key(b, key);
+    rtmp_amf_number(b, v);
+}
+
+void rtmp_amf_object_end(byte_buf_t *b) {
+    byte_buf_be24(b, 9);
+}
+
+static int amf_read_number(const uint8_t *p, size_t size, size_t *pos, double *v) {
+    if (*pos + 9 > size || p[*pos] != 0) return -1;
+    uint64_t bits = ((uint64_t)rd_be32(p + *pos + 1) << 32) | rd_be32(p + *pos + 5);
+    *v = av_int2double(bits);
+    *pos += 9;
+    return 0;
+}
+
+// 跳过一个AMF0值; 只处理命令回复里会出现的类型
+static int amf_skip(const uint8_t *p, size_t size, size_t *pos, int depth) {
+    if (*pos >= size || depth > 8) return -1;
+    uint8_t type = p[(*pos)++];
+    switch (type) {
+    case 0: *pos += 8; break;                           // number
+    case 1: *pos += 1; break;                           // boolean
+    case 2:                                             // string
+        if (*pos + 2 > size) return -1;
+        *pos += 2 + ((p[*pos] << 8) | p[*pos + 1]);
+        break;
+    case 5: case 6: break;                              // null/undefined
+    case 8:                                             // ECMA array
+        *pos += 4;
+        /* fall through */
+    case 3:                                             // object
+        for (;;) {
+            if (*pos + 3 > size) return -1;
+            size_t len = (p[*pos] << 8) | p[*pos + 1];
+            *pos += 2;
+            if (len == 0 && p[*pos] == 9) {
+                (*pos)++;
+                break;
+            }
+            *pos += len;
+            if (amf_skip(p, size, pos, depth + 1) < 0) return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    return *pos <= size ? 0 : -1;
+}
+
+int rtmp_amf_command(const uint8_t *data, size_t size, char *name, size_t name_size, double *txn) {
+    if (size < 3 || data[0] != 2) return -1;
+    size_t len = (data[1] << 8) | data[2];
+    if (3 + len > size) return -1;
+    size_t copy = len < name_size - 1 ? len : name_size - 1;
+    memcpy(name, data + 3, copy);
+    name[copy] = '\0';
+    size_t pos = 3 + len;
+    if (amf_read_number(data, size, &pos, txn) < 0) return -1;
+    return (int)pos;
+}
+
+// ---- chunked writes ----
+
+static int ensure_capacity(rtmp_client_t *c, size_t hdr_bytes, int iovs, int segs) {
+    if (hdr_bytes > c->hdr_capacity) {
+        uint8_t *p = (uint8_t*)realloc(c->hdr, hdr_bytes);
+        if (!p) return -1;
+        c->hdr = p;
+        c->hdr_capacity = hdr_bytes;
+    }
+    if (iovs > c->iov_capacity) {
+        struct iovec *p = (struct iovec*)realloc(c->iov, iovs * sizeof(*p));
+        if (!p) return -1;
+        c->iov = p;
+        c->iov_capacity = iovs;
+    }
+    if (segs > c->seg_capacity) {
+        rtmp_seg_t *p = (rtmp_seg_t*)realloc(c->segs, segs * sizeof(*p));
+        if (!p) return -1;
+        c->segs = p;
+        c->seg_capacity = segs;
+    }
+    return 0;
+}
+
+static int write_iov(rtmp_client_t *c, struct iovec *iov, int count) {
+    while (count > 0) {
+        int batch = count < IOV_MAX ? count : IOV_MAX;
+        ssize_t n = writev(c->fd, iov, batch);
+        c->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        c->bytes += n;
+        // 部分写: 跳过已写完的iovec, 调整当前这个
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static size_t chunk_count(const rtmp_client_t *c, size_t total) {
+    return total ? (total + c->chunk_size - 1) / c->chunk_size : 1;
+}
+
+// Worst case bytes of chunk headers for a message
+static size_t chunk_header_bytes(const rtmp_client_t *c, size_t total, uint32_t timestamp) {
+    int ext = timestamp >= RTMP_EXT_TS;
+    return 12 + chunk_count(c, total) * (ext ? 5 : 1) + (ext ? 4 : 0);
+}
+
+// Chunk headers go to c->hdr from hdr_offset on; the segments themselves
+// are referenced, never copied. The caller has reserved room so nothing
+// here can move c->hdr.
+static int write_segments(rtmp_client_t *c, size_t hdr_offset, int csid, uint8_t type,
+                          uint32_t stream_id, uint32_t timestamp, const rtmp_seg_t *segs, int nsegs) {
+    size_t total = 0;
+    for (int i = 0; i < nsegs; i++) {
+        total += segs[i].size;
+    }
+    int ext = timestamp >= RTMP_EXT_TS;
+    uint8_t *h = c->hdr + hdr_offset;
+    struct iovec *iov = c->iov;
+    int n = 0;
+    uint32_t ts = ext ? RTMP_EXT_TS : timestamp;
+    uint8_t *start = h;
+    *h++ = (uint8_t)csid;                               // fmt 0
+    *h++ = ts >> 16; *h++ = ts >> 8; *h++ = ts;
+    *h++ = total >> 16; *h++ = total >> 8; *h++ = total;
+    *h++ = type;
+    *h++ = stream_id; *h++ = stream_id >> 8; *h++ = stream_id >> 16; *h++ = stream_id >> 24;
+    if (ext) {
+        *h++ = timestamp >> 24; *h++ = timestamp >> 16; *h++ = timestamp >> 8; *h++ = timestamp;
+    }
+    iov[n].iov_base = start;
+    iov[n++].iov_len = h - start;
+
+    size_t in_chunk = 0;
+    for (int i = 0; i < nsegs; i++) {
+        const uint8_t *p = segs[i].data;
+        size_t left = segs[i].size;
+        while (left > 0) {
+            if (in_chunk == c->chunk_size) {
+                start = h;
+                *h++ = 0xc0 | csid;                     // fmt 3
+                if (ext) {
+                    *h++ = timestamp >> 24; *h++ = timestamp >> 16; *h++ = timestamp >> 8; *h++ = timestamp;
+                }
+                iov[n].iov_base = start;
+                iov[n++].iov_len = h - start;
+                in_chunk = 0;
+            }
+            size_t take = left < c->chunk_size - in_chunk ? left : c->chunk_size - in_chunk;
+            // 与上一个iovec相邻(比如tag前缀后面紧跟的NAL长度)就合并
+            if (n > 0 && (const uint8_t*)c->iov[n - 1].iov_base + c->iov[n - 1].iov_len == p) {
+                c->iov[n - 1].iov_len += take;
+            } else {
+                iov[n].iov_base = (void*)p;
+                iov[n++].iov_len = take;
+            }
+            p += take;
+            left -= take;
+            in_chunk += take;
+        }
+    }
+    c->messages++;
+    return write_iov(c, iov, n);
+}
+
+int rtmp_client_write_message(rtmp_client_t *c, int csid, uint8_t type, uint32_t stream_id,
+                              uint32_t timestamp, const rtmp_seg_t *segs, int nsegs) {
+    size_t total = 0;
+    for (int i = 0; i < nsegs; i++) {
+        total += segs[i].size;
+    }
+    if (ensure_capacity(c, chunk_header_bytes(c, total, timestamp),
+                        nsegs + 2 * (int)chunk_count(c, total) + 1, 0) < 0) {
+        return -1;
+    }
+    return write_segments(c, 0, csid, type, stream_id, timestamp, segs, nsegs);
+}
+
+static int send_buf(rtmp_client_t *c, int csid, uint8_t type, uint32_t stream_id,
+                    uint32_t timestamp, const byte_buf_t *b) {
+    if (b->error) return -1;
+    rtmp_seg_t seg = { b->data, b->size };
+    return rtmp_client_write_message(c, csid, type, stream_id, timestamp, &seg, 1);
+}
+
+// ---- connection ----
+
+static int parse_url(const char *url, char *host, size_t host_size, int *port,
+                     char *app, size_t app_size, const char **stream) {
+    if (strncmp(url, "rtmp://", 7) != 0) return -1;
+    const char *p = url + 7;
+    const char *slash = strchr(p, '/');
+    if (!slash) return -1;
+    const char *colon = (const char*)memchr(p, ':', slash - p);
+    const char *host_end = colon ? colon : slash;
+    if (host_end == p || (size_t)(host_end - p) >= host_size) return -1;
+    memcpy(host, p, host_end - p);
+    host[host_end - p] = '\0';
+    *port = colon ? atoi(colon + 1) : RTMP_DEFAULT_PORT;
+    // app是最后一个'/'之前的部分, 之后是流名
+    const char *last = strrchr(slash + 1, '/');
+    if (!last || last[1] == '\0' || (size_t)(last - slash - 1) >= app_size) return -1;
+    memcpy(app, slash + 1, last - slash - 1);
+    app[last - slash - 1] = '\0';
+    *stream = last + 1;
+    return *port > 0 && *port <= 65535 ? 0 : -1;
+}
+
+static int tcp_connect(const char *host, int port, int timeout_ms) {
+    char service[16];
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    int err = getaddrinfo(host, service, &hints, &res);
+    if (err) {
+        fprintf(stderr, "RTMP: cannot resolve %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        if (errno == EINPROGRESS) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int so_err = 0;
+            socklen_t len = sizeof(so_err);
+            if (poll(&pfd, 1, timeout_ms) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_err, &len) == 0 && so_err == 0) {
+                break;
+            }
+            errno = so_err ? so_err : ETIMEDOUT;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        return -1;
+    }
+    // 之后都是阻塞读写, 超时相当于libavformat的rw_timeout
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Simple (version 3, no digest) handshake, which is all a publisher needs
+static int handshake(int fd) {
+    uint8_t c0c1[1 + RTMP_HANDSHAKE_SIZE];
+    uint8_t s0s1[1 + RTMP_HANDSHAKE_SIZE];
+    uint8_t s2[RTMP_HANDSHAKE_SIZE];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint32_t seed = (uint32_t)now.tv_nsec ^ (uint32_t)getpid();
+    memset(c0c1, 0, 9);
+    c0c1[0] = 3;
+    for (int i = 9; i < (int)sizeof(c0c1); i++) {
+        seed = seed * 1103515245u + 12345u;
+        c0c1[i] = seed >> 16;
+    }
+    if (rtmp_write_full(fd, c0c1, sizeof(c0c1)) < 0 ||
+        rtmp_read_full(fd, s0s1, sizeof(s0s1)) < 0 ||
+        rtmp_read_full(fd, s2, sizeof(s2)) < 0) {
+        return -1;
+    }
+    if (s0s1[0] != 3) {
+        fprintf(stderr, "RTMP: server version %d\n", s0s1[0]);
+        return -1;
+    }
+    // C2回显S1
+    return rtmp_write_full(fd, s0s1 + 1, RTMP_HANDSHAKE_SIZE);
+}
+
+// Reads messages until the reply to txn (or, for txn 0, onStatus) arrives
+static int wait_reply(rtmp_client_t *c, double txn, double *stream_id) {
+    for (;;) {
+        rtmp_message_t msg;
+        if (rtmp_read_message(&c->reader, &msg) < 0) {
+            perror("RTMP: waiting for server reply");
+            return -1;
+        }
+        if (msg.type != RTMP_MSG_COMMAND_AMF0) {
+            continue;                   // window size, peer bandwidth, user control
+        }
+        char name[32];
+        double id;
+        int pos = rtmp_amf_command(msg.data, msg.size, name, sizeof(name), &id);
+        if (pos < 0) continue;
+        if (txn == 0 && !strcmp(name, "onStatus")) {
+            if (memmem(msg.data, msg.size, "NetStream.Publish.Start", 23)) {
+                return 0;
+            }
+            fprintf(stderr, "RTMP: publish of '%s' rejected\n", c->stream_name);
+            return -1;
+        }
+        if (id != txn) continue;
+        if (!strcmp(name, "_error")) {
+            fprintf(stderr, "RTMP: server returned an error for transaction %g\n", txn);
+            return -1;
+        }
+        if (!strcmp(name, "_result")) {
+            if (stream_id) {
+                size_t p = pos;
+                if (amf_skip(msg.data, msg.size, &p, 0) < 0 ||
+                    amf_read_number(msg.data, msg.size, &p, stream_id) < 0) {
+                    fprintf(stderr, "RTMP: malformed createStream result\n");
+                    return -1;
+                }
+            }
+            return 0;
+        }
+    }
+}
+
+static int send_command(rtmp_client_t *c, const char *name, double txn, uint32_t stream_id,
+                        const char *arg) {
+    byte_buf_t b = { 0 };
+    rtmp_amf_string(&b, name);
+    rtmp_amf_number(&b, txn);
+    rtmp_amf_null(&b);
+    if (arg) rtmp_amf_string(&b, arg);
+    if (!strcmp(name, "publish")) rtmp_amf_string(&b, "live");
+    int ret = send_buf(c, stream_id ? CSID_DATA : CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, stream_id, 0, &b);
+    byte_buf_free(&b);
+    return ret;
+}
+
+static int publish(rtmp_client_t *c, const char *host, int port, const char *app) {
+    // Set Chunk Size在connect之前发, 之后所有消息都用这个块大小
+    uint8_t chunk[4] = { (uint8_t)(c->chunk_size >> 24), (uint8_t)(c->chunk_size >> 16),
+                         (uint8_t)(c->chunk_size >> 8), (uint8_t)c->chunk_size };
+    rtmp_seg_t seg = { chunk, sizeof(chunk) };
+    if (rtmp_client_write_message(c, CSID_CONTROL, RTMP_MSG_SET_CHUNK_SIZE, 0, 0, &seg, 1) < 0) {
+        return -1;
+    }
+
+    char tc_url[512];
+    snprintf(tc_url, sizeof(tc_url), "rtmp://%s:%d/%s", host, port, app);
+    byte_buf_t b = { 0 };
+    rtmp_amf_string(&b, "connect");
+    rtmp_amf_number(&b, TXN_CONNECT);
+    rtmp_amf_object_begin(&b);
+    rtmp_amf_prop_string(&b, "app", app);
+    rtmp_amf_prop_string(&b, "type", "nonprivate");
+    rtmp_amf_prop_string(&b, "flashVer", "FMLE/3.0 (compatible; Lavf)");
+    rtmp_amf_prop_string(&b, "tcUrl", tc_url);
+    rtmp_amf_object_end(&b);
+    int ret = send_buf(c, CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, 0, &b);
+    byte_buf_free(&b);
+    if (ret < 0 || wait_reply(c, TXN_CONNECT, NULL) < 0) {
+        return -1;
+    }
+
+    double stream_id = 0;
+    if (send_command(c, "releaseStream", 2, 0, c->stream_name) < 0 ||
+        send_command(c, "FCPublish", 3, 0, c->stream_name) < 0 ||
+        send_command(c, "createStream", TXN_CREATE_STREAM, 0, NULL) < 0 ||
+        wait_reply(c, TXN_CREATE_STREAM, &stream_id) < 0) {
+        return -1;
+    }
+    c->stream_id = (uint32_t)stream_id;
+    if (send_command(c, "publish", 5, c->stream_id, c->stream_name) < 0 ||
+        wait_reply(c, 0, NULL) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+rtmp_client_t* rtmp_client_connect(const char *url, int chunk_size, int timeout_ms) {
+    char host[256];
+    char app[256];
+    const char *stream;
+    int port;
+    if (parse_url(url, host, sizeof(host), &port, app, sizeof(app), &stream) < 0) {
+        fprintf(stderr, "RTMP: invalid URL '%s', expected rtmp://host[:port]/app/stream\n", url);
+        return NULL;
+    }
+    rtmp_client_t *c = (rtmp_client_t*)calloc(1, sizeof(rtmp_client_t));
+    if (!c) {
+        perror("Failed to allocate RTMP client");
+        return NULL;
+    }
+    c->chunk_size = chunk_size > 0 ? chunk_size : RTMP_DEFAULT_CHUNK_SIZE;
+    c->stream_name = strdup(stream);
+    c->reader.chunk_size = 128;
+    c->fd = tcp_connect(host, port, timeout_ms);
+    c->reader.fd = c->fd;
+    // 预分配: 一个典型P帧不需要再分配
+    if (c->fd < 0 || !c->stream_name || ensure_capacity(c, 4096, 256, 64) < 0 ||
+        handshake(c->fd) < 0 || publish(c, host, port, app) < 0) {
+        if (c->fd < 0) fprintf(stderr, "RTMP: cannot connect to %s:%d: %s\n", host, port, strerror(errno));
+        rtmp_client_close(c, 0);
+        return NULL;
+    }
+    return c;
+}
+
+// Sends a tag built by flv_tag.cc without its 11 byte header and PreviousTagSize
+static int send_flv_tag(rtmp_client_t *c, int csid, const byte_buf_t *tag, const char *prefix) {
+    if (tag->error || tag->size < FLV_TAG_HEADER_SIZE + 4) return -1;
+    byte_buf_t b = { 0 };
+    if (prefix) rtmp_amf_string(&b, prefix);
+    byte_buf_append(&b, tag->data + FLV_TAG_HEADER_SIZE, tag->size - FLV_TAG_HEADER_SIZE - 4);
+    int ret = send_buf(c, csid, tag->data[0], c->stream_id, 0, &b);
+    byte_buf_free(&b);
+    return ret;
+}
+
+int rtmp_client_write_header(rtmp_client_t *c, const AVCodecParameters *video, int fps,
+                             const AVCodecParameters *audio) {
+    byte_buf_t tag = { 0 };
+    flv_write_metadata(&tag, video, fps, audio);
+    int ret = send_flv_tag(c, CSID_DATA, &tag, "@setDataFrame");
+    byte_buf_reset(&tag);
+    if (ret == 0) {
+        ret = flv_write_avc_config(&tag, video) < 0 ? -1 : send_flv_tag(c, CSID_VIDEO, &tag, NULL);
+    }
+    byte_buf_reset(&tag);
+    if (ret == 0 && audio) {
+        ret = flv_write_aac_config(&tag, audio) < 0 ? -1 : send_flv_tag(c, CSID_AUDIO, &tag, NULL);
+    }
+    byte_buf_free(&tag);
+    return ret;
+}
+
+// 推流开始后服务器只会发确认和ping, 内容用不到; 每个GOP读掉一次,
+// 免得对端的发送缓冲积满
+static void drain_input(rtmp_client_t *c) {
+    uint8_t scratch[4096];
+    while (recv(c->fd, scratch, sizeof(scratch), MSG_DONTWAIT) > 0) {
+    }
+}
+
+int rtmp_client_write_packet(rtmp_client_t *c, const AVPacket *pkt, AVRational time_base) {
+    int64_t dts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    uint32_t ts = (uint32_t)av_rescale_q(dts, time_base, (AVRational){1, 1000});
+
+    if (pkt->stream_index == 1) {
+        static const uint8_t aac[2] = { 0xaf, 0x01 };  // 与flv_write_audio相同
+        rtmp_seg_t segs[2] = { { aac, 2 }, { pkt->data, (size_t)pkt->size } };
+        return rtmp_client_write_message(c, CSID_AUDIO, RTMP_MSG_AUDIO, c->stream_id, ts, segs, 2);
+    }
+
+    // 先数NAL, 一次性保证前缀区、chunk头和iovec都够用, 之后不再realloc
+    int nals = 0;
+    size_t total = 5;
+    size_t pos = 0;
+    nal_unit_t nal;
+    while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+        nals++;
+        total += 4 + nal.size;
+    }
+    size_t prefix_bytes = 5 + 4 * (size_t)nals;
+    if (ensure_capacity(c, prefix_bytes + chunk_header_bytes(c, total, ts),
+                        2 * nals + 2 * (int)chunk_count(c, total) + 2, 2 * nals + 1) < 0) {
+        return -1;
+    }
+
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        drain_input(c);
+    }
+    int64_t cts = av_rescale_q(pkt->pts - dts, time_base, (AVRational){1, 1000});
+    uint8_t *h = c->hdr;
+    h[0] = (pkt->flags & AV_PKT_FLAG_KEY) ? 0x17 : 0x27;   // AVC key/inter frame
+    h[1] = 1;                                               // AVC NALU
+    h[2] = (uint32_t)cts >> 16; h[3] = (uint32_t)cts >> 8; h[4] = (uint32_t)cts;
+    rtmp_seg_t *segs = c->segs;
+    int n = 0;
+    segs[n].data = h;
+    segs[n++].size = 5;
+    h += 5;
+    pos = 0;
+    while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+        h[0] = nal.size >> 24; h[1] = nal.size >> 16; h[2] = nal.size >> 8; h[3] = nal.size;
+        segs[n].data = h;
+        segs[n++].size = 4;
+        segs[n].data = nal.data;
+        segs[n++].size = nal.size;
+        h += 4;
+    }
+    return write_segments(c, prefix_bytes, CSID_VIDEO, RTMP_MSG_VIDEO, c->stream_id, ts, segs, n);
+}
+
+void rtmp_client_close(rtmp_client_t *c, int graceful) {
+    if (!c) return;
+    if (graceful && c->fd >= 0 && c->stream_id) {
+        send_command(c, "FCUnpublish", 6, 0, c->stream_name);
+        byte_buf_t b = { 0 };
+        rtmp_amf_string(&b, "deleteStream");
+        rtmp_amf_number(&b, 7);
+        rtmp_amf_null(&b);
+        rtmp_amf_number(&b, c->stream_id);
+        send_buf(c, CSID_COMMAND, RTMP_MSG_COMMAND_AMF0, 0, 0, &b);
+        byte_buf_free(&b);
+    }
+    if (c->fd >= 0) close(c->fd);
+    rtmp_reader_free(&c->reader);
+    free(c->stream_name);
+    free(c->hdr);
+    free(c->segs);
+    free(c->iov);
+    free(c);
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "rtp_multicast.h"
+#include "packet_queue.h"
+
+// 一个IDR帧的全部分片都能放进发送缓冲区，不会因为突发而丢包
+#define RTP_MULTICAST_SNDBUF (2 * 1024 * 1024)
+
+void multicast_config_default(multicast_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ttl = 1;
+}
+
+static int parse_dest(const char *spec, struct sockaddr_in *addr) {
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+    int port = atoi(colon + 1);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, host, &addr->sin_addr) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+rtp_multicast_t* rtp_multicast_open(const multicast_config_t *cfg) {
+    rtp_multicast_t *m = (rtp_multicast_t*)calloc(1, sizeof(rtp_multicast_t));
+    if (!m) {
+        perror("Failed to allocate RTP multicast output");
+        return NULL;
+    }
+    m->cfg = *cfg;
+    if (parse_dest(cfg->group, &m->dest) < 0) {
+        fprintf(stderr, "Invalid multicast destination '%s', expected IP:PORT\n", cfg->group);
+        free(m);
+        return NULL;
+    }
+    m->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (m->fd < 0) {
+        perror("RTP multicast socket");
+        free(m);
+        return NULL;
+    }
+
+    int sndbuf = RTP_MULTICAST_SNDBUF;
+    setsockopt(m->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    if (IN_MULTICAST(ntohl(m->dest.sin_addr.s_addr))) {
+        unsigned char ttl = cfg->ttl;
+        unsigned char loop = 1;     // 本机的接收端(及回环测试)也能收到
+        setsockopt(m->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        setsockopt(m->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+        if (cfg->iface) {
+            struct in_addr iface;
+            if (inet_pton(AF_INET, cfg->iface, &iface) != 1 ||
+                setsockopt(m->fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0) {
+                fprintf(stderr, "Cannot send multicast through interface '%s'\n", cfg->iface);
+                close(m->fd);
+                free(m);
+                return NULL;
+            }
+        }
+    } else {
+        printf("RTP output %s is not a multicast group, sending unicast\n", cfg->group);
+    }
+    // connect后sendmmsg不需要逐个消息填目的地址
+    if (connect(m->fd, (struct sockaddr*)&m->dest, sizeof(m->dest)) < 0) {
+        perror("RTP multicast connect");
+        close(m->fd);
+        free(m);
+        return NULL;
+    }
+
+    uint32_t ssrc = (uint32_t)(monotonic_us() * 2654435761u) ^ (uint32_t)getpid();
+    rtp_packetizer_init(&m->rtp, RTP_H264_PAYLOAD_TYPE, ssrc, RTP_DEFAULT_PAYLOAD);
+    for (int i = 0; i < RTP_BATCH_MAX; i++) {
+        m->iov[i][0].iov_base = m->headers[i];
+        m->msgs[i].msg_hdr.msg_iov = m->iov[i];
+        m->msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    printf("RTP multicast to %s, ttl %d\n", cfg->group, cfg->ttl);
+    return m;
+}
+
+// 原子地重写SDP: 接收端随时读取都是完整的文件
+static int write_sdp(rtp_multicast_t *m) {
+    char media[1024];
+    char ip[INET_ADDRSTRLEN];
+    char tmp[512];
+    if (rtp_h264_sdp_media(m->codecpar, m->rtp.payload_type, ntohs(m->dest.sin_port),
+                           media, sizeof(media)) < 0) {
+        fprintf(stderr, "No usable SPS/PPS for the SDP file\n");
+        return -1;
+    }
+    inet_ntop(AF_INET, &m->dest.sin_addr, ip, sizeof(ip));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->cfg.sdp_path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        perror("Failed to write SDP file");
+        return -1;
+    }
+    fprintf(fp, "v=0\r\no=- %u 1 IN IP4 %s\r\ns=live\r\n", m->rtp.ssrc, m->cfg.iface ? m->cfg.iface : "0.0.0.0");
+    if (IN_MULTICAST(ntohl(m->dest.sin_addr.s_addr))) {
+        fprintf(fp, "c=IN IP4 %s/%d\r\n", ip, m->cfg.ttl);
+    } else {
+        fprintf(fp, "c=IN IP4 %s\r\n", ip);
+    }
+    fprintf(fp, "t=0 0\r\n%s", media);
+    fclose(fp);
+    if (rename(tmp, m->cfg.sdp_path) < 0) {
+        perror("Failed to replace SDP file");
+        return -1;
+    }
+    return 0;
+}
+
+int rtp_multicast_start(rtp_multicast_t *m, const AVCodecParameters *codecpar, AVRational time_base) {
+    if (codecpar->codec_id != AV_CODEC_ID_H264) {
+        fprintf(stderr, "RTP multicast only carries H.264\n");
+        return -1;
+    }
+    if (!m->codecpar) {
+        m->codecpar = avcodec_parameters_alloc();
+    }
+    if (!m->codecpar || avcodec_parameters_copy(m->codecpar, codecpar) < 0) {
+        avcodec_parameters_free(&m->codecpar);
+        return -1;
+    }
+    m->time_base = time_base;
+    if (m->cfg.sdp_path && write_sdp(m) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void flush_batch(rtp_multicast_t *m) {
+    int done = 0;
+    while (done < m->batch) {
+        int n = sendmmsg(m->fd, m->msgs + done, m->batch - done, MSG_DONTWAIT);
+        m->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // 发送缓冲区满或没有接收端(ECONNREFUSED)时丢弃本批剩余的包
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED) {
+                perror("RTP multicast sendmmsg");
+            }
+            break;
+        }
+        done += n;
+    }
+    m->packets_sent += done;
+    m->packets_dropped += m->batch - done;
+    m->batch = 0;
+}
+
+static int add_packet(void *opaque, const uint8_t *header, size_t header_size,
+                      const uint8_t *payload, size_t payload_size) {
+    rtp_multicast_t *m = (rtp_multicast_t*)opaque;
+    if (m->batch == RTP_BATCH_MAX) {
+        flush_batch(m);
+    }
+    int i = m->batch++;
+    memcpy(m->headers[i], header, header_size);
+    m->iov[i][0].iov_len = header_size;
+    m->iov[i][1].iov_base = (void*)payload;
+    m->iov[i][1].iov_len = payload_size;
+    return 0;
+}
+
+void rtp_multicast_send(rtp_multicast_t *m, const AVPacket *pkt) {
+    if (!m->codecpar || pkt->stream_index != 0) {
+        return;
+    }
+    // payload指向编码器输出的包，在本函数返回前发送完毕
+    rtp_packetize_h264(&m->rtp, pkt, m->time_base, m->codecpar, add_packet, m);
+    flush_batch(m);
+    m->frames++;
+}
+
+void rtp_multicast_close(rtp_multicast_t *m) {
+    if (!m) return;
+    printf("RTP multicast: %llu frames, %llu packets in %llu sendmmsg calls, %llu dropped\n",
+           (unsigned long long)m->frames, (unsigned long long)m->packets_sent,
+           (unsigned long long)m->syscalls, (unsigned long long)m->packets_dropped);
+    close(m->fd);
+    avcodec_parameters_free(&m->codecpar);
+    free(m);
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include "rtp_packetizer.h"
+#include "nal_utils.h"
+
+extern "C" {
+#include <libavutil/base64.h>
+#include <libavutil/mathematics.h>
+}
+
+#define NAL_TYPE_FU_A 28
+
+void rtp_packetizer_init(rtp_packetizer_t *p, uint8_t payload_type, uint32_t ssrc, size_t max_payload) {
+    memset(p, 0, sizeof(*p));
+    p->payload_type = payload_type;
+    p->ssrc = ssrc;
+    // 初始序号随机化，接收端借此区分重启前后的流
+    p->seq = (uint16_t)(ssrc >> 7);
+    p->max_payload = max_payload;
+}
+
+uint32_t rtp_timestamp(int64_t pts, AVRational time_base) {
+    return (uint32_t)av_rescale_q(pts, time_base, (AVRational){1, 90000});
+}
+
+static void write_header(rtp_packetizer_t *p, uint8_t *h, uint32_t ts, int marker) {
+    h[0] = 0x80;                        // version 2
+    h[1] = (marker ? 0x80 : 0) | p->payload_type;
+    h[2] = p->seq >> 8;
+    h[3] = p->seq & 0xff;
+    h[4] = ts >> 24;
+    h[5] = ts >> 16;
+    h[6] = ts >> 8;
+    h[7] = ts;
+    h[8] = p->ssrc >> 24;
+    h[9] = p->ssrc >> 16;
+    h[10] = p->ssrc >> 8;
+    h[11] = p->ssrc;
+    p->seq++;
+    p->packets++;
+}
+
+static int send_nal(rtp_packetizer_t *p, const nal_unit_t *nal, uint32_t ts, int last,
+                    rtp_emit_fn emit, void *opaque) {
+    uint8_t h[RTP_HEADER_SIZE + 2];
+    if (nal->size <= p->max_payload) {
+        write_header(p, h, ts, last);
+        return emit(opaque, h, RTP_HEADER_SIZE, nal->data, nal->size);
+    }
+
+    // FU-A: NAL头拆成FU indicator(F/NRI + 类型28)和FU header(S/E + 原类型)
+    const uint8_t *data = nal->data + 1;
+    size_t left = nal->size - 1;
+    size_t chunk_max = p->max_payload - 2;
+    int first = 1;
+    while (left > 0) {
+        size_t chunk = left < chunk_max ? left : chunk_max;
+        int end = chunk == left;
+        write_header(p, h, ts, last && end);
+        h[RTP_HEADER_SIZE] = (nal->data[0] & 0xe0) | NAL_TYPE_FU_A;
+        h[RTP_HEADER_SIZE + 1] = (first ? 0x80 : 0) | (end ? 0x40 : 0) | (nal->data[0] & 0x1f);
+        int ret = emit(opaque, h, sizeof(h), data, chunk);
+        if (ret < 0) {
+            return ret;
+        }
+        data += chunk;
+        left -= chunk;
+        first = 0;
+    }
+    return 0;
+}
+
+int rtp_packetize_h264(rtp_packetizer_t *p, const AVPacket *pkt, AVRational time_base,
+                       const AVCodecParameters *par, rtp_emit_fn emit, void *opaque) {
+    uint32_t ts = rtp_timestamp(pkt->pts, time_base);
+    size_t pos = 0;
+    nal_unit_t nal;
+
+    // 带全局头编码时关键帧不含SPS/PPS，RTP没有带外参数通道，需要在IDR前补上
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        int has_sps = 0;
+        while (nal_next(pkt->data, pkt->size, &pos, &nal)) {
+            if (nal_type(AV_CODEC_ID_H264, &nal) == 7) {
+                has_sps = 1;
+                break;
+            }
+        }
+        nal_unit_t sps, pps;
+        if (!has_sps && par &&
+            nal_h264_parameter_sets(par->extradata, par->extradata_size, &sps, &pps) == 0) {
+            int ret = send_nal(p, &sps, ts, 0, emit, opaque);
+            if (ret >= 0) {
+                ret = send_nal(p, &pps, ts, 0, emit, opaque);
+            }
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        pos = 0;
+    }
+
+    // 预读下一个NAL，最后一个NAL的最后一个包置marker
+    nal_unit_t next;
+    int have = nal_next(pkt->data, pkt->size, &pos, &nal);
+    while (have) {
+        int have_next = nal_next(pkt->data, pkt->size, &pos, &next);
+        // 访问单元分隔符在RTP中没有意义
+        if (nal_type(AV_CODEC_ID_H264, &nal) != 9) {
+            int ret = send_nal(p, &nal, ts, !have_next, emit, opaque);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        nal = next;
+        have = have_next;
+    }
+    return 0;
+}
+
+int rtp_h264_sdp_media(const AVCodecParameters *par, uint8_t payload_type, int port,
+                       char *buf, size_t size) {
+    nal_unit_t sps, pps;
+    if (nal_h264_parameter_sets(par->extradata, par->extradata_size, &sps, &pps) < 0 || sps.size < 4) {
+        return -1;
+    }
+    char sps64[AV_BASE64_SIZE(256)];
+    char pps64[AV_BASE64_SIZE(256)];
+    if (sps.size > 256 || pps.size > 256 ||
+        !av_base64_encode(sps64, sizeof(sps64), sps.data, sps.size) ||
+        !av_base64_encode(pps64, sizeof(pps64), pps.data, pps.size)) {
+        return -1;
+    }
+    int n = snprintf(buf, size,
+                     "m=video %d RTP/AVP %d\r\n"
+                     "a=rtpmap:%d H264/90000\r\n"
+                     "a=fmtp:%d packetization-mode=1;profile-level-id=%02X%02X%02X;"
+                     "sprop-parameter-sets=%s,%s\r\n",
+                     port, payload_type, payload_type, payload_type,
+                     sps.data[1], sps.data[2], sps.data[3], sps64, pps64);
+    return n > 0 && (size_t)n < size ? n : -1;
+}
@@ -0,0 +1,857 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "segment_store.h"
+#include "nal_utils.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#define STORE_IO_BEGIN 0x1
+#define STORE_IO_END 0x2
+#define STORE_QUEUE_SIZE 512
+#define STORE_AVIO_SIZE (64 * 1024)
+#define STORE_SLOT_ALIGN (1024 * 1024)
+#define STORE_INDEX_NAME "segments.idx"
+// 每个分片以关键帧开始，断电后最多丢失最后一个GOP
+#define STORE_MUX_OPTIONS "movflags=+frag_keyframe+empty_moov+default_base_moof"
+
+static int64_t realtime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void store_config_default(store_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->max_bytes = (int64_t)4 * 1024 * 1024 * 1024;
+    cfg->segment_s = 60;
+}
+
+static void slot_path(const segment_store_t *store, int slot, char *path, size_t size) {
+    snprintf(path, size, "%s/seg_%04d.mp4", store->cfg.dir, slot);
+}
+
+// Reserves the whole slot without changing the file size, so players see only written data
+static void reserve_slot(segment_store_t *store, int fd) {
+    static int warned = 0;
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, store->slot_size) < 0 && !warned) {
+        fprintf(stderr, "fallocate not supported on %s (%s), slots are not preallocated\n",
+                store->cfg.dir, strerror(errno));
+        warned = 1;
+    }
+}
+
+// Forgets the segment a slot holds. The file keeps its size and allocation and
+// is overwritten in place; segments.idx records how much of it is valid
+static void reset_slot(segment_slot_t *s) {
+    s->state = SEG_FREE;
+    s->seq = 0;
+    s->start_ms = 0;
+    s->duration_ms = 0;
+    s->bytes = 0;
+}
+
+// Drops the data of an expired slot. Zeroing the range keeps the blocks
+// allocated; fall back to truncating where the file system cannot do that
+static void wipe_slot(segment_store_t *store, segment_slot_t *s) {
+    struct stat st;
+    if (fstat(s->fd, &st) == 0 && st.st_size > 0 &&
+        fallocate(s->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, 0, st.st_size) < 0) {
+        if (ftruncate(s->fd, 0) < 0) {
+            perror("ftruncate expired segment");
+        }
+        reserve_slot(store, s->fd);
+    }
+    reset_slot(s);
+}
+
+// The slot size changed since the data was written: cut the file back so the
+// reservation matches the new size
+static void trim_slot(segment_store_t *store, segment_slot_t *s) {
+    if (ftruncate(s->fd, 0) < 0) {
+        perror("ftruncate segment slot");
+    }
+    reserve_slot(store, s->fd);
+    s->trim = 0;
+}
+
+// mfhd sequence number of the first fragment of segment seq. Each segment
+// numbers its fragments from its own base, so fragments left behind by the
+// slot's previous segment never continue the sequence of the current one
+static uint32_t fragment_base(uint64_t seq) {
+    return (uint32_t)(seq % 32768) * 65536 + 1;
+}
+
+// 原子地重写索引: 先写临时文件并落盘，再rename
+static int save_index(segment_store_t *store) {
+    char path[512];
+    char tmp[520];
+    snprintf(path, sizeof(path), "%s/" STORE_INDEX_NAME, store->cfg.dir);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        perror("Failed to write segment index");
+        return -1;
+    }
+    fprintf(fp, "# slot_size %lld\n", (long long)store->slot_size);
+    fprintf(fp, "# slot seq state start_ms duration_ms bytes\n");
+    // 封装线程选槽位时也会改slots[]，只在格式化期间持锁，落盘在锁外
+    pthread_mutex_lock(&store->io_mutex);
+    for (int i = 0; i < store->slot_count; i++) {
+        segment_slot_t *s = &store->slots[i];
+        fprintf(fp, "%d %llu %d %lld %lld %lld\n", i, (unsigned long long)s->seq, (int)s->state,
+                (long long)s->start_ms, (long long)s->duration_ms, (long long)s->bytes);
+    }
+    pthread_mutex_unlock(&store->io_mutex);
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+    if (rename(tmp, path) < 0) {
+        perror("Failed to replace segment index");
+        return -1;
+    }
+    int dir_fd = open(store->cfg.dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return 0;
+}
+
+static void load_index(segment_store_t *store) {
+    char path[512];
+    char line[256];
+    snprintf(path, sizeof(path), "%s/" STORE_INDEX_NAME, store->cfg.dir);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return;
+    }
+    long long index_slot_size = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        int slot, state;
+        unsigned long long seq;
+        long long start_ms, duration_ms, bytes;
+        if (sscanf(line, "# slot_size %lld", &index_slot_size) == 1) {
+            continue;
+        }
+        if (line[0] == '#' || sscanf(line, "%d %llu %d %lld %lld %lld", &slot, &seq, &state,
+                                     &start_ms, &duration_ms, &bytes) != 6) {
+            continue;
+        }
+        if (slot < 0 || slot >= store->slot_count || state < SEG_FREE || state > SEG_DONE) {
+            continue;
+        }
+        segment_slot_t *s = &store->slots[slot];
+        s->state = (segment_state_t)state;
+        s->seq = seq;
+        s->start_ms = start_ms;
+        s->duration_ms = duration_ms;
+        s->bytes = bytes;
+    }
+    fclose(fp);
+    if (index_slot_size > 0 && index_slot_size != store->slot_size) {
+        printf("Segment slot size changed from %lld MB, slots are trimmed on reuse\n", index_slot_size >> 20);
+        for (int i = 0; i < store->slot_count; i++) {
+            store->slots[i].trim = 1;
+        }
+    }
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void write_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static int pwrite_all(int fd, const uint8_t *data, size_t len, int64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// A reused slot still holds the previous segment past the new one. Covering
+// [bytes, end of file) with a free box keeps the reservation and makes the
+// file a complete fMP4 by itself, for players, copies and index-less recovery
+static void seal_slot(int fd, int64_t bytes) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= bytes) {
+        return;
+    }
+    uint64_t gap = st.st_size - bytes;
+    uint8_t hdr[16];
+    size_t len = 8;
+    // 剩余不足一个box头时把文件延长到8字节
+    if (gap < 8) {
+        gap = 8;
+    }
+    memcpy(hdr + 4, "free", 4);
+    if (gap > UINT32_MAX) {
+        write_be32(hdr, 1);
+        write_be32(hdr + 8, (uint32_t)(gap >> 32));
+        write_be32(hdr + 12, (uint32_t)gap);
+        len = 16;
+    } else {
+        write_be32(hdr, (uint32_t)gap);
+    }
+    if (pwrite_all(fd, hdr, len, bytes) < 0) {
+        perror("Failed to seal segment slot");
+    }
+}
+
+static int known_box(const uint8_t *type) {
+    static const char *const types[] = { "ftyp", "moov", "moof", "mdat", "free", "skip", "styp", "sidx", "mfra" };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (!memcmp(type, types[i], 4)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Walks the top-level MP4 boxes and returns the end of the last complete mdat,
+// i.e. the length of the playable prefix of a segment cut short by a crash.
+// A reused slot still holds the previous segment past the new data, so the
+// walk stops at the first box that does not continue the fragment sequence;
+// first_fragment is the expected mfhd number of the first moof, 0 if unknown
+static int64_t scan_fmp4(int fd, int64_t file_size, uint32_t first_fragment) {
+    int64_t pos = 0;
+    int64_t valid = 0;
+    uint32_t next_fragment = first_fragment;
+    int moofs = 0;
+    uint8_t hdr[24];
+    while (pos + 8 <= file_size) {
+        if (pread(fd, hdr, 24, pos) < 8) {
+            break;
+        }
+        uint64_t size = read_be32(hdr);
+        if (size == 1) {
+            if (pos + 16 > file_size) break;
+            size = ((uint64_t)read_be32(hdr + 8) << 32) | read_be32(hdr + 12);
+        }
+        if (size < 8 || pos + (int64_t)size > file_size || !known_box(hdr + 4)) {
+            break;
+        }
+        if (!memcmp(hdr + 4, "moof", 4)) {
+            // moof的第一个子box是mfhd，序号必须接着上一个fragment
+            if (size < 24 || memcmp(hdr + 12, "mfhd", 4)) {
+                break;
+            }
+            uint32_t fragment = read_be32(hdr + 20);
+            // 不同版本的mov muxer在empty_moov之后可能先跳过一个序号
+            if (next_fragment && fragment != next_fragment &&
+                (moofs > 0 || fragment != next_fragment + 1)) {
+                break;
+            }
+            next_fragment = fragment + 1;
+            moofs++;
+        }
+        pos += size;
+        if (!memcmp(hdr + 4, "mdat", 4)) {
+            valid = pos;
+        }
+    }
+    return valid;
+}
+
+static void recover_slots(segment_store_t *store) {
+    int recovered = 0;
+    int kept = 0;
+    for (int i = 0; i < store->slot_count; i++) {
+        segment_slot_t *s = &store->slots[i];
+        struct stat st;
+        if (fstat(s->fd, &st) < 0) {
+            continue;
+        }
+        // 复用的槽位文件可能比分片长，有效长度以索引为准
+        if (s->state == SEG_DONE && s->bytes <= st.st_size) {
+            seal_slot(s->fd, s->bytes);
+            kept++;
+            continue;
+        }
+        if (st.st_size == 0) {
+            reset_slot(s);
+            continue;
+        }
+        if (s->trim && s->state == SEG_FREE) {
+            trim_slot(store, s);
+            reset_slot(s);
+            continue;
+        }
+        // 异常退出时正在写的分片: 只保留到最后一个完整的fragment
+        int64_t valid = scan_fmp4(s->fd, st.st_size, s->state == SEG_OPEN ? fragment_base(s->seq) : 0);
+        if (valid <= 0) {
+            reset_slot(s);
+            continue;
+        }
+        if (s->state == SEG_FREE) {
+            // 索引丢失的分片，当作最旧的数据优先覆盖
+            s->seq = 0;
+            s->start_ms = (int64_t)st.st_mtime * 1000;
+        }
+        int64_t end_ms = (int64_t)st.st_mtime * 1000;
+        s->duration_ms = end_ms > s->start_ms ? end_ms - s->start_ms : 0;
+        s->state = SEG_DONE;
+        s->bytes = valid;
+        seal_slot(s->fd, valid);
+        recovered++;
+    }
+    for (int i = 0; i < store->slot_count; i++) {
+        if (store->slots[i].seq >= store->next_seq) {
+            store->next_seq = store->slots[i].seq + 1;
+        }
+    }
+    printf("Segment store %s: %d slots of %lld MB, %d segments kept, %d recovered\n",
+           store->cfg.dir, store->slot_count, (long long)(store->slot_size >> 20), kept, recovered);
+}
+
+segment_store_t* segment_store_open(const store_config_t *cfg, int64_t bit_rate) {
+    segment_store_t *store = (segment_store_t*)calloc(1, sizeof(segment_store_t));
+    if (!store) {
+        perror("Failed to allocate segment store");
+        return NULL;
+    }
+    store->cfg = *cfg;
+    store->cur_slot = -1;
+    pthread_mutex_init(&store->io_mutex, NULL);
+    pthread_cond_init(&store->io_cond, NULL);
+
+    int64_t seg_bytes = bit_rate / 8 * cfg->segment_s * 3 / 2;
+    store->slot_size = (seg_bytes + STORE_SLOT_ALIGN - 1) / STORE_SLOT_ALIGN * STORE_SLOT_ALIGN;
+    if (store->slot_size < STORE_SLOT_ALIGN) {
+        store->slot_size = STORE_SLOT_ALIGN;
+    }
+    store->slot_count = (int)(cfg->max_bytes / store->slot_size);
+    if (store->slot_count < 2) {
+        fprintf(stderr, "Store size %lld MB is too small for %d s segments\n",
+                (long long)(cfg->max_bytes >> 20), cfg->segment_s);
+        segment_store_close(store);
+        return NULL;
+    }
+    if (mkdir(cfg->dir, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s: %s\n", cfg->dir, strerror(errno));
+        segment_store_close(store);
+        return NULL;
+    }
+
+    store->slots = (segment_slot_t*)calloc(store->slot_count, sizeof(segment_slot_t));
+    if (!store->slots) {
+        perror("Failed to allocate segment slots");
+        segment_store_close(store);
+        return NULL;
+    }
+    for (int i = 0; i < store->slot_count; i++) {
+        store->slots[i].fd = -1;
+    }
+    for (int i = 0; i < store->slot_count; i++) {
+        char path[512];
+        slot_path(store, i, path, sizeof(path));
+        store->slots[i].fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (store->slots[i].fd < 0) {
+            fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+            segment_store_close(store);
+            return NULL;
+        }
+        reserve_slot(store, store->slots[i].fd);
+    }
+    load_index(store);
+    recover_slots(store);
+    save_index(store);
+
+    for (int i = 0; i < STORE_IO_BUFS; i++) {
+        if (posix_memalign((void**)&store->bufs[i].data, 4096, STORE_IO_BUF_SIZE) != 0) {
+            store->bufs[i].data = NULL;
+            fprintf(stderr, "Could not allocate store I/O buffers\n");
+            segment_store_close(store);
+            return NULL;
+        }
+        store->free_bufs[store->free_count++] = &store->bufs[i];
+    }
+    store->queue = packet_queue_create(STORE_QUEUE_SIZE, AV_CODEC_ID_NONE);
+    if (!store->queue) {
+        segment_store_close(store);
+        return NULL;
+    }
+
+#ifdef HAVE_LIBURING
+    struct io_uring *ring = (struct io_uring*)calloc(1, sizeof(struct io_uring));
+    if (ring && io_uring_queue_init(STORE_IO_BUFS, ring, 0) == 0) {
+        store->uring = ring;
+        printf("Segment store uses io_uring\n");
+    } else {
+        free(ring);
+    }
+#endif
+    return store;
+}
+
+// ---- write-behind thread ----
+
+static void write_batch(segment_store_t *store, store_io_buf_t **batch, int n) {
+#ifdef HAVE_LIBURING
+    if (store->uring) {
+        struct io_uring *ring = (struct io_uring*)store->uring;
+        int queued = 0;
+        for (int i = 0; i < n; i++) {
+            if (batch[i]->len == 0) continue;
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            io_uring_prep_write(sqe, store->slots[batch[i]->slot].fd, batch[i]->data,
+                                batch[i]->len, batch[i]->offset);
+            io_uring_sqe_set_data(sqe, batch[i]);
+            queued++;
+        }
+        io_uring_submit(ring);
+        for (int i = 0; i < queued; i++) {
+            struct io_uring_cqe *cqe;
+            if (io_uring_wait_cqe(ring, &cqe) < 0) {
+                break;
+            }
+            store_io_buf_t *b = (store_io_buf_t*)io_uring_cqe_get_data(cqe);
+            int res = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+            // 短写或出错时用pwrite补完剩余部分
+            size_t done = res > 0 ? (size_t)res : 0;
+            if (done < b->len &&
+                pwrite_all(store->slots[b->slot].fd, b->data + done, b->len - done, b->offset + done) < 0) {
+                perror("Segment write failed");
+            }
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+        store_io_buf_t *b = batch[i];
+        if (b->len > 0 && pwrite_all(store->slots[b->slot].fd, b->data, b->len, b->offset) < 0) {
+            perror("Segment write failed");
+        }
+    }
+}
+
+static void expire_old_segments(segment_store_t *store) {
+    if (store->cfg.max_age_s <= 0) {
+        return;
+    }
+    int64_t limit_ms = realtime_ms() - (int64_t)store->cfg.max_age_s * 1000;
+    for (int i = 0; i < store->slot_count; i++) {
+        segment_slot_t *s = &store->slots[i];
+        if (s->state == SEG_DONE && s->start_ms + s->duration_ms < limit_ms) {
+            pthread_mutex_lock(&store->io_mutex);
+            wipe_slot(store, s);
+            pthread_mutex_unlock(&store->io_mutex);
+        }
+    }
+}
+
+static void handle_markers(segment_store_t *store, store_io_buf_t *b) {
+    segment_slot_t *s = &store->slots[b->slot];
+    if (b->flags & STORE_IO_BEGIN) {
+        // 封装线程选槽位时已经占用并记下序号，这里只处理磁盘上的文件: 原地覆盖，
+        // 不释放预分配的空间，只有槽位大小变了才截断
+        pthread_mutex_lock(&store->io_mutex);
+        if (s->trim) {
+            trim_slot(store, s);
+        }
+        pthread_mutex_unlock(&store->io_mutex);
+        save_index(store);
+    }
+    if (b->flags & STORE_IO_END) {
+        int64_t bytes = b->offset + (int64_t)b->len;
+        seal_slot(s->fd, bytes);
+        fdatasync(s->fd);
+        pthread_mutex_lock(&store->io_mutex);
+        s->state = SEG_DONE;
+        s->duration_ms = b->duration_ms;
+        s->bytes = bytes;
+        pthread_mutex_unlock(&store->io_mutex);
+        expire_old_segments(store);
+        save_index(store);
+        store->segments_written++;
+        printf("Segment %llu (slot %d): %.1f MB, %.1f s, io max %.1f ms\n",
+               (unsigned long long)s->seq, b->slot, s->bytes / 1048576.0, s->duration_ms / 1000.0,
+               store->io_ms_max);
+        store->io_ms_max = 0;
+    }
+}
+
+static void* io_thread_func(void *arg) {
+    segment_store_t *store = (segment_store_t*)arg;
+    store_io_buf_t *batch[STORE_IO_BUFS];
+
+    pthread_mutex_lock(&store->io_mutex);
+    for (;;) {
+        while (store->pending_count == 0 && !store->io_abort) {
+            pthread_cond_wait(&store->io_cond, &store->io_mutex);
+        }
+        if (store->pending_count == 0) {
+            break;
+        }
+        // 一次取走所有待写缓冲区，批量提交
+        int n = store->pending_count;
+        for (int i = 0; i < n; i++) {
+            batch[i] = store->pending[(store->pending_head + i) % STORE_IO_BUFS];
+        }
+        store->pending_head = (store->pending_head + n) % STORE_IO_BUFS;
+        store->pending_count = 0;
+        pthread_mutex_unlock(&store->io_mutex);
+
+        for (int i = 0; i < n; i++) {
+            if (batch[i]->flags & STORE_IO_BEGIN) {
+                handle_markers(store, batch[i]);
+            }
+        }
+        int64_t start_us = monotonic_us();
+        write_batch(store, batch, n);
+        for (int i = 0; i < n; i++) {
+            if (batch[i]->len > 0) {
+                // 提前启动回写，避免分片结束时一次性fsync造成长时间阻塞
+                sync_file_range(store->slots[batch[i]->slot].fd, batch[i]->offset, batch[i]->len,
+                                SYNC_FILE_RANGE_WRITE);
+                store->bytes_written += batch[i]->len;
+            }
+        }
+        double io_ms = (monotonic_us() - start_us) / 1000.0;
+        if (io_ms > store->io_ms_max) {
+            store->io_ms_max = io_ms;
+        }
+        for (int i = 0; i < n; i++) {
+            if (batch[i]->flags & STORE_IO_END) {
+                handle_markers(store, batch[i]);
+            }
+        }
+
+        pthread_mutex_lock(&store->io_mutex);
+        for (int i = 0; i < n; i++) {
+            store->free_bufs[store->free_count++] = batch[i];
+        }
+        pthread_cond_broadcast(&store->io_cond);
+    }
+    pthread_mutex_unlock(&store->io_mutex);
+    return NULL;
+}
+
+// ---- mux thread ----
+
+static store_io_buf_t* get_free_buf(segment_store_t *store) {
+    pthread_mutex_lock(&store->io_mutex);
+    while (store->free_count == 0) {
+        pthread_cond_wait(&store->io_cond, &store->io_mutex);
+    }
+    store_io_buf_t *b = store->free_bufs[--store->free_count];
+    pthread_mutex_unlock(&store->io_mutex);
+    b->len = 0;
+    b->flags = 0;
+    return b;
+}
+
+static void submit_buf(segment_store_t *store, store_io_buf_t *b) {
+    pthread_mutex_lock(&store->io_mutex);
+    store->pending[(store->pending_head + store->pending_count) % STORE_IO_BUFS] = b;
+    store->pending_count++;
+    pthread_cond_broadcast(&store->io_cond);
+    pthread_mutex_unlock(&store->io_mutex);
+}
+
+// Muxer output: fills aligned buffers and hands full ones to the I/O thread
+static int avio_write_cb(void *opaque, uint8_t *buf, int size) {
+    segment_store_t *store = (segment_store_t*)opaque;
+    int left = size;
+    while (left > 0) {
+        store_io_buf_t *b = store->fill;
+        size_t n = STORE_IO_BUF_SIZE - b->len;
+        if (n > (size_t)left) n = left;
+        memcpy(b->data + b->len, buf, n);
+        b->len += n;
+        buf += n;
+        left -= n;
+        if (b->len == STORE_IO_BUF_SIZE) {
+            submit_buf(store, b);
+            store->cur_offset += b->len;
+            store->fill = get_free_buf(store);
+            store->fill->slot = store->cur_slot;
+            store->fill->offset = store->cur_offset;
+        }
+    }
+    return size;
+}
+
+// Free slot first, otherwise the oldest finished segment. The slot is taken
+// here, before the I/O thread gets to its BEGIN marker, so a backlog of
+// short segments never picks the same slot twice
+static int pick_slot(segment_store_t *store, uint64_t seq, int64_t start_ms) {
+    int best = -1;
+    pthread_mutex_lock(&store->io_mutex);
+    for (int i = 0; i < store->slot_count; i++) {
+        segment_slot_t *s = &store->slots[i];
+        if (s->state == SEG_FREE) {
+            best = i;
+            break;
+        }
+        if (s->state == SEG_DONE && (best < 0 || s->seq < store->slots[best].seq)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        segment_slot_t *s = &store->slots[best];
+        reset_slot(s);
+        s->state = SEG_OPEN;
+        s->seq = seq;
+        s->start_ms = start_ms;
+    }
+    pthread_mutex_unlock(&store->io_mutex);
+    return best;
+}
+
+static void free_muxer(segment_store_t *store) {
+    if (store->avio) {
+        av_freep(&store->avio->buffer);
+        avio_context_free(&store->avio);
+    }
+    avformat_free_context(store->mux);
+    store->mux = NULL;
+}
+
+static int begin_segment(segment_store_t *store, const AVPacket *pkt) {
+    int64_t start_ms = realtime_ms();
+    int slot = pick_slot(store, store->next_seq, start_ms);
+    if (slot < 0) {
+        return -1;
+    }
+    store->cur_slot = slot;
+    store->cur_offset = 0;
+    store->seg_start_pts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    store->seg_start_ms = start_ms;
+
+    store_io_buf_t *b = get_free_buf(store);
+    b->slot = slot;
+    b->offset = 0;
+    b->flags = STORE_IO_BEGIN;
+    b->seq = store->next_seq++;
+    store->fill = b;
+
+    avformat_alloc_output_context2(&store->mux, NULL, "mp4", NULL);
+    uint8_t *avio_buf = (uint8_t*)av_malloc(STORE_AVIO_SIZE);
+    if (store->mux && avio_buf) {
+        store->avio = avio_alloc_context(avio_buf, STORE_AVIO_SIZE, 1, store, NULL, avio_write_cb, NULL);
+    }
+    if (!store->avio) {
+        av_free(avio_buf);
+        goto fail;
+    }
+    store->mux->pb = store->avio;
+    store->mux->flags |= AVFMT_FLAG_CUSTOM_IO;
+    {
+        AVStream *st = avformat_new_stream(store->mux, NULL);
+        if (!st || avcodec_parameters_copy(st->codecpar, store->codecpar) < 0) {
+            goto fail;
+        }
+        st->time_base = store->time_base;
+        AVDictionary *opts = NULL;
+        av_dict_parse_string(&opts, STORE_MUX_OPTIONS, "=", ":", 0);
+        av_dict_set_int(&opts, "fragment_index", fragment_base(b->seq), 0);
+        int ret = avformat_write_header(store->mux, &opts);
+        av_dict_free(&opts);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+    return 0;
+
+fail:
+    fprintf(stderr, "Could not start segment in slot %d\n", slot);
+    free_muxer(store);
+    // 仍然提交BEGIN标记，槽位在结束标记中记为空分片
+    store->fill->flags |= STORE_IO_END;
+    submit_buf(store, store->fill);
+    store->fill = NULL;
+    store->cur_slot = -1;
+    return -1;
+}
+
+static void end_segment(segment_store_t *store, int64_t last_pts) {
+    if (store->cur_slot < 0) {
+        return;
+    }
+    av_write_trailer(store->mux);
+    avio_flush(store->avio);
+    free_muxer(store);
+
+    store_io_buf_t *b = store->fill;
+    b->flags |= STORE_IO_END;
+    b->duration_ms = av_rescale_q(last_pts - store->seg_start_pts, store->time_base, (AVRational){1, 1000});
+    submit_buf(store, b);
+    store->fill = NULL;
+    store->cur_slot = -1;
+}
+
+static void* mux_thread_func(void *arg) {
+    segment_store_t *store = (segment_store_t*)arg;
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt) {
+        fprintf(stderr, "Could not allocate packet\n");
+        return NULL;
+    }
+    int64_t last_pts = 0;
+    int64_t segment_ts = av_rescale_q(store->cfg.segment_s, (AVRational){1, 1}, store->time_base);
+
+    while (packet_queue_get(store->queue, pkt, NULL) == 0) {
+        if (pkt->size == 0) {
+            // 码流参数变化的标记包: 结束当前分片，后续数据用新的参数
+            end_segment(store, last_pts);
+            pthread_mutex_lock(&store->io_mutex);
+            if (store->pending_codecpar) {
+                avcodec_parameters_free(&store->codecpar);
+                store->codecpar = store->pending_codecpar;
+                store->pending_codecpar = NULL;
+            }
+            pthread_mutex_unlock(&store->io_mutex);
+            av_packet_unref(pkt);
+            continue;
+        }
+        int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        // 分片只能从IDR开始: 帧内刷新的恢复点也带关键帧标记，但要参考之前的帧
+        int is_key = nal_packet_is_idr(store->codecpar->codec_id, pkt);
+        // 按时长切分，单个分片超出槽位的90%时提前在关键帧处切分
+        int due = store->cur_slot < 0 ||
+                  ts - store->seg_start_pts >= segment_ts || store->cur_offset > store->slot_size * 9 / 10;
+        if (is_key) {
+            store->idr_requested = 0;
+        } else if (due && !store->idr_requested) {
+            // 低延迟模式没有周期IDR，向编码器要一个
+            __atomic_store_n(&store->keyframe_request, 1, __ATOMIC_RELEASE);
+            store->idr_requested = 1;
+        }
+        if (store->cur_slot >= 0 && is_key && due) {
+            end_segment(store, last_pts);
+        }
+        if (store->cur_slot < 0 && (!is_key || begin_segment(store, pkt) < 0)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        last_pts = ts;
+        if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= store->seg_start_pts;
+        if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= store->seg_start_pts;
+        av_packet_rescale_ts(pkt, store->time_base, store->mux->streams[0]->time_base);
+        pkt->stream_index = 0;
+        if (av_write_frame(store->mux, pkt) < 0) {
+            fprintf(stderr, "Error muxing segment packet\n");
+        }
+        av_packet_unref(pkt);
+    }
+    end_segment(store, last_pts);
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+int segment_store_start(segment_store_t *store, const AVCodecParameters *codecpar, AVRational time_base) {
+    store->codecpar = avcodec_parameters_alloc();
+    if (!store->codecpar || avcodec_parameters_copy(store->codecpar, codecpar) < 0) {
+        return -1;
+    }
+    store->time_base = time_base;
+    if (pthread_create(&store->io_thread, NULL, io_thread_func, store) != 0) {
+        perror("Failed to create store I/O thread");
+        return -1;
+    }
+    if (pthread_create(&store->mux_thread, NULL, mux_thread_func, store) != 0) {
+        perror("Failed to create store mux thread");
+        pthread_mutex_lock(&store->io_mutex);
+        store->io_abort = 1;
+        pthread_cond_broadcast(&store->io_cond);
+        pthread_mutex_unlock(&store->io_mutex);
+        pthread_join(store->io_thread, NULL);
+        return -1;
+    }
+    store->threads_started = 1;
+    return 0;
+}
+
+int segment_store_send(segment_store_t *store, const AVPacket *pkt) {
+    return packet_queue_put(store->queue, pkt);
+}
+
+int segment_store_keyframe_requested(segment_store_t *store) {
+    return __atomic_exchange_n(&store->keyframe_request, 0, __ATOMIC_ACQ_REL);
+}
+
+int segment_store_update_codecpar(segment_store_t *store, const AVCodecParameters *codecpar) {
+    // 标记包和数据包走同一个队列，保证新参数恰好从新编码器的第一个包开始生效
+    AVPacket *marker = av_packet_alloc();
+    if (!marker) {
+        return AVERROR(ENOMEM);
+    }
+    marker->flags = AV_PKT_FLAG_KEY;
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par || avcodec_parameters_copy(par, codecpar) < 0) {
+        avcodec_parameters_free(&par);
+        av_packet_free(&marker);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_lock(&store->io_mutex);
+    avcodec_parameters_free(&store->pending_codecpar);
+    store->pending_codecpar = par;
+    pthread_mutex_unlock(&store->io_mutex);
+    int ret = packet_queue_put(store->queue, marker);
+    av_packet_free(&marker);
+    return ret;
+}
+
+void segment_store_close(segment_store_t *store) {
+    if (!store) return;
+
+    if (store->threads_started) {
+        // 先让封装线程写完队列中的数据并结束当前分片，再停止写盘线程
+        packet_queue_finish(store->queue);
+        pthread_join(store->mux_thread, NULL);
+        pthread_mutex_lock(&store->io_mutex);
+        store->io_abort = 1;
+        pthread_cond_broadcast(&store->io_cond);
+        pthread_mutex_unlock(&store->io_mutex);
+        pthread_join(store->io_thread, NULL);
+        printf("Segment store closed: %llu segments, %.1f MB written\n",
+               (unsigned long long)store->segments_written, store->bytes_written / 1048576.0);
+    }
+#ifdef HAVE_LIBURING
+    if (store->uring) {
+        io_uring_queue_exit((struct io_uring*)store->uring);
+        free(store->uring);
+    }
+#endif
+    packet_queue_destroy(store->queue);
+    for (int i = 0; i < STORE_IO_BUFS; i++) {
+        free(store->bufs[i].data);
+    }
+    if (store->slots) {
+        for (int i = 0; i < store->slot_count; i++) {
+            if (store->slots[i].fd >= 0) {
+                close(store->slots[i].fd);
+            }
+        }
+        free(store->slots);
+    }
+    avcodec_parameters_free(&store->codecpar);
+    avcodec_parameters_free(&store->pending_codecpar);
+    pthread_mutex_destroy(&store->io_mutex);
+    pthread_cond_destroy(&store->io_cond);
+    free(store);
+}
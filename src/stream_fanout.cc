@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream_fanout.h"
+
+// RTMP沿用拥塞丢帧策略，保持实时；本地录像和HLS写磁盘，用长队列吸收存储抖动，
+// 不丢非参考帧，只有队列满了才整GOP丢弃并记录
+static const sink_type_t sink_types[] = {
+    { "rtmp", "flv",     NULL, 1, 1, QUEUE_DROP_GOP },
+    // 同一个RTMP推流, 用树内的FLV/RTMP实现代替libavformat, 每包一次writev
+    { "rtmp-lite", "rtmp-lite", NULL, 1, 1, QUEUE_DROP_GOP },
+    { "flv",  "flv",     NULL, 0, 8, QUEUE_NO_DROP },
+    { "mp4",  "segment", "segment_format=mp4:segment_time=60:reset_timestamps=1:strftime=1", 0, 8,
+      QUEUE_NO_DROP },
+    { "hls",  "hls",     "hls_time=2:hls_list_size=6:hls_flags=delete_segments+independent_segments", 0, 8,
+      QUEUE_NO_DROP },
+};
+#define SINK_TYPE_NUM (int)(sizeof(sink_types) / sizeof(sink_types[0]))
+
+static int has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s);
+    size_t m = strlen(suffix);
+    return n >= m && !strcasecmp(s + n - m, suffix);
+}
+
+static const sink_type_t* find_sink_type(const char *name, size_t len) {
+    for (int i = 0; i < SINK_TYPE_NUM; i++) {
+        if (strlen(sink_types[i].name) == len && !strncmp(sink_types[i].name, name, len)) {
+            return &sink_types[i];
+        }
+    }
+    return NULL;
+}
+
+static const sink_type_t* guess_sink_type(const stream_fanout_t *f, const char *url) {
+    // rtmps需要TLS, 只有libavformat能推
+    if (!strncmp(url, "rtmp://", 7) && f->rtmp_lite) return find_sink_type("rtmp-lite", 9);
+    if (!strncmp(url, "rtmp://", 7) || !strncmp(url, "rtmps://", 8)) return find_sink_type("rtmp", 4);
+    if (has_suffix(url, ".m3u8")) return find_sink_type("hls", 3);
+    if (has_suffix(url, ".mp4")) return find_sink_type("mp4", 3);
+    if (has_suffix(url, ".flv")) return find_sink_type("flv", 3);
+    return NULL;
+}
+
+stream_fanout_t* stream_fanout_create(int queue_size) {
+    stream_fanout_t *f = (stream_fanout_t*)calloc(1, sizeof(stream_fanout_t));
+    if (!f) {
+        perror("Failed to allocate stream fan-out");
+        return NULL;
+    }
+    f->queue_size = queue_size;
+    f->rtmp_chunk_size = RTMP_DEFAULT_CHUNK_SIZE;
+    pthread_mutex_init(&f->mutex, NULL);
+    return f;
+}
+
+void stream_fanout_destroy(stream_fanout_t *f) {
+    if (!f) return;
+    stream_fanout_stop(f);
+    for (int i = 0; i < f->count; i++) {
+        free(f->sinks[i].url);
+    }
+    avcodec_parameters_free(&f->codecpar);
+    avcodec_parameters_free(&f->audio_codecpar);
+    pthread_mutex_destroy(&f->mutex);
+    free(f);
+}
+
+// Called with the mutex held
+static int open_sink(stream_fanout_t *f, stream_sink_t *sink) {
+    const char *mux_options = sink->type->mux_options;
+    char chunk_option[32];
+    if (!strcmp(sink->type->format, "rtmp-lite")) {
+        snprintf(chunk_option, sizeof(chunk_option), "chunk_size=%d", f->rtmp_chunk_size);
+        mux_options = chunk_option;
+    }
+    sink->writer = stream_writer_open(sink->url, sink->type->format, mux_options,
+                                      f->codecpar, f->time_base,
+                                      f->queue_size * sink->type->queue_factor);
+    if (sink->writer) {
+        stream_writer_set_queue_policy(sink->writer, sink->type->policy);
+    }
+    if (sink->writer && f->audio_codecpar &&
+        stream_writer_set_audio(sink->writer, f->audio_codecpar, f->audio_time_base) < 0) {
+        fprintf(stderr, "Could not add audio to %s sink '%s'\n", sink->type->name, sink->url);
+    }
+    if (!sink->writer || stream_writer_start(sink->writer) < 0) {
+        fprintf(stderr, "Could not start %s sink '%s'\n", sink->type->name, sink->url);
+        stream_writer_close(sink->writer);
+        sink->writer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int stream_fanout_add(stream_fanout_t *f, const char *spec) {
+    const sink_type_t *type = NULL;
+    const char *url = spec;
+    const char *colon = strchr(spec, ':');
+    // "rtmp://..." 中的冒号属于URL本身，不是类型前缀
+    if (colon && strncmp(colon + 1, "//", 2)) {
+        type = find_sink_type(spec, colon - spec);
+        if (type) {
+            url = colon + 1;
+        }
+    }
+    if (!type) {
+        type = guess_sink_type(f, url);
+    }
+    if (!type || !*url) {
+        fprintf(stderr, "Cannot tell the sink type of '%s'\n", spec);
+        stream_fanout_list_types();
+        return -1;
+    }
+
+    pthread_mutex_lock(&f->mutex);
+    if (f->count >= FANOUT_MAX_SINKS) {
+        pthread_mutex_unlock(&f->mutex);
+        fprintf(stderr, "Too many sinks (max %d)\n", FANOUT_MAX_SINKS);
+        return -1;
+    }
+    for (int i = 0; i < f->count; i++) {
+        if (!strcmp(f->sinks[i].url, url)) {
+            pthread_mutex_unlock(&f->mutex);
+            fprintf(stderr, "Sink '%s' already exists\n", url);
+            return -1;
+        }
+    }
+    stream_sink_t *sink = &f->sinks[f->count];
+    sink->type = type;
+    sink->url = strdup(url);
+    sink->writer = NULL;
+    if (!sink->url || (f->started && open_sink(f, sink) < 0)) {
+        free(sink->url);
+        sink->url = NULL;
+        pthread_mutex_unlock(&f->mutex);
+        return -1;
+    }
+    f->count++;
+    pthread_mutex_unlock(&f->mutex);
+    printf("Added %s sink %s\n", type->name, url);
+    return 0;
+}
+
+int stream_fanout_remove(stream_fanout_t *f, const char *url) {
+    stream_sink_t removed;
+    int found = 0;
+
+    pthread_mutex_lock(&f->mutex);
+    for (int i = 0; i < f->count; i++) {
+        if (!strcmp(f->sinks[i].url, url)) {
+            removed = f->sinks[i];
+            memmove(&f->sinks[i], &f->sinks[i + 1], (f->count - i - 1) * sizeof(stream_sink_t));
+            f->count--;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+
+    if (!found) {
+        fprintf(stderr, "No sink '%s'\n", url);
+        return -1;
+    }
+    // 关闭可能要等待网络超时，放在锁外，其他输出不受影响
+    stream_writer_close(removed.writer);
+    printf("Removed %s sink %s\n", removed.type->name, removed.url);
+    free(removed.url);
+    return 0;
+}
+
+void stream_fanout_list(stream_fanout_t *f) {
+    pthread_mutex_lock(&f->mutex);
+    printf("%d sink(s):\n", f->count);
+    for (int i = 0; i < f->count; i++) {
+        stream_sink_t *sink = &f->sinks[i];
+        if (!sink->writer) {
+            printf("  %-4s %s (not started)\n", sink->type->name, sink->url);
+            continue;
+        }
+        stream_writer_stats_t s;
+        stream_writer_get_stats(sink->writer, &s);
+        printf("  %-4s %s: %s, depth %d, written %llu, dropped %llu\n", sink->type->name, sink->url,
+               s.connected ? "up" : "down", s.queue_depth, (unsigned long long)s.written_packets,
+               (unsigned long long)s.dropped_packets);
+    }
+    pthread_mutex_unlock(&f->mutex);
+}
+
+void stream_fanout_list_types(void) {
+    printf("Sink types:\n");
+    for (int i = 0; i < SINK_TYPE_NUM; i++) {
+        printf("  %-4s %s%s%s, %s\n", sink_types[i].name, sink_types[i].format,
+               sink_types[i].mux_options ? " " : "",
+               sink_types[i].mux_options ? sink_types[i].mux_options : "",
+               sink_types[i].policy == QUEUE_NO_DROP ? "keeps every frame" : "drops frames to stay live");
+    }
+}
+
+int stream_fanout_set_audio(stream_fanout_t *f, const AVCodecParameters *codecpar, AVRational time_base) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par || avcodec_parameters_copy(par, codecpar) < 0) {
+        avcodec_parameters_free(&par);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_lock(&f->mutex);
+    avcodec_parameters_free(&f->audio_codecpar);
+    f->audio_codecpar = par;
+    f->audio_time_base = time_base;
+    pthread_mutex_unlock(&f->mutex);
+    return 0;
+}
+
+int stream_fanout_start(stream_fanout_t *f, const AVCodecParameters *codecpar, AVRational time_base) {
+    pthread_mutex_lock(&f->mutex);
+    if (!f->codecpar) {
+        f->codecpar = avcodec_parameters_alloc();
+    }
+    if (!f->codecpar || avcodec_parameters_copy(f->codecpar, codecpar) < 0) {
+        pthread_mutex_unlock(&f->mutex);
+        return -1;
+    }
+    f->time_base = time_base;
+    f->started = 1;
+    int opened = 0;
+    for (int i = 0; i < f->count; i++) {
+        if (open_sink(f, &f->sinks[i]) == 0) {
+            opened++;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+    // 某个输出打不开不影响其他输出
+    return opened > 0 || f->count == 0 ? 0 : -1;
+}
+
+void stream_fanout_stop(stream_fanout_t *f) {
+    stream_writer_t *writers[FANOUT_MAX_SINKS];
+    int n = 0;
+
+    pthread_mutex_lock(&f->mutex);
+    f->started = 0;
+    for (int i = 0; i < f->count; i++) {
+        if (f->sinks[i].writer) {
+            writers[n++] = f->sinks[i].writer;
+            f->sinks[i].writer = NULL;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+
+    for (int i = 0; i < n; i++) {
+        stream_writer_close(writers[i]);
+    }
+}
+
+void stream_fanout_send(stream_fanout_t *f, const AVPacket *pkt) {
+    // 入队只做引用计数，不会阻塞
+    pthread_mutex_lock(&f->mutex);
+    for (int i = 0; i < f->count; i++) {
+        if (f->sinks[i].writer) {
+            stream_writer_send(f->sinks[i].writer, pkt);
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+}
+
+int stream_fanout_keyframe_requested(stream_fanout_t *f) {
+    int requested = 0;
+    pthread_mutex_lock(&f->mutex);
+    for (int i = 0; i < f->count; i++) {
+        if (f->sinks[i].writer && stream_writer_keyframe_requested(f->sinks[i].writer)) {
+            requested = 1;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return requested;
+}
+
+int stream_fanout_update_codecpar(stream_fanout_t *f, const AVCodecParameters *codecpar) {
+    int ret = 0;
+    pthread_mutex_lock(&f->mutex);
+    if (avcodec_parameters_copy(f->codecpar, codecpar) < 0) {
+        ret = -1;
+    }
+    for (int i = 0; i < f->count; i++) {
+        if (f->sinks[i].writer && stream_writer_update_codecpar(f->sinks[i].writer, codecpar) < 0) {
+            ret = -1;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return ret;
+}
+
+int stream_fanout_abr_update(stream_fanout_t *f, abr_controller_t *abr, int64_t now_us) {
+    int changed = 0;
+    pthread_mutex_lock(&f->mutex);
+    for (int i = 0; i < f->count; i++) {
+        if (f->sinks[i].type->network && f->sinks[i].writer) {
+            changed = abr_update(abr, f->sinks[i].writer, now_us);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return changed;
+}
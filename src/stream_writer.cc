@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "stream_writer.h"
+#include "net_utils.h"
+#include "nal_utils.h"
+
+#define STATS_PRINT_INTERVAL_US 5000000
+#define EWMA_ALPHA 0.1
+#define RECONNECT_MIN_MS 500
+#define RECONNECT_MAX_MS 30000
+#define IO_TIMEOUT_US "5000000"
+
+stream_writer_t* stream_writer_open(const char *url, const char *format, const char *mux_options,
+                                    const AVCodecParameters *codecpar, AVRational time_base,
+                                    int queue_size) {
+    stream_writer_t *w = (stream_writer_t*)calloc(1, sizeof(stream_writer_t));
+    if (!w) {
+        perror("Failed to allocate stream writer");
+        return NULL;
+    }
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->url = strdup(url);
+    w->format = strdup(format);
+    w->src_time_base = time_base;
+    w->ts_offset = AV_NOPTS_VALUE;
+    w->last_idr_pts = AV_NOPTS_VALUE;
+    w->sock_fd = -1;
+    // segment/hls 等muxer的URL也是本地路径
+    const char *proto = avio_find_protocol_name(url);
+    w->local = proto && !strcmp(proto, "file");
+    w->native = !strcmp(format, "rtmp-lite");
+
+    w->codecpar = avcodec_parameters_alloc();
+    if (!w->url || !w->format || !w->codecpar ||
+        avcodec_parameters_copy(w->codecpar, codecpar) < 0) {
+        fprintf(stderr, "Could not allocate writer for '%s'\n", url);
+        stream_writer_close(w);
+        return NULL;
+    }
+    if (mux_options && av_dict_parse_string(&w->mux_opts, mux_options, "=", ":", 0) < 0) {
+        fprintf(stderr, "Invalid muxer options '%s' for '%s'\n", mux_options, url);
+        stream_writer_close(w);
+        return NULL;
+    }
+    if (w->native) {
+        AVDictionaryEntry *e = av_dict_get(w->mux_opts, "chunk_size", NULL, 0);
+        w->chunk_size = e ? atoi(e->value) : RTMP_DEFAULT_CHUNK_SIZE;
+        if (w->chunk_size < 128 || w->chunk_size > 0xffffff) {
+            fprintf(stderr, "Invalid RTMP chunk size for '%s'\n", url);
+            stream_writer_close(w);
+            return NULL;
+        }
+    }
+
+    // 分片muxer在关键帧处切分，每个分片都要从IDR开始
+    if (!strcmp(format, "hls") || !strcmp(format, "segment")) {
+        AVDictionaryEntry *e = av_dict_get(w->mux_opts, !strcmp(format, "hls") ? "hls_time" : "segment_time",
+                                           NULL, 0);
+        w->segment_us = (int64_t)((e ? atof(e->value) : 2.0) * 1000000);
+    }
+
+    w->queue = packet_queue_create(queue_size, codecpar->codec_id);
+    if (!w->queue) {
+        stream_writer_close(w);
+        return NULL;
+    }
+    return w;
+}
+
+static int interrupt_cb(void *opaque) {
+    stream_writer_t *w = (stream_writer_t*)opaque;
+    return __atomic_load_n(&w->abort, __ATOMIC_RELAXED);
+}
+
+static void disconnect(stream_writer_t *w, int write_trailer) {
+    // 先在锁内清掉sock_fd, ABR不会再拿到即将关闭(或被复用)的fd
+    pthread_mutex_lock(&w->mutex);
+    w->stats.connected = 0;
+    w->sock_fd = -1;
+    pthread_mutex_unlock(&w->mutex);
+
+    if (w->rtmp) {
+        rtmp_client_close(w->rtmp, write_trailer);
+        w->rtmp = NULL;
+        return;
+    }
+    if (!w->out_ctx) return;
+    if (write_trailer) {
+        av_write_trailer(w->out_ctx);
+    }
+    if (!(w->out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&w->out_ctx->pb);
+    }
+    avformat_free_context(w->out_ctx);
+    w->out_ctx = NULL;
+    w->stream = NULL;
+    w->audio_stream = NULL;
+}
+
+// 连接建立后两种路径共用的收尾: 丢积压、请求IDR、登记socket
+static void on_connected(stream_writer_t *w, int sock_fd) {
+    w->ts_offset = AV_NOPTS_VALUE;
+    w->last_idr_pts = AV_NOPTS_VALUE;
+
+    // 丢弃断线期间积压的旧数据，从新的IDR开始，观众可以立即恢复；
+    // 本地文件没有实时性要求，保留积压的数据
+    if (!w->local) {
+        packet_queue_flush(w->queue);
+    }
+    __atomic_store_n(&w->keyframe_request, 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&w->mutex);
+    w->stats.connected = 1;
+    w->sock_fd = sock_fd;
+    pthread_mutex_unlock(&w->mutex);
+    printf("Writer connected to %s\n", w->out_url ? w->out_url : w->url);
+}
+
+static int connect_native(stream_writer_t *w) {
+    rtmp_client_t *c = rtmp_client_connect(w->url, w->chunk_size, atoi(IO_TIMEOUT_US) / 1000);
+    if (!c) {
+        return -1;
+    }
+    // 编码器参数里带着帧率, 只用于onMetaData
+    int fps = w->codecpar->framerate.num > 0 ? w->codecpar->framerate.num / w->codecpar->framerate.den : 0;
+    if (rtmp_client_write_header(c, w->codecpar, fps, w->audio_codecpar) < 0) {
+        fprintf(stderr, "Error writing header to '%s'\n", w->url);
+        rtmp_client_close(c, 0);
+        return -1;
+    }
+    w->rtmp = c;
+    // 自己的socket, 不需要按端口去找
+    on_connected(w, c->fd);
+    return 0;
+}
+
+// 本地输出重新打开时不能截断已经写好的录像: 文件换一个没用过的名字
+// (rec.flv -> rec-1.flv)，HLS继续写原播放列表，追加分片并延续序号
+static void next_local_output(stream_writer_t *w) {
+    w->reopens++;
+    if (!strcmp(w->format, "hls")) {
+        return;
+    }
+    const char *slash = strrchr(w->url, '/');
+    const char *ext = strrchr(w->url, '.');
+    if (!ext || (slash && ext < slash)) {
+        ext = w->url + strlen(w->url);
+    }
+    char name[1024];
+    for (;;) {
+        snprintf(name, sizeof(name), "%.*s-%d%s", (int)(ext - w->url), w->url, w->reopens, ext);
+        // strftime模板的实际文件名由muxer决定，无法预先检查
+        if (strchr(w->url, '%') || access(name, F_OK) != 0) {
+            break;
+        }
+        w->reopens++;
+    }
+    free(w->out_url);
+    w->out_url = strdup(name);
+    printf("Writer %s: continuing in %s\n", w->url, name);
+}
+
+// Builds a fresh muxer from the cached codec parameters and writes the header
+static int connect_output(stream_writer_t *w) {
+    if (w->native) {
+        return connect_native(w);
+    }
+    const char *url = w->out_url ? w->out_url : w->url;
+    AVFormatContext *out_ctx = NULL;
+    avformat_alloc_output_context2(&out_ctx, NULL, w->format, url);
+    if (!out_ctx) {
+        fprintf(stderr, "Could not create output context for '%s'\n", url);
+        return -1;
+    }
+    out_ctx->interrupt_callback.callback = interrupt_cb;
+    out_ctx->interrupt_callback.opaque = w;
+    out_ctx->flags |= AVFMT_FLAG_NOBUFFER;
+    out_ctx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+
+    AVStream *stream = avformat_new_stream(out_ctx, NULL);
+    if (!stream) {
+        fprintf(stderr, "Could not create stream\n");
+        avformat_free_context(out_ctx);
+        return -1;
+    }
+    stream->id = 0;
+    stream->time_base = w->src_time_base;
+    avcodec_parameters_copy(stream->codecpar, w->codecpar);
+
+    AVStream *audio_stream = NULL;
+    if (w->audio_codecpar) {
+        audio_stream = avformat_new_stream(out_ctx, NULL);
+        if (!audio_stream) {
+            fprintf(stderr, "Could not create audio stream\n");
+            avformat_free_context(out_ctx);
+            return -1;
+        }
+        audio_stream->id = 1;
+        audio_stream->time_base = w->audio_time_base;
+        avcodec_parameters_copy(audio_stream->codecpar, w->audio_codecpar);
+    }
+
+    int sock_fd = -1;
+    if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+        // 发送卡住超过超时时间视为断线
+        AVDictionary *opts = NULL;
+        av_dict_set(&opts, "rw_timeout", IO_TIMEOUT_US, 0);
+        net_socket_set_t before;
+        net_socket_snapshot(&before);
+        int ret = avio_open2(&out_ctx->pb, url, AVIO_FLAG_WRITE, &out_ctx->interrupt_callback, &opts);
+        av_dict_free(&opts);
+        if (ret >= 0 && !w->local) {
+            sock_fd = net_find_new_peer_socket(&before, w->url, strncmp(w->url, "rtmp", 4) ? 80 : 1935);
+            if (sock_fd < 0) {
+                fprintf(stderr, "Writer %s: connection socket not identified, no TCP_INFO for rate control\n",
+                        w->url);
+            }
+        }
+        net_socket_set_free(&before);
+        if (ret < 0) {
+            fprintf(stderr, "Could not open output URL '%s'\n", url);
+            avformat_free_context(out_ctx);
+            return -1;
+        }
+    }
+
+    AVDictionary *mux_opts = NULL;
+    av_dict_copy(&mux_opts, w->mux_opts, 0);
+    if (w->local && w->reopens > 0 && !strcmp(w->format, "hls")) {
+        AVDictionaryEntry *e = av_dict_get(mux_opts, "hls_flags", NULL, 0);
+        char flags[256];
+        snprintf(flags, sizeof(flags), "%s%sappend_list", e ? e->value : "", e ? "+" : "");
+        av_dict_set(&mux_opts, "hls_flags", flags, 0);
+    }
+    int ret = avformat_write_header(out_ctx, &mux_opts);
+    av_dict_free(&mux_opts);
+    if (ret < 0) {
+        fprintf(stderr, "Error writing header to '%s'\n", url);
+        if (!(out_ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&out_ctx->pb);
+        }
+        avformat_free_context(out_ctx);
+        return -1;
+    }
+
+    w->out_ctx = out_ctx;
+    w->stream = stream;
+    w->audio_stream = audio_stream;
+
+    on_connected(w, sock_fd);
+    return 0;
+}
+
+// Sleeps for ms unless the writer is closed meanwhile. Returns -1 on abort.
+static int wait_abortable(stream_writer_t *w, int ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    while (!w->abort) {
+        if (pthread_cond_timedwait(&w->cond, &w->mutex, &deadline) != 0) {
+            break;
+        }
+    }
+    int aborted = w->abort;
+    pthread_mutex_unlock(&w->mutex);
+    return aborted ? -1 : 0;
+}
+
+static int connect_with_backoff(stream_writer_t *w) {
+    int backoff_ms = RECONNECT_MIN_MS;
+    while (connect_output(w) < 0) {
+        // 已结束的写入器不再重试，close才不会无限等待
+        if (__atomic_load_n(&w->queue->finished, __ATOMIC_RELAXED)) {
+            return -1;
+        }
+        fprintf(stderr, "Writer %s: retrying in %d ms\n", w->url, backoff_ms);
+        if (wait_abortable(w, backoff_ms) < 0) {
+            return -1;
+        }
+        backoff_ms = backoff_ms * 2 > RECONNECT_MAX_MS ? RECONNECT_MAX_MS : backoff_ms * 2;
+    }
+    return 0;
+}
+
+static int64_t thread_cpu_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void update_stats(stream_writer_t *w, const AVPacket *pkt, int ret, int64_t enqueue_us,
+                         int64_t start_us, int64_t end_us, int64_t cpu_us) {
+    double send_ms = (end_us - start_us) / 1000.0;
+    double latency_ms = (end_us - enqueue_us) / 1000.0;
+
+    pthread_mutex_lock(&w->mutex);
+    stream_writer_stats_t *s = &w->stats;
+    if (ret < 0) {
+        s->write_errors++;
+    } else {
+        s->written_packets++;
+        s->written_bytes += pkt->size;
+    }
+    if (s->written_packets <= 1) {
+        s->send_ms_avg = send_ms;
+        s->latency_ms_avg = latency_ms;
+        s->cpu_us_avg = cpu_us;
+    } else {
+        s->send_ms_avg += EWMA_ALPHA * (send_ms - s->send_ms_avg);
+        s->latency_ms_avg += EWMA_ALPHA * (latency_ms - s->latency_ms_avg);
+        s->cpu_us_avg += EWMA_ALPHA * (cpu_us - s->cpu_us_avg);
+    }
+    if (send_ms > s->send_ms_max) {
+        s->send_ms_max = send_ms;
+    }
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static void print_stats(stream_writer_t *w) {
+    stream_writer_stats_t s;
+    stream_writer_get_stats(w, &s);
+    printf("Writer %s: %s, depth %d (%lld KB), send %.1f/%.1f ms avg/max, latency %.1f ms, "
+           "cpu %.0f us/pkt, written %llu, dropped %llu (nonref %llu, gops %llu), flushed %llu, "
+           "errors %llu, reconnects %llu\n",
+           w->url, s.connected ? "up" : "down", s.queue_depth, (long long)(s.queue_bytes / 1024),
+           s.send_ms_avg, s.send_ms_max, s.latency_ms_avg, s.cpu_us_avg,
+           (unsigned long long)s.written_packets,
+           (unsigned long long)s.dropped_packets, (unsigned long long)s.dropped_nonref,
+           (unsigned long long)s.dropped_gops, (unsigned long long)s.flushed_packets,
+           (unsigned long long)s.write_errors,
+           (unsigned long long)s.reconnects);
+    pthread_mutex_lock(&w->mutex);
+    w->stats.send_ms_max = 0;
+    pthread_mutex_unlock(&w->mutex);
+}
+
+// Segmenting muxers cut wherever the key flag is set. Intra refresh recovery
+// points lose the flag, packets before the first IDR of a connection are
+// skipped (returns 0), and once a segment is due without an IDR the encoder
+// is asked for one.
+static int filter_segment_start(stream_writer_t *w, AVPacket *pkt) {
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        if (nal_packet_is_idr(w->codecpar->codec_id, pkt)) {
+            w->last_idr_pts = ts;
+            w->idr_requested = 0;
+            return 1;
+        }
+        pkt->flags &= ~AV_PKT_FLAG_KEY;
+        w->recovery_points = 1;
+    }
+    if (w->last_idr_pts == AV_NOPTS_VALUE) {
+        pthread_mutex_lock(&w->mutex);
+        w->stats.flushed_packets++;
+        pthread_mutex_unlock(&w->mutex);
+        return 0;
+    }
+    // 只有编码器不再输出周期IDR(帧内刷新)时才需要请求，普通GOP不受影响
+    if (w->recovery_points && !w->idr_requested &&
+        av_rescale_q(ts - w->last_idr_pts, w->src_time_base, AV_TIME_BASE_Q) >= w->segment_us) {
+        __atomic_store_n(&w->keyframe_request, 1, __ATOMIC_RELEASE);
+        w->idr_requested = 1;
+    }
+    return 1;
+}
+
+static void* writer_thread_func(void *arg) {
+    stream_writer_t *w = (stream_writer_t*)arg;
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt) {
+        fprintf(stderr, "Could not allocate packet\n");
+        return NULL;
+    }
+    int64_t last_print_us = monotonic_us();
+    int64_t enqueue_us = 0;
+
+    if (connect_with_backoff(w) < 0) {
+        av_packet_free(&pkt);
+        __atomic_store_n(&w->thread_exited, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    while (packet_queue_get(w->queue, pkt, &enqueue_us) == 0) {
+        pthread_mutex_lock(&w->mutex);
+        AVCodecParameters *pending = w->pending_codecpar;
+        w->pending_codecpar = NULL;
+        pthread_mutex_unlock(&w->mutex);
+        if (pending) {
+            // 码流参数变化(如分辨率)，用新的序列头重建连接，旧参数的包全部丢弃
+            av_packet_unref(pkt);
+            packet_queue_flush(w->queue);
+            avcodec_parameters_free(&w->codecpar);
+            w->codecpar = pending;
+            disconnect(w, 1);
+            if (w->local) {
+                next_local_output(w);
+            }
+            if (connect_with_backoff(w) < 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (pkt->stream_index == 1) {
+            // 音频与视频共用同一个起点，连接建立前(第一个视频关键帧之前)的音频丢弃
+            int64_t offset = w->ts_offset != AV_NOPTS_VALUE ?
+                             av_rescale_q(w->ts_offset, w->src_time_base, w->audio_time_base) : 0;
+            int has_audio = w->native ? w->audio_codecpar != NULL : w->audio_stream != NULL;
+            if (!has_audio || w->ts_offset == AV_NOPTS_VALUE || pkt->pts < offset) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            pkt->pts -= offset;
+            pkt->dts -= offset;
+            if (!w->native) {
+                av_packet_rescale_ts(pkt, w->audio_time_base, w->audio_stream->time_base);
+                pkt->stream_index = w->audio_stream->index;
+            }
+        } else {
+            if (w->segment_us > 0 && !filter_segment_start(w, pkt)) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            if (w->ts_offset == AV_NOPTS_VALUE) {
+                w->ts_offset = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+            }
+            if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= w->ts_offset;
+            if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= w->ts_offset;
+            if (!w->native) {
+                av_packet_rescale_ts(pkt, w->src_time_base, w->stream->time_base);
+                pkt->stream_index = w->stream->index;
+            }
+        }
+
+        int64_t start_us = monotonic_us();
+        int64_t start_cpu_us = thread_cpu_us();
+        int ret;
+        if (w->native) {
+            // 原生路径直接用采集/音频时基, 由客户端换算成毫秒
+            AVRational tb = pkt->stream_index == 1 ? w->audio_time_base : w->src_time_base;
+            ret = rtmp_client_write_packet(w->rtmp, pkt, tb) < 0 ? AVERROR(errno ? errno : EIO) : 0;
+        } else {
+            ret = av_write_frame(w->out_ctx, pkt);
+        }
+        int64_t end_us = monotonic_us();
+        update_stats(w, pkt, ret, enqueue_us, start_us, end_us, thread_cpu_us() - start_cpu_us);
+        av_packet_unref(pkt);
+
+        if (ret < 0 && !interrupt_cb(w)) {
+            // 断线: 丢掉旧连接，退避重连，采集和推理线程不受影响
+            char err[AV_ERROR_MAX_STRING_SIZE] = {0};
+            av_strerror(ret, err, sizeof(err));
+            fprintf(stderr, "Error writing packet to %s: %s, reconnecting\n", w->url, err);
+            // 本地文件先把已写的部分收尾(mp4需要moov)，再换新文件继续
+            disconnect(w, w->local);
+            pthread_mutex_lock(&w->mutex);
+            w->stats.reconnects++;
+            pthread_mutex_unlock(&w->mutex);
+            if (w->local) {
+                next_local_output(w);
+            }
+            if (connect_with_backoff(w) < 0) {
+                break;
+            }
+        }
+
+        if (end_us - last_print_us >= STATS_PRINT_INTERVAL_US) {
+            print_stats(w);
+            last_print_us = end_us;
+        }
+    }
+
+    // finish之后在写线程里写流尾，关闭时不再占用调用者的线程
+    if (!interrupt_cb(w)) {
+        disconnect(w, 1);
+    }
+    av_packet_free(&pkt);
+    __atomic_store_n(&w->thread_exited, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int stream_writer_set_audio(stream_writer_t *w, const AVCodecParameters *codecpar, AVRational time_base) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par || avcodec_parameters_copy(par, codecpar) < 0) {
+        avcodec_parameters_free(&par);
+        return AVERROR(ENOMEM);
+    }
+    avcodec_parameters_free(&w->audio_codecpar);
+    w->audio_codecpar = par;
+    w->audio_time_base = time_base;
+    return 0;
+}
+
+int stream_writer_start(stream_writer_t *w) {
+    if (pthread_create(&w->thread, NULL, writer_thread_func, w) != 0) {
+        perror("Failed to create writer thread");
+        return -1;
+    }
+    w->thread_started = 1;
+    return 0;
+}
+
+void stream_writer_set_queue_policy(stream_writer_t *w, queue_policy_t policy) {
+    w->queue_policy = policy;
+    packet_queue_set_policy(w->queue, policy);
+}
+
+int stream_writer_send(stream_writer_t *w, const AVPacket *pkt) {
+    int ret = packet_queue_put(w->queue, pkt);
+    if (w->queue_policy == QUEUE_NO_DROP) {
+        // 录像只在队列满时才丢数据，丢了就要在日志里看得到
+        uint64_t gops = packet_queue_dropped_gops(w->queue);
+        if (gops != w->dropped_gops_seen) {
+            w->dropped_gops_seen = gops;
+            if (gops % 50 == 1) {
+                fprintf(stderr, "Writer %s: queue full, dropped the oldest GOP (%llu so far)\n",
+                        w->url, (unsigned long long)gops);
+            }
+        }
+    }
+    return ret;
+}
+
+int stream_writer_keyframe_requested(stream_writer_t *w) {
+    return __atomic_exchange_n(&w->keyframe_request, 0, __ATOMIC_ACQ_REL);
+}
+
+int stream_writer_update_codecpar(stream_writer_t *w, const AVCodecParameters *codecpar) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par || avcodec_parameters_copy(par, codecpar) < 0) {
+        avcodec_parameters_free(&par);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_lock(&w->mutex);
+    avcodec_parameters_free(&w->pending_codecpar);
+    w->pending_codecpar = par;
+    pthread_mutex_unlock(&w->mutex);
+    return 0;
+}
+
+int stream_writer_get_tcp_info(stream_writer_t *w, struct tcp_info *info) {
+    // 持锁查询: disconnect要先拿到锁才能关闭fd, 查到的一定是当前连接
+    pthread_mutex_lock(&w->mutex);
+    int ret = net_get_tcp_info(w->sock_fd, info);
+    pthread_mutex_unlock(&w->mutex);
+    return ret;
+}
+
+void stream_writer_get_stats(stream_writer_t *w, stream_writer_stats_t *stats) {
+    pthread_mutex_lock(&w->mutex);
+    *stats = w->stats;
+    pthread_mutex_unlock(&w->mutex);
+
+    packet_queue_t *q = w->queue;
+    pthread_mutex_lock(&q->mutex);
+    stats->queue_depth = q->count;
+    stats->queue_bytes = q->bytes;
+    stats->dropped_packets = q->dropped_packets;
+    stats->flushed_packets += q->flushed_packets;
+    stats->dropped_nonref = q->dropped_nonref;
+    stats->dropped_gops = q->dropped_gops;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+void stream_writer_finish(stream_writer_t *w) {
+    packet_queue_finish(w->queue);
+}
+
+int stream_writer_finished(stream_writer_t *w) {
+    return !w->thread_started || __atomic_load_n(&w->thread_exited, __ATOMIC_ACQUIRE);
+}
+
+void stream_writer_close(stream_writer_t *w) {
+    if (!w) return;
+
+    // finish之后队列里的数据要完整写完，不能中断
+    int finishing = w->queue && __atomic_load_n(&w->queue->finished, __ATOMIC_RELAXED);
+    if (!finishing) {
+        pthread_mutex_lock(&w->mutex);
+        __atomic_store_n(&w->abort, 1, __ATOMIC_RELAXED);
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->mutex);
+        if (w->queue) {
+            packet_queue_abort(w->queue);
+        }
+    }
+    if (w->thread_started) {
+        pthread_join(w->thread, NULL);
+        print_stats(w);
+    }
+    // 中断回调已触发，写流尾前先复位，避免尾部写入被打断
+    __atomic_store_n(&w->abort, 0, __ATOMIC_RELAXED);
+    disconnect(w, 1);
+    packet_queue_destroy(w->queue);
+    avcodec_parameters_free(&w->codecpar);
+    avcodec_parameters_free(&w->pending_codecpar);
+    avcodec_parameters_free(&w->audio_codecpar);
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->cond);
+    av_dict_free(&w->mux_opts);
+    free(w->url);
+    free(w->out_url);
+    free(w->format);
+    free(w);
+}
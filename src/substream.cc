@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "substream.h"
+#include "image_converter.h"
+#include <rga/im2d.h>
+
+extern "C" {
+#include <libavutil/mathematics.h>
+}
+
+void substream_config_default(substream_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->width = 640;
+    cfg->height = 360;
+    cfg->bit_rate = 800000;
+}
+
+substream_t* substream_create(const substream_config_t *cfg, stream_fanout_t *fanout) {
+    substream_t *s = (substream_t*)calloc(1, sizeof(substream_t));
+    if (!s) {
+        perror("Failed to allocate substream");
+        stream_fanout_destroy(fanout);
+        return NULL;
+    }
+    s->cfg = *cfg;
+    s->fanout = fanout;
+    return s;
+}
+
+int substream_start(substream_t *s, const encoder_config_t *main_cfg, AVRational clock_time_base) {
+    // 帧池很小: 子码流编码器最多同时持有一两帧
+    s->pool = init_dma_frame_pool(3, s->cfg.width, s->cfg.height);
+    if (!s->pool) {
+        fprintf(stderr, "Could not create the substream frame pool\n");
+        return -1;
+    }
+    encoder_config_t enc_cfg = *main_cfg;
+    enc_cfg.width = s->cfg.width;
+    enc_cfg.height = s->cfg.height;
+    enc_cfg.bit_rate = s->cfg.bit_rate;
+    s->enc = encoder_open(&enc_cfg, s->pool->frames_ref);
+    s->codecpar = avcodec_parameters_alloc();
+    s->pkt = av_packet_alloc();
+    if (!s->enc || !s->codecpar || !s->pkt) {
+        fprintf(stderr, "Could not open the substream encoder\n");
+        substream_stop(s);
+        return -1;
+    }
+    s->clock_time_base = clock_time_base;
+    avcodec_parameters_from_context(s->codecpar, s->enc->ctx);
+    if (stream_fanout_start(s->fanout, s->codecpar, s->enc->ctx->time_base) < 0) {
+        fprintf(stderr, "Could not start any substream output\n");
+        substream_stop(s);
+        return -1;
+    }
+    printf("Substream %dx%d at %lld bps%s\n", s->cfg.width, s->cfg.height, (long long)s->cfg.bit_rate,
+           s->pool->is_memfd ? ", scaled with libswscale" : "");
+    return 0;
+}
+
+// memfd帧池RGA访问不到，用libswscale(自带NEON/SSE)缩放并转NV12
+static int scale_sw(substream_t *s, const char *rgb, int width, int height, dma_frame_slot_t *slot) {
+    s->sws = sws_getCachedContext(s->sws, width, height, AV_PIX_FMT_RGB24,
+                                  s->cfg.width, s->cfg.height, AV_PIX_FMT_NV12,
+                                  SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!s->sws) {
+        return -1;
+    }
+    const uint8_t *src[1] = { (const uint8_t*)rgb };
+    int src_stride[1] = { width * 3 };
+    uint8_t *dst[2] = { (uint8_t*)slot->map, (uint8_t*)slot->map + (size_t)slot->pitch * slot->vstride };
+    int dst_stride[2] = { slot->pitch, slot->pitch };
+    return sws_scale(s->sws, src, src_stride, 0, height, dst, dst_stride) > 0 ? 0 : -1;
+}
+
+void substream_encode(substream_t *s, const char *rgb, int width, int height, int64_t pts, int64_t duration) {
+    if (!s->enc) return;
+    int slot = dma_frame_pool_acquire(s->pool);
+    if (slot < 0) {
+        if (++s->dropped % 100 == 1) {
+            fprintf(stderr, "Substream: no free frame, dropped %llu frames\n", (unsigned long long)s->dropped);
+        }
+        return;
+    }
+    dma_frame_slot_t *d = &s->pool->slots[slot];
+    if (s->pool->is_memfd) {
+        scale_sw(s, rgb, width, height, d);
+    } else {
+        // 缩放和RGB转NV12在RGA的一次操作里完成，CPU不碰像素
+        if (convert_RGB_to_NV12_dma_buf((char*)rgb, d->fd, NULL, width, height,
+                                        s->cfg.width, s->cfg.height, d->pitch, d->vstride) != IM_STATUS_SUCCESS) {
+            dma_frame_pool_release(s->pool, slot);
+            return;
+        }
+    }
+    AVFrame *frame = dma_frame_pool_wrap(s->pool, slot);
+    if (!frame) {
+        return;
+    }
+    AVRational tb = s->enc->ctx->time_base;
+    frame->pts = av_rescale_q(pts, s->clock_time_base, tb);
+    // 子码流的观众(重)连接后同样立即给IDR
+    if (stream_fanout_keyframe_requested(s->fanout)) {
+        encoder_force_idr(s->enc);
+    }
+    int ret = encoder_send_frame(s->enc, frame);
+    av_frame_free(&frame);
+    if (ret < 0) {
+        return;
+    }
+    while (encoder_receive_packet(s->enc, s->pkt) >= 0) {
+        s->pkt->duration = av_rescale_q(duration, s->clock_time_base, tb);
+        stream_fanout_send(s->fanout, s->pkt);
+        av_packet_unref(s->pkt);
+    }
+    s->frames++;
+}
+
+void substream_send_audio(substream_t *s, const AVPacket *pkt) {
+    if (s->enc) {
+        stream_fanout_send(s->fanout, pkt);
+    }
+}
+
+void substream_set_bitrate(substream_t *s, int64_t bit_rate) {
+    if (s->enc) {
+        encoder_set_bitrate(s->enc, bit_rate);
+    }
+}
+
+void substream_force_idr(substream_t *s) {
+    if (s->enc) {
+        encoder_force_idr(s->enc);
+    }
+}
+
+void substream_stop(substream_t *s) {
+    stream_fanout_stop(s->fanout);
+    // 编码器释放帧引用后才能销毁帧池
+    encoder_close(s->enc);
+    s->enc = NULL;
+    destroy_dma_frame_pool(s->pool);
+    s->pool = NULL;
+    avcodec_parameters_free(&s->codecpar);
+    av_packet_free(&s->pkt);
+    sws_freeContext(s->sws);
+    s->sws = NULL;
+    if (s->frames) {
+        printf("Substream encoded %llu frames, dropped %llu\n", (unsigned long long)s->frames,
+               (unsigned long long)s->dropped);
+    }
+}
+
+void substream_destroy(substream_t *s) {
+    if (!s) return;
+    stream_fanout_destroy(s->fanout);
+    free(s);
+}
@@ -0,0 +1,116 @@
+// Searches a detection index without touching the recordings, e.g.
+//   detindex_query -c person -f "2026-10-01 08:00:00" -t "2026-10-01 18:00:00" /data/rec/detections.idx
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "detection_index.h"
+
+typedef struct {
+    int count_only;
+    uint64_t limit;
+    uint64_t printed;
+} query_opts_t;
+
+// Accepts epoch seconds or local "YYYY-MM-DD HH:MM:SS"
+static int parse_time(const char *s, int64_t *ms) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+    if (!end) {
+        end = strptime(s, "%Y-%m-%d", &tm);
+    }
+    if (end && *end == '\0') {
+        tm.tm_isdst = -1;
+        *ms = (int64_t)mktime(&tm) * 1000;
+        return 0;
+    }
+    char *num_end;
+    long long v = strtoll(s, &num_end, 10);
+    if (*s && *num_end == '\0') {
+        *ms = v * 1000;
+        return 0;
+    }
+    return -1;
+}
+
+static int print_hit(const detection_hit_t *hit, void *opaque) {
+    query_opts_t *opts = (query_opts_t*)opaque;
+    if (opts->count_only) {
+        return 0;
+    }
+    char stamp[32];
+    time_t sec = hit->time_ms / 1000;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%03d %-12s %.2f (%d, %d, %d, %d)\n", stamp, (int)(hit->time_ms % 1000), hit->class_name,
+           hit->prop, hit->box.left, hit->box.top, hit->box.right, hit->box.bottom);
+    return opts->limit && ++opts->printed >= opts->limit;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] INDEX\n"
+           "  -f, --from TIME       start time, epoch seconds or \"YYYY-MM-DD[ HH:MM:SS]\"\n"
+           "  -t, --to TIME         end time (default now)\n"
+           "  -c, --classes LIST    comma separated class names (default all)\n"
+           "  -n, --limit N         stop after N detections\n"
+           "  -s, --count           only print the number of matches\n"
+           "  -h, --help\n", prog);
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_opts[] = {
+        { "from",    required_argument, NULL, 'f' },
+        { "to",      required_argument, NULL, 't' },
+        { "classes", required_argument, NULL, 'c' },
+        { "limit",   required_argument, NULL, 'n' },
+        { "count",   no_argument,       NULL, 's' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int64_t from_ms = 0;
+    int64_t to_ms = (int64_t)time(NULL) * 1000 + 1000;
+    const char *classes = NULL;
+    query_opts_t opts;
+    memset(&opts, 0, sizeof(opts));
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:t:c:n:sh", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+        case 't':
+            if (parse_time(optarg, opt == 'f' ? &from_ms : &to_ms) < 0) {
+                fprintf(stderr, "Invalid time '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'c': classes = optarg; break;
+        case 'n': opts.limit = strtoull(optarg, NULL, 10); break;
+        case 's': opts.count_only = 1; break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    detection_query_stats_t stats;
+    if (detection_index_query(argv[optind], from_ms, to_ms, classes, print_hit, &opts, &stats) < 0) {
+        return 1;
+    }
+    fprintf(stderr, "%llu detections, %d of %d blocks scanned, %d skipped by class\n",
+            (unsigned long long)stats.hits, stats.blocks_scanned, stats.blocks_total,
+            stats.blocks_skipped);
+    if (opts.count_only) {
+        printf("%llu\n", (unsigned long long)stats.hits);
+    }
+    return 0;
+}
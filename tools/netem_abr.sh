@@ -0,0 +1,118 @@
+#!/bin/sh
+# 用netem给lo限速/加延迟/丢包，推流到本地RTMP替身，看ABR在链路变差和恢复时的决策。
+# 时间线: 前WARMUP秒不限速，然后限速SHAPED秒，之后恢复直到DURATION秒结束。
+# 需要root(tc)，在板子上运行，例如:
+#   tools/netem_abr.sh -r 2mbit -d 40ms -l 0.5% -s /data/test_1080p.nv12
+set -u
+
+RATE=2mbit
+DELAY=20ms
+LOSS=0%
+WARMUP=10
+SHAPED=30
+DURATION=60
+PORT=19350
+SOURCE=""
+BIN_DIR=$(cd "$(dirname "$0")/../bin" && pwd)
+EXTRA=""
+
+usage() {
+    cat <<EOF
+Usage: $0 [options] [-- extra v4l2_displayer_test options]
+  -r RATE     netem rate while shaped (default $RATE)
+  -d DELAY    netem delay while shaped (default $DELAY)
+  -l LOSS     netem loss while shaped (default $LOSS)
+  -w SEC      unshaped warm-up (default $WARMUP)
+  -t SEC      shaped period (default $SHAPED)
+  -T SEC      total run time (default $DURATION)
+  -p PORT     stand-in port (default $PORT)
+  -s FILE     raw 1920x1080 NV12 source; generated with ffmpeg if omitted
+  -b DIR      directory with v4l2_displayer_test and rtmp_bench (default $BIN_DIR)
+EOF
+}
+
+while getopts "r:d:l:w:t:T:p:s:b:h" opt; do
+    case $opt in
+    r) RATE=$OPTARG ;;
+    d) DELAY=$OPTARG ;;
+    l) LOSS=$OPTARG ;;
+    w) WARMUP=$OPTARG ;;
+    t) SHAPED=$OPTARG ;;
+    T) DURATION=$OPTARG ;;
+    p) PORT=$OPTARG ;;
+    s) SOURCE=$OPTARG ;;
+    b) BIN_DIR=$OPTARG ;;
+    h) usage; exit 0 ;;
+    *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "${1:-}" = "--" ] && shift
+EXTRA="$*"
+
+if [ "$(id -u)" != 0 ]; then
+    echo "netem needs root" >&2
+    exit 1
+fi
+if [ $((WARMUP + SHAPED)) -gt "$DURATION" ]; then
+    echo "warm-up plus shaped period is longer than the run" >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d /tmp/netem_abr.XXXXXX)
+STANDIN_PID=""
+cleanup() {
+    tc qdisc del dev lo root 2>/dev/null
+    [ -n "$STANDIN_PID" ] && kill "$STANDIN_PID" 2>/dev/null && wait "$STANDIN_PID" 2>/dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+if [ -z "$SOURCE" ]; then
+    # 没有指定源文件时生成10秒的测试图案，文件源会循环播放
+    SOURCE=$WORK/testsrc.nv12
+    if ! ffmpeg -loglevel error -f lavfi -i testsrc2=size=1920x1080:rate=25 -t 10 \
+            -pix_fmt nv12 -f rawvideo "$SOURCE"; then
+        echo "no source: pass -s FILE or install ffmpeg" >&2
+        exit 1
+    fi
+fi
+
+# 给每行输出加上从开始推流算起的秒数，替身的输出自带秒数
+stamp() {
+    start=$(date +%s)
+    while IFS= read -r line; do
+        echo "$(( $(date +%s) - start ))s $line"
+    done
+}
+
+"$BIN_DIR/rtmp_bench" -l "$PORT" > "$WORK/standin.log" 2>&1 &
+STANDIN_PID=$!
+sleep 1
+
+# 控制台读到EOF就停止管线，所以stdin接一个按总时长退出的sleep
+(
+    sleep "$WARMUP"
+    echo "$(date +%T) shaping lo: rate $RATE delay $DELAY loss $LOSS" >&2
+    tc qdisc add dev lo root netem rate "$RATE" delay "$DELAY" loss "$LOSS"
+    sleep "$SHAPED"
+    echo "$(date +%T) link clear" >&2
+    tc qdisc del dev lo root
+) &
+SHAPER_PID=$!
+
+# shellcheck disable=SC2086
+sleep "$DURATION" | "$BIN_DIR/v4l2_displayer_test" -s "$SOURCE" \
+    -o "rtmp://127.0.0.1:$PORT/live/netem" --abr --npu-backend mock $EXTRA 2>&1 | stamp > "$WORK/pipeline.log"
+wait "$SHAPER_PID"
+cleanup
+STANDIN_PID=""
+
+echo "== netem rate $RATE delay $DELAY loss $LOSS from ${WARMUP}s to $((WARMUP + SHAPED))s =="
+echo "-- ABR decisions --"
+grep " ABR:" "$WORK/pipeline.log" || echo "(none)"
+echo "-- writer stats --"
+grep -i "writer\|reconnect" "$WORK/pipeline.log" | tail -n 20
+echo "-- received by the stand-in --"
+grep "stand-in:" "$WORK/standin.log"
+echo "logs in $WORK"
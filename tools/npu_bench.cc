@@ -0,0 +1,305 @@
+// Measures aggregate detections per second of the NPU scheduler with N
+// cameras feeding frames at camera rate: with one worker, with a pool of
+// workers and, given a batch model, with batching added, e.g.
+//   npu_bench -c 4 -W 3                           (one worker per RK3588 core)
+//   npu_bench -m model/yolov5s-640-640.rknn -b model/yolov5s-640-640-b4.rknn -c 4
+//   npu_bench -b ... -i frame_1920x1080.nv12      (a real frame instead of gray)
+//   npu_bench -B mock:30:15 -W 3                  (host: checks result ordering)
+//   npu_bench -W 1 -M model/attr.rknn -J 8        (detection next to a saturated second stage)
+//   npu_bench -W 1 -l model/yolov5s-416-416.rknn -l model/yolov5s-320-320.rknn -d 60
+//                                                 (overload: lite models keep the deadline)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "detector.h"
+#include "npu_scheduler.h"
+#include "packet_queue.h"
+
+typedef struct {
+    const char *model;
+    const char *batch_model;
+    const char *input;
+    const char *backend;
+    const char *second_model;
+    const char *second_backend;
+    const char *lite_models[NPU_MAX_LEVELS - 1];
+    int lite_count;
+    int crops;                  // second-stage inputs per frame
+    int workers;
+    int cameras;
+    int fps;
+    int seconds;
+    int width;
+    int height;
+    int window_ms;
+    int deadline_ms;
+} bench_opts_t;
+
+typedef struct {
+    npu_scheduler_t *npu;
+    npu_client_t *client;
+    const unsigned char *frame;
+    int fps;
+    int64_t end_us;
+    uint64_t results;
+    uint64_t out_of_order;      // results whose id did not increase
+    double latency_ms_max;      // submit -> result seen, worst case
+    double latency_ms_sum;
+    uint64_t latency_samples;
+    int second;                 // second-stage model index, -1 = none
+    int crops;
+    uint64_t crops_done;        // written by the NPU workers
+    uint64_t jobs_failed;
+} feeder_t;
+
+static void crops_done(void *opaque, const float *outputs, int count, int output_size) {
+    feeder_t *f = (feeder_t*)opaque;
+    if (outputs) {
+        __atomic_fetch_add(&f->crops_done, count, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&f->jobs_failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// 模拟一个摄像头的推理线程: 按帧率提交，同时轮询结果
+static void* feeder_thread(void *arg) {
+    feeder_t *f = (feeder_t*)arg;
+    detect_result_group_t result;
+    uint64_t seq = 0;
+    int64_t interval = 1000000 / f->fps;
+    int64_t next = monotonic_us();
+    int64_t submitted_at = 0;
+    int last_id = -1;
+    while (monotonic_us() < f->end_us) {
+        int64_t now = monotonic_us();
+        if (npu_scheduler_submit(f->npu, f->client, f->frame, now) && !submitted_at) {
+            submitted_at = now;
+        }
+        // 每帧都送一批裁剪图，第二级模型的队列满了就被拒
+        if (f->second >= 0) {
+            npu_job_t *job = npu_job_begin(f->npu, f->second, f->crops);
+            if (job) {
+                npu_job_commit(f->npu, job, now + 1000000, crops_done, f);
+            }
+        }
+        next += interval;
+        // 结果在下一帧之前随时可能到，1ms粒度轮询以便测量延迟
+        while ((now = monotonic_us()) < next) {
+            if (npu_client_poll(f->npu, f->client, &result, &seq)) {
+                f->results++;
+                if (result.id <= last_id) {
+                    f->out_of_order++;
+                }
+                last_id = result.id;
+                if (submitted_at) {
+                    double ms = (now - submitted_at) / 1000.0;
+                    if (ms > f->latency_ms_max) {
+                        f->latency_ms_max = ms;
+                    }
+                    f->latency_ms_sum += ms;
+                    f->latency_samples++;
+                    submitted_at = 0;
+                }
+            }
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+static double run(const bench_opts_t *o, int workers, const char *batch_model, int second, int lite,
+                  const unsigned char *frame) {
+    npu_config_t cfg;
+    npu_config_default(&cfg);
+    cfg.backend = o->backend;
+    cfg.workers = workers;
+    if (second) {
+        cfg.models[0] = (npu_model_config_t){ "second", o->second_model, o->second_backend, 0 };
+        cfg.model_count = 1;
+    }
+    cfg.model_path = o->model;
+    cfg.batch_model_path = batch_model;
+    cfg.batch_window_ms = o->window_ms;
+    cfg.deadline_ms = o->deadline_ms;
+    for (int i = 0; lite && i < o->lite_count; i++) {
+        cfg.lite_models[cfg.lite_count++] = o->lite_models[i];
+    }
+    npu_scheduler_t *npu = npu_scheduler_create(&cfg);
+    if (!npu) {
+        return -1;
+    }
+    feeder_t feeders[NPU_MAX_CLIENTS];
+    pthread_t threads[NPU_MAX_CLIENTS];
+    int64_t end_us = monotonic_us() + (int64_t)o->seconds * 1000000;
+    for (int i = 0; i < o->cameras; i++) {
+        feeders[i] = (feeder_t){ npu, npu_scheduler_add_client(npu, i, o->width, o->height, 1, 0),
+                                 frame, o->fps, end_us, 0, 0, 0, 0, 0,
+                                 second ? npu_scheduler_find_model(npu, "second") : -1, o->crops, 0, 0 };
+        pthread_create(&threads[i], NULL, feeder_thread, &feeders[i]);
+    }
+    uint64_t total = 0;
+    uint64_t out_of_order = 0;
+    uint64_t samples = 0;
+    uint64_t crops = 0;
+    double latency_max = 0;
+    double latency_sum = 0;
+    for (int i = 0; i < o->cameras; i++) {
+        pthread_join(threads[i], NULL);
+        total += feeders[i].results;
+        out_of_order += feeders[i].out_of_order;
+        latency_sum += feeders[i].latency_ms_sum;
+        samples += feeders[i].latency_samples;
+        if (feeders[i].latency_ms_max > latency_max) {
+            latency_max = feeders[i].latency_ms_max;
+        }
+    }
+    npu_scheduler_print_stats(npu);
+    npu_scheduler_destroy(npu);
+    // 回调在worker线程里，destroy之后才读
+    for (int i = 0; i < o->cameras; i++) {
+        crops += feeders[i].crops_done;
+    }
+    double rate = (double)total / o->seconds;
+    printf("%d worker%s, %s%s%s: %.1f detections/s over %d cameras, submit to result %.1f ms avg, %.1f ms worst\n",
+           workers, workers > 1 ? "s" : "", batch_model ? "batched" : "per-frame",
+           second ? " + second stage" : "", lite ? " + lite models" : "", rate, o->cameras, samples ? latency_sum / samples : 0.0, latency_max);
+    if (second) {
+        printf("second stage: %.1f crops/s\n", (double)crops / o->seconds);
+    }
+    if (out_of_order) {
+        printf("ERROR: %llu results out of frame order\n", (unsigned long long)out_of_order);
+    }
+    printf("\n");
+    return out_of_order ? -1 : rate;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -m, --model PATH      batch-1 model (default " NPU_DEFAULT_MODEL ")\n"
+           "  -b, --batch-model PATH batch-N build of the same model (default no batch run)\n"
+           "  -B, --backend B       rknn or mock[:LATENCY_MS[:JITTER_MS]] (default rknn)\n"
+           "  -W, --workers N       inference workers, 1..%d (default 3)\n"
+           "  -M, --second-model PATH second-stage model fed crops with every frame\n"
+           "  -S, --second-backend B backend of the second-stage model (default as -B)\n"
+           "  -l, --lite-model PATH lower resolution build adapted to under load, repeatable\n"
+           "                        (max %d, heaviest first)\n"
+           "  -J, --crops N         second-stage inputs per frame, 1..%d (default 8)\n"
+           "  -i, --input FILE      raw NV12 frame of WxH (default mid gray)\n"
+           "  -c, --cameras N       simulated cameras, 1..%d (default 4)\n"
+           "  -f, --fps N           frame rate of every camera (default 30)\n"
+           "  -t, --seconds S       duration of each run (default 20)\n"
+           "  -s, --size WxH        frame size (default 1920x1080)\n"
+           "  -w, --window MS       batch window (default 5)\n"
+           "  -d, --deadline MS     detection deadline and lite model budget (default 100)\n"
+           "  -h, --help\n", prog, NPU_MAX_WORKERS, NPU_MAX_LEVELS - 1, NPU_JOB_MAX_INPUTS, NPU_MAX_CLIENTS);
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = { NPU_DEFAULT_MODEL, NULL, NULL, "rknn", NULL, NULL, { NULL }, 0, 8, 3, 4, 30, 20, 1920, 1080, 5, 100 };
+    static const struct option long_opts[] = {
+        { "model", required_argument, NULL, 'm' },
+        { "batch-model", required_argument, NULL, 'b' },
+        { "input", required_argument, NULL, 'i' },
+        { "backend", required_argument, NULL, 'B' },
+        { "workers", required_argument, NULL, 'W' },
+        { "second-model", required_argument, NULL, 'M' },
+        { "second-backend", required_argument, NULL, 'S' },
+        { "lite-model", required_argument, NULL, 'l' },
+        { "crops", required_argument, NULL, 'J' },
+        { "cameras", required_argument, NULL, 'c' },
+        { "fps", required_argument, NULL, 'f' },
+        { "seconds", required_argument, NULL, 't' },
+        { "size", required_argument, NULL, 's' },
+        { "window", required_argument, NULL, 'w' },
+        { "deadline", required_argument, NULL, 'd' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:b:i:B:W:M:S:l:J:c:f:t:s:w:d:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'm': o.model = optarg; break;
+        case 'b': o.batch_model = optarg; break;
+        case 'i': o.input = optarg; break;
+        case 'B': o.backend = optarg; break;
+        case 'W': o.workers = atoi(optarg); break;
+        case 'M': o.second_model = optarg; break;
+        case 'S': o.second_backend = optarg; break;
+        case 'l':
+            if (o.lite_count >= NPU_MAX_LEVELS - 1) {
+                fprintf(stderr, "At most %d lite models\n", NPU_MAX_LEVELS - 1);
+                return 1;
+            }
+            o.lite_models[o.lite_count++] = optarg;
+            break;
+        case 'J': o.crops = atoi(optarg); break;
+        case 'c': o.cameras = atoi(optarg); break;
+        case 'f': o.fps = atoi(optarg); break;
+        case 't': o.seconds = atoi(optarg); break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &o.width, &o.height) != 2) {
+                fprintf(stderr, "Invalid size '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w': o.window_ms = atoi(optarg); break;
+        case 'd': o.deadline_ms = atoi(optarg); break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!detector_backend_valid(o.backend) || (o.second_backend && !detector_backend_valid(o.second_backend)) ||
+        o.crops < 1 || o.crops > NPU_JOB_MAX_INPUTS || o.workers < 1 || o.workers > NPU_MAX_WORKERS || o.cameras < 1 || o.cameras > NPU_MAX_CLIENTS || o.fps <= 0 || o.seconds <= 0 ||
+        o.width <= 0 || o.height <= 0 || o.window_ms < 0 || o.deadline_ms <= o.window_ms) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    size_t frame_size = (size_t)o.width * o.height * 3 / 2;
+    unsigned char *frame = (unsigned char*)malloc(frame_size);
+    if (!frame) {
+        perror("malloc");
+        return 1;
+    }
+    memset(frame, 128, frame_size);
+    if (o.input) {
+        FILE *fp = fopen(o.input, "rb");
+        if (!fp || fread(frame, 1, frame_size, fp) != frame_size) {
+            fprintf(stderr, "Could not read a %dx%d NV12 frame from %s\n", o.width, o.height, o.input);
+            if (fp) fclose(fp);
+            free(frame);
+            return 1;
+        }
+        fclose(fp);
+    }
+
+    double single = run(&o, 1, NULL, 0, 0, frame);
+    double pooled = o.workers > 1 ? run(&o, o.workers, NULL, 0, 0, frame) : single;
+    double batched = o.batch_model ? run(&o, o.workers, o.batch_model, 0, 0, frame) : 0;
+    double second = o.second_model ? run(&o, o.workers, NULL, 1, 0, frame) : 0;
+    double lite = o.lite_count ? run(&o, o.workers, NULL, 0, 1, frame) : 0;
+    free(frame);
+    if (single <= 0 || pooled <= 0 || batched < 0 || second < 0 || lite < 0) {
+        return 1;
+    }
+    if (o.workers > 1) {
+        printf("%d workers: %.2fx the detections/s of one at %d cameras\n", o.workers, pooled / single, o.cameras);
+    }
+    if (o.batch_model) {
+        printf("Batching: %+.1f%% detections/s at %d cameras\n", (batched / pooled - 1) * 100, o.cameras);
+    }
+    if (o.second_model) {
+        printf("Second stage: %+.1f%% detections/s at %d cameras\n", (second / pooled - 1) * 100, o.cameras);
+    }
+    if (o.lite_count) {
+        printf("Lite models: %+.1f%% detections/s at %d cameras\n", (lite / pooled - 1) * 100, o.cameras);
+    }
+    return 0;
+}
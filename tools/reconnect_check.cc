@@ -0,0 +1,198 @@
+// Kills the RTMP server in the middle of a publish and restarts it on the
+// same port, then checks what stream_writer sent on the new connection:
+// onMetaData and the AVC sequence header again, and an IDR as the first
+// coded frame without waiting for the next GOP. Runs the libavformat and the
+// rtmp-lite path against the built-in stand-in, e.g.
+//   reconnect_check            (exit status 0 when both paths pass)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "packet_queue.h"
+#include "stream_writer.h"
+#include "rtmp_standin.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#define CHECK_WIDTH 640
+#define CHECK_HEIGHT 368
+#define CHECK_TIMEOUT_US 20000000
+
+typedef struct {
+    int fps;
+    int gop;                    // long, so only a forced IDR can start the new connection in time
+    int key_bytes;
+    int p_bytes;
+    int kill_after;             // frames published before the server goes away
+    int down_ms;                // how long the server stays down
+} check_opts_t;
+
+// Publishes one frame at the frame rate; the writer's keyframe request starts a new GOP
+static void publish_frame(stream_writer_t *w, const check_opts_t *o, int64_t *frame_no, int *gop_pos,
+                          uint32_t *seed) {
+    if (stream_writer_keyframe_requested(w)) {
+        *gop_pos = 0;
+    }
+    int key = *gop_pos == 0;
+    AVPacket *pkt = synth_h264_frame(key ? o->key_bytes : o->p_bytes, 1, key, seed);
+    if (pkt) {
+        pkt->pts = pkt->dts = *frame_no * 90000 / o->fps;
+        pkt->duration = 90000 / o->fps;
+        stream_writer_send(w, pkt);
+        av_packet_free(&pkt);
+    }
+    (*frame_no)++;
+    *gop_pos = (*gop_pos + 1) % o->gop;
+    usleep(1000000 / o->fps);
+}
+
+static int check_conn(const char *path, const char *what, const standin_conn_t *c, int64_t max_wait_us) {
+    int ok = 1;
+    if (!c->metadata) {
+        printf("%s %s: FAIL no onMetaData before the first frame\n", path, what);
+        ok = 0;
+    }
+    if (!c->sequence_header) {
+        printf("%s %s: FAIL no AVC sequence header before the first frame\n", path, what);
+        ok = 0;
+    }
+    if (c->first_key != 1) {
+        printf("%s %s: FAIL first video frame is not an IDR\n", path, what);
+        ok = 0;
+    }
+    int64_t wait_us = c->first_frame_us - c->publish_us;
+    if (c->first_key == 1 && wait_us > max_wait_us) {
+        printf("%s %s: FAIL first IDR came %lld ms after publish, the keyframe request was not honoured\n",
+               path, what, (long long)wait_us / 1000);
+        ok = 0;
+    }
+    if (ok) {
+        printf("%s %s: ok (metadata, sequence header, IDR %lld ms after publish)\n", path, what,
+               (long long)wait_us / 1000);
+    }
+    return ok;
+}
+
+static int run_check(const char *format, const check_opts_t *o, const AVCodecParameters *par) {
+    standin_t standin;
+    memset(&standin, 0, sizeof(standin));
+    if (standin_start(&standin, 0) < 0) {
+        return 0;
+    }
+    int port = standin.port;
+    char url[64];
+    snprintf(url, sizeof(url), "rtmp://127.0.0.1:%d/live/check", port);
+    stream_writer_t *w = stream_writer_open(url, format, NULL, par, (AVRational){1, 90000}, 256);
+    if (!w || stream_writer_start(w) < 0) {
+        standin_stop(&standin);
+        stream_writer_close(w);
+        return 0;
+    }
+
+    // 一半GOP的时间都等不到IDR, 说明新连接在等自然关键帧
+    int64_t max_wait_us = (int64_t)o->gop * 1000000 / o->fps / 2;
+    int64_t frame_no = 0;
+    int gop_pos = 0;
+    uint32_t seed = 1;
+    for (int i = 0; i < o->kill_after; i++) {
+        publish_frame(w, o, &frame_no, &gop_pos, &seed);
+    }
+    standin_conn_t first;
+    int ok = standin_get_conn(&standin, 0, &first) && check_conn(format, "first connection", &first, max_wait_us);
+
+    // 模拟服务器崩溃: 监听和当前连接一起断开, 停一段时间后在同一端口重启
+    standin_stop(&standin);
+    int64_t down_until = monotonic_us() + (int64_t)o->down_ms * 1000;
+    while (monotonic_us() < down_until) {
+        publish_frame(w, o, &frame_no, &gop_pos, &seed);
+    }
+    if (standin_start(&standin, port) < 0) {
+        stream_writer_close(w);
+        return 0;
+    }
+    standin_conn_t second;
+    int got = 0;
+    int64_t deadline = monotonic_us() + CHECK_TIMEOUT_US;
+    while (!got && monotonic_us() < deadline) {
+        publish_frame(w, o, &frame_no, &gop_pos, &seed);
+        got = standin_get_conn(&standin, 0, &second) && second.first_key >= 0;
+    }
+    if (!got) {
+        printf("%s reconnect: FAIL no video within %d s of the restart\n", format, CHECK_TIMEOUT_US / 1000000);
+        ok = 0;
+    } else {
+        ok = check_conn(format, "reconnect", &second, max_wait_us) && ok;
+    }
+
+    stream_writer_close(w);
+    standin_stop(&standin);
+    return ok;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -f, --fps N           frame rate (default 25)\n"
+           "  -g, --gop N           frames per GOP (default 250)\n"
+           "  -k, --kill-after N    frames before the server is killed (default 50)\n"
+           "  -d, --down-ms N       how long the server stays down (default 1000)\n"
+           "  -h, --help\n", prog);
+}
+
+int main(int argc, char **argv) {
+    check_opts_t o = { 25, 250, 20000, 4000, 50, 1000 };
+    static const struct option long_opts[] = {
+        { "fps", required_argument, NULL, 'f' },
+        { "gop", required_argument, NULL, 'g' },
+        { "kill-after", required_argument, NULL, 'k' },
+        { "down-ms", required_argument, NULL, 'd' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "f:g:k:d:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f': o.fps = atoi(optarg); break;
+        case 'g': o.gop = atoi(optarg); break;
+        case 'k': o.kill_after = atoi(optarg); break;
+        case 'd': o.down_ms = atoi(optarg); break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (o.fps <= 0 || o.gop <= 1 || o.kill_after <= 0 || o.down_ms < 0) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    uint8_t extradata[64];
+    int extradata_size = synth_h264_extradata(extradata, CHECK_WIDTH, CHECK_HEIGHT);
+    if (!par || !(par->extradata = (uint8_t*)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE))) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memcpy(par->extradata, extradata, extradata_size);
+    par->extradata_size = extradata_size;
+    par->codec_type = AVMEDIA_TYPE_VIDEO;
+    par->codec_id = AV_CODEC_ID_H264;
+    par->width = CHECK_WIDTH;
+    par->height = CHECK_HEIGHT;
+    par->framerate = (AVRational){ o.fps, 1 };
+
+    avformat_network_init();
+    int ok = run_check("flv", &o, par);
+    ok = run_check("rtmp-lite", &o, par) && ok;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+
+    avcodec_parameters_free(&par);
+    avformat_network_deinit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,337 @@
+// Compares the libavformat RTMP muxer with the in-tree rtmp-lite client:
+// CPU time per packet and socket write calls, publishing the same synthetic
+// H.264 stream to a local RTMP server stand-in that accepts the publish and
+// discards the media, e.g.
+//   rtmp_bench -n 3000 -c 4096
+//   rtmp_bench -u rtmp://192.168.1.10/live/bench      (a real server instead)
+//   rtmp_bench -l 1935          (only run the stand-in, e.g. for tools/netem_abr.sh)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "rtmp_client.h"
+#include "rtmp_standin.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// 通过替换libc的写入口统计系统调用: libavformat和rtmp_client都走这里，
+// 只统计正在跑测试的线程，服务器线程的回复不算
+static __thread int g_counting;
+static uint64_t g_write_calls;
+
+#define COUNT_CALL() do { if (g_counting) g_write_calls++; } while (0)
+
+extern "C" ssize_t send(int fd, const void *buf, size_t len, int flags) {
+    static ssize_t (*real)(int, const void*, size_t, int) =
+        (ssize_t (*)(int, const void*, size_t, int))dlsym(RTLD_NEXT, "send");
+    COUNT_CALL();
+    return real(fd, buf, len, flags);
+}
+
+extern "C" ssize_t sendto(int fd, const void *buf, size_t len, int flags,
+                          const struct sockaddr *addr, socklen_t addr_len) {
+    static ssize_t (*real)(int, const void*, size_t, int, const struct sockaddr*, socklen_t) =
+        (ssize_t (*)(int, const void*, size_t, int, const struct sockaddr*, socklen_t))dlsym(RTLD_NEXT, "sendto");
+    COUNT_CALL();
+    return real(fd, buf, len, flags, addr, addr_len);
+}
+
+extern "C" ssize_t sendmsg(int fd, const struct msghdr *msg, int flags) {
+    static ssize_t (*real)(int, const struct msghdr*, int) =
+        (ssize_t (*)(int, const struct msghdr*, int))dlsym(RTLD_NEXT, "sendmsg");
+    COUNT_CALL();
+    return real(fd, msg, flags);
+}
+
+extern "C" ssize_t write(int fd, const void *buf, size_t len) {
+    static ssize_t (*real)(int, const void*, size_t) =
+        (ssize_t (*)(int, const void*, size_t))dlsym(RTLD_NEXT, "write");
+    COUNT_CALL();
+    return real(fd, buf, len);
+}
+
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int count) {
+    static ssize_t (*real)(int, const struct iovec*, int) =
+        (ssize_t (*)(int, const struct iovec*, int))dlsym(RTLD_NEXT, "writev");
+    COUNT_CALL();
+    return real(fd, iov, count);
+}
+
+typedef struct {
+    int packets;
+    int fps;
+    int gop;
+    int width;
+    int height;
+    int key_bytes;
+    int p_bytes;
+    int slices;
+    int chunk_size;
+    const char *url;
+} bench_opts_t;
+
+typedef struct {
+    const char *name;
+    int packets;
+    uint64_t bytes;
+    uint64_t writes;
+    double cpu_us;
+    double wall_us;
+} bench_result_t;
+
+static int64_t now_us(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ---- the two paths ----
+
+typedef int (*write_fn)(void *ctx, AVPacket *pkt, AVRational tb);
+
+static int lavf_write(void *ctx, AVPacket *pkt, AVRational tb) {
+    AVFormatContext *out = (AVFormatContext*)ctx;
+    av_packet_rescale_ts(pkt, tb, out->streams[0]->time_base);
+    return av_write_frame(out, pkt);
+}
+
+static int lite_write(void *ctx, AVPacket *pkt, AVRational tb) {
+    return rtmp_client_write_packet((rtmp_client_t*)ctx, pkt, tb);
+}
+
+// Timed loop shared by both paths; the GOP of packets is generated up front
+static int run_loop(const bench_opts_t *o, AVPacket **gop, write_fn fn, void *ctx, bench_result_t *r) {
+    AVRational tb = { 1, 90000 };
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt) return -1;
+    uint64_t writes0 = g_write_calls;
+    int64_t cpu0 = now_us(CLOCK_THREAD_CPUTIME_ID);
+    int64_t wall0 = now_us(CLOCK_MONOTONIC);
+    g_counting = 1;
+    int ret = 0;
+    for (int i = 0; i < o->packets && ret >= 0; i++) {
+        ret = av_packet_ref(pkt, gop[i % o->gop]);
+        if (ret < 0) break;
+        pkt->pts = pkt->dts = (int64_t)i * 90000 / o->fps;
+        r->bytes += pkt->size;
+        ret = fn(ctx, pkt, tb);
+        av_packet_unref(pkt);
+        r->packets++;
+    }
+    g_counting = 0;
+    r->cpu_us = now_us(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    r->wall_us = now_us(CLOCK_MONOTONIC) - wall0;
+    r->writes = g_write_calls - writes0;
+    av_packet_free(&pkt);
+    return ret < 0 ? -1 : 0;
+}
+
+static int bench_lavf(const bench_opts_t *o, const AVCodecParameters *par, AVPacket **gop, bench_result_t *r) {
+    AVFormatContext *out = NULL;
+    avformat_alloc_output_context2(&out, NULL, "flv", o->url);
+    if (!out) return -1;
+    // 与stream_writer相同的设置: 不缓冲, 每包flush
+    out->flags |= AVFMT_FLAG_NOBUFFER | AVFMT_FLAG_FLUSH_PACKETS;
+    AVStream *st = avformat_new_stream(out, NULL);
+    if (!st || avcodec_parameters_copy(st->codecpar, par) < 0 ||
+        avio_open2(&out->pb, o->url, AVIO_FLAG_WRITE, NULL, NULL) < 0) {
+        fprintf(stderr, "libavformat: cannot open %s\n", o->url);
+        avformat_free_context(out);
+        return -1;
+    }
+    st->time_base = (AVRational){1, 90000};
+    int ret = avformat_write_header(out, NULL);
+    if (ret >= 0) {
+        ret = run_loop(o, gop, lavf_write, out, r);
+        av_write_trailer(out);
+    }
+    avio_closep(&out->pb);
+    avformat_free_context(out);
+    return ret < 0 ? -1 : 0;
+}
+
+static int bench_lite(const bench_opts_t *o, const AVCodecParameters *par, AVPacket **gop, bench_result_t *r) {
+    rtmp_client_t *c = rtmp_client_connect(o->url, o->chunk_size, 5000);
+    if (!c) return -1;
+    int ret = rtmp_client_write_header(c, par, o->fps, NULL);
+    if (ret == 0) {
+        ret = run_loop(o, gop, lite_write, c, r);
+    }
+    rtmp_client_close(c, 1);
+    return ret;
+}
+
+static void print_result(const bench_opts_t *o, const bench_result_t *r) {
+    double per_pkt = r->packets ? (double)r->writes / r->packets : 0;
+    printf("%-12s %7d %9.1f %12.1f %11.2f %14.0f %12.1f\n", r->name, r->packets, r->bytes / 1e6,
+           r->packets ? r->cpu_us / r->packets : 0, per_pkt, per_pkt * o->fps,
+           r->packets ? r->wall_us / r->packets : 0);
+}
+
+// Runs only the stand-in, printing what each connection receives, until SIGINT/SIGTERM
+static int serve(int port) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    standin_t standin;
+    memset(&standin, 0, sizeof(standin));
+    standin.verbose = 1;
+    if (standin_start(&standin, port) < 0) {
+        return 1;
+    }
+    printf("RTMP stand-in listening on rtmp://127.0.0.1:%d/live/\n", standin.port);
+    fflush(stdout);
+    int sig;
+    sigwait(&set, &sig);
+    standin_stop(&standin);
+    for (int i = 0; i < standin.connections && i < STANDIN_MAX_CONNS; i++) {
+        printf("stand-in: connection %d: %llu media bytes, %d video frames\n", i,
+               (unsigned long long)standin.conns[i].media_bytes, standin.conns[i].video_frames);
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n"
+           "  -n, --packets N       video packets per run (default 3000)\n"
+           "  -f, --fps N           nominal frame rate for the syscalls/s column (default 15)\n"
+           "  -g, --gop N           frames per GOP (default 30)\n"
+           "  -k, --key-bytes N     keyframe size (default 60000)\n"
+           "  -p, --p-bytes N       P frame size (default 12000)\n"
+           "  -s, --slices N        NAL units per frame (default 4)\n"
+           "  -c, --chunk-size N    rtmp-lite chunk size; libavformat always uses 4096 (default 4096)\n"
+           "  -u, --url URL         publish to this server instead of the built-in stand-in\n"
+           "  -l, --listen PORT     no benchmark, only serve the stand-in on PORT until killed\n"
+           "  -h, --help\n", prog);
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t o = { 3000, 15, 30, 1280, 720, 60000, 12000, 4, RTMP_DEFAULT_CHUNK_SIZE, NULL };
+    static const struct option long_opts[] = {
+        { "packets", required_argument, NULL, 'n' },
+        { "fps", required_argument, NULL, 'f' },
+        { "gop", required_argument, NULL, 'g' },
+        { "key-bytes", required_argument, NULL, 'k' },
+        { "p-bytes", required_argument, NULL, 'p' },
+        { "slices", required_argument, NULL, 's' },
+        { "chunk-size", required_argument, NULL, 'c' },
+        { "url", required_argument, NULL, 'u' },
+        { "listen", required_argument, NULL, 'l' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int listen_port = -1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:f:g:k:p:s:c:u:l:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n': o.packets = atoi(optarg); break;
+        case 'f': o.fps = atoi(optarg); break;
+        case 'g': o.gop = atoi(optarg); break;
+        case 'k': o.key_bytes = atoi(optarg); break;
+        case 'p': o.p_bytes = atoi(optarg); break;
+        case 's': o.slices = atoi(optarg); break;
+        case 'c': o.chunk_size = atoi(optarg); break;
+        case 'u': o.url = optarg; break;
+        case 'l': listen_port = atoi(optarg); break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (listen_port >= 0) {
+        return serve(listen_port);
+    }
+    if (o.packets <= 0 || o.fps <= 0 || o.gop <= 0 || o.slices <= 0 || o.chunk_size < 128 ||
+        o.key_bytes < o.slices * 16 || o.p_bytes < o.slices * 16) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    standin_t standin;
+    memset(&standin, 0, sizeof(standin));
+    char local_url[64];
+    int local = !o.url;
+    if (local) {
+        if (standin_start(&standin, 0) < 0) return 1;
+        snprintf(local_url, sizeof(local_url), "rtmp://127.0.0.1:%d/live/bench", standin.port);
+        o.url = local_url;
+    }
+
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    AVPacket **gop = (AVPacket**)calloc(o.gop, sizeof(AVPacket*));
+    uint8_t extradata[64];
+    int extradata_size = synth_h264_extradata(extradata, o.width, o.height);
+    if (!par || !gop || !(par->extradata = (uint8_t*)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE))) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    memcpy(par->extradata, extradata, extradata_size);
+    par->extradata_size = extradata_size;
+    par->codec_type = AVMEDIA_TYPE_VIDEO;
+    par->codec_id = AV_CODEC_ID_H264;
+    par->width = o.width;
+    par->height = o.height;
+    par->bit_rate = (int64_t)(o.key_bytes + (o.gop - 1) * o.p_bytes) * 8 * o.fps / o.gop;
+    uint32_t seed = 1;
+    for (int i = 0; i < o.gop; i++) {
+        gop[i] = synth_h264_frame(i == 0 ? o.key_bytes : o.p_bytes, o.slices, i == 0, &seed);
+        if (!gop[i]) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    printf("Publishing %d packets (%d slices, GOP %d) to %s\n", o.packets, o.slices, o.gop, o.url);
+    printf("%-12s %7s %9s %12s %11s %14s %12s\n", "path", "packets", "MB", "cpu us/pkt",
+           "writes/pkt", "writes/s@fps", "wall us/pkt");
+    bench_result_t lavf = { "libavformat", 0, 0, 0, 0, 0 };
+    bench_result_t lite = { "rtmp-lite", 0, 0, 0, 0, 0 };
+    int failed = 0;
+    if (bench_lavf(&o, par, gop, &lavf) == 0) {
+        print_result(&o, &lavf);
+    } else {
+        fprintf(stderr, "libavformat run failed\n");
+        failed = 1;
+    }
+    if (bench_lite(&o, par, gop, &lite) == 0) {
+        print_result(&o, &lite);
+    } else {
+        fprintf(stderr, "rtmp-lite run failed\n");
+        failed = 1;
+    }
+
+    if (local) {
+        standin_stop(&standin);
+    }
+    if (local && !failed) {
+        // 两条路径的媒体负载应当一致, 否则其中一条丢了数据; join之后读取不需要加锁
+        printf("stand-in received %llu / %llu media bytes\n", (unsigned long long)standin.conns[0].media_bytes,
+               (unsigned long long)standin.conns[1].media_bytes);
+    }
+    if (!failed && lavf.packets && lite.packets) {
+        printf("rtmp-lite vs libavformat: %.2fx cpu per packet, %.2fx write calls\n",
+               lite.cpu_us / lavf.cpu_us * lavf.packets / lite.packets,
+               lavf.writes ? (double)lite.writes / lavf.writes * lavf.packets / lite.packets : 0);
+    }
+
+    for (int i = 0; i < o.gop; i++) {
+        av_packet_free(&gop[i]);
+    }
+    free(gop);
+    avcodec_parameters_free(&par);
+    return failed;
+}
@@ -0,0 +1,325 @@
+// RTMP server stand-in and synthetic H.264 source shared by the RTMP tools
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "rtmp_client.h"
+#include "rtmp_standin.h"
+
+static int64_t monotonic_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int reply(rtmp_client_t *c, uint32_t stream_id, byte_buf_t *b) {
+    rtmp_seg_t seg = { b->data, b->size };
+    int ret = rtmp_client_write_message(c, 3, RTMP_MSG_COMMAND_AMF0, stream_id, 0, &seg, 1);
+    byte_buf_free(b);
+    return ret;
+}
+
+// FLV视频负载: 帧类型/编码ID, AVCPacketType, CTS, 然后是4字节长度前缀的NAL
+static int has_idr_nal(const uint8_t *data, size_t size) {
+    size_t pos = 5;
+    while (pos + 5 <= size) {
+        uint32_t len = (uint32_t)data[pos] << 24 | data[pos + 1] << 16 | data[pos + 2] << 8 | data[pos + 3];
+        if ((data[pos + 4] & 0x1f) == 5) {
+            return 1;
+        }
+        pos += 4 + (size_t)len;
+    }
+    return 0;
+}
+
+static void record_message(standin_t *s, const rtmp_message_t *msg) {
+    pthread_mutex_lock(&s->mutex);
+    standin_conn_t *conn = s->connections < STANDIN_MAX_CONNS ? &s->conns[s->connections] : NULL;
+    if (conn && msg->type == RTMP_MSG_DATA_AMF0 && conn->first_key < 0) {
+        conn->metadata = 1;
+    } else if (conn && (msg->type == RTMP_MSG_AUDIO || msg->type == RTMP_MSG_VIDEO)) {
+        conn->media_bytes += msg->size;
+        if (msg->type == RTMP_MSG_VIDEO && msg->size >= 5) {
+            if (msg->data[1] == 0) {
+                if (conn->first_key < 0) conn->sequence_header = 1;
+            } else {
+                if (conn->first_key < 0) {
+                    conn->first_key = (msg->data[0] >> 4) == 1 && has_idr_nal(msg->data, msg->size);
+                    conn->first_frame_us = monotonic_now_us();
+                }
+                conn->video_frames++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s->mutex);
+}
+
+static void serve_connection(standin_t *s, int fd) {
+    uint8_t c0c1[1 + RTMP_HANDSHAKE_SIZE];
+    uint8_t s0s1s2[1 + 2 * RTMP_HANDSHAKE_SIZE];
+    if (rtmp_read_full(fd, c0c1, sizeof(c0c1)) < 0) {
+        close(fd);
+        return;
+    }
+    // 简单握手: S1全0, S2回显C1; 推流端不校验digest
+    memset(s0s1s2, 0, sizeof(s0s1s2));
+    s0s1s2[0] = 3;
+    memcpy(s0s1s2 + 1 + RTMP_HANDSHAKE_SIZE, c0c1 + 1, RTMP_HANDSHAKE_SIZE);
+    if (rtmp_write_full(fd, s0s1s2, sizeof(s0s1s2)) < 0 ||
+        rtmp_read_full(fd, c0c1, RTMP_HANDSHAKE_SIZE) < 0) {
+        close(fd);
+        return;
+    }
+
+    // 复用客户端的分块读写, 回复用默认的128字节块
+    rtmp_client_t *c = (rtmp_client_t*)calloc(1, sizeof(rtmp_client_t));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    c->chunk_size = 128;
+    c->reader.fd = fd;
+    c->reader.chunk_size = 128;
+    int index = s->connections;
+    uint64_t window_bytes = 0;
+    int window_frames = 0;
+    int64_t window_start_us = monotonic_now_us();
+    rtmp_message_t msg;
+    while (rtmp_read_message(&c->reader, &msg) == 0) {
+        record_message(s, &msg);
+        if (msg.type == RTMP_MSG_AUDIO || msg.type == RTMP_MSG_VIDEO) {
+            window_bytes += msg.size;
+            window_frames += msg.type == RTMP_MSG_VIDEO;
+            int64_t now = monotonic_now_us();
+            if (s->verbose && now - window_start_us >= 1000000) {
+                printf("stand-in: %4.0fs connection %d received %.0f kbit/s, %.1f video msg/s\n",
+                       (now - s->start_us) / 1e6, index, window_bytes * 8000.0 / (now - window_start_us),
+                       window_frames * 1e6 / (now - window_start_us));
+                fflush(stdout);
+                window_bytes = 0;
+                window_frames = 0;
+                window_start_us = now;
+            }
+            continue;
+        }
+        char name[32];
+        double txn;
+        if (msg.type != RTMP_MSG_COMMAND_AMF0 ||
+            rtmp_amf_command(msg.data, msg.size, name, sizeof(name), &txn) < 0) {
+            continue;
+        }
+        byte_buf_t b = { 0 };
+        if (!strcmp(name, "connect")) {
+            rtmp_amf_string(&b, "_result");
+            rtmp_amf_number(&b, txn);
+            rtmp_amf_object_begin(&b);
+            rtmp_amf_prop_string(&b, "fmsVer", "FMS/3,0,1,123");
+            rtmp_amf_prop_number(&b, "capabilities", 31);
+            rtmp_amf_object_end(&b);
+            rtmp_amf_object_begin(&b);
+            rtmp_amf_prop_string(&b, "level", "status");
+            rtmp_amf_prop_string(&b, "code", "NetConnection.Connect.Success");
+            rtmp_amf_prop_number(&b, "objectEncoding", 0);
+            rtmp_amf_object_end(&b);
+            reply(c, 0, &b);
+        } else if (!strcmp(name, "createStream")) {
+            rtmp_amf_string(&b, "_result");
+            rtmp_amf_number(&b, txn);
+            rtmp_amf_null(&b);
+            rtmp_amf_number(&b, 1);
+            reply(c, 0, &b);
+        } else if (!strcmp(name, "publish")) {
+            rtmp_amf_string(&b, "onStatus");
+            rtmp_amf_number(&b, 0);
+            rtmp_amf_null(&b);
+            rtmp_amf_object_begin(&b);
+            rtmp_amf_prop_string(&b, "level", "status");
+            rtmp_amf_prop_string(&b, "code", "NetStream.Publish.Start");
+            rtmp_amf_prop_string(&b, "description", "Start publishing");
+            rtmp_amf_object_end(&b);
+            reply(c, msg.stream_id, &b);
+            pthread_mutex_lock(&s->mutex);
+            if (index < STANDIN_MAX_CONNS) s->conns[index].publish_us = monotonic_now_us();
+            pthread_mutex_unlock(&s->mutex);
+            if (s->verbose) {
+                printf("stand-in: connection %d publishing\n", index);
+                fflush(stdout);
+            }
+        }
+    }
+    if (s->verbose) {
+        printf("stand-in: connection %d closed\n", index);
+        fflush(stdout);
+    }
+    // 先在锁内清掉client_fd, standin_stop不会去shutdown一个已关闭(可能被复用)的fd
+    pthread_mutex_lock(&s->mutex);
+    s->client_fd = -1;
+    pthread_mutex_unlock(&s->mutex);
+    rtmp_client_close(c, 0);
+}
+
+static void* standin_thread_func(void *arg) {
+    standin_t *s = (standin_t*)arg;
+    for (;;) {
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            break;                  // listen socket shut down
+        }
+        pthread_mutex_lock(&s->mutex);
+        s->client_fd = fd;
+        if (s->connections < STANDIN_MAX_CONNS) s->conns[s->connections].first_key = -1;
+        pthread_mutex_unlock(&s->mutex);
+        serve_connection(s, fd);
+        pthread_mutex_lock(&s->mutex);
+        s->connections++;
+        pthread_mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+int standin_start(standin_t *s, int port) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s->start_us = monotonic_now_us();
+    memset(s->conns, 0, sizeof(s->conns));
+    s->connections = 0;
+    s->client_fd = -1;
+    pthread_mutex_init(&s->mutex, NULL);
+    // 重启后要绑定同一个端口, 上一次的连接可能还在TIME_WAIT
+    int on = 1;
+    s->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0 || setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(s->listen_fd, 4) < 0 || getsockname(s->listen_fd, (struct sockaddr*)&addr, &len) < 0) {
+        perror("RTMP stand-in");
+        if (s->listen_fd >= 0) close(s->listen_fd);
+        pthread_mutex_destroy(&s->mutex);
+        return -1;
+    }
+    s->port = ntohs(addr.sin_port);
+    if (pthread_create(&s->thread, NULL, standin_thread_func, s) != 0) {
+        perror("Failed to create stand-in thread");
+        close(s->listen_fd);
+        pthread_mutex_destroy(&s->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+void standin_stop(standin_t *s) {
+    shutdown(s->listen_fd, SHUT_RDWR);
+    pthread_mutex_lock(&s->mutex);
+    if (s->client_fd >= 0) {
+        shutdown(s->client_fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    pthread_join(s->thread, NULL);
+    close(s->listen_fd);
+    pthread_mutex_destroy(&s->mutex);
+}
+
+int standin_get_conn(standin_t *s, int i, standin_conn_t *conn) {
+    pthread_mutex_lock(&s->mutex);
+    int ok = i >= 0 && i < STANDIN_MAX_CONNS && (i < s->connections || (i == s->connections && s->client_fd >= 0));
+    if (ok) {
+        *conn = s->conns[i];
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return ok;
+}
+
+// ---- synthetic stream ----
+
+typedef struct {
+    uint8_t buf[64];
+    int bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, int n, uint32_t v) {
+    for (int i = n - 1; i >= 0; i--) {
+        if ((v >> i) & 1) w->buf[w->bits / 8] |= 0x80 >> (w->bits % 8);
+        w->bits++;
+    }
+}
+
+static void put_ue(bit_writer_t *w, uint32_t v) {
+    int len = 0;
+    while ((v + 1) >> (len + 1)) len++;
+    put_bits(w, len, 0);
+    put_bits(w, len + 1, v + 1);
+}
+
+int synth_h264_extradata(uint8_t *out, int width, int height) {
+    static const uint8_t start[4] = { 0, 0, 0, 1 };
+    bit_writer_t sps = { { 0 }, 0 };
+    put_bits(&sps, 8, 0x67);
+    put_bits(&sps, 8, 66);                  // profile_idc baseline
+    put_bits(&sps, 8, 0xc0);                // constraint_set0/1
+    put_bits(&sps, 8, 31);                  // level 3.1
+    put_ue(&sps, 0);                        // seq_parameter_set_id
+    put_ue(&sps, 0);                        // log2_max_frame_num_minus4
+    put_ue(&sps, 2);                        // pic_order_cnt_type
+    put_ue(&sps, 1);                        // max_num_ref_frames
+    put_bits(&sps, 1, 0);                   // gaps_in_frame_num_allowed
+    put_ue(&sps, width / 16 - 1);
+    put_ue(&sps, height / 16 - 1);
+    put_bits(&sps, 1, 1);                   // frame_mbs_only
+    put_bits(&sps, 1, 1);                   // direct_8x8_inference
+    put_bits(&sps, 1, 0);                   // frame_cropping
+    put_bits(&sps, 1, 0);                   // vui_parameters_present
+    put_bits(&sps, 1, 1);                   // rbsp stop bit
+    bit_writer_t pps = { { 0 }, 0 };
+    put_bits(&pps, 8, 0x68);
+    put_ue(&pps, 0);                        // pic_parameter_set_id
+    put_ue(&pps, 0);                        // seq_parameter_set_id
+    put_bits(&pps, 2, 0);                   // CAVLC, bottom_field_pic_order
+    put_ue(&pps, 0);                        // num_slice_groups_minus1
+    put_ue(&pps, 0);                        // num_ref_idx_l0_default_minus1
+    put_ue(&pps, 0);                        // num_ref_idx_l1_default_minus1
+    put_bits(&pps, 3, 0);                   // weighted_pred, weighted_bipred_idc
+    put_ue(&pps, 0);                        // pic_init_qp_minus26 (se 0)
+    put_ue(&pps, 0);                        // pic_init_qs_minus26
+    put_ue(&pps, 0);                        // chroma_qp_index_offset
+    put_bits(&pps, 3, 4);                   // deblocking_filter_control_present
+    put_bits(&pps, 1, 1);                   // rbsp stop bit
+    int n = 0;
+    memcpy(out + n, start, 4);
+    n += 4;
+    memcpy(out + n, sps.buf, (sps.bits + 7) / 8);
+    n += (sps.bits + 7) / 8;
+    memcpy(out + n, start, 4);
+    n += 4;
+    memcpy(out + n, pps.buf, (pps.bits + 7) / 8);
+    n += (pps.bits + 7) / 8;
+    return n;
+}
+
+// Payload bytes are never 0, so there is no start code emulation to worry about
+AVPacket* synth_h264_frame(int size, int slices, int key, uint32_t *seed) {
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt || av_new_packet(pkt, size) < 0) {
+        av_packet_free(&pkt);
+        return NULL;
+    }
+    int slice_size = size / slices;
+    for (int i = 0; i < slices; i++) {
+        uint8_t *p = pkt->data + i * slice_size;
+        int len = i == slices - 1 ? size - i * slice_size : slice_size;
+        p[0] = 0; p[1] = 0; p[2] = 0; p[3] = 1;
+        p[4] = key ? 0x65 : 0x41;
+        for (int j = 5; j < len; j++) {
+            *seed = *seed * 1103515245u + 12345u;
+            p[j] = (*seed >> 16) | 1;
+        }
+    }
+    if (key) pkt->flags |= AV_PKT_FLAG_KEY;
+    return pkt;
+}
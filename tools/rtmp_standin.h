@@ -0,0 +1,50 @@
+#ifndef RTMP_STANDIN_H
+#define RTMP_STANDIN_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#define STANDIN_MAX_CONNS 16
+
+// What one publishing connection delivered
+typedef struct {
+    uint64_t media_bytes;       // audio/video payload
+    int video_frames;           // coded frames, sequence headers not counted
+    int metadata;               // onMetaData arrived before the first coded frame
+    int sequence_header;        // AVC sequence header arrived before the first coded frame
+    int first_key;              // first coded frame is a keyframe with an IDR NAL: 1, not: 0, none yet: -1
+    int64_t publish_us;         // publish accepted, CLOCK_MONOTONIC
+    int64_t first_frame_us;
+} standin_conn_t;
+
+// Local RTMP server stand-in: accepts one publisher at a time, answers
+// connect/createStream/publish and records what each connection sent
+typedef struct {
+    int listen_fd;
+    int port;
+    int verbose;                // print every connection and its received rate
+    int64_t start_us;           // verbose lines are stamped with the time since start
+    standin_conn_t conns[STANDIN_MAX_CONNS];
+    int connections;            // connections served so far, also the index of the current one
+    int client_fd;              // connection being served, -1 between connections
+    pthread_mutex_t mutex;      // guards conns, connections and client_fd
+    pthread_t thread;
+} standin_t;
+
+// port 0 picks a free port; the chosen one is in s->port
+int standin_start(standin_t *s, int port);
+// Closes the listen socket and drops the connection being served, like a server crash
+void standin_stop(standin_t *s);
+// Copy of connection i, 0 if it has been accepted
+int standin_get_conn(standin_t *s, int i, standin_conn_t *conn);
+
+// Synthetic H.264 to publish: baseline SPS/PPS for width x height (multiples
+// of 16), Annex-B, and frames of `slices` NAL units of random payload
+int synth_h264_extradata(uint8_t *out, int width, int height);
+AVPacket* synth_h264_frame(int size, int slices, int key, uint32_t *seed);
+
+#endif /* RTMP_STANDIN_H */